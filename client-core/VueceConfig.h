@@ -27,6 +27,12 @@
 //This is used to filter away small files if the duration is below predefined value
 #define VUECE_MIN_MUSIC_DURATION_SEC         5
 
+/*
+ * Set to 1 to run stream engine in pipelined mode (bumper on its own thread),
+ * 0 runs all stages on engine thread
+ */
+#define VUECE_STREAM_ENGINE_PIPELINED 0
+
 #define VUECE_TIMEOUT_WAIT_SESSION_RELEASED 15
 
 #define VUECE_SESSION_MGR_TIMEOUT  20
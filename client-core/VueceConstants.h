@@ -48,7 +48,6 @@ typedef enum _VueceRosterSubscriptionType{
 #define LOCAL_PORT_RECEIVER		3000
 #define LOCAL_PORT_SENDER		4000
 #define VUECE_PAYLOAD_IDX_AAC	127
-#define VUECE_MAX_BUFFER_SIZE	64 * 1024 + 1024//32678 bytes
 #define VUECE_MAX_PACKET_SIZE	1000 * 1024
 #define VUECE_ENCODE_OUTPUT_BUFFER_SIZE 5 * 1024
 #define FAKE_REMOTE_IP 					"127.0.0.1"
@@ -120,6 +119,22 @@ typedef enum _VueceRosterSubscriptionType{
  */
 #define VUECE_STREAM_FRAME_HEADER_LENGTH 9
 
+/*
+ * Renditions of a music item, see FileShareManifest::MakeRenditions()
+ * Hub offers the AAC bit rates (bps) of this ladder which are lower than the
+ * item's own bit rate, plus the item's own bit rate.
+ */
+#define VUECE_STREAM_RENDITION_LADDER {48000, 96000, 160000}
+
+//client picks the highest rendition whose bit rate times this percentage fits its measured throughput
+#define VUECE_STREAM_RENDITION_HEADROOM_PERCENT 150
+
+//weight in percent of the latest throughput sample in the smoothed value
+#define VUECE_STREAM_THROUGHPUT_SAMPLE_WEIGHT 50
+
+//a download shorter than this doesn't give a throughput sample
+#define VUECE_STREAM_THROUGHPUT_MIN_SAMPLE_MS 2000
+
 #define VUECE_CHUNK_BUF_LEN VUECE_MAX_FRAME_SIZE * VUECE_AUDIO_FRAMES_PER_CHUNK
 
 #define VUECE_STREAM_PACKET_TYPE_EOF	0
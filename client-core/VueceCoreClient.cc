@@ -88,6 +88,7 @@
 #include "sqlite3.h"
 #include "VueceWinUtilities.h"
 #include "VueceMediaDBManager.h"
+#include "VuecePreTranscoder.h"
 #endif
 
 //#define MAX_CONCURRENT_SESSION_NR 3
@@ -215,6 +216,9 @@ VueceCoreClient::VueceCoreClient(vuece::VueceNativeInterface* _vNativeInstance,
 
 	VueceMediaDBManager::RetrieveDBFileChecksum(true);
 
+	preTranscoder = new VuecePreTranscoder();
+	preTranscoder->Start();
+
 	remoteNodeServingMap = new RemoteNodeServingMap();
 	remoteActiveDeviceMap = new RemoteActiveDeviceMap();
 
@@ -260,6 +264,9 @@ VueceCoreClient::~VueceCoreClient()
 
 
 #ifdef VUECE_APP_ROLE_HUB
+	preTranscoder->Stop();
+	delete preTranscoder;
+
 	dbMgr->Close();
 	delete dbMgr;
 
@@ -91,6 +91,7 @@ typedef std::map<std::string, VueceStreamingDevice*> RemoteActiveDeviceMap;
 
 #ifdef VUECE_APP_ROLE_HUB
 class VueceMediaDBManager;
+class VuecePreTranscoder;
 #endif
 
 class VueceConnectionKeeper;
@@ -408,6 +409,7 @@ private:
 
 #ifdef VUECE_APP_ROLE_HUB
 	VueceMediaDBManager* dbMgr;
+	VuecePreTranscoder* preTranscoder;
 #endif
 };
 
@@ -762,7 +762,26 @@ int VueceGlobalContext::GetTotalAudioFrameCounter()
 	return ret;
 }
 
+void VueceGlobalContext::SetStreamThroughput(int bps)
+{
+	mutex_var.Lock();
 
+	pVueceGlobalSetting->iStreamThroughput = bps;
 
+	VueceLogger::Info("VueceGlobalContext::SetStreamThroughput - %d", bps);
 
+	mutex_var.Unlock();
+}
 
+int VueceGlobalContext::GetStreamThroughput()
+{
+	int ret = 0;
+
+	mutex_var.Lock();
+
+	ret = pVueceGlobalSetting->iStreamThroughput;
+
+	mutex_var.Unlock();
+
+	return ret;
+}
@@ -35,6 +35,9 @@ typedef struct VueceGlobalSetting
 
 	bool bIsDowloadCompleted;
 
+	//smoothed download throughput of music streams in bps, 0 if not measured yet
+	int iStreamThroughput;
+
 	char device_name[VUECE_MAX_SETTING_VALUE_LEN+1];
 	char app_version[VUECE_MAX_SETTING_VALUE_LEN+1];
 
@@ -234,6 +237,9 @@ public:
 	static void SetDownloadCompleted(bool b);
 	static bool IsDownloadCompleted();
 
+	static void SetStreamThroughput(int bps);
+	static int GetStreamThroughput();
+
 };
 
 #endif /* VUECE_GLOBAL_SETTING_H */
@@ -188,6 +188,13 @@ VueceMediaItemList* VueceMediaDBManager::QueryMediaItemWithUri(const std::string
 }
 
 
+VueceMediaItemList* VueceMediaDBManager::QueryAllSongs()
+{
+	LOG(LS_VERBOSE) << "VueceMediaDBManager::QueryAllSongs";
+
+	return QueryMediaItemsWithSqlCmd(DB_CMD_QUERY_ALL_SONGS);
+}
+
 VueceMediaItemList* VueceMediaDBManager::QueryMediaItemsWithSqlCmd(const char*  sqlCmd) {
 	int ret = -1;
 	char *dbErrMsg;
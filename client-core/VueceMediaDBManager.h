@@ -25,6 +25,7 @@
 #define DB_CMD_DROP_TABLE "DROP TABLE VueceMediaItems"
 #define DB_CMD_QUERY_ALL_ITEMS_WITH_PARENT_URI "SELECT * FROM VueceMediaItems WHERE parent_uri='%s'"
 #define DB_CMD_QUERY_ITEM_WITH_URI "SELECT * FROM VueceMediaItems WHERE uri='%s'"
+#define DB_CMD_QUERY_ALL_SONGS "SELECT * FROM VueceMediaItems WHERE type='file'"
 #define DB_CMD_CREATE_INDEX_ON_URI "CREATE INDEX Uri_Idx ON VueceMediaItems (uri)"
 
 #define DB_COL_ID_ID 0
@@ -68,6 +69,7 @@ public:
 
 	VueceMediaItemList* BrowseMediaItem(const std::string &uri);
 	VueceMediaItemList* QueryMediaItemWithUri(const std::string &uri);
+	VueceMediaItemList* QueryAllSongs();
 	void UpdateMediaDB(VueceMediaItemList* itemList);
 
 	//static methods
@@ -0,0 +1,469 @@
+/*
+ * VuecePreTranscoder.cpp
+ *
+ *  Created on: Mar 29, 2015
+ *      Author: jingjing
+ */
+
+#include "VueceWinUtilities.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "talk/base/base64.h"
+#include "talk/base/fileutils.h"
+#include "talk/base/logging.h"
+#include "talk/base/pathutils.h"
+#include "talk/base/stream.h"
+#include "talk/session/fileshare/VueceMediaStream.h"
+#include "talk/session/fileshare/VueceTranscodeCache.h"
+
+#include "VueceConstants.h"
+#include "VueceLogger.h"
+#include "VueceMediaDBManager.h"
+#include "VuecePreTranscoder.h"
+
+using namespace vuece;
+
+static bool newer_first(const VuecePreTranscodeJob& a, const VuecePreTranscodeJob& b)
+{
+	return a.mtime > b.mtime;
+}
+
+/* ---------------------------- worker ---------------------------- */
+
+VuecePreTranscodeWorker::VuecePreTranscodeWorker(VuecePreTranscoder* owner_, int id_)
+{
+	owner = owner_;
+	id = id_;
+	buffer = (char*)malloc(VUECE_PRETRANSCODE_READ_BUFFER_SIZE);
+}
+
+VuecePreTranscodeWorker::~VuecePreTranscodeWorker()
+{
+	free(buffer);
+}
+
+void* VuecePreTranscodeWorker::Thread()
+{
+	VuecePreTranscodeJob job;
+
+	ThreadStarted();
+
+#ifdef WIN32
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_IDLE);
+#endif
+
+	LOG(INFO) << "VuecePreTranscodeWorker[" << id << "] - Started";
+
+	while(!owner->IsStopping() && owner->NextJob(&job))
+	{
+		owner->JobDone(job, RunJob(job));
+	}
+
+	LOG(INFO) << "VuecePreTranscodeWorker[" << id << "] - Exit";
+
+	return NULL;
+}
+
+/*
+ * Runs a pre-transcoding stream to the end of the track, encoded frames go into
+ * transcode cache, nothing is done if the track is already cached, being transcoded
+ * by another stream, or doesn't need transcoding
+ */
+int VuecePreTranscodeWorker::RunJob(const VuecePreTranscodeJob& job)
+{
+	talk_base::StreamResult sr = talk_base::SR_SUCCESS;
+	talk_base::VueceMediaStream* stream = NULL;
+	uint64_t start_ms = 0;
+	size_t read = 0;
+	int error = 0;
+	int ret = VuecePreTranscoder::JobResult_Transcoded;
+
+	LOG(LS_VERBOSE) << "VuecePreTranscodeWorker[" << id << "] - Pre-transcoding: " << job.path;
+
+	stream = new talk_base::VueceMediaStream(VUECE_STREAM_MODE_PRETRANSCODE, job.sample_rate, job.bit_rate, job.nchannels, job.duration);
+
+	if(!stream->Open(job.path, VUECE_STREAM_MODE_PRETRANSCODE))
+	{
+		LOG(LS_WARNING) << "VuecePreTranscodeWorker[" << id << "] - Cannot open: " << job.path;
+		delete stream;
+		return VuecePreTranscoder::JobResult_Failed;
+	}
+
+	if(!stream->IsWritingTranscodeCache())
+	{
+		delete stream;
+		return VuecePreTranscoder::JobResult_Skipped;
+	}
+
+	while(true)
+	{
+		if(!owner->WaitWhileStreaming())
+		{
+			ret = VuecePreTranscoder::JobResult_Interrupted;
+			break;
+		}
+
+		start_ms = VueceThreadUtil::GetCurTimeMs();
+
+		sr = stream->Read(buffer, VUECE_PRETRANSCODE_READ_BUFFER_SIZE, &read, &error);
+
+		if(sr == talk_base::SR_EOS)
+		{
+			break;
+		}
+
+		if(sr != talk_base::SR_SUCCESS)
+		{
+			LOG(LS_WARNING) << "VuecePreTranscodeWorker[" << id << "] - Read failed: " << sr << ", file: " << job.path;
+			ret = VuecePreTranscoder::JobResult_Failed;
+			break;
+		}
+
+		if(!owner->Throttle(VueceThreadUtil::GetCurTimeMs() - start_ms, read))
+		{
+			ret = VuecePreTranscoder::JobResult_Interrupted;
+			break;
+		}
+	}
+
+	//an unfinished cache entry is dropped when the stream is closed
+	delete stream;
+
+	return ret;
+}
+
+/* ---------------------------- pool ---------------------------- */
+
+VuecePreTranscoder::VuecePreTranscoder()
+{
+	LOG(INFO) << "VuecePreTranscoder - Constructor called.";
+
+	bJobListBuilt = false;
+	bStopping = false;
+
+	transcoded_count = 0;
+	skipped_count = 0;
+	failed_count = 0;
+
+	VueceThreadUtil::InitMutex(&mutex_jobs);
+}
+
+VuecePreTranscoder::~VuecePreTranscoder()
+{
+	LOG(INFO) << "VuecePreTranscoder - Destructor called.";
+
+	Stop();
+}
+
+void VuecePreTranscoder::Start()
+{
+	talk_base::Pathname path;
+	int i = 0;
+
+	if(!workers.empty())
+	{
+		LOG(LS_WARNING) << "VuecePreTranscoder::Start - Already started";
+		return;
+	}
+
+	//create cache here so workers and streaming sessions never race on it
+	VueceTranscodeCache::Instance();
+
+	talk_base::Filesystem::GetTemporaryFolder(path, true, NULL);
+	path.AppendFolder(VUECE_TRANSCODE_CACHE_FOLDER);
+	path.SetFilename(VUECE_PRETRANSCODE_PROGRESS_FILE);
+
+	progress_path = path.pathname();
+	db_checksum = VueceMediaDBManager::RetrieveDBFileChecksum(false);
+
+	LoadProgress();
+
+	bStopping = false;
+
+	for(i = 0; i < VUECE_PRETRANSCODE_WORKER_NUM; i++)
+	{
+		VuecePreTranscodeWorker* w = new VuecePreTranscodeWorker(this, i);
+
+		if(w->Start() < 0)
+		{
+			LOG(LS_ERROR) << "VuecePreTranscoder::Start - Cannot start worker " << i;
+			delete w;
+			continue;
+		}
+
+		workers.push_back(w);
+	}
+
+	LOG(INFO) << "VuecePreTranscoder::Start - " << workers.size() << " worker(s) started";
+}
+
+void VuecePreTranscoder::Stop()
+{
+	size_t i = 0;
+
+	bStopping = true;
+
+	for(i = 0; i < workers.size(); i++)
+	{
+		while(workers[i]->IsRunning())
+		{
+			VueceThreadUtil::SleepMs(100);
+		}
+
+		delete workers[i];
+	}
+
+	if(!workers.empty())
+	{
+		LOG(INFO) << "VuecePreTranscoder::Stop - Done, transcoded: " << transcoded_count
+				<< ", skipped: " << skipped_count << ", failed: " << failed_count;
+	}
+
+	workers.clear();
+}
+
+bool VuecePreTranscoder::IsStopping()
+{
+	return bStopping;
+}
+
+bool VuecePreTranscoder::SleepUnlessStopping(int ms)
+{
+	while(ms > 0 && !bStopping)
+	{
+		VueceThreadUtil::SleepMs(ms > 100 ? 100 : ms);
+		ms -= 100;
+	}
+
+	return !bStopping;
+}
+
+/*
+ * Blocks as long as any client is being served, returns false if the pool is stopping
+ */
+bool VuecePreTranscoder::WaitWhileStreaming()
+{
+	while(!bStopping && talk_base::VueceMediaStream::GetActiveServerStreamCount() > 0)
+	{
+		SleepUnlessStopping(VUECE_PRETRANSCODE_BUSY_CHECK_MS);
+	}
+
+	return !bStopping;
+}
+
+/*
+ * Called after each read of a worker, busy_ms is the time it took and bytes is
+ * the amount of data produced, sleeps long enough to stay within both budgets
+ */
+bool VuecePreTranscoder::Throttle(uint64_t busy_ms, size_t bytes)
+{
+	int64_t cpu_sleep_ms = (int64_t)busy_ms * (100 - VUECE_PRETRANSCODE_CPU_PERCENT) / VUECE_PRETRANSCODE_CPU_PERCENT;
+	int64_t io_sleep_ms = (int64_t)bytes * 1000 / VUECE_PRETRANSCODE_MAX_BYTES_PER_SEC - (int64_t)busy_ms;
+
+	return SleepUnlessStopping((int)(cpu_sleep_ms > io_sleep_ms ? cpu_sleep_ms : io_sleep_ms));
+}
+
+/*
+ * Progress file: media DB checksum on the first line, then one uri per line for
+ * each handled track, it's reset when the DB is rebuilt
+ */
+void VuecePreTranscoder::LoadProgress()
+{
+	char line[256];
+	FILE* f = NULL;
+	size_t len = 0;
+	bool valid = false;
+
+	done_uris.clear();
+
+	f = fopen(progress_path.c_str(), "r");
+
+	if(f != NULL)
+	{
+		while(fgets(line, sizeof(line), f) != NULL)
+		{
+			len = strlen(line);
+
+			while(len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+			{
+				line[--len] = 0;
+			}
+
+			if(!valid)
+			{
+				valid = (db_checksum.compare(line) == 0);
+
+				if(!valid)
+				{
+					break;
+				}
+
+				continue;
+			}
+
+			done_uris.insert(std::string(line));
+		}
+
+		fclose(f);
+	}
+
+	if(!valid)
+	{
+		f = fopen(progress_path.c_str(), "w");
+
+		if(f != NULL)
+		{
+			fprintf(f, "%s\n", db_checksum.c_str());
+			fclose(f);
+		}
+	}
+
+	LOG(INFO) << "VuecePreTranscoder::LoadProgress - " << done_uris.size() << " track(s) handled in previous runs";
+}
+
+/*
+ * Must be called with job mutex held
+ */
+void VuecePreTranscoder::BuildJobList()
+{
+	VueceMediaDBManager* dbMgr = new VueceMediaDBManager();
+	VueceMediaItemList* list = NULL;
+	std::vector<VuecePreTranscodeJob> candidates;
+	std::list<vuece::VueceMediaItem*>::iterator iter;
+	size_t i = 0;
+
+	bJobListBuilt = true;
+
+	if(!dbMgr->Open())
+	{
+		LOG(LS_ERROR) << "VuecePreTranscoder::BuildJobList - DB cannot be opened.";
+		delete dbMgr;
+		return;
+	}
+
+	list = dbMgr->QueryAllSongs();
+
+	dbMgr->Close();
+	delete dbMgr;
+
+	for(iter = list->begin(); iter != list->end(); iter++)
+	{
+		VueceMediaItem* v = *iter;
+		VuecePreTranscodeJob job;
+		std::string path_utf8;
+		std::string ext;
+		struct stat file_stats;
+
+		if(v->IsFolder() || done_uris.find(v->Uri()) != done_uris.end()
+				|| v->SampleRate() <= 0 || v->BitRate() <= 0 || v->NChannels() <= 0 || v->Duration() <= 0)
+		{
+			delete v;
+			continue;
+		}
+
+		talk_base::Base64::Decode(v->Path(), talk_base::Base64::DO_STRICT, &path_utf8, NULL);
+
+		//same conversions as the path of a streaming session goes through, cache is keyed by path
+		talk_base::Pathname raw_local_path("");
+		raw_local_path.AppendPathname(VueceWinUtilities::ws2s(VueceWinUtilities::utf8_decode(path_utf8)));
+
+		talk_base::Pathname local_path;
+		local_path.AppendPathname(raw_local_path.pathname());
+
+		ext = local_path.extension();
+		std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+		//only MP3/MP2 is transcoded
+		if((ext.compare(".mp3") == 0 || ext.compare(".mp2") == 0) && stat(local_path.pathname().c_str(), &file_stats) == 0)
+		{
+			job.uri = v->Uri();
+			job.path = local_path.pathname();
+			job.mtime = file_stats.st_mtime;
+			job.sample_rate = v->SampleRate();
+			job.bit_rate = v->BitRate();
+			job.nchannels = v->NChannels();
+			job.duration = v->Duration();
+
+			candidates.push_back(job);
+		}
+
+		delete v;
+	}
+
+	delete list;
+
+	std::sort(candidates.begin(), candidates.end(), newer_first);
+
+	for(i = 0; i < candidates.size() && i < VUECE_PRETRANSCODE_MAX_TRACKS; i++)
+	{
+		jobs.push_back(candidates[i]);
+	}
+
+	LOG(INFO) << "VuecePreTranscoder::BuildJobList - " << candidates.size() << " candidate(s), " << jobs.size() << " queued";
+}
+
+bool VuecePreTranscoder::NextJob(VuecePreTranscodeJob* job)
+{
+	bool ret = false;
+
+	VueceThreadUtil::MutexLock(&mutex_jobs);
+
+	if(!bJobListBuilt)
+	{
+		BuildJobList();
+	}
+
+	if(!jobs.empty())
+	{
+		*job = jobs.front();
+		jobs.pop_front();
+		ret = true;
+	}
+
+	VueceThreadUtil::MutexUnlock(&mutex_jobs);
+
+	return ret;
+}
+
+void VuecePreTranscoder::JobDone(const VuecePreTranscodeJob& job, int result)
+{
+	FILE* f = NULL;
+
+	VueceThreadUtil::MutexLock(&mutex_jobs);
+
+	switch(result)
+	{
+	case JobResult_Transcoded:
+		transcoded_count++;
+		break;
+	case JobResult_Skipped:
+		skipped_count++;
+		break;
+	case JobResult_Failed:
+		failed_count++;
+		break;
+	default:
+		break;
+	}
+
+	//an interrupted track is picked up again next time
+	if(result != JobResult_Interrupted)
+	{
+		f = fopen(progress_path.c_str(), "a");
+
+		if(f != NULL)
+		{
+			fprintf(f, "%s\n", job.uri.c_str());
+			fclose(f);
+		}
+	}
+
+	VueceThreadUtil::MutexUnlock(&mutex_jobs);
+
+	LOG(INFO) << "VuecePreTranscoder::JobDone - result: " << result << ", file: " << job.path;
+}
@@ -0,0 +1,135 @@
+/*
+ * VuecePreTranscoder.h
+ *
+ *  Created on: Mar 29, 2015
+ *      Author: jingjing
+ */
+
+#ifndef VUECEPRETRANSCODER_H_
+#define VUECEPRETRANSCODER_H_
+
+#include <time.h>
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "jthread.h"
+#include "VueceThreadUtil.h"
+
+#define VUECE_PRETRANSCODE_WORKER_NUM 2
+
+/*
+ * Share of wall clock time a worker is allowed to spend in transcoding,
+ * it sleeps for the rest of time
+ */
+#define VUECE_PRETRANSCODE_CPU_PERCENT 25
+
+/*
+ * Max number of bytes per second a worker writes into transcode cache, input
+ * is read at about the same rate
+ */
+#define VUECE_PRETRANSCODE_MAX_BYTES_PER_SEC (128*1024)
+
+//leave half of the cache to tracks which are actually played
+#define VUECE_PRETRANSCODE_MAX_TRACKS (VUECE_TRANSCODE_CACHE_MAX_ENTRIES / 2)
+
+#define VUECE_PRETRANSCODE_READ_BUFFER_SIZE (16*1024)
+
+//how often a paused worker checks if streaming sessions are gone
+#define VUECE_PRETRANSCODE_BUSY_CHECK_MS 1000
+
+#define VUECE_PRETRANSCODE_PROGRESS_FILE "pretranscode_progress.txt"
+
+typedef struct VuecePreTranscodeJob
+{
+	//media DB uri, used to remember progress
+	std::string uri;
+	//file path in the same form as the one opened by a streaming session
+	std::string path;
+	time_t mtime;
+	int sample_rate;
+	int bit_rate;
+	int nchannels;
+	int duration;
+} VuecePreTranscodeJob;
+
+class VuecePreTranscoder;
+
+class VuecePreTranscodeWorker: public JThread
+{
+public:
+	VuecePreTranscodeWorker(VuecePreTranscoder* owner, int id);
+	virtual ~VuecePreTranscodeWorker();
+
+	void* Thread();
+
+private:
+	int RunJob(const VuecePreTranscodeJob& job);
+
+private:
+	VuecePreTranscoder* owner;
+	int id;
+	char* buffer;
+};
+
+/*
+ * Transcodes MP3/MP2 tracks of the media DB into transcode cache in background
+ * so they can be streamed without on-line encoding, see VueceTranscodeCache.
+ *
+ * Recently added tracks (by file modification time) go first. Workers run at idle
+ * priority with CPU and IO budgets, and are paused as long as any streaming session
+ * is active. A paused worker keeps its track open and continues where it stopped,
+ * tracks which have been handled are remembered in a progress file so they are not
+ * probed again after a restart, until the media DB is rebuilt.
+ */
+class VuecePreTranscoder
+{
+public:
+	VuecePreTranscoder();
+	virtual ~VuecePreTranscoder();
+
+	void Start();
+	void Stop();
+
+	//worker side
+	bool NextJob(VuecePreTranscodeJob* job);
+	void JobDone(const VuecePreTranscodeJob& job, int result);
+	bool IsStopping();
+	bool WaitWhileStreaming();
+	bool Throttle(uint64_t busy_ms, size_t bytes);
+
+	typedef enum _JobResult{
+		JobResult_Transcoded = 0,
+		JobResult_Skipped,
+		JobResult_Failed,
+		JobResult_Interrupted
+	}JobResult;
+
+private:
+	void BuildJobList();
+	void LoadProgress();
+	bool SleepUnlessStopping(int ms);
+
+private:
+	std::vector<VuecePreTranscodeWorker*> workers;
+
+	std::deque<VuecePreTranscodeJob> jobs;
+	bool bJobListBuilt;
+
+	//uris of tracks handled in previous runs
+	std::set<std::string> done_uris;
+
+	std::string progress_path;
+	std::string db_checksum;
+
+	volatile bool bStopping;
+
+	long transcoded_count;
+	long skipped_count;
+	long failed_count;
+
+	JMutex mutex_jobs;
+};
+
+#endif /* VUECEPRETRANSCODER_H_ */
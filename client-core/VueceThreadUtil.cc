@@ -6,6 +6,9 @@
  */
 
 #include <errno.h>
+#ifndef WIN32
+#include <sys/time.h>
+#endif
 #include "VueceThreadUtil.h"
 #include "VueceLogger.h"
 
@@ -59,17 +62,44 @@ void VueceThreadUtil::MutexUnlock(JMutex* m)
 	m->Unlock();
 }
 
-#ifdef ANDROID
+#ifndef WIN32
 void VueceThreadUtil::CondWait(pthread_cond_t* cond, JMutex* m)
 {
 	pthread_cond_wait(cond, (pthread_mutex_t*)m->Handle());
 }
 
+/*
+ * Returns 0 if signaled, ETIMEDOUT if timeout_ms elapsed
+ */
+int VueceThreadUtil::CondTimedWait(pthread_cond_t* cond, JMutex* m, int timeout_ms)
+{
+	struct timeval now;
+	struct timespec abstime;
+
+	gettimeofday(&now, NULL);
+
+	abstime.tv_sec = now.tv_sec + timeout_ms / 1000;
+	abstime.tv_nsec = now.tv_usec * 1000L + (timeout_ms % 1000) * 1000000L;
+
+	if(abstime.tv_nsec >= 1000000000L)
+	{
+		abstime.tv_sec++;
+		abstime.tv_nsec -= 1000000000L;
+	}
+
+	return pthread_cond_timedwait(cond, (pthread_mutex_t*)m->Handle(), &abstime);
+}
+
 void VueceThreadUtil::CondSignal(pthread_cond_t* cond)
 {
 	pthread_cond_signal(cond);
 }
 
+void VueceThreadUtil::CondBroadcast(pthread_cond_t* cond)
+{
+	pthread_cond_broadcast(cond);
+}
+
 int VueceThreadUtil::CreateThread(pthread_t *thread, pthread_attr_t *attr, void * (*routine)(void*), void *arg)
 {
 	pthread_attr_t my_attr;
@@ -10,6 +10,7 @@
 
 #include "jthread.h"
 
+#ifdef _WIN32
 #ifndef int64_t
 typedef long long int		int64_t;
 #endif
@@ -17,6 +18,9 @@ typedef long long int		int64_t;
 #ifndef uint64_t
 typedef unsigned long long int	uint64_t;
 #endif
+#else
+#include <stdint.h>
+#endif
 
 
 typedef struct VueceTimeSpec{
@@ -37,9 +41,11 @@ public:
 	static void SleepSec(int seconds);
 	static void ThreadExit(void* ref_val);
 
-#ifdef ANDROID
+#ifndef WIN32
 	static void CondWait(pthread_cond_t* cond, JMutex* m);
+	static int  CondTimedWait(pthread_cond_t* cond, JMutex* m, int timeout_ms);
 	static void CondSignal(pthread_cond_t* cond);
+	static void CondBroadcast(pthread_cond_t* cond);
 	static int CreateThread(pthread_t *thread, pthread_attr_t *attr, void * (*routine)(void*), void *arg);
 	static int ThreadJoin(pthread_t thread);
 #endif
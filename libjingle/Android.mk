@@ -108,6 +108,7 @@ talk/base/timeutils.cc \
 talk/base/urlencode.cc \
 talk/base/unixfilesystem.cc \
 talk/base/streamutils.cc \
+talk/base/tarprefetcher.cc \
 talk/base/tarstream.cc \
 
 MY_JINGLE_SRC_FILES_P2P := \
@@ -195,6 +196,19 @@ talk/session/fileshare/VueceNetworkPlayerFsm.cc \
 talk/session/fileshare/VueceStreamPlayerMonitorThread2.cc \
 talk/session/fileshare/VueceMediaDataBumperFsm.cc \
 talk/session/fileshare/VueceMemQueue.cc \
+talk/session/fileshare/VueceFrameRing.cc \
+talk/session/fileshare/VueceMmapChunkReader.cc \
+talk/session/fileshare/VueceChunkFrameIndex.cc \
+talk/session/fileshare/VueceSegmentStore.cc \
+talk/session/fileshare/VueceJitterController.cc \
+talk/session/fileshare/VueceAudioTrackSink.cc \
+talk/session/fileshare/VueceFileAudioSink.cc \
+talk/session/fileshare/VueceJabberClientObserver.cc \
+talk/session/fileshare/VueceTranscodeCache.cc \
+talk/session/fileshare/VueceSeekIndex.cc \
+talk/session/fileshare/VueceAudioResampler.cc \
+talk/session/fileshare/VueceStreamFrameQueue.cc \
+talk/session/fileshare/VueceMappedFileStream.cc \
 talk/session/fileshare/VueceAACDecoder.cc \
 talk/session/fileshare/VueceAudioWriter.cc \
 talk/session/fileshare/VueceStreamEngine.cc \
@@ -770,6 +770,16 @@ HttpBase::flush_data() {
 //    	LOG(LS_VERBOSE) << "HttpBase::flush_data:Send is NOT required, queue document data now.";
 //    }
 
+    if (!send_required && (0 == len_) && !chunk_data_
+        && (NULL != data_->document.get())
+        && data_->document->SupportsReadV()) {
+      // Nothing is buffered, so document data goes to the network straight
+      // from the document's own buffers instead of being copied into buffer_.
+      if (!flush_document_v())
+        return;
+      continue;
+    }
+
     if (!send_required && (NULL != data_->document.get())) {
       // Next, attempt to queue document data.
 
@@ -920,6 +930,52 @@ HttpBase::flush_data() {
   ASSERT(false);
 }
 
+// Writes one batch of document data pieces returned by ReadV.  Returns true if
+// the batch was written completely and flushing may continue.
+bool
+HttpBase::flush_document_v() {
+  StreamIoVec iov[kMaxIoVecs];
+  size_t count = 0, total = 0;
+  int error = 0;
+
+  StreamResult result = data_->document->ReadV(iov, kMaxIoVecs, kBufferSize,
+                                               &count, &error);
+  if (result == SR_BLOCK) {
+    // Document will signal SE_READ when it has more data.
+    return false;
+  } else if (result == SR_EOS) {
+    do_complete();
+    return false;
+  } else if (result != SR_SUCCESS) {
+    LOG_F(LS_ERROR) << "Read error: " << error;
+    do_complete(HE_STREAM);
+    return false;
+  }
+
+  result = SR_SUCCESS;
+  for (size_t i = 0; (i < count) && (result == SR_SUCCESS); ++i) {
+    size_t written = 0;
+    result = http_stream_->Write(iov[i].base, iov[i].len, &written, &error);
+    if (result == SR_SUCCESS) {
+      total += written;
+      if (written < iov[i].len) {
+        // Network is not writeable for now, continue on SE_WRITE.
+        result = SR_BLOCK;
+      }
+    }
+  }
+
+  data_->document->ConsumeReadData(total);
+
+  if (result == SR_ERROR) {
+    LOG_F(LS_ERROR) << "error";
+    OnHttpStreamEvent(http_stream_, SE_CLOSE, error);
+    return false;
+  }
+
+  return (result == SR_SUCCESS);
+}
+
 bool
 HttpBase::queue_headers() {
 	//LOG(LS_VERBOSE) << "HttpBase::queue_headers";
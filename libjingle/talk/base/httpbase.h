@@ -158,6 +158,7 @@ protected:
 
   void read_and_process_data();
   void flush_data();
+  bool flush_document_v();
   bool queue_headers();
   void do_complete(HttpError err = HE_NONE);
 
@@ -181,6 +182,7 @@ private:
   friend class DocumentStream;
 
   enum { kBufferSize = 32 * 1024 };
+  enum { kMaxIoVecs = 16 };
 
   HttpMode mode_;
   HttpData* data_;
@@ -891,7 +891,7 @@ StreamResult FifoBuffer::Read(void* buffer, size_t bytes,
     }
 
     // if we were full before, and now we're not, post an event
-    if (!was_writable && copy > 0) {
+    if (owner_ && !was_writable && copy > 0) {
       PostEvent(owner_, SE_WRITE, 0);
     }
   }
@@ -914,7 +914,7 @@ StreamResult FifoBuffer::Write(const void* buffer, size_t bytes,
     }
 
     // if we didn't have any data to read before, and now we do, post an event
-    if (!was_readable && copy > 0) {
+    if (owner_ && !was_readable && copy > 0) {
       PostEvent(owner_, SE_READ, 0);
     }
   }
@@ -939,7 +939,7 @@ void FifoBuffer::ConsumeReadData(size_t size) {
   const bool was_writable = data_length_ < buffer_length_;
   read_position_ = (read_position_ + size) % buffer_length_;
   data_length_ -= size;
-  if (!was_writable && size > 0) {
+  if (owner_ && !was_writable && size > 0) {
     PostEvent(owner_, SE_WRITE, 0);
   }
 }
@@ -968,7 +968,7 @@ void FifoBuffer::ConsumeWriteBuffer(size_t size) {
   ASSERT(size <= buffer_length_ - data_length_);
   const bool was_readable = (data_length_ > 0);
   data_length_ += size;
-  if (!was_readable && size > 0) {
+  if (owner_ && !was_readable && size > 0) {
     PostEvent(owner_, SE_READ, 0);
   }
 }
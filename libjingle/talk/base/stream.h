@@ -72,6 +72,12 @@ struct StreamEventData : public MessageData {
   StreamEventData(int ev, int er) : events(ev), error(er) { }
 };
 
+// One contiguous piece of stream data returned by ReadV.
+struct StreamIoVec {
+  const void* base;
+  size_t len;
+};
+
 class StreamInterface : public MessageHandler {
  public:
   enum {
@@ -148,6 +154,19 @@ class StreamInterface : public MessageHandler {
   virtual const void* GetReadData(size_t* data_len) { return NULL; }
   virtual void ConsumeReadData(size_t used) {}
 
+  // ReadV is the scatter/gather form of GetReadData, for streams which keep
+  // their output in several buffers.  At most iov_max pieces, describing up to
+  // max_len bytes, are returned in iov and iov_count.  Results are the same as
+  // Read.  The pieces are owned by the stream and stay valid until the next
+  // Read, ReadV or ConsumeReadData call.  The caller must call ConsumeReadData
+  // with the number of processed bytes.  ReadV is only supported if
+  // SupportsReadV returns true.
+  virtual bool SupportsReadV() const { return false; }
+  virtual StreamResult ReadV(StreamIoVec* iov, size_t iov_max, size_t max_len,
+                             size_t* iov_count, int* error) {
+    return SR_ERROR;
+  }
+
   // GetWriteBuffer returns a pointer to a buffer which is owned by the stream.
   // The buffer has a capacity of buf_len bytes.  NULL is returned if there is
   // no buffer available, or if the method fails.  The call may write data to
@@ -642,7 +661,8 @@ class FifoBuffer : public StreamInterface {
  public:
   // Creates a FIFO buffer with the specified capacity.
   explicit FifoBuffer(size_t length);
-  // Creates a FIFO buffer with the specified capacity and owner
+  // Creates a FIFO buffer with the specified capacity and owner.  Without an
+  // owner (NULL), no stream events are posted.
   FifoBuffer(size_t length, Thread* owner);
   virtual ~FifoBuffer();
   // Gets the amount of data currently readable from the buffer.
@@ -203,3 +203,19 @@ talk_base::StreamResult StreamCounter::Write(
   SignalUpdateByteCount(count_);
   return result;
 }
+
+bool StreamCounter::SupportsReadV() const {
+  return const_cast<StreamCounter*>(this)->stream()->SupportsReadV();
+}
+
+talk_base::StreamResult StreamCounter::ReadV(
+    talk_base::StreamIoVec* iov, size_t iov_max, size_t max_len,
+    size_t* iov_count, int* error) {
+  return stream()->ReadV(iov, iov_max, max_len, iov_count, error);
+}
+
+void StreamCounter::ConsumeReadData(size_t used) {
+  stream()->ConsumeReadData(used);
+  count_ += used;
+  SignalUpdateByteCount(count_);
+}
@@ -85,6 +85,13 @@ class StreamCounter : public talk_base::StreamAdapterInterface {
   virtual talk_base::StreamResult Write(const void* data, size_t data_len,
                                         size_t* written, int* error);
 
+  // ReadV passes through to the wrapped stream, consumed bytes are counted.
+  virtual bool SupportsReadV() const;
+  virtual talk_base::StreamResult ReadV(talk_base::StreamIoVec* iov,
+                                        size_t iov_max, size_t max_len,
+                                        size_t* iov_count, int* error);
+  virtual void ConsumeReadData(size_t used);
+
  private:
   size_t count_;
 };
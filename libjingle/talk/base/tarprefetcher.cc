@@ -0,0 +1,245 @@
+#include "talk/base/tarprefetcher.h"
+
+#if defined(WIN32)
+#include "talk/base/win32.h"
+#elif defined(POSIX)
+#include <unistd.h>
+#endif
+
+#include "talk/base/common.h"
+#include "talk/base/logging.h"
+
+using namespace talk_base;
+
+///////////////////////////////////////////////////////////////////////////////
+// TarPrefetcher::Job
+///////////////////////////////////////////////////////////////////////////////
+
+class TarPrefetcher::Job {
+ public:
+  enum State { PENDING, RUNNING, DONE };
+
+  Job(const std::string& pathname, size_t size)
+      : pathname_(pathname), size_(size), state_(PENDING), stream_(NULL),
+        buffered_(0) {
+  }
+  ~Job() {
+    delete stream_;
+  }
+
+  std::string pathname_;
+  size_t size_;
+  State state_;
+  // Result of the job, NULL if the file could not be opened.
+  StreamInterface* stream_;
+  // Bytes of stream_ which count against the read-ahead budget.
+  size_t buffered_;
+};
+
+namespace {
+
+// A file which was read ahead, the stream owns the memory.
+class PrefetchedStream : public ExternalMemoryStream {
+ public:
+  PrefetchedStream(char* data, size_t length)
+      : ExternalMemoryStream(data, length), data_(data) {
+  }
+  virtual ~PrefetchedStream() {
+    delete [] data_;
+  }
+
+ private:
+  char* data_;
+};
+
+}  // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// TarPrefetcher
+///////////////////////////////////////////////////////////////////////////////
+
+TarPrefetcher::TarPrefetcher(size_t threads, size_t buffer_size,
+                             size_t max_file_size)
+    : buffer_size_(buffer_size), max_file_size_(max_file_size), pending_(0),
+      buffered_(0), stop_(false), work_(false, false), done_(false, false) {
+  // Events set themselves up on first use, make sure that doesn't happen on
+  // several threads at once.
+  work_.Reset();
+  done_.Reset();
+
+  for (size_t i = 0; i < threads; ++i) {
+    Thread* thread = new Thread();
+    thread->SetName("TarPrefetcher", this);
+    if (!thread->Start(this)) {
+      LOG_F(LS_WARNING) << "Couldn't start prefetch thread " << i;
+      delete thread;
+      break;
+    }
+    threads_.push_back(thread);
+  }
+}
+
+TarPrefetcher::~TarPrefetcher() {
+  {
+    CritScope cs(&crit_);
+    stop_ = true;
+  }
+  work_.Set();
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    threads_[i]->Stop();
+    delete threads_[i];
+  }
+  threads_.clear();
+
+  for (JobList::iterator it = jobs_.begin(); it != jobs_.end(); ++it) {
+    delete *it;
+  }
+  jobs_.clear();
+}
+
+TarPrefetcher::Job* TarPrefetcher::Add(const std::string& pathname,
+                                       size_t size) {
+  Job* job = new Job(pathname, size);
+  {
+    CritScope cs(&crit_);
+    jobs_.push_back(job);
+    ++pending_;
+  }
+  if (!threads_.empty()) {
+    work_.Set();
+  }
+  return job;
+}
+
+StreamInterface* TarPrefetcher::Take(Job* job) {
+  while (true) {
+    Job* next = NULL;
+    {
+      CritScope cs(&crit_);
+      if (Job::DONE == job->state_)
+        break;
+      next = StartNextJob();
+    }
+    if (next) {
+      // Rather than wait for the workers, help them.  Jobs are taken in the
+      // order they were added, so this is the wanted job when it is pending.
+      Process(next);
+    } else {
+      done_.Wait(kForever);
+    }
+  }
+
+  StreamInterface* stream;
+  {
+    CritScope cs(&crit_);
+    jobs_.remove(job);
+    buffered_ -= job->buffered_;
+    stream = job->stream_;
+    job->stream_ = NULL;
+  }
+  delete job;
+  return stream;
+}
+
+void TarPrefetcher::Run(Thread* thread) {
+  while (true) {
+    Job* job = NULL;
+    bool more = false;
+    {
+      CritScope cs(&crit_);
+      if (stop_)
+        break;
+      job = StartNextJob();
+      more = (pending_ > 0);
+    }
+
+    if (more) {
+      // Wake up another worker for the remaining jobs.
+      work_.Set();
+    }
+
+    if (job) {
+      Process(job);
+    } else {
+      work_.Wait(kForever);
+    }
+  }
+
+  // Pass the stop request on to the next worker.
+  work_.Set();
+}
+
+size_t TarPrefetcher::DefaultThreads() {
+  long cpus = 1;
+#if defined(WIN32)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  cpus = info.dwNumberOfProcessors;
+#elif defined(POSIX)
+  cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  if (cpus <= 1)
+    return 0;
+  return _min(static_cast<size_t>(cpus - 1),
+              static_cast<size_t>(kMaxThreads));
+}
+
+// Returns the oldest job nobody has started on, marked as running, or NULL.
+// crit_ must be held.
+TarPrefetcher::Job* TarPrefetcher::StartNextJob() {
+  if (0 == pending_)
+    return NULL;
+  for (JobList::iterator it = jobs_.begin(); it != jobs_.end(); ++it) {
+    if (Job::PENDING == (*it)->state_) {
+      (*it)->state_ = Job::RUNNING;
+      --pending_;
+      return *it;
+    }
+  }
+  ASSERT(false);
+  return NULL;
+}
+
+void TarPrefetcher::Process(Job* job) {
+  FileStream* file = new FileStream;
+  if (!file->Open(job->pathname_.c_str(), "rb", NULL)) {
+    delete file;
+    file = NULL;
+  }
+
+  // Without workers the file is read right away by the caller, reading it
+  // into memory first would only add a copy.
+  size_t reserved = 0;
+  if (file && !threads_.empty() && (job->size_ > 0)
+      && (job->size_ <= max_file_size_)) {
+    CritScope cs(&crit_);
+    if (buffered_ + job->size_ <= buffer_size_) {
+      buffered_ += job->size_;
+      reserved = job->size_;
+    }
+  }
+
+  StreamInterface* stream = file;
+  if (reserved > 0) {
+    char* data = new char[reserved];
+    if (SR_SUCCESS == file->ReadAll(data, reserved, NULL, NULL)) {
+      stream = new PrefetchedStream(data, reserved);
+      delete file;
+    } else {
+      // The file changed since it was found, leave it to the reader.
+      delete [] data;
+      file->SetPosition(0);
+      CritScope cs(&crit_);
+      buffered_ -= reserved;
+      reserved = 0;
+    }
+  }
+
+  {
+    CritScope cs(&crit_);
+    job->stream_ = stream;
+    job->buffered_ = reserved;
+    job->state_ = Job::DONE;
+  }
+  done_.Set();
+}
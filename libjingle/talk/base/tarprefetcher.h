@@ -0,0 +1,79 @@
+#ifndef TALK_BASE_TARPREFETCHER_H__
+#define TALK_BASE_TARPREFETCHER_H__
+
+#include <list>
+#include <string>
+#include <vector>
+#include "talk/base/criticalsection.h"
+#include "talk/base/event.h"
+#include "talk/base/stream.h"
+#include "talk/base/thread.h"
+
+namespace talk_base {
+
+///////////////////////////////////////////////////////////////////////////////
+// TarPrefetcher - opens the files which a TarStream is about to send on a
+// small pool of worker threads, so that the per-file open latency of many
+// small files is overlapped instead of being paid one file at a time.  Files
+// up to max_file_size are also read into memory, as long as the total size of
+// read-ahead data stays within buffer_size.
+///////////////////////////////////////////////////////////////////////////////
+
+class TarPrefetcher : public Runnable {
+ public:
+  class Job;
+
+  // With zero threads, files are opened by Take, as before prefetching.
+  TarPrefetcher(size_t threads, size_t buffer_size, size_t max_file_size);
+  virtual ~TarPrefetcher();
+
+  // Queues a file of the given size.  Jobs are processed in the order they
+  // were added.
+  Job* Add(const std::string& pathname, size_t size);
+
+  // Waits for the job, and returns the file contents as a stream owned by the
+  // caller, or NULL if the file could not be opened.  The job is released.
+  // While waiting, the caller processes jobs no worker has started on yet.
+  StreamInterface* Take(Job* job);
+
+  // Runnable
+  virtual void Run(Thread* thread);
+
+  // Number of threads worth starting on this host: one per CPU besides the
+  // reading thread, up to kMaxThreads.  On a single CPU the workers would
+  // only compete with the reader, so it is 0 there.
+  static size_t DefaultThreads();
+
+ private:
+  typedef std::list<Job*> JobList;
+  enum { kMaxThreads = 2 };
+
+  Job* StartNextJob();
+  void Process(Job* job);
+
+  size_t buffer_size_;
+  size_t max_file_size_;
+  std::vector<Thread*> threads_;
+
+  // The following are protected by crit_.
+  CriticalSection crit_;
+  JobList jobs_;
+  // Jobs nobody has started on yet.
+  size_t pending_;
+  // Bytes read ahead and not yet taken.
+  size_t buffered_;
+  bool stop_;
+
+  // Signaled when a job is added, or when the workers should exit.
+  Event work_;
+  // Signaled when a job is done.
+  Event done_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(TarPrefetcher);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+}  // namespace talk_base
+
+#endif  // TALK_BASE_TARPREFETCHER_H__
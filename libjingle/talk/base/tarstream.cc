@@ -4,6 +4,7 @@
 #include "talk/base/pathutils.h"
 #include "talk/base/stringutils.h"
 #include "talk/base/common.h"
+#include "talk/base/logging.h"
 
 using namespace talk_base;
 
@@ -12,7 +13,9 @@ using namespace talk_base;
 ///////////////////////////////////////////////////////////////////////////////
 
 TarStream::TarStream() : mode_(M_NONE), next_block_(NB_NONE), block_pos_(0),
-                         current_(NULL), current_bytes_(0) {
+                         current_(NULL), current_bytes_(0), queued_files_(0),
+                         prefetcher_(NULL),
+                         prefetch_threads_(TarPrefetcher::DefaultThreads()) {
 }
 
 TarStream::~TarStream() {
@@ -49,10 +52,16 @@ bool TarStream::Open(const std::string& folder, bool read) {
     find_.push_front(iter);
     next_block_ = NB_FILE_HEADER;
     block_pos_ = BLOCK_SIZE;
+    prefetcher_ = new TarPrefetcher(prefetch_threads_, kPrefetchBufferSize,
+                                    kPrefetchMaxFileSize);
     int error;
     if (SR_SUCCESS != ProcessNextEntry(find_.front(), &error)) {
       return false;
     }
+    // Get the first files prefetched while the response headers are sent.
+    if (SR_SUCCESS != FindEntries(&error)) {
+      return false;
+    }
   } else {
     if (!Filesystem::CreateFolder(root_folder_)) {
       return false;
@@ -98,6 +107,10 @@ void TarStream::Close() {
   }
   find_.clear();
   subfolder_.clear();
+  entries_.clear();
+  queued_files_ = 0;
+  delete prefetcher_;
+  prefetcher_ = NULL;
 }
 
 StreamResult TarStream::ProcessBuffer(void* buffer, size_t buffer_len,
@@ -245,26 +258,58 @@ StreamResult TarStream::ReadNextFile(int* error) {
   ASSERT(BLOCK_SIZE == block_pos_);
   ASSERT(NULL == current_);
 
-  // ReadNextFile conducts a depth-first recursive search through the directory
+  while (true) {
+    // Keep the search ahead of the output, so the prefetcher has the next
+    // files to work on while this one is sent.  It is refilled in batches,
+    // so the prefetch threads are not woken up for every single file.
+    if (entries_.empty() || (queued_files_ <= kPrefetchDepth / 2)) {
+      StreamResult result = FindEntries(error);
+      if (SR_SUCCESS != result) {
+        return result;
+      }
+    }
+    if (entries_.empty()) {
+      return SR_EOS;
+    }
+
+    Entry entry = entries_.front();
+    entries_.pop_front();
+
+    if (!entry.is_folder) {
+      --queued_files_;
+      current_ = prefetcher_->Take(entry.job);
+      if (NULL == current_) {
+        // TODO: Should this be an error?
+        LOG_F(LS_WARNING) << "Couldn't open file: " << entry.archive_path;
+        continue;
+      }
+      current_bytes_ = entry.size;
+    }
+
+    return WriteEntryHeader(entry, error);
+  }
+}
+
+StreamResult TarStream::FindEntries(int* error) {
+  ASSERT(NULL != error);
+  ASSERT(M_READ == mode_);
+
+  // FindEntries conducts a depth-first recursive search through the directory
   // tree.  find_ maintains a stack of open directory handles, which
   // corresponds to our current position in the tree.  At any point, the
   // directory at the top (front) of the stack is being enumerated.  If a
-  // directory is found, it is opened and pushed onto the top of the stack.
-  // When a directory enumeration completes, that directory is popped off the
-  // top of the stack.
-
-  // Note: Since ReadNextFile can only return one block of data at a time, we
-  // cannot simultaneously return the entry for a directory, and the entry for
-  // the first element in that directory at the same time.  In this case, we
-  // push a NULL entry onto the find_ stack, which indicates that the next
-  // iteration should begin enumeration of the "new" directory.
-  StreamResult result = SR_SUCCESS;
-  while (BLOCK_SIZE == block_pos_) {
-    ASSERT(!find_.empty());
+  // directory is found, it is pushed onto the top of the stack.  When a
+  // directory enumeration completes, that directory is popped off the top of
+  // the stack.
 
+  // Note: A directory found by ProcessNextEntry is pushed as a NULL entry onto
+  // the find_ stack, which indicates that the next iteration should begin
+  // enumeration of the "new" directory.
+  StreamResult result = SR_SUCCESS;
+  while (!find_.empty() && (queued_files_ < kPrefetchDepth)) {
     if (NULL != find_.front()) {
       if (find_.front()->Next()) {
-	result = ProcessNextEntry(find_.front(), error);
+        result = ProcessNextEntry(find_.front(), error);
         if (SR_SUCCESS != result) {
           return result;
         }
@@ -288,13 +333,8 @@ StreamResult TarStream::ReadNextFile(int* error) {
 
     find_.pop_front();
     subfolder_ = Pathname(subfolder_).parent_folder();
-
-    if (find_.empty()) {
-      return SR_EOS;
-    }
   }
 
-  ASSERT(0 == block_pos_);
   return SR_SUCCESS;
 }
 
@@ -421,10 +461,6 @@ StreamResult TarStream::WriteNextFile(int* error) {
 
 StreamResult TarStream::ProcessNextEntry(const DirectoryIterator *data, int *error) {
   ASSERT(M_READ == mode_);
-  ASSERT(NB_FILE_HEADER == next_block_);
-  ASSERT(BLOCK_SIZE == block_pos_);
-  ASSERT(NULL == current_);
-  ASSERT(0 == current_bytes_);
 
   if (data->IsDirectory() &&
       (data->Name() == "." || data->Name() == ".."))
@@ -448,9 +484,13 @@ StreamResult TarStream::ProcessNextEntry(const DirectoryIterator *data, int *err
     return SR_ERROR;
   }
 
-  Pathname local_path(root_folder_);
-  local_path.AppendPathname(archive_path.pathname());
-  local_path.Normalize();
+  Entry entry;
+  entry.archive_path = archive_path.pathname();
+  entry.name = archive_path.filename();
+  entry.is_folder = data->IsDirectory();
+  entry.size = 0;
+  entry.modify_time = data->FileModifyTime();
+  entry.job = NULL;
 
   if (data->IsDirectory()) {
     // Note: the NULL handle indicates that we need to open the folder next 
@@ -458,20 +498,25 @@ StreamResult TarStream::ProcessNextEntry(const DirectoryIterator *data, int *err
     find_.push_front(NULL);
     subfolder_ = archive_path.pathname();
   } else {
-    FileStream* stream = new FileStream;
-    if (!stream->Open(local_path.pathname().c_str(), "rb", NULL)) {
-      // TODO: Should this be an error?
-      LOG_F(LS_WARNING) << "Couldn't open file: " << local_path.pathname();
-      delete stream;
-      return SR_SUCCESS;
-    }
-    current_ = stream;
-    current_bytes_ = data->FileSize();
+    Pathname local_path(root_folder_);
+    local_path.AppendPathname(archive_path.pathname());
+    local_path.Normalize();
+
+    entry.size = data->FileSize();
+    entry.job = prefetcher_->Add(local_path.pathname(), entry.size);
+    ++queued_files_;
   }
 
-  time_t modify_time = data->FileModifyTime();
+  entries_.push_back(entry);
+  return SR_SUCCESS;
+}
 
-  std::string pathname = archive_path.pathname();
+StreamResult TarStream::WriteEntryHeader(const Entry& entry, int* error) {
+  ASSERT(M_READ == mode_);
+  ASSERT(NB_FILE_HEADER == next_block_);
+  ASSERT(BLOCK_SIZE == block_pos_);
+
+  std::string pathname = entry.archive_path;
   std::string magic, user, group, dev_major, dev_minor, prefix;  
   std::string name = pathname;
   bool ustar = false;
@@ -486,13 +531,13 @@ StreamResult TarStream::ProcessNextEntry(const DirectoryIterator *data, int *err
   size_t block_data = 0;
   memset(block_, 0, BLOCK_SIZE);
   WriteFieldS(block_data, 100, name.c_str());
-  WriteFieldS(block_data, 8,   data->IsDirectory() ? "777" : "666");   // mode
+  WriteFieldS(block_data, 8,   entry.is_folder ? "777" : "666");   // mode
   WriteFieldS(block_data, 8,   "5");   // owner uid
   WriteFieldS(block_data, 8,   "5");   // owner gid
   WriteFieldN(block_data, 12,  current_bytes_);
-  WriteFieldN(block_data, 12,  modify_time);
+  WriteFieldN(block_data, 12,  entry.modify_time);
   WriteFieldS(block_data, 8, "        "); // Checksum. To be filled in later.
-  WriteFieldS(block_data, 1,   data->IsDirectory() ? "5" : "0");  // link indicator (0 == normal file, 5 == directory)
+  WriteFieldS(block_data, 1,   entry.is_folder ? "5" : "0");  // link indicator (0 == normal file, 5 == directory)
   WriteFieldS(block_data, 100, "");   // name of linked file
 
   if (ustar) {
@@ -511,10 +556,10 @@ StreamResult TarStream::ProcessNextEntry(const DirectoryIterator *data, int *err
 
   block_pos_ = 0;
   if (current_bytes_ > 0) {
-    next_block_ = data->IsDirectory() ? NB_FILE_HEADER : NB_DATA;
+    next_block_ = entry.is_folder ? NB_FILE_HEADER : NB_DATA;
   }
 
-  SignalNextEntry(archive_path.filename(), current_bytes_);
+  SignalNextEntry(entry.name, current_bytes_);
 
   return result;
 }
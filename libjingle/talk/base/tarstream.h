@@ -1,17 +1,21 @@
 #ifndef TALK_APP_WIN32_TARSTREAM_H__
 #define TALK_APP_WIN32_TARSTREAM_H__
 
+#include <list>
 #include <string>
 #include <vector>
 #include "talk/base/fileutils.h"
 #include "talk/base/sigslot.h"
 #include "talk/base/stream.h"
+#include "talk/base/tarprefetcher.h"
 
 namespace talk_base {
 
 ///////////////////////////////////////////////////////////////////////////////
 // TarStream - acts as a source or sink for a tar-encoded collection of files
-// and directories.  Operates synchronously.
+// and directories.  Operates synchronously.  When reading, the directory
+// search runs a few files ahead of the output, and those files are opened (and
+// small ones read) in parallel by a TarPrefetcher.
 ///////////////////////////////////////////////////////////////////////////////
 
 class TarStream : public StreamInterface {
@@ -26,6 +30,11 @@ class TarStream : public StreamInterface {
   // must be added before opening the stream.
   bool AddFilter(const std::string& pathname);
 
+  // Number of threads used to prefetch files when reading, 0 disables
+  // prefetching.  Defaults to TarPrefetcher::DefaultThreads().  Must be
+  // called before opening the stream.
+  void SetPrefetchThreads(size_t threads) { prefetch_threads_ = threads; }
+
   // 'folder' is parent of the tar contents.  All paths will be evaluated
   // relative to it.  When 'read' is true, the specified folder will be 
   // traversed, and a tar stream will be generated (via Read).  Otherwise, a
@@ -52,6 +61,24 @@ class TarStream : public StreamInterface {
   enum ModeType { M_NONE, M_READ, M_WRITE };
   enum NextBlockType { NB_NONE, NB_FILE_HEADER, NB_DATA, NB_TRAILER };
   enum { BLOCK_SIZE = 512 };
+  enum {
+    // Number of files the directory search may run ahead of the output.
+    kPrefetchDepth = 16,
+    kPrefetchBufferSize = 4 * 1024 * 1024,
+    kPrefetchMaxFileSize = 256 * 1024
+  };
+
+  // An entry found by the directory search, but not yet written.
+  struct Entry {
+    std::string archive_path;
+    std::string name;
+    bool is_folder;
+    size_t size;
+    time_t modify_time;
+    // The file being prefetched, NULL for folders.
+    TarPrefetcher::Job* job;
+  };
+  typedef std::list<Entry> EntryList;
 
   talk_base::StreamResult ProcessBuffer(void* buffer, size_t buffer_len,
                                         size_t* consumed, int* error);
@@ -60,8 +87,11 @@ class TarStream : public StreamInterface {
   talk_base::StreamResult ReadNextFile(int* error);
   talk_base::StreamResult WriteNextFile(int* error);
 
+  // Continues the directory search until kPrefetchDepth files are queued.
+  talk_base::StreamResult FindEntries(int* error);
   talk_base::StreamResult ProcessNextEntry(const DirectoryIterator *data, 
                                            int *error);
+  talk_base::StreamResult WriteEntryHeader(const Entry& entry, int* error);
 
   // Determine whether the given entry is allowed by our filters
   bool CheckFilter(const std::string& pathname);
@@ -87,7 +117,7 @@ class TarStream : public StreamInterface {
   char block_[BLOCK_SIZE];
   size_t block_pos_;
   // The file which is currently being read or written
-  talk_base::FileStream* current_;
+  talk_base::StreamInterface* current_;
   // Bytes remaining to be processed for current_
   size_t current_bytes_;
   // Note: the following variables are used in M_READ mode only.
@@ -95,6 +125,11 @@ class TarStream : public StreamInterface {
   DirectoryList find_;
   // Subfolder path corresponding to current position in the directory tree
   std::string subfolder_;
+  // Entries found ahead of the output, and how many of them are files
+  EntryList entries_;
+  size_t queued_files_;
+  TarPrefetcher* prefetcher_;
+  size_t prefetch_threads_;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,106 @@
+// Creates a tree of small files (if not there yet), and prints the time taken
+// to read it as a tar stream, with and without prefetching.  Prefetching uses
+// TarPrefetcher::DefaultThreads() unless a thread count is given.
+//
+// usage: tarstream_benchmark <folder> [files] [file size] [threads]
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "talk/base/basictypes.h"
+#include "talk/base/common.h"
+#include "talk/base/fileutils.h"
+#include "talk/base/logging.h"
+#include "talk/base/pathutils.h"
+#include "talk/base/stringutils.h"
+#include "talk/base/tarprefetcher.h"
+#include "talk/base/tarstream.h"
+#include "talk/base/timeutils.h"
+
+using namespace talk_base;
+
+namespace {
+
+const size_t kFilesPerFolder = 100;
+
+bool CreateTree(const std::string& folder, size_t files, size_t file_size) {
+  std::string data(file_size, 'x');
+  char name[32];
+
+  for (size_t i = 0; i < files; ++i) {
+    Pathname path;
+    path.SetFolder(folder);
+    sprintfn(name, ARRAY_SIZE(name), "d%04u",
+             static_cast<unsigned int>(i / kFilesPerFolder));
+    path.AppendFolder(name);
+    if ((i % kFilesPerFolder == 0) && !Filesystem::CreateFolder(path)) {
+      std::cerr << "Couldn't create folder: " << path.pathname() << std::endl;
+      return false;
+    }
+    sprintfn(name, ARRAY_SIZE(name), "f%06u.dat",
+             static_cast<unsigned int>(i));
+    path.SetFilename(name);
+    if (Filesystem::IsFile(path))
+      continue;
+    FileStream file;
+    if (!file.Open(path.pathname(), "wb", NULL)
+        || (SR_SUCCESS != file.WriteAll(data.data(), data.size(), NULL, NULL))) {
+      std::cerr << "Couldn't create file: " << path.pathname() << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns the time taken in ms, or -1 on error.
+int ReadTree(const std::string& folder, size_t threads, size_t* total) {
+  TarStream tar;
+  tar.SetPrefetchThreads(threads);
+
+  uint32 start = Time();
+  if (!tar.Open(folder, true)) {
+    std::cerr << "Couldn't open folder: " << folder << std::endl;
+    return -1;
+  }
+
+  char buffer[32 * 1024];
+  size_t read = 0;
+  *total = 0;
+  while (SR_SUCCESS == tar.Read(buffer, sizeof(buffer), &read, NULL)) {
+    *total += read;
+  }
+  return TimeSince(start);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc < 2 || argc > 5) {
+    std::cerr << "usage: tarstream_benchmark <folder> [files] [file size]"
+              << " [threads]" << std::endl;
+    return 1;
+  }
+  LogMessage::LogToDebug(LS_WARNING);
+
+  const std::string folder = argv[1];
+  const size_t files = (argc > 2) ? atoi(argv[2]) : 10000;
+  const size_t file_size = (argc > 3) ? atoi(argv[3]) : 4096;
+  const size_t threads = (argc > 4) ? atoi(argv[4])
+                                    : TarPrefetcher::DefaultThreads();
+
+  if (!CreateTree(folder, files, file_size))
+    return 1;
+
+  // Alternate between the two modes, so both see a warm file cache.
+  for (int run = 0; run < 4; ++run) {
+    size_t run_threads = ((run % 2) != 0) ? threads : 0;
+    size_t total = 0;
+    int elapsed = ReadTree(folder, run_threads, &total);
+    if (elapsed < 0)
+      return 1;
+    std::cout << run_threads << " prefetch thread(s): " << total
+              << " bytes in " << elapsed << " ms" << std::endl;
+  }
+  return 0;
+}
@@ -235,6 +235,7 @@ extern const buzz::QName QN_SHARE_FOLDER;
 extern const buzz::QName QN_SHARE_FILE;
 extern const buzz::QName QN_SHARE_MUSIC;
 extern const buzz::QName QN_SHARE_NAME;
+extern const buzz::QName QN_SHARE_RENDITION;
 extern const buzz::QName QN_SHARE_IMAGE;
 extern const buzz::QName QN_SHARE_PROTOCOL;
 extern const buzz::QName QN_SHARE_HTTP;
@@ -223,6 +223,7 @@ const buzz::QName QN_SHARE_FOLDER(true, NS_GOOGLE_SHARE, "folder");
 const buzz::QName QN_SHARE_FILE(true, NS_GOOGLE_SHARE, "file");
 const buzz::QName QN_SHARE_MUSIC(true, NS_GOOGLE_SHARE, "music");
 const buzz::QName QN_SHARE_NAME(true, NS_GOOGLE_SHARE, "name");
+const buzz::QName QN_SHARE_RENDITION(true, NS_GOOGLE_SHARE, "rendition");
 const buzz::QName QN_SHARE_IMAGE(true, NS_GOOGLE_SHARE, "image");
 const buzz::QName QN_SHARE_PROTOCOL(true, NS_GOOGLE_SHARE, "protocol");
 const buzz::QName QN_SHARE_HTTP(true, NS_GOOGLE_SHARE, "http");
@@ -27,6 +27,7 @@
 
 #include "talk/p2p/base/pseudotcp.h"
 
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 
@@ -97,15 +98,27 @@ const uint32 JINGLE_HEADER_SIZE = 64; // when relay framing is in use
 //  8 |                     Acknowledgment Number                     |
 //    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
 //    |               |   |U|A|P|R|S|F|                               |
-// 12 |    Control    |   |R|C|S|S|Y|I|            Window             |
+// 12 |  Option Len   |   |R|C|S|S|Y|I|            Window             |
 //    |               |   |G|K|H|T|N|N|                               |
 //    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
 // 16 |                       Timestamp sending                       |
 //    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
 // 20 |                      Timestamp receiving                      |
 //    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-// 24 |                             data                              |
+// 24 |                    options (Option Len words)                 |
 //    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//    |                             data                              |
+//    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//
+// The data of a connect control segment is the connect code, followed by
+// options in the TCP format: a kind byte, then (except for EOL and NOOP) a
+// length byte covering the whole option, and the value.  Older versions
+// send no options, and ignore them.
+//
+// Header options use the same format, in Option Len 32 bit words before the
+// data.  Older versions always send 0 there, so they are only sent once the
+// peer offered them on connect: SACK blocks (RFC 2018) with the ranges of
+// data received out of order.
 //
 //////////////////////////////////////////////////////////////////////
 
@@ -127,6 +140,19 @@ const uint8 CTL_CONNECT = 0;
 //const uint8 CTL_REDIRECT = 1;
 const uint8 CTL_EXTRA = 255;
 
+const uint8 TCP_OPT_EOL = 0;        // End of list
+const uint8 TCP_OPT_NOOP = 1;       // No-op
+const uint8 TCP_OPT_WND_SCALE = 3;  // Window scale factor (RFC 1323)
+const uint8 TCP_OPT_SACK_PERMITTED = 4; // Selective acks offered (RFC 2018)
+const uint8 TCP_OPT_SACK = 5;       // Selective ack blocks (RFC 2018)
+
+const uint8 MAX_WND_SCALE = 14;     // RFC 1323, Sec 2.3
+const uint32 MAX_SACK_BLOCKS = 4;
+// Two NOOPs for alignment, the kind and length, and the blocks
+const uint32 MAX_SACK_SIZE = 4 + 8 * MAX_SACK_BLOCKS;
+// Segments sacked above a hole before it counts as lost (RFC 6675)
+const uint32 DUP_THRESH = 3;
+
 /*
 const uint8 FLAG_FIN = 0x01;
 const uint8 FLAG_SYN = 0x02;
@@ -135,6 +161,10 @@ const uint8 FLAG_ACK = 0x10;
 
 const uint32 CTRL_BOUND = 0x80000000;
 
+const uint32 PACE_BURST = 1; // Paced data may go out 1 ms worth at once
+const uint32 BLOCKED_RETRY = 10; // Data the network didn't take is retried after 10 ms
+const uint32 NAGLE_DELAY = 20; // Small writes are held back 20 ms at most
+
 const long DEFAULT_TIMEOUT = 4000; // If there are no pending clocks, wake up every 4 seconds
 const long CLOSED_TIMEOUT = 60 * 1000; // If the connection is closed, once per minute
 
@@ -206,6 +236,504 @@ void ReportStats() {
 
 #endif
 
+//////////////////////////////////////////////////////////////////////
+// Congestion Control
+//////////////////////////////////////////////////////////////////////
+
+// The connection keeps the recovery state (duplicate acks, the recovery point,
+// what to retransmit), and reports the events which move the window to its
+// controller.  This base class is NewReno, leaving slow start early once the
+// round trip grows (like HyStart).  Windows are in bytes, times in ms.
+class CongestionController {
+ public:
+  // What the connection knows when an ack arrives
+  struct Ack {
+    uint32 now;
+    uint32 acked;       // Bytes newly acknowledged
+    uint32 delivered;   // Bytes the peer got so far, in order or not
+    uint32 snd_una;     // First byte not acknowledged
+    uint32 snd_nxt;     // First byte not sent yet
+    uint32 snd_wnd;     // The peer's window
+    bool app_limited;   // Nothing is queued behind the data in flight
+    bool sack;          // The connection counts what is in flight from
+                        // selective acks, rather than inflating the window
+
+    uint32 in_flight() const { return snd_nxt - snd_una; }
+  };
+
+  CongestionController(uint32 mss, uint32 ssthresh)
+      : mss_(mss), cwnd_(2 * mss), ssthresh_(ssthresh), late_(0) {
+  }
+  virtual ~CongestionController() {}
+
+  uint32 cwnd() const { return cwnd_; }
+  uint32 ssthresh() const { return ssthresh_; }
+
+  // The segment size changed along with the path MTU
+  void SetMss(uint32 mss) {
+    mss_ = mss;
+    ssthresh_ = talk_base::_max(ssthresh_, 2 * mss_);
+    cwnd_ = talk_base::_max(cwnd_, mss_);
+  }
+  // A packet turned out too large, the segment size went down
+  void ReduceMss(uint32 mss) {
+    mss_ = mss;
+    cwnd_ = 2 * mss_; // I added this... haven't researched actual formula
+  }
+
+  // A round-trip time sample, and the smallest one seen on the connection
+  virtual void OnRtt(uint32 now, uint32 rtt, uint32 minrtt) {
+    // Leave slow start once a queue builds up on the path, as the round trip
+    // grows.  With the large windows scaling allows, overshooting would lose
+    // more at once than recovery handles well.  Paced data only queues once
+    // the window is past what the path holds, so a few ms of queue count
+    // (like Linux, 4 to 16 ms).
+    // A single late ack (a delayed one) doesn't count.
+    uint32 delay = talk_base::_min<uint32>(
+        talk_base::_max<uint32>(minrtt / 8, 4), 16);
+    if (rtt > minrtt + delay) {
+      ++late_;
+    } else {
+      late_ = 0;
+    }
+    if ((cwnd_ < ssthresh_) && (cwnd_ >= 16 * mss_) && (late_ >= 8)) {
+      ssthresh_ = cwnd_;
+    }
+  }
+
+  // New data was acked outside of recovery
+  virtual void OnAck(const Ack& ack) {
+    // Slow start, congestion avoidance.  Not past the peer's window though:
+    // when that grows at once (as its receive buffer grows), the window
+    // would go out in one burst.
+    if (cwnd_ >= ack.snd_wnd) {
+      // The peer's window is what limits us
+    } else if (cwnd_ < ssthresh_) {
+      cwnd_ += mss_;
+    } else {
+      cwnd_ += talk_base::_max<uint32>(1, mss_ * mss_ / cwnd_);
+    }
+  }
+
+  // The third duplicate ack: a segment was lost, fast recovery starts.
+  // Without selective acks, the window is inflated by the segments the
+  // duplicate acks tell have left the network (RFC 5681, Sec 3.2).
+  virtual void OnRecoveryStart(const Ack& ack) {
+    ssthresh_ = LossThreshold(ack.in_flight());
+    cwnd_ = ack.sack ? ssthresh_ : ssthresh_ + 3 * mss_;
+  }
+  // Every further duplicate ack in recovery means a segment left the network
+  // (only without selective acks)
+  virtual void OnRecoveryDupAck() {
+    cwnd_ += mss_;
+  }
+  // Data was acked in recovery, short of the recovery point (NewReno)
+  virtual void OnRecoveryAck(const Ack& ack) {
+    if (!ack.sack) {
+      cwnd_ += mss_ - talk_base::_min(ack.acked, cwnd_);
+    }
+  }
+  // The recovery point was acked
+  virtual void OnRecoveryEnd(const Ack& ack) {
+    cwnd_ = talk_base::_min(ssthresh_, ack.in_flight() + mss_);
+  }
+
+  // The retransmit timer expired
+  virtual void OnTimeout(uint32 now, uint32 in_flight) {
+    ssthresh_ = LossThreshold(in_flight);
+    cwnd_ = mss_;
+  }
+  // Sending again after being idle for longer than the retransmit timeout
+  virtual void OnIdle(uint32 now) {
+    cwnd_ = mss_;
+  }
+
+  // Whether sending is spread out at PacingRate even with OPT_PACING off,
+  // rather than going out as the window opens
+  virtual bool Paced() const {
+    return false;
+  }
+  // The rate to spread the window over a round trip with, in bytes per
+  // second, 0 while unknown.  Like Linux, it leaves room for the window to
+  // grow: twice the window per round trip in slow start, 1.2 times after.
+  virtual uint32 PacingRate(uint32 srtt) const {
+    if (srtt == 0)
+      return 0;
+    uint64 rate = static_cast<uint64>(cwnd_) * 1000 / srtt;
+    rate = (cwnd_ < ssthresh_) ? 2 * rate : rate * 6 / 5;
+    return static_cast<uint32>(talk_base::_min<uint64>(rate, 0xFFFFFFFF));
+  }
+
+ protected:
+  // The slow start threshold after a loss
+  virtual uint32 LossThreshold(uint32 in_flight) {
+    return talk_base::_max(in_flight / 2, 2 * mss_);
+  }
+
+  uint32 mss_, cwnd_, ssthresh_;
+
+ private:
+  // Round-trip time samples in a row well above the smallest one
+  uint32 late_;
+};
+
+// CUBIC (RFC 8312).  After a loss, the window grows along a cubic function of
+// the time since: quickly at first, flat around the window the loss happened
+// at (w_max), then probing beyond it.  As the growth doesn't depend on the
+// round trip, long paths recover as fast as short ones.
+class CubicController : public CongestionController {
+ public:
+  CubicController(uint32 mss, uint32 ssthresh)
+      : CongestionController(mss, ssthresh), minrtt_(0), epoch_(0),
+        w_max_(0), w_last_max_(0), w_est_(0), k_(0) {
+  }
+
+  virtual void OnRtt(uint32 now, uint32 rtt, uint32 minrtt) {
+    CongestionController::OnRtt(now, rtt, minrtt);
+    minrtt_ = minrtt;
+  }
+
+  virtual void OnAck(const Ack& ack) {
+    if ((cwnd_ >= ack.snd_wnd) || (cwnd_ < ssthresh_)) {
+      CongestionController::OnAck(ack);
+      return;
+    }
+
+    if (epoch_ == 0) {
+      epoch_ = ack.now;
+      if (w_max_ > cwnd_) {
+        k_ = pow((w_max_ - cwnd_) / (kC * mss_), 1.0 / 3);
+      } else {
+        k_ = 0;
+        w_max_ = cwnd_;
+      }
+      w_est_ = cwnd_;
+    }
+
+    // The window a round trip from now
+    double t = (talk_base::TimeDiff(ack.now, epoch_) + minrtt_) / 1000.0;
+    double target = w_max_ + kC * (t - k_) * (t - k_) * (t - k_) * mss_;
+    // Not slower than Reno would grow (the TCP-friendly region)
+    w_est_ += 3 * (1 - kBeta) / (1 + kBeta) * mss_ * ack.acked / cwnd_;
+    target = talk_base::_max(target, w_est_);
+    // Not more than half the window per round trip
+    target = talk_base::_min(target, 1.5 * cwnd_);
+    if (target > cwnd_) {
+      cwnd_ += talk_base::_max<uint32>(1,
+          static_cast<uint32>((target - cwnd_) * ack.acked / cwnd_));
+    }
+  }
+
+ protected:
+  virtual uint32 LossThreshold(uint32 in_flight) {
+    epoch_ = 0;
+    // Fast convergence: when losses come at a smaller window than the last
+    // time, another flow likely joined, leave room for it
+    if (cwnd_ < w_last_max_) {
+      w_max_ = cwnd_ * (1 + kBeta) / 2;
+    } else {
+      w_max_ = cwnd_;
+    }
+    w_last_max_ = cwnd_;
+    return talk_base::_max(static_cast<uint32>(cwnd_ * kBeta), 2 * mss_);
+  }
+
+ private:
+  static const double kC;
+  static const double kBeta;
+
+  uint32 minrtt_;
+  // Start of the growth since the last loss, 0 if none yet
+  uint32 epoch_;
+  double w_max_, w_last_max_;
+  // The window Reno would have
+  double w_est_;
+  // Seconds until the window is back at w_max
+  double k_;
+};
+
+const double CubicController::kC = 0.4;
+const double CubicController::kBeta = 0.7;
+
+// Like BBR: the bottleneck bandwidth is the largest delivery rate of the
+// recent round trips, and the window is twice what that delivers within the
+// smallest recent round trip (the bandwidth-delay product).  Losses only hold
+// the window to the data in flight while they are recovered, so random loss
+// doesn't cost throughput, and a queue doesn't build up since the window
+// stops at what the path holds.  A round trip ends once the data sent after
+// its start is acked.
+class BbrController : public CongestionController {
+ public:
+  BbrController(uint32 mss, uint32 ssthresh)
+      : CongestionController(mss, ssthresh), mode_(STARTUP),
+        delivered_(0), round_start_(0), round_end_(0), round_time_(0),
+        bw_rounds_(0), full_bw_(0), full_bw_count_(0), full_bw_reached_(false),
+        minrtt_(0), minrtt_time_(0), late_(0), probe_rtt_done_(0), cycle_(0),
+        cycle_time_(0), prior_cwnd_(0) {
+    memset(bw_, 0, sizeof(bw_));
+  }
+
+  virtual void OnRtt(uint32 now, uint32 rtt, uint32 minrtt) {
+    // The smallest round trip expires, so that a path which got longer is
+    // noticed.  Draining the queue (PROBE_RTT) measures it again.
+    bool expired = (minrtt_ != 0)
+        && (talk_base::TimeDiff(now, minrtt_time_) > kMinRttExpiry);
+    if ((minrtt_ == 0) || (rtt <= minrtt_) || expired) {
+      minrtt_ = rtt;
+      minrtt_time_ = now;
+    }
+    if (expired && (mode_ != PROBE_RTT)) {
+      prior_cwnd_ = talk_base::_max(prior_cwnd_, cwnd_);
+      mode_ = PROBE_RTT;
+      probe_rtt_done_ = 0;
+    }
+    // Where the queue is short, startup would overflow it before the
+    // bandwidth stops growing.  A queue building up (as in the base class)
+    // means the bandwidth was found, too.
+    if ((mode_ == STARTUP) && !full_bw_reached_) {
+      if (rtt > minrtt_ + talk_base::_max<uint32>(minrtt_ / 8, 4)) {
+        ++late_;
+      } else {
+        late_ = 0;
+      }
+      if (late_ >= 8) {
+        full_bw_reached_ = true;
+        LOG(LS_INFO) << "BBR bandwidth: " << bandwidth()
+                     << " bytes/s, queue building (minrtt: " << minrtt_ << ")";
+      }
+    }
+  }
+
+  virtual void OnAck(const Ack& ack) {
+    update(ack);
+
+    // Draining holds the window to what the path holds
+    uint32 target = talk_base::_max(
+        bdp((mode_ == DRAIN) ? kUnitGain : kCwndGain), kMinCwnd * mss_);
+    // Not past the peer's window, see CongestionController
+    uint32 acked = (cwnd_ < ack.snd_wnd) ? ack.acked : 0;
+    if (full_bw_reached_) {
+      cwnd_ = talk_base::_min(cwnd_ + acked, target);
+    } else if ((cwnd_ < target) || (bandwidth() == 0)) {
+      // Startup: the target doubles along with the measured bandwidth
+      cwnd_ += acked;
+    }
+    cwnd_ = talk_base::_max(cwnd_, kMinCwnd * mss_);
+    if (mode_ == PROBE_RTT) {
+      cwnd_ = talk_base::_min(cwnd_, kMinCwnd * mss_);
+    }
+  }
+
+  // Packet conservation: send one segment per segment that left the network.
+  // A loss in startup means the bandwidth was found, the queue overflowed.
+  virtual void OnRecoveryStart(const Ack& ack) {
+    full_bw_reached_ = true;
+    prior_cwnd_ = talk_base::_max(prior_cwnd_, cwnd_);
+    cwnd_ = ack.in_flight() + mss_;
+  }
+  virtual void OnRecoveryAck(const Ack& ack) {
+    update(ack);
+    CongestionController::OnRecoveryAck(ack);
+  }
+  // The window the loss interrupted is still right
+  virtual void OnRecoveryEnd(const Ack& ack) {
+    update(ack);
+    cwnd_ = talk_base::_max(prior_cwnd_, ack.in_flight() + mss_);
+    if (mode_ != PROBE_RTT)
+      prior_cwnd_ = 0;
+  }
+
+  // Acks grow the window back to the target
+  virtual void OnTimeout(uint32 now, uint32 in_flight) {
+    cwnd_ = mss_;
+  }
+  // Resume with what the path holds, more would only queue
+  virtual void OnIdle(uint32 now) {
+    if (bandwidth() > 0) {
+      cwnd_ = talk_base::_max(talk_base::_min(cwnd_, bdp(kUnitGain)),
+                              kMinCwnd * mss_);
+    }
+  }
+
+  // The window is only a bound, the rate is what keeps the queue short
+  virtual bool Paced() const {
+    return true;
+  }
+  virtual uint32 PacingRate(uint32 srtt) const {
+    uint32 bw = bandwidth();
+    if (bw == 0)
+      return CongestionController::PacingRate(srtt);
+    return static_cast<uint32>(talk_base::_min<uint64>(
+        static_cast<uint64>(bw) * pacingGain() / kUnitGain, 0xFFFFFFFF));
+  }
+
+ private:
+  enum Mode {
+    STARTUP,    // Doubling the rate every round trip, until it stops growing
+    DRAIN,      // Draining the queue startup built up
+    PROBE_BW,   // Sending at the bandwidth, now and then probing for more
+    PROBE_RTT   // Draining the queue to measure the round trip again
+  };
+
+  // Gains in thousandths
+  static const uint32 kUnitGain = 1000;
+  static const uint32 kHighGain = 2885;   // 2 / ln(2)
+  static const uint32 kDrainGain = 347;   // 1 / kHighGain
+  static const uint32 kCwndGain = 2000;
+  static const uint32 kCycleGains[];
+  static const uint32 kCycleLength = 8;
+
+  static const uint32 kBwRounds = 10;     // Round trips a bandwidth is kept
+  static const int32 kMinRttExpiry = 10000;
+  static const uint32 kProbeRttTime = 200;
+  static const uint32 kMinCwnd = 4;       // Segments
+
+  uint32 bandwidth() const {
+    uint32 bw = 0;
+    for (uint32 i = 0; i < kBwRounds; ++i) {
+      bw = talk_base::_max(bw, bw_[i]);
+    }
+    return bw;
+  }
+
+  // The data the path holds, times gain
+  uint32 bdp(uint32 gain) const {
+    return static_cast<uint32>(talk_base::_min<uint64>(
+        static_cast<uint64>(bandwidth()) * minrtt_ / 1000 * gain / kUnitGain,
+        0xFFFFFFFF));
+  }
+
+  uint32 pacingGain() const {
+    switch (mode_) {
+      case STARTUP: return kHighGain;
+      case DRAIN: return kDrainGain;
+      case PROBE_BW: return kCycleGains[cycle_];
+      default: return kUnitGain;
+    }
+  }
+
+  void update(const Ack& ack) {
+    delivered_ = ack.delivered;
+
+    if (static_cast<int32>(ack.snd_una - round_end_) > 0) {
+      // A round trip is over, it gives a bandwidth sample.  While the
+      // application doesn't keep up, only a larger one counts.  A round
+      // can't be shorter than the path: when a cumulative ack covers a
+      // recovered hole, a lot is acked at once.
+      long elapsed = talk_base::_max<long>(
+          talk_base::TimeDiff(ack.now, round_time_), minrtt_);
+      if ((round_time_ != 0) && (elapsed > 0)) {
+        uint32 bw = static_cast<uint32>(static_cast<uint64>(delivered_
+            - round_start_) * 1000 / elapsed);
+        if (!ack.app_limited || (bw > bandwidth())) {
+          bw_[bw_rounds_++ % kBwRounds] = bw;
+          checkFullBandwidth(bw);
+        }
+      }
+      round_start_ = delivered_;
+      round_end_ = ack.snd_nxt;
+      round_time_ = ack.now;
+    }
+
+    switch (mode_) {
+      case STARTUP:
+        if (full_bw_reached_)
+          mode_ = DRAIN;
+        break;
+      case DRAIN:
+        if (ack.in_flight() <= bdp(kUnitGain))
+          enterProbeBw(ack.now);
+        break;
+      case PROBE_BW:
+        if (talk_base::TimeDiff(ack.now, cycle_time_)
+            > static_cast<long>(minrtt_)) {
+          cycle_ = (cycle_ + 1) % kCycleLength;
+          cycle_time_ = ack.now;
+        }
+        break;
+      case PROBE_RTT:
+        if ((probe_rtt_done_ == 0) && (ack.in_flight() <= kMinCwnd * mss_)) {
+          probe_rtt_done_ = ack.now + kProbeRttTime;
+        } else if ((probe_rtt_done_ != 0)
+                   && (talk_base::TimeDiff(ack.now, probe_rtt_done_) >= 0)) {
+          minrtt_time_ = ack.now;
+          cwnd_ = talk_base::_max(cwnd_, prior_cwnd_);
+          prior_cwnd_ = 0;
+          if (full_bw_reached_) {
+            enterProbeBw(ack.now);
+          } else {
+            mode_ = STARTUP;
+          }
+        }
+        break;
+    }
+  }
+
+  // Startup is over when the bandwidth grew less than 25% in 3 round trips
+  void checkFullBandwidth(uint32 bw) {
+    if (full_bw_reached_)
+      return;
+    if (bw >= full_bw_ + full_bw_ / 4) {
+      full_bw_ = bw;
+      full_bw_count_ = 0;
+    } else if (++full_bw_count_ >= 3) {
+      full_bw_reached_ = true;
+      LOG(LS_INFO) << "BBR bandwidth: " << full_bw_ << " bytes/s (minrtt: "
+                   << minrtt_ << ")";
+    }
+  }
+
+  void enterProbeBw(uint32 now) {
+    mode_ = PROBE_BW;
+    // Not at the probing phase, the queue was just drained
+    cycle_ = 2;
+    cycle_time_ = now;
+  }
+
+  Mode mode_;
+  // Bytes acked so far, and at the start of the current round trip, which
+  // ends when data sent from round_end_ on is acked
+  uint32 delivered_, round_start_, round_end_, round_time_;
+  // Bandwidth samples of the last rounds, in bytes per second
+  uint32 bw_[kBwRounds];
+  uint32 bw_rounds_;
+  // Startup progress
+  uint32 full_bw_, full_bw_count_;
+  bool full_bw_reached_;
+  uint32 minrtt_, minrtt_time_;
+  // Round-trip time samples in a row well above minrtt_ in startup
+  uint32 late_;
+  uint32 probe_rtt_done_;
+  uint32 cycle_, cycle_time_;
+  // Window before a recovery or PROBE_RTT, to return to
+  uint32 prior_cwnd_;
+};
+
+const uint32 BbrController::kCycleGains[BbrController::kCycleLength] = {
+  1250, 750, 1000, 1000, 1000, 1000, 1000, 1000
+};
+
+//////////////////////////////////////////////////////////////////////
+// IPseudoTcpNotify
+//////////////////////////////////////////////////////////////////////
+
+int IPseudoTcpNotify::TcpWritePackets(PseudoTcp* tcp, const char* buffer,
+                                      const size_t* lens, int count,
+                                      WriteResult* result) {
+  *result = WR_SUCCESS;
+  for (int i = 0; i < count; ++i) {
+    *result = TcpWritePacket(tcp, buffer, lens[i]);
+    if (*result != WR_SUCCESS)
+      return i;
+    buffer += lens[i];
+  }
+  return count;
+}
+
+uint32 IPseudoTcpNotify::TcpNow(PseudoTcp* tcp) {
+  return PseudoTcp::Now();
+}
+
 //////////////////////////////////////////////////////////////////////
 // PseudoTcp
 //////////////////////////////////////////////////////////////////////
@@ -218,17 +746,25 @@ uint32 PseudoTcp::Now() {
 #endif
 }
 
+uint32 PseudoTcp::currentTime() {
+  return m_notify->TcpNow(this);
+}
+
 PseudoTcp::PseudoTcp(IPseudoTcpNotify* notify, uint32 conv)
-    : m_notify(notify), m_shutdown(SD_NONE), m_error(0) {
+    : m_notify(notify), m_shutdown(SD_NONE), m_error(0),
+      m_rbuf(kDefaultRcvBufSize, NULL), m_rbuf_len(kDefaultRcvBufSize),
+      m_rbuf_max(kDefaultMaxRcvBufSize),
+      m_sbuf(kDefaultSndBufSize, NULL), m_sbuf_len(kDefaultSndBufSize),
+      m_sbuf_max(kDefaultMaxSndBufSize), m_packets(new char[MAX_PACKET]) {
 
   // Sanity check on buffer sizes (needed for OnTcpWriteable notification logic)
-  ASSERT(sizeof(m_rbuf) + MIN_PACKET < sizeof(m_sbuf));
+  ASSERT(kDefaultRcvBufSize + MIN_PACKET < kDefaultSndBufSize);
 
-  uint32 now = Now();
+  uint32 now = currentTime();
 
   m_state = TCP_LISTEN;
   m_conv = conv;
-  m_rcv_wnd = sizeof(m_rbuf);
+  m_rcv_wnd = m_rbuf_len;
   m_snd_nxt = m_slen = 0;
   m_snd_wnd = 1;
   m_snd_una = m_rcv_nxt = m_rlen = 0;
@@ -244,8 +780,20 @@ PseudoTcp::PseudoTcp(IPseudoTcpNotify* notify, uint32 conv)
 
   m_rto_base = 0;
 
-  m_cwnd = 2 * m_mss;
-  m_ssthresh = sizeof(m_rbuf);
+  m_batch_count = m_batch_len = 0;
+  m_batching = false;
+
+  m_rwnd_scale = m_swnd_scale = 0;
+  m_support_wnd_scale = true;
+  m_support_sack = true;
+  m_rcv_sack_last = 0;
+  m_sacked = m_sack_rxt = m_sack_lost = 0;
+  m_delivered = 0;
+  m_rcv_rtt = m_rcv_tune_seq = m_rcv_tune_time = 0;
+  m_snd_tune_una = m_snd_tune_time = 0;
+
+  m_cc_type = CC_RENO;
+  resetCongestionControl();
   m_lastrecv = m_lastsend = m_lasttraffic = now;
   m_bOutgoing = false;
 
@@ -255,7 +803,14 @@ PseudoTcp::PseudoTcp(IPseudoTcpNotify* notify, uint32 conv)
   m_ts_recent = m_ts_lastack = 0;
 
   m_rx_rto = DEF_RTO;
-  m_rx_srtt = m_rx_rttvar = 0;
+  m_rx_srtt = m_rx_rttvar = m_rx_minrtt = 0;
+  m_retransmits = 0;
+
+  m_pace_time = m_pace_wait = 0;
+  m_pace_credit = 0;
+  m_pacing = true;
+  m_nodelay = false;
+  m_nagle_wait = 0;
 }
 
 PseudoTcp::~PseudoTcp() {
@@ -270,9 +825,7 @@ int PseudoTcp::Connect() {
   m_state = TCP_SYN_SENT;
   LOG(LS_INFO) << "State: TCP_SYN_SENT";
 
-  char buffer[1];
-  buffer[0] = CTL_CONNECT;
-  queue(buffer, 1, true);
+  queueConnectMessage();
   attemptSend();
 
   return 0;
@@ -308,10 +861,14 @@ void PseudoTcp::NotifyClock(uint32 now) {
         return;
       }
 
-      uint32 nInFlight = m_snd_nxt - m_snd_una;
-      m_ssthresh = talk_base::_max(nInFlight / 2, 2 * m_mss);
-      //LOG(LS_INFO) << "m_ssthresh: " << m_ssthresh << "  nInFlight: " << nInFlight << "  m_mss: " << m_mss;
-      m_cwnd = m_mss;
+      m_cc->OnTimeout(now, m_snd_nxt - m_snd_una);
+      if (m_support_sack) {
+        // Every hole counts as lost now, and goes out again as the window
+        // opens (RFC 6675, Sec 5.1)
+        m_dup_acks = 0;
+        m_recover = m_sack_lost = m_snd_nxt;
+        m_sack_rxt = m_snd_una + m_slist.front().len;
+      }
 
       // Back off retransmit timer.  Note: the limit is lower when connecting.
       uint32 rto_limit = (m_state < TCP_ESTABLISHED) ? DEF_RTO : MAX_RTO;
@@ -341,6 +898,14 @@ void PseudoTcp::NotifyClock(uint32 now) {
     packet(m_snd_nxt, 0, 0, 0);
   }
 
+  // Check if paced data, or small writes held back, may go out.  Note: an
+  // expired m_nagle_wait stays set until the data goes out.
+  if ((m_pace_wait && (talk_base::TimeDiff(m_pace_wait, now) <= 0))
+      || (m_nagle_wait && (talk_base::TimeDiff(m_nagle_wait, now) <= 0))) {
+    m_pace_wait = 0;
+    attemptSend();
+  }
+
 #if PSEUDO_KEEPALIVE
   // Check for idle timeout
   if ((m_state == TCP_ESTABLISHED) && (TimeDiff(m_lastrecv + IDLE_TIMEOUT, now) <= 0)) {
@@ -386,18 +951,16 @@ int PseudoTcp::Recv(char* buffer, size_t len) {
     return SOCKET_ERROR;
   }
 
-  uint32 read = talk_base::_min(uint32(len), m_rlen);
-  memcpy(buffer, m_rbuf, read);
+  size_t read = 0;
+  m_rbuf.Read(buffer, talk_base::_min(uint32(len), m_rlen), &read, NULL);
   m_rlen -= read;
 
-  // !?! until we create a circular buffer, we need to move all of the rest of the buffer up!
-  memmove(m_rbuf, m_rbuf + read, sizeof(m_rbuf) - read/*m_rlen*/);
-
-  if ((sizeof(m_rbuf) - m_rlen - m_rcv_wnd)
-      >= talk_base::_min<uint32>(sizeof(m_rbuf) / 2, m_mss)) {
-    bool bWasClosed = (m_rcv_wnd == 0); // !?! Not sure about this was closed business
+  if ((m_rbuf_len - m_rlen - m_rcv_wnd)
+      >= talk_base::_min<uint32>(m_rbuf_len / 2, m_mss)) {
+    // !?! Not sure about this was closed business
+    bool bWasClosed = ((m_rcv_wnd >> m_rwnd_scale) == 0);
 
-    m_rcv_wnd = sizeof(m_rbuf) - m_rlen;
+    m_rcv_wnd = m_rbuf_len - m_rlen;
 
     if (bWasClosed) {
       attemptSend(sfImmediateAck);
@@ -413,7 +976,7 @@ int PseudoTcp::Send(const char* buffer, size_t len) {
     return SOCKET_ERROR;
   }
 
-  if (m_slen == sizeof(m_sbuf)) {
+  if (m_slen == m_sbuf_len) {
     m_bWriteEnable = true;
     m_error = EWOULDBLOCK;
     return SOCKET_ERROR;
@@ -433,14 +996,94 @@ int PseudoTcp::GetError() {
   return m_error;
 }
 
+void PseudoTcp::GetOption(Option opt, int* value) {
+  switch (opt) {
+    case OPT_RCVBUF:
+      *value = m_rbuf_len;
+      break;
+    case OPT_SNDBUF:
+      *value = m_sbuf_len;
+      break;
+    case OPT_MAX_RCVBUF:
+      *value = m_rbuf_max;
+      break;
+    case OPT_MAX_SNDBUF:
+      *value = m_sbuf_max;
+      break;
+    case OPT_CONGESTION_CONTROL:
+      *value = m_cc_type;
+      break;
+    case OPT_NODELAY:
+      *value = m_nodelay;
+      break;
+    case OPT_PACING:
+      *value = m_pacing;
+      break;
+    default:
+      ASSERT(false);
+  }
+}
+
+void PseudoTcp::SetOption(Option opt, int value) {
+  // The window scale is picked from the receive buffer limit when connecting
+  bool valid = (value > 0);
+  if (opt == OPT_CONGESTION_CONTROL) {
+    valid = (value >= CC_RENO) && (value <= CC_BBR);
+  } else if ((opt == OPT_NODELAY) || (opt == OPT_PACING)) {
+    valid = (value == 0) || (value == 1);
+  }
+  if ((m_state != TCP_LISTEN) || !valid) {
+    LOG_F(LS_WARNING) << "Ignored option " << opt << ": " << value;
+    ASSERT(false);
+    return;
+  }
+
+  switch (opt) {
+    case OPT_RCVBUF:
+      resizeReceiveBuffer(value);
+      break;
+    case OPT_SNDBUF:
+      resizeSendBuffer(value);
+      break;
+    case OPT_MAX_RCVBUF:
+      m_rbuf_max = value;
+      break;
+    case OPT_MAX_SNDBUF:
+      m_sbuf_max = value;
+      break;
+    case OPT_CONGESTION_CONTROL:
+      m_cc_type = static_cast<CongestionControl>(value);
+      break;
+    case OPT_NODELAY:
+      m_nodelay = (value != 0);
+      break;
+    case OPT_PACING:
+      m_pacing = (value != 0);
+      break;
+    default:
+      ASSERT(false);
+  }
+  resetCongestionControl();
+}
+
+void PseudoTcp::GetStats(Stats* stats) {
+  stats->cwnd = m_cc->cwnd();
+  stats->ssthresh = m_cc->ssthresh();
+  stats->srtt = m_rx_srtt;
+  stats->rttvar = m_rx_rttvar;
+  stats->rto = m_rx_rto;
+  stats->retransmits = m_retransmits;
+  stats->pacing_rate = m_cc->PacingRate(m_rx_srtt);
+}
+
 //
 // Internal Implementation
 //
 
 uint32 PseudoTcp::queue(const char* data, uint32 len, bool bCtrl) {
-  if (len > sizeof(m_sbuf) - m_slen) {
+  if (len > m_sbuf_len - m_slen) {
     ASSERT(!bCtrl);
-    len = sizeof(m_sbuf) - m_slen;
+    len = m_sbuf_len - m_slen;
   }
 
   // We can concatenate data if the last segment is the same type
@@ -452,32 +1095,235 @@ uint32 PseudoTcp::queue(const char* data, uint32 len, bool bCtrl) {
     m_slist.push_back(sseg);
   }
 
-  memcpy(m_sbuf + m_slen, data, len);
+  m_sbuf.Write(data, len, NULL, NULL);
   m_slen += len;
   //LOG(LS_INFO) << "PseudoTcp::queue - m_slen = " << m_slen;
   return len;
 }
 
+void PseudoTcp::queueConnectMessage() {
+  char buffer[6];
+  uint32 len = 0;
+  buffer[len++] = CTL_CONNECT;
+
+  if (m_support_wnd_scale) {
+    // The smallest scale which lets the window cover the receive buffer, as
+    // far as it can grow
+    uint32 nMaxWindow = talk_base::_max(m_rbuf_len, m_rbuf_max);
+    m_rwnd_scale = 0;
+    while (((nMaxWindow >> m_rwnd_scale) > 0xFFFF)
+           && (m_rwnd_scale < MAX_WND_SCALE)) {
+      ++m_rwnd_scale;
+    }
+    buffer[len++] = TCP_OPT_WND_SCALE;
+    buffer[len++] = 3;
+    buffer[len++] = m_rwnd_scale;
+  }
+  if (m_support_sack) {
+    buffer[len++] = TCP_OPT_SACK_PERMITTED;
+    buffer[len++] = 2;
+  }
+
+  // Make sure the message goes out in one segment, even though the peer's
+  // window is not known yet
+  m_snd_wnd = talk_base::_max(m_snd_wnd, len);
+  queue(buffer, len, true);
+}
+
+void PseudoTcp::parseOptions(const char* data, uint32 len) {
+  const uint8* options = reinterpret_cast<const uint8*>(data);
+  bool bWndScale = false, bSack = false;
+
+  for (uint32 pos = 0; pos < len; ) {
+    uint8 kind = options[pos];
+    if (kind == TCP_OPT_EOL) {
+      break;
+    } else if (kind == TCP_OPT_NOOP) {
+      ++pos;
+      continue;
+    }
+
+    if ((pos + 2 > len) || (options[pos + 1] < 2)
+        || (pos + options[pos + 1] > len)) {
+      LOG_F(LS_WARNING) << "Malformed option: " << static_cast<unsigned>(kind);
+      break;
+    }
+
+    if ((kind == TCP_OPT_WND_SCALE) && (options[pos + 1] == 3)) {
+      m_swnd_scale = talk_base::_min(options[pos + 2], MAX_WND_SCALE);
+      bWndScale = true;
+    } else if (kind == TCP_OPT_SACK_PERMITTED) {
+      bSack = true;
+    }
+    pos += options[pos + 1];
+  }
+
+  // Windows are scaled only when both sides offer it
+  if (!bWndScale) {
+    LOG(LS_INFO) << "Peer doesn't support window scaling";
+    m_support_wnd_scale = false;
+    m_rwnd_scale = m_swnd_scale = 0;
+  }
+  if (!bSack) {
+    LOG(LS_INFO) << "Peer doesn't support selective acks";
+    m_support_sack = false;
+  }
+}
+
+// Writes the SACK option for the data held beyond m_rcv_nxt to buffer, and
+// returns its size (0 if there is nothing out of order).  The block with the
+// latest segment goes first, then the others from the top (RFC 2018, Sec 4).
+uint32 PseudoTcp::writeSack(uint8* buffer) {
+  if (!m_support_sack || m_rlist.empty())
+    return 0;
+
+  uint32 nBlocks = 0;
+  uint8* blocks = buffer + 4;
+
+  // Out of order segments may adjoin or overlap, so blocks are merged runs
+  uint32 nFirst = 0;
+  for (RList::iterator it = m_rlist.begin(); it != m_rlist.end(); ) {
+    uint32 nLeft = it->seq, nRight = it->seq + it->len;
+    for (++it; (it != m_rlist.end()) && (it->seq <= nRight); ++it) {
+      nRight = talk_base::_max(nRight, it->seq + it->len);
+    }
+    if ((nLeft <= m_rcv_sack_last) && (m_rcv_sack_last < nRight)) {
+      long_to_bytes(nLeft, blocks);
+      long_to_bytes(nRight, blocks + 4);
+      nFirst = nLeft;
+      ++nBlocks;
+      break;
+    }
+  }
+  for (RList::reverse_iterator it = m_rlist.rbegin();
+       (it != m_rlist.rend()) && (nBlocks < MAX_SACK_BLOCKS); ) {
+    uint32 nLeft = it->seq, nRight = it->seq + it->len;
+    for (++it; (it != m_rlist.rend()) && (it->seq + it->len >= nLeft); ++it) {
+      nLeft = it->seq;
+      nRight = talk_base::_max(nRight, it->seq + it->len);
+    }
+    if ((nBlocks > 0) && (nLeft == nFirst))
+      continue;
+    long_to_bytes(nLeft, blocks + 8 * nBlocks);
+    long_to_bytes(nRight, blocks + 8 * nBlocks + 4);
+    ++nBlocks;
+  }
+
+  buffer[0] = TCP_OPT_NOOP;
+  buffer[1] = TCP_OPT_NOOP;
+  buffer[2] = TCP_OPT_SACK;
+  buffer[3] = static_cast<uint8>(2 + 8 * nBlocks);
+  return 4 + 8 * nBlocks;
+}
+
+// Marks the segments inside the SACK blocks of a header as held by the peer.
+void PseudoTcp::parseSack(const char* data, uint32 len) {
+  const uint8* options = reinterpret_cast<const uint8*>(data);
+
+  for (uint32 pos = 0; pos < len; ) {
+    uint8 kind = options[pos];
+    if (kind == TCP_OPT_EOL) {
+      break;
+    } else if (kind == TCP_OPT_NOOP) {
+      ++pos;
+      continue;
+    }
+
+    if ((pos + 2 > len) || (options[pos + 1] < 2)
+        || (pos + options[pos + 1] > len)) {
+      LOG_F(LS_WARNING) << "Malformed option: " << static_cast<unsigned>(kind);
+      break;
+    }
+
+    if (kind == TCP_OPT_SACK) {
+      for (uint32 block = pos + 2; block + 8 <= pos + options[pos + 1];
+           block += 8) {
+        uint32 nLeft = bytes_to_long(options + block);
+        uint32 nRight = bytes_to_long(options + block + 4);
+        if ((nLeft < m_snd_una) || (nRight > m_snd_nxt))
+          continue;
+        for (SList::iterator it = m_slist.begin();
+             (it != m_slist.end()) && (it->seq < nRight); ++it) {
+          if (!it->bSacked && (it->xmit > 0) && (it->seq >= nLeft)
+              && (it->seq + it->len <= nRight)) {
+            it->bSacked = true;
+            m_sacked += it->len;
+            m_delivered += it->len;
+          }
+        }
+      }
+    }
+    pos += options[pos + 1];
+  }
+}
+
+// The most data a segment may carry: room is left for SACK blocks while data
+// is out of order.
+uint32 PseudoTcp::maxSegment() const {
+  if (m_support_sack && !m_rlist.empty())
+    return m_mss - MAX_SACK_SIZE;
+  return m_mss;
+}
+
+// Returns the bytes in flight as the SACK scoreboard tells (RFC 6675, Sec 4):
+// those neither sacked nor lost, and those retransmitted.  In recovery, the
+// first lost hole not retransmitted yet is returned in hole, or else
+// m_slist.end().
+uint32 PseudoTcp::scoreboard(SList::iterator* hole) {
+  *hole = m_slist.end();
+  uint32 nPipe = 0;
+  uint32 nSackedAbove = m_sacked;
+  for (SList::iterator it = m_slist.begin();
+       (it != m_slist.end()) && (it->xmit > 0); ++it) {
+    if (it->bSacked) {
+      nSackedAbove -= it->len;
+      continue;
+    }
+    bool bLost = (it->seq < m_sack_lost)
+        || (nSackedAbove > (DUP_THRESH - 1) * m_mss);
+    if (!bLost) {
+      nPipe += it->len;
+    }
+    if (it->seq < m_sack_rxt) {
+      nPipe += it->len;
+    } else if (bLost && (m_snd_una < m_recover)
+               && (*hole == m_slist.end())) {
+      *hole = it;
+    }
+  }
+  return nPipe;
+}
+
+// Sends len bytes from the send buffer, starting offset bytes after
+// m_snd_una, or just an ack when len is 0.  While attemptSend batches, the
+// packet is only built, and taken as sent.
 IPseudoTcpNotify::WriteResult PseudoTcp::packet(uint32 seq, uint8 flags,
-                                                const char* data, uint32 len) {
-  ASSERT(HEADER_SIZE + len <= MAX_PACKET);
+                                                uint32 offset, uint32 len) {
+  ASSERT(HEADER_SIZE + MAX_SACK_SIZE + len <= MAX_PACKET - m_batch_len);
+  ASSERT(m_batching || (m_batch_count == 0));
 
-  uint32 now = Now();
+  uint32 now = currentTime();
 
-  uint8 buffer[MAX_PACKET];
+  uint8* buffer = reinterpret_cast<uint8 *>(m_packets.get()) + m_batch_len;
+  uint32 nOptions = writeSack(buffer + HEADER_SIZE);
   long_to_bytes(m_conv, buffer);
   long_to_bytes(seq, buffer + 4);
   long_to_bytes(m_rcv_nxt, buffer + 8);
-  buffer[12] = 0;
+  buffer[12] = static_cast<uint8>(nOptions / 4);
   buffer[13] = flags;
-  short_to_bytes(uint16(m_rcv_wnd), buffer + 14);
+  short_to_bytes(static_cast<uint16>(
+      talk_base::_min<uint32>(m_rcv_wnd >> m_rwnd_scale, 0xFFFF)), buffer + 14);
 
   // Timestamp computations
   long_to_bytes(now, buffer + 16);
   long_to_bytes(m_ts_recent, buffer + 20);
   m_ts_lastack = m_rcv_nxt;
 
-  memcpy(buffer + HEADER_SIZE, data, len);
+  if (len > 0) {
+    size_t read = 0;
+    m_sbuf.ReadOffset(buffer + HEADER_SIZE + nOptions, len, offset, &read);
+    ASSERT(read == len);
+  }
 
 #if _DEBUGMSG >= _DBG_VERBOSE
   LOG(LS_INFO) << "<-- <CONV=" << m_conv
@@ -487,14 +1333,23 @@ IPseudoTcpNotify::WriteResult PseudoTcp::packet(uint32 seq, uint8 flags,
                << "><WND=" << m_rcv_wnd
                << "><TS="  << (now % 10000)
                << "><TSR=" << (m_ts_recent % 10000)
-               << "><LEN=" << len << ">";
+               << "><LEN=" << len
+               << "><OPT=" << nOptions << ">";
 #endif // _DEBUGMSG
 
-  IPseudoTcpNotify::WriteResult wres = m_notify->TcpWritePacket(this, reinterpret_cast<char *>(buffer), len + HEADER_SIZE);
-  // Note: When data is NULL, this is an ACK packet.  We don't read the return value for those,
+  uint32 nSize = HEADER_SIZE + nOptions + len;
+  IPseudoTcpNotify::WriteResult wres = IPseudoTcpNotify::WR_SUCCESS;
+  if (m_batching) {
+    m_batch_lens[m_batch_count++] = nSize;
+    m_batch_len += nSize;
+  } else {
+    wres = m_notify->TcpWritePacket(this, reinterpret_cast<char *>(buffer),
+                                    nSize);
+  }
+  // Note: When len is 0, this is an ACK packet.  We don't read the return value for those,
   // and thus we won't retry.  So go ahead and treat the packet as a success (basically simulate
   // as if it were dropped), which will prevent our timers from being messed up.
-  if ((wres != IPseudoTcpNotify::WR_SUCCESS) && (NULL != data))
+  if ((wres != IPseudoTcpNotify::WR_SUCCESS) && (len > 0))
     return wres;
 
   m_t_ack = 0;
@@ -507,8 +1362,94 @@ IPseudoTcpNotify::WriteResult PseudoTcp::packet(uint32 seq, uint8 flags,
   return IPseudoTcpNotify::WR_SUCCESS;
 }
 
+// Writes the packets attemptSend built to the network at once.  Like a lost
+// packet, one the network refuses is left to the retransmit logic.  When the
+// network would block, the data of the packets it didn't take counts as not
+// sent, and goes out again BLOCKED_RETRY ms later, or with the next ack.
+// Returns false if not all of them went out.
+bool PseudoTcp::sendBatch() {
+  if (m_batch_count == 0)
+    return true;
+
+  IPseudoTcpNotify::WriteResult wres = IPseudoTcpNotify::WR_SUCCESS;
+  int nSent = m_notify->TcpWritePackets(this, m_packets.get(), m_batch_lens,
+                                        m_batch_count, &wres);
+  uint32 nCount = m_batch_count;
+  m_batch_count = m_batch_len = 0;
+  ASSERT(nSent >= 0);
+  if (static_cast<uint32>(nSent) >= nCount)
+    return true;
+
+  LOG_F(LS_VERBOSE) << "sent " << nSent << " of " << nCount << " packets";
+
+  // Find the packets not sent
+  const uint8* buffers[kMaxBatch];
+  const uint8* buffer = reinterpret_cast<const uint8 *>(m_packets.get());
+  for (uint32 i = 0; i < nCount; ++i) {
+    buffers[i] = buffer;
+    buffer += m_batch_lens[i];
+  }
+
+  if (wres == IPseudoTcpNotify::WR_TOO_LARGE) {
+    uint32 nLen = m_batch_lens[nSent] - HEADER_SIZE - 4 * buffers[nSent][12];
+    if (nLen > 0) {
+      shrinkMss(nLen);
+    }
+  } else if (wres == IPseudoTcpNotify::WR_SUCCESS) {
+    // Blocked.  Undo transmit for the packets not sent, the last one first.
+    for (uint32 i = nCount; i-- > static_cast<uint32>(nSent); ) {
+      uint32 nLen = m_batch_lens[i] - HEADER_SIZE - 4 * buffers[i][12];
+      if (nLen == 0)
+        continue;
+      uint32 seq = bytes_to_long(buffers[i] + 4);
+      SList::iterator seg = m_slist.begin();
+      while ((seg != m_slist.end()) && (seg->seq != seq)) {
+        ++seg;
+      }
+      ASSERT((seg != m_slist.end()) && (seg->xmit > 0));
+      if ((seg == m_slist.end()) || (seg->xmit == 0))
+        continue;
+      seg->xmit -= 1;
+      if (seg->xmit == 0) {
+        m_snd_nxt = seg->seq;
+      } else {
+        --m_retransmits;
+      }
+      if (m_sack_rxt == seg->seq + seg->len) {
+        m_sack_rxt = seg->seq;
+      }
+    }
+    if (m_snd_nxt == m_snd_una) {
+      m_rto_base = 0;
+    }
+    m_pace_wait = currentTime() + BLOCKED_RETRY;
+  }
+  return false;
+}
+
+// Moves down PACKET_MAXIMUMS until segments are smaller than len bytes, the
+// size of one the network refused.  Returns false at the end of the list.
+bool PseudoTcp::shrinkMss(uint32 len) {
+  while (true) {
+    if (PACKET_MAXIMUMS[m_msslevel + 1] == 0) {
+      LOG_F(LS_VERBOSE) << "MTU too small";
+      return false;
+    }
+    // !?! We need to break up all outstanding and pending packets and then retransmit!?!
+
+    m_mss = PACKET_MAXIMUMS[++m_msslevel] - PACKET_OVERHEAD;
+    m_cc->ReduceMss(m_mss);
+    if (maxSegment() < len)
+      break;
+  }
+#if _DEBUGMSG >= _DBG_NORMAL
+  LOG(LS_INFO) << "Adjusting mss to " << m_mss << " bytes";
+#endif // _DEBUGMSG
+  return true;
+}
+
 bool PseudoTcp::parse(const uint8* buffer, uint32 size) {
-  if (size < 12)
+  if (size < HEADER_SIZE)
     return false;
 
   Segment seg;
@@ -521,8 +1462,12 @@ bool PseudoTcp::parse(const uint8* buffer, uint32 size) {
   seg.tsval = bytes_to_long(buffer + 16);
   seg.tsecr = bytes_to_long(buffer + 20);
 
-  seg.data = reinterpret_cast<const char *>(buffer) + HEADER_SIZE;
-  seg.len = size - HEADER_SIZE;
+  seg.optlen = 4 * buffer[12];
+  if (HEADER_SIZE + seg.optlen > size)
+    return false;
+  seg.options = reinterpret_cast<const char *>(buffer) + HEADER_SIZE;
+  seg.data = seg.options + seg.optlen;
+  seg.len = size - HEADER_SIZE - seg.optlen;
 
 #if _DEBUGMSG >= _DBG_VERBOSE
   LOG(LS_INFO) << "--> <CONV=" << seg.conv
@@ -532,7 +1477,8 @@ bool PseudoTcp::parse(const uint8* buffer, uint32 size) {
                << "><WND=" << seg.wnd
                << "><TS="  << (seg.tsval % 10000)
                << "><TSR=" << (seg.tsecr % 10000)
-               << "><LEN=" << seg.len << ">";
+               << "><LEN=" << seg.len
+               << "><OPT=" << seg.optlen << ">";
 #endif // _DEBUGMSG
 
   return process(seg);
@@ -566,6 +1512,14 @@ bool PseudoTcp::clock_check(uint32 now, long& nTimeout) {
   if (m_snd_wnd == 0) {
     nTimeout = talk_base::_min<int32>(nTimeout, talk_base::TimeDiff(m_lastsend + m_rx_rto, now));
   }
+  if (m_pace_wait) {
+    nTimeout = talk_base::_min<int32>(nTimeout,
+      talk_base::TimeDiff(m_pace_wait, now));
+  }
+  if (m_nagle_wait && (talk_base::TimeDiff(m_nagle_wait, now) > 0)) {
+    nTimeout = talk_base::_min<int32>(nTimeout,
+      talk_base::TimeDiff(m_nagle_wait, now));
+  }
 #if PSEUDO_KEEPALIVE
   if (m_state == TCP_ESTABLISHED) {
     nTimeout = talk_base::_min<int32>(nTimeout,
@@ -585,7 +1539,7 @@ bool PseudoTcp::process(Segment& seg) {
     return false;
   }
 
-  uint32 now = Now();
+  uint32 now = currentTime();
   m_lasttraffic = m_lastrecv = now;
   m_bOutgoing = false;
 
@@ -613,12 +1567,12 @@ bool PseudoTcp::process(Segment& seg) {
         m_state = TCP_SYN_RECEIVED;
         LOG(LS_INFO) << "State: TCP_SYN_RECEIVED";
         //m_notify->associate(addr);
-        char buffer[1];
-        buffer[0] = CTL_CONNECT;
-        queue(buffer, 1, true);
+        parseOptions(seg.data + 1, seg.len - 1);
+        queueConnectMessage();
       } else if (m_state == TCP_SYN_SENT) {
         m_state = TCP_ESTABLISHED;
         LOG(LS_INFO) << "State: TCP_ESTABLISHED";
+        parseOptions(seg.data + 1, seg.len - 1);
         adjustMTU();
         if (m_notify) {
           m_notify->OnTcpOpen(this);
@@ -631,11 +1585,18 @@ bool PseudoTcp::process(Segment& seg) {
     }
   }
 
-  // Update timestamp
-  if ((seg.seq <= m_ts_lastack) && (m_ts_lastack < seg.seq + seg.len)) {
+  // Update timestamp.  An empty segment in sequence counts too, so that data
+  // echoes the time of the latest ack, which the receiver measures the
+  // round-trip time with.
+  if ((seg.seq <= m_ts_lastack) && ((m_ts_lastack < seg.seq + seg.len)
+      || ((seg.len == 0) && (seg.seq == m_ts_lastack)))) {
     m_ts_recent = seg.tsval;
   }
 
+  if (m_support_sack && (seg.optlen > 0)) {
+    parseSack(seg.options, seg.optlen);
+  }
+
   // Check if this is a valuable ack
   if ((seg.ack > m_snd_una) && (seg.ack <= m_snd_nxt)) {
     // Calculate round-trip time
@@ -649,6 +1610,10 @@ bool PseudoTcp::process(Segment& seg) {
           m_rx_rttvar = (3 * m_rx_rttvar + abs(long(rtt - m_rx_srtt))) / 4;
           m_rx_srtt = (7 * m_rx_srtt + rtt) / 8;
         }
+        if ((m_rx_minrtt == 0) || (static_cast<uint32>(rtt) < m_rx_minrtt)) {
+          m_rx_minrtt = rtt;
+        }
+        m_cc->OnRtt(now, rtt, m_rx_minrtt);
         m_rx_rto = bound(MIN_RTO, m_rx_srtt +
             talk_base::_max<uint32>(1, 4 * m_rx_rttvar), MAX_RTO);
 #if _DEBUGMSG >= _DBG_VERBOSE
@@ -661,7 +1626,7 @@ bool PseudoTcp::process(Segment& seg) {
       }
     }
 
-    m_snd_wnd = seg.wnd;
+    m_snd_wnd = static_cast<uint32>(seg.wnd) << m_swnd_scale;
 
     uint32 nAcked = seg.ack - m_snd_una;
     m_snd_una = seg.ack;
@@ -669,31 +1634,54 @@ bool PseudoTcp::process(Segment& seg) {
     m_rto_base = (m_snd_una == m_snd_nxt) ? 0 : now;
 
     m_slen -= nAcked;
-    memmove(m_sbuf, m_sbuf + nAcked, m_slen);
+    m_sbuf.ConsumeReadData(nAcked);
+    tuneSendBuffer(now);
     //LOG(LS_INFO) << "PseudoTcp::process - m_slen = " << m_slen;
 
     for (uint32 nFree = nAcked; nFree > 0; ) {
       ASSERT(!m_slist.empty());
       if (nFree < m_slist.front().len) {
         m_slist.front().len -= nFree;
+        if (m_slist.front().bSacked) {
+          m_sacked -= nFree;
+        } else {
+          m_delivered += nFree;
+        }
         nFree = 0;
       } else {
         if (m_slist.front().len > m_largest) {
           m_largest = m_slist.front().len;
         }
+        if (m_slist.front().bSacked) {
+          m_sacked -= m_slist.front().len;
+        } else {
+          m_delivered += m_slist.front().len;
+        }
         nFree -= m_slist.front().len;
         m_slist.pop_front();
       }
     }
 
+    CongestionController::Ack ack;
+    ack.now = now;
+    ack.acked = nAcked;
+    ack.delivered = m_delivered;
+    ack.snd_una = m_snd_una;
+    ack.snd_nxt = m_snd_nxt;
+    ack.snd_wnd = m_snd_wnd;
+    ack.app_limited = (m_slen <= ack.in_flight());
+    ack.sack = m_support_sack;
+
     if (m_dup_acks >= 3) {
       if (m_snd_una >= m_recover) { // NewReno
-        uint32 nInFlight = m_snd_nxt - m_snd_una;
-        m_cwnd = talk_base::_min(m_ssthresh, nInFlight + m_mss); // (Fast Retransmit)
+        m_cc->OnRecoveryEnd(ack); // (Fast Retransmit)
 #if _DEBUGMSG >= _DBG_NORMAL
         LOG(LS_INFO) << "exit recovery";
 #endif // _DEBUGMSG
         m_dup_acks = 0;
+      } else if (m_support_sack) {
+        // The holes go out from attemptSend, as the scoreboard allows
+        m_cc->OnRecoveryAck(ack);
       } else {
 #if _DEBUGMSG >= _DBG_NORMAL
         LOG(LS_INFO) << "recovery retransmit";
@@ -702,16 +1690,11 @@ bool PseudoTcp::process(Segment& seg) {
           closedown(ECONNABORTED);
           return false;
         }
-        m_cwnd += m_mss - talk_base::_min(nAcked, m_cwnd);
+        m_cc->OnRecoveryAck(ack);
       }
     } else {
       m_dup_acks = 0;
-      // Slow start, congestion avoidance
-      if (m_cwnd < m_ssthresh) {
-        m_cwnd += m_mss;
-      } else {
-        m_cwnd += talk_base::_max<uint32>(1, m_mss * m_mss / m_cwnd);
-      }
+      m_cc->OnAck(ack);
     }
 
     // !?! A bit hacky
@@ -728,7 +1711,7 @@ bool PseudoTcp::process(Segment& seg) {
     // If we make room in the send queue, notify the user
     // The goal it to make sure we always have at least enough data to fill the
     // window.  We'd like to notify the app when we are halfway to that point.
-    const uint32 kIdealRefillSize = (sizeof(m_sbuf) + sizeof(m_rbuf)) / 2;
+    const uint32 kIdealRefillSize = (m_sbuf_len + m_snd_wnd) / 2;
     if (m_bWriteEnable && (m_slen < kIdealRefillSize)) {
       m_bWriteEnable = false;
       if (m_notify) {
@@ -738,13 +1721,22 @@ bool PseudoTcp::process(Segment& seg) {
     }
   } else if (seg.ack == m_snd_una) {
     // !?! Note, tcp says don't do this... but otherwise how does a closed window become open?
-    m_snd_wnd = seg.wnd;
+    m_snd_wnd = static_cast<uint32>(seg.wnd) << m_swnd_scale;
 
     // Check duplicate acks
     if (seg.len > 0) {
       // it's a dup ack, but with a data payload, so don't modify m_dup_acks
+    } else if (m_support_sack && (m_snd_una < m_recover)) {
+      // In recovery already, or retransmitting after a timeout (RFC 6582,
+      // Sec 3.2): the scoreboard tells what else left the network
     } else if (m_snd_una != m_snd_nxt) {
       m_dup_acks += 1;
+      // With selective acks, the first segment is lost as soon as enough
+      // data beyond it arrived (RFC 6675, Sec 5)
+      if (m_support_sack && (m_dup_acks < 3)
+          && (m_sacked > (DUP_THRESH - 1) * m_mss)) {
+        m_dup_acks = 3;
+      }
       if (m_dup_acks == 3) { // (Fast Retransmit)
 #if _DEBUGMSG >= _DBG_NORMAL
         LOG(LS_INFO) << "enter recovery";
@@ -755,12 +1747,19 @@ bool PseudoTcp::process(Segment& seg) {
           return false;
         }
         m_recover = m_snd_nxt;
-        uint32 nInFlight = m_snd_nxt - m_snd_una;
-        m_ssthresh = talk_base::_max(nInFlight / 2, 2 * m_mss);
-        //LOG(LS_INFO) << "m_ssthresh: " << m_ssthresh << "  nInFlight: " << nInFlight << "  m_mss: " << m_mss;
-        m_cwnd = m_ssthresh + 3 * m_mss;
+        m_sack_rxt = m_snd_una + m_slist.front().len;
+        CongestionController::Ack ack;
+        ack.now = now;
+        ack.acked = 0;
+        ack.delivered = m_delivered;
+        ack.snd_una = m_snd_una;
+        ack.snd_nxt = m_snd_nxt;
+        ack.snd_wnd = m_snd_wnd;
+        ack.app_limited = (m_slen <= ack.in_flight());
+        ack.sack = m_support_sack;
+        m_cc->OnRecoveryStart(ack);
       } else if (m_dup_acks > 3) {
-        m_cwnd += m_mss;
+        m_cc->OnRecoveryDupAck();
       }
     } else {
       m_dup_acks = 0;
@@ -800,8 +1799,8 @@ bool PseudoTcp::process(Segment& seg) {
       seg.len = 0;
     }
   }
-  if ((seg.seq + seg.len - m_rcv_nxt) > (sizeof(m_rbuf) - m_rlen)) {
-    uint32 nAdjust = seg.seq + seg.len - m_rcv_nxt - (sizeof(m_rbuf) - m_rlen);
+  if ((seg.seq + seg.len - m_rcv_nxt) > (m_rbuf_len - m_rlen)) {
+    uint32 nAdjust = seg.seq + seg.len - m_rcv_nxt - (m_rbuf_len - m_rlen);
     if (nAdjust < seg.len) {
       seg.len -= nAdjust;
     } else {
@@ -819,8 +1818,11 @@ bool PseudoTcp::process(Segment& seg) {
       }
     } else {
       uint32 nOffset = seg.seq - m_rcv_nxt;
-      memcpy(m_rbuf + m_rlen + nOffset, seg.data, seg.len);
+      size_t written = 0;
+      m_rbuf.WriteOffset(seg.data, seg.len, nOffset, &written);
+      ASSERT(written == seg.len);
       if (seg.seq == m_rcv_nxt) {
+        uint32 nStart = m_rcv_nxt;
         m_rlen += seg.len;
         m_rcv_nxt += seg.len;
         m_rcv_wnd -= seg.len;
@@ -840,6 +1842,21 @@ bool PseudoTcp::process(Segment& seg) {
           }
           it = m_rlist.erase(it);
         }
+        m_rbuf.ConsumeWriteBuffer(m_rcv_nxt - nStart);
+
+        if (seg.tsecr) {
+          // The time since the ack the sender last heard of, which is at least
+          // one round trip.  Keep the estimate near the smallest sample.
+          long rtt = talk_base::TimeDiff(now, seg.tsecr);
+          if (rtt > 0) {
+            if ((m_rcv_rtt == 0) || (static_cast<uint32>(rtt) < m_rcv_rtt)) {
+              m_rcv_rtt = rtt;
+            } else {
+              m_rcv_rtt = (7 * m_rcv_rtt + rtt) / 8;
+            }
+          }
+        }
+        tuneReceiveBuffer(now);
       } else {
 #if _DEBUGMSG >= _DBG_NORMAL
         LOG(LS_INFO) << "Saving " << seg.len << " bytes (" << seg.seq << " -> " << seg.seq + seg.len << ")";
@@ -847,6 +1864,7 @@ bool PseudoTcp::process(Segment& seg) {
         RSegment rseg;
         rseg.seq = seg.seq;
         rseg.len = seg.len;
+        m_rcv_sack_last = seg.seq;
         RList::iterator it = m_rlist.begin();
         while ((it != m_rlist.end()) && (it->seq < rseg.seq)) {
           ++it;
@@ -879,13 +1897,13 @@ bool PseudoTcp::transmit(const SList::iterator& seg, uint32 now) {
     return false;
   }
 
-  uint32 nTransmit = talk_base::_min(seg->len, m_mss);
+  uint32 nTransmit = talk_base::_min(seg->len, maxSegment());
 
   while (true) {
     uint32 seq = seg->seq;
     uint8 flags = (seg->bCtrl ? FLAG_CTL : 0);
-    const char* buffer = m_sbuf + (seg->seq - m_snd_una);
-    IPseudoTcpNotify::WriteResult wres = this->packet(seq, flags, buffer, nTransmit);
+    IPseudoTcpNotify::WriteResult wres = this->packet(seq, flags,
+        seg->seq - m_snd_una, nTransmit);
 
     if (wres == IPseudoTcpNotify::WR_SUCCESS)
       break;
@@ -897,23 +1915,9 @@ bool PseudoTcp::transmit(const SList::iterator& seg, uint32 now) {
 
     ASSERT(wres == IPseudoTcpNotify::WR_TOO_LARGE);
 
-    while (true) {
-      if (PACKET_MAXIMUMS[m_msslevel + 1] == 0) {
-        LOG_F(LS_VERBOSE) << "MTU too small";
-        return false;
-      }
-      // !?! We need to break up all outstanding and pending packets and then retransmit!?!
-
-      m_mss = PACKET_MAXIMUMS[++m_msslevel] - PACKET_OVERHEAD;
-      m_cwnd = 2 * m_mss; // I added this... haven't researched actual formula
-      if (m_mss < nTransmit) {
-        nTransmit = m_mss;
-        break;
-      }
-    }
-#if _DEBUGMSG >= _DBG_NORMAL
-    LOG(LS_INFO) << "Adjusting mss to " << m_mss << " bytes";
-#endif // _DEBUGMSG
+    if (!shrinkMss(nTransmit))
+      return false;
+    nTransmit = maxSegment();
   }
 
   if (nTransmit < seg->len) {
@@ -930,10 +1934,13 @@ bool PseudoTcp::transmit(const SList::iterator& seg, uint32 now) {
 
   if (seg->xmit == 0) {
     m_snd_nxt += seg->len;
+  } else {
+    ++m_retransmits;
   }
   seg->xmit += 1;
   //seg->tstamp = now;
-  if (m_rto_base == 0) {
+  if ((m_rto_base == 0) || (seg->seq == m_snd_una)) {
+    // A retransmitted first segment gets a whole timeout to be acked in
     m_rto_base = now;
   }
 
@@ -941,10 +1948,10 @@ bool PseudoTcp::transmit(const SList::iterator& seg, uint32 now) {
 }
 
 void PseudoTcp::attemptSend(SendFlags sflags) {
-  uint32 now = Now();
+  uint32 now = currentTime();
 
   if (talk_base::TimeDiff(now, m_lastsend) > static_cast<long>(m_rx_rto)) {
-    m_cwnd = m_mss;
+    m_cc->OnIdle(now);
   }
 
 #if _DEBUGMSG
@@ -952,16 +1959,38 @@ void PseudoTcp::attemptSend(SendFlags sflags) {
   UNUSED(bFirst);
 #endif // _DEBUGMSG
 
+  // The packets go out together at the end, or whenever the buffer is full
+  m_batching = true;
   while (true) {
-    uint32 cwnd = m_cwnd;
-    if ((m_dup_acks == 1) || (m_dup_acks == 2)) { // Limited Transmit
+    if ((m_batch_count == kMaxBatch) || (m_batch_len + HEADER_SIZE
+        + MAX_SACK_SIZE + m_mss > MAX_PACKET)) {
+      if (!sendBatch())
+        break;
+    }
+
+    uint32 cwnd = m_cc->cwnd();
+    if (!m_support_sack && ((m_dup_acks == 1) || (m_dup_acks == 2))) { // Limited Transmit
       cwnd += m_dup_acks * m_mss;
     }
     uint32 nWindow = talk_base::_min(m_snd_wnd, cwnd);
     uint32 nInFlight = m_snd_nxt - m_snd_una;
     uint32 nUseable = (nInFlight < nWindow) ? (nWindow - nInFlight) : 0;
 
-    uint32 nAvailable = talk_base::_min(m_slen - nInFlight, m_mss);
+    uint32 nAvailable = talk_base::_min(m_slen - nInFlight, maxSegment());
+
+    // With selective acks, what the peer holds or lost has left the network,
+    // and the congestion window only counts the rest (RFC 6675).  The first
+    // lost hole goes out before new data.
+    SList::iterator hole = m_slist.end();
+    if (m_support_sack && ((m_sacked > 0) || (m_sack_rxt > m_snd_una))) {
+      uint32 nPipe = scoreboard(&hole);
+      nUseable = (nPipe < cwnd) ? (cwnd - nPipe) : 0;
+      if (hole != m_slist.end()) {
+        nAvailable = (hole->len <= nUseable) ? hole->len : 0;
+      } else if (nInFlight + nUseable > m_snd_wnd) {
+        nUseable = (nInFlight < m_snd_wnd) ? (m_snd_wnd - nInFlight) : 0;
+      }
+    }
 
     if (nAvailable > nUseable) {
       if (nUseable * 4 < nWindow) {
@@ -972,64 +2001,110 @@ void PseudoTcp::attemptSend(SendFlags sflags) {
       }
     }
 
+    uint32 nRate = (m_pacing || m_cc->Paced())
+        ? m_cc->PacingRate(m_rx_srtt) : 0;
+    if ((nAvailable > 0) && (nRate > 0) && !pace(now, nRate)) {
+      nAvailable = 0;
+    }
+
 #if _DEBUGMSG >= _DBG_VERBOSE
     if (bFirst) {
       bFirst = false;
-      LOG(LS_INFO) << "[cwnd: " << m_cwnd
+      LOG(LS_INFO) << "[cwnd: " << m_cc->cwnd()
                    << "  nWindow: " << nWindow
                    << "  nInFlight: " << nInFlight
                    << "  nAvailable: " << nAvailable
                    << "  nQueued: " << m_slen - nInFlight
-                   << "  nEmpty: " << sizeof(m_sbuf) - m_slen
-                   << "  ssthresh: " << m_ssthresh << "]";
+                   << "  nEmpty: " << m_sbuf_len - m_slen
+                   << "  ssthresh: " << m_cc->ssthresh() << "]";
     }
 #endif // _DEBUGMSG
 
     if (nAvailable == 0) {
       if (sflags == sfNone)
-        return;
+        break;
 
       // If this is an immediate ack, or the second delayed ack
       if ((sflags == sfImmediateAck) || m_t_ack) {
         packet(m_snd_nxt, 0, 0, 0);
       } else {
-        m_t_ack = Now();
+        m_t_ack = now;
       }
-      return;
+      break;
     }
 
-    // Nagle algorithm
-    if ((m_snd_nxt > m_snd_una) && (nAvailable < m_mss))  {
-      return;
-    }
+    SList::iterator seg = hole;
+    if (seg == m_slist.end()) {
+      // Nagle algorithm, but small writes wait NAGLE_DELAY at most for the
+      // data in flight to be acked
+      if (!m_nodelay && (m_snd_nxt > m_snd_una)
+          && (nAvailable < maxSegment())) {
+        if (m_nagle_wait == 0) {
+          m_nagle_wait = now + NAGLE_DELAY;
+        }
+        if (talk_base::TimeDiff(m_nagle_wait, now) > 0)
+          break;
+      }
+      m_nagle_wait = 0;
 
-    // Find the next segment to transmit
-    SList::iterator it = m_slist.begin();
-    while (it->xmit > 0) {
-      ++it;
-      ASSERT(it != m_slist.end());
-    }
-    SList::iterator seg = it;
+      // Find the next segment to transmit
+      SList::iterator it = m_slist.begin();
+      while (it->xmit > 0) {
+        ++it;
+        ASSERT(it != m_slist.end());
+      }
+      seg = it;
 
-    // If the segment is too large, break it into two
-    if (seg->len > nAvailable) {
-      SSegment subseg(seg->seq + nAvailable, seg->len - nAvailable, seg->bCtrl);
-      seg->len = nAvailable;
-      m_slist.insert(++it, subseg);
+      // If the segment is too large, break it into two
+      if (seg->len > nAvailable) {
+        SSegment subseg(seg->seq + nAvailable, seg->len - nAvailable, seg->bCtrl);
+        seg->len = nAvailable;
+        m_slist.insert(++it, subseg);
+      }
     }
 
     if (!transmit(seg, now)) {
       LOG_F(LS_VERBOSE) << "transmit failed";
       // TODO: consider closing socket
-      return;
+      break;
+    }
+    if (seg == hole) {
+#if _DEBUGMSG >= _DBG_NORMAL
+      LOG(LS_INFO) << "sack retransmit " << seg->seq;
+#endif // _DEBUGMSG
+      m_sack_rxt = seg->seq + seg->len;
+    }
+    if (nRate > 0) {
+      m_pace_credit -= seg->len;
     }
 
     sflags = sfNone;
   }
+  m_batching = false;
+  sendBatch();
+}
+
+// Returns whether paced data may go out now, or else when it may in
+// m_pace_wait.  Credit for the data to send builds up at the pacing rate.
+bool
+PseudoTcp::pace(uint32 now, uint32 rate) {
+  int64 nCredit = m_pace_credit + static_cast<int64>(
+      talk_base::TimeDiff(now, m_pace_time)) * rate / 1000;
+  int64 nBurst = talk_base::_max<int64>(2 * m_mss, rate * PACE_BURST / 1000);
+  m_pace_credit = static_cast<int32>(talk_base::_min(nCredit, nBurst));
+  m_pace_time = now;
+  if (m_pace_credit > 0) {
+    m_pace_wait = 0;
+    return true;
+  }
+  m_pace_wait = now + talk_base::_max<uint32>(1,
+      static_cast<uint32>((1000 * static_cast<int64>(-m_pace_credit) + rate - 1) / rate));
+  return false;
 }
 
 void
 PseudoTcp::closedown(uint32 err) {
+  m_sbuf.ConsumeReadData(m_slen);
   m_slen = 0;
 
   LOG(LS_INFO) << "State: TCP_CLOSED";
@@ -1054,8 +2129,115 @@ PseudoTcp::adjustMTU() {
   LOG(LS_INFO) << "Adjusting mss to " << m_mss << " bytes";
 #endif // _DEBUGMSG
   // Enforce minimums on ssthresh and cwnd
-  m_ssthresh = talk_base::_max(m_ssthresh, 2 * m_mss);
-  m_cwnd = talk_base::_max(m_cwnd, m_mss);
+  m_cc->SetMss(m_mss);
+}
+
+void
+PseudoTcp::resetCongestionControl() {
+  // The peer's window may grow as large as our receive buffer can
+  uint32 ssthresh = talk_base::_max(m_rbuf_len, m_rbuf_max);
+  switch (m_cc_type) {
+    case CC_CUBIC:
+      m_cc.reset(new CubicController(m_mss, ssthresh));
+      break;
+    case CC_BBR:
+      m_cc.reset(new BbrController(m_mss, ssthresh));
+      break;
+    default:
+      m_cc.reset(new CongestionController(m_mss, ssthresh));
+      break;
+  }
+}
+
+void
+PseudoTcp::resizeSendBuffer(uint32 new_size) {
+  if (!m_sbuf.SetCapacity(new_size)) {
+    LOG_F(LS_WARNING) << "can't resize send buffer to " << new_size;
+    ASSERT(false);
+    return;
+  }
+  m_sbuf_len = new_size;
+}
+
+void
+PseudoTcp::resizeReceiveBuffer(uint32 new_size) {
+  // Only the m_rlen bytes in sequence are kept, see tuneReceiveBuffer
+  ASSERT(m_rlist.empty());
+  if (!m_rbuf.SetCapacity(new_size)) {
+    LOG_F(LS_WARNING) << "can't resize receive buffer to " << new_size;
+    ASSERT(false);
+    return;
+  }
+  m_rcv_wnd = m_rcv_wnd + new_size - m_rbuf_len;
+  m_rbuf_len = new_size;
+}
+
+// Once per round trip, the data acked during it is the bandwidth-delay
+// product.  The send buffer holds the data in flight plus what is queued
+// behind it, so it is kept at twice that, and half again as large as the
+// peer's window (like the default sizes).
+void
+PseudoTcp::tuneSendBuffer(uint32 now) {
+  if ((m_rx_srtt == 0) || (m_sbuf_len >= m_sbuf_max))
+    return;
+
+  long elapsed = talk_base::TimeDiff(now, m_snd_tune_time);
+  if (m_snd_tune_time == 0) {
+    m_snd_tune_time = now;
+    m_snd_tune_una = m_snd_una;
+    return;
+  } else if (elapsed < static_cast<long>(m_rx_srtt)) {
+    return;
+  }
+
+  uint32 nBdp = static_cast<uint32>(static_cast<uint64>(m_snd_una
+      - m_snd_tune_una) * m_rx_srtt / elapsed);
+  m_snd_tune_time = now;
+  m_snd_tune_una = m_snd_una;
+
+  uint32 nTarget = talk_base::_max(2 * nBdp, m_snd_wnd + m_snd_wnd / 2);
+  if (nTarget > m_sbuf_len) {
+    // Grow in large steps, every step copies the buffer
+    nTarget = talk_base::_max(nTarget, m_sbuf_len + m_sbuf_len / 2);
+    resizeSendBuffer(talk_base::_min(nTarget, m_sbuf_max));
+    LOG(LS_INFO) << "Send buffer: " << m_sbuf_len << " bytes (bdp: " << nBdp
+                 << ", srtt: " << m_rx_srtt << ")";
+  }
+}
+
+// The same for the receive buffer, going by the data which arrived in a
+// round trip: when the peer sends more than half the buffer per round trip,
+// the window is likely what limits it.
+void
+PseudoTcp::tuneReceiveBuffer(uint32 now) {
+  // The window we announce can't cover more than this
+  uint32 nMax = talk_base::_min(m_rbuf_max,
+                                static_cast<uint32>(0xFFFF) << m_rwnd_scale);
+  // Out of order segments would be lost when the buffer is reallocated,
+  // wait for the gap to be filled
+  if ((m_rcv_rtt == 0) || (m_rbuf_len >= nMax) || !m_rlist.empty())
+    return;
+
+  long elapsed = talk_base::TimeDiff(now, m_rcv_tune_time);
+  if (m_rcv_tune_time == 0) {
+    m_rcv_tune_time = now;
+    m_rcv_tune_seq = m_rcv_nxt;
+    return;
+  } else if (elapsed < static_cast<long>(m_rcv_rtt)) {
+    return;
+  }
+
+  uint32 nBdp = static_cast<uint32>(static_cast<uint64>(m_rcv_nxt
+      - m_rcv_tune_seq) * m_rcv_rtt / elapsed);
+  m_rcv_tune_time = now;
+  m_rcv_tune_seq = m_rcv_nxt;
+
+  if (2 * nBdp > m_rbuf_len) {
+    uint32 nTarget = talk_base::_max(2 * nBdp, m_rbuf_len + m_rbuf_len / 2);
+    resizeReceiveBuffer(talk_base::_min(nTarget, nMax));
+    LOG(LS_INFO) << "Receive buffer: " << m_rbuf_len << " bytes (bdp: "
+                 << nBdp << ", rtt: " << m_rcv_rtt << ")";
+  }
 }
 
 }  // namespace cricket
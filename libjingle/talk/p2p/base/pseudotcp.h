@@ -31,6 +31,9 @@
 #include <list>
 
 #include "talk/base/basictypes.h"
+#include "talk/base/constructormagic.h"
+#include "talk/base/scoped_ptr.h"
+#include "talk/base/stream.h"
 
 namespace cricket {
 
@@ -39,6 +42,8 @@ namespace cricket {
 //////////////////////////////////////////////////////////////////////
 
 class PseudoTcp;
+// Congestion control algorithm of a PseudoTcp, see pseudotcp.cc
+class CongestionController;
 
 class IPseudoTcpNotify {
  public:
@@ -53,6 +58,19 @@ class IPseudoTcpNotify {
   enum WriteResult { WR_SUCCESS, WR_TOO_LARGE, WR_FAIL };
   virtual WriteResult TcpWritePacket(PseudoTcp* tcp,
                                      const char* buffer, size_t len) = 0;
+  // Write count packets, stored back to back in buffer, in one go.  Returns
+  // how many were written, and in result why the next one wasn't: WR_SUCCESS
+  // if the network would block, and the rest goes out again later.  By
+  // default they go one at a time through TcpWritePacket.
+  virtual int TcpWritePackets(PseudoTcp* tcp, const char* buffer,
+                              const size_t* lens, int count,
+                              WriteResult* result);
+
+  // Current time in ms, which the connection's timers run on.  By default
+  // PseudoTcp::Now, an emulated network may run the connection on its own
+  // clock instead.  It must then pass the same time to NotifyClock and
+  // GetNextClock.
+  virtual uint32 TcpNow(PseudoTcp* tcp);
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -72,6 +90,47 @@ class PseudoTcp {
   void Close(bool force);
   int GetError();
 
+  // Congestion control algorithms.  Only the sending side uses one, so each
+  // end may pick a different one.
+  enum CongestionControl {
+    // NewReno: a loss halves the window.  The default.
+    CC_RENO,
+    // CUBIC (RFC 8312): a loss takes 30% off the window, which grows back to
+    // where the loss happened in a few round trips, independent of the delay.
+    CC_CUBIC,
+    // BBR-like: the window follows the measured bottleneck bandwidth and
+    // round-trip time, so random loss (Wi-Fi, cellular) doesn't shrink it.
+    CC_BBR
+  };
+
+  // Buffer sizes, in bytes.  The buffers start at the initial size, and grow
+  // up to the limit as the measured bandwidth-delay product requires, so a
+  // limit no larger than the initial size turns auto-tuning off.  Options can
+  // only be set before the connection is opened.
+  enum Option {
+    OPT_RCVBUF,       // Initial receive buffer size
+    OPT_SNDBUF,       // Initial send buffer size
+    OPT_MAX_RCVBUF,   // Receive buffer limit
+    OPT_MAX_SNDBUF,   // Send buffer limit
+    OPT_CONGESTION_CONTROL, // A CongestionControl value
+    OPT_NODELAY,      // Whether small writes go out without waiting (no Nagle)
+    OPT_PACING        // Whether data is spread over the round trip (default 1)
+  };
+  // Gets the current size of a buffer, or its limit.
+  void GetOption(Option opt, int* value);
+  void SetOption(Option opt, int value);
+
+  struct Stats {
+    uint32 cwnd;          // Congestion window, in bytes
+    uint32 ssthresh;      // Slow start threshold, in bytes
+    uint32 srtt;          // Smoothed round-trip time, in ms
+    uint32 rttvar;        // Round-trip time variation, in ms
+    uint32 rto;           // Retransmit timeout, in ms
+    uint32 retransmits;   // Segments sent more than once
+    uint32 pacing_rate;   // Rate the algorithm aims at, in bytes per second
+  };
+  void GetStats(Stats* stats);
+
   enum TcpState {
     TCP_LISTEN, TCP_SYN_SENT, TCP_SYN_RECEIVED, TCP_ESTABLISHED, TCP_CLOSED
   };
@@ -95,11 +154,17 @@ class PseudoTcp {
  protected:
   enum SendFlags { sfNone, sfDelayedAck, sfImmediateAck };
   enum {
-    // Note: can't go as high as 1024 * 64, because of uint16 precision
-    kRcvBufSize = 1024 * 60,
+    // Note: without window scaling (an older peer) the window can't go as
+    // high as 1024 * 64, because of uint16 precision
+    kDefaultRcvBufSize = 1024 * 60,
     // Note: send buffer should be larger to make sure we can always fill the
     // receiver window
-    kSndBufSize = 1024 * 90
+    kDefaultSndBufSize = 1024 * 90,
+    // Limits of buffer auto-tuning, enough for 300 ms at 25 Mbps
+    kDefaultMaxRcvBufSize = 1024 * 1024,
+    kDefaultMaxSndBufSize = 1024 * 1536,
+    // Packets written to the network at once
+    kMaxBatch = 16
   };
 
   struct Segment {
@@ -109,16 +174,21 @@ class PseudoTcp {
     const char * data;
     uint32 len;
     uint32 tsval, tsecr;
+    // Header options (SACK blocks), in the TCP format
+    const char * options;
+    uint32 optlen;
   };
 
   struct SSegment {
     SSegment(uint32 s, uint32 l, bool c)
-        : seq(s), len(l), /*tstamp(0),*/ xmit(0), bCtrl(c) {
+        : seq(s), len(l), /*tstamp(0),*/ xmit(0), bCtrl(c), bSacked(false) {
     }
     uint32 seq, len;
     //uint32 tstamp;
     uint8 xmit;
     bool bCtrl;
+    // The peer reported holding it (SACK)
+    bool bSacked;
   };
   typedef std::list<SSegment> SList;
 
@@ -127,12 +197,23 @@ class PseudoTcp {
   };
 
   uint32 queue(const char* data, uint32 len, bool bCtrl);
+  void queueConnectMessage();
+  void parseOptions(const char* data, uint32 len);
+  uint32 writeSack(uint8* buffer);
+  void parseSack(const char* data, uint32 len);
+  uint32 maxSegment() const;
+  uint32 scoreboard(SList::iterator* hole);
 
   IPseudoTcpNotify::WriteResult packet(uint32 seq, uint8 flags,
-                                       const char* data, uint32 len);
+                                       uint32 offset, uint32 len);
+  bool sendBatch();
+  bool shrinkMss(uint32 len);
   bool parse(const uint8* buffer, uint32 size);
 
+  uint32 currentTime();
+
   void attemptSend(SendFlags sflags = sfNone);
+  bool pace(uint32 now, uint32 rate);
 
   void closedown(uint32 err = 0);
 
@@ -143,6 +224,13 @@ class PseudoTcp {
 
   void adjustMTU();
 
+  void resizeSendBuffer(uint32 new_size);
+  void resizeReceiveBuffer(uint32 new_size);
+  void tuneSendBuffer(uint32 now);
+  void tuneReceiveBuffer(uint32 now);
+
+  void resetCongestionControl();
+
  private:
   IPseudoTcpNotify* m_notify;
   enum Shutdown { SD_NONE, SD_GRACEFUL, SD_FORCEFUL } m_shutdown;
@@ -157,29 +245,78 @@ class PseudoTcp {
   // Incoming data
   typedef std::list<RSegment> RList;
   RList m_rlist;
-  char m_rbuf[kRcvBufSize];
+  // Circular, starting at the first byte not yet read by the application.
+  // Out of order segments are stored at their offset from m_rcv_nxt, beyond
+  // the m_rlen bytes ready to be read.
+  talk_base::FifoBuffer m_rbuf;
+  uint32 m_rbuf_len, m_rbuf_max;
   uint32 m_rcv_nxt, m_rcv_wnd, m_rlen, m_lastrecv;
+  // Scale factor of the window we announce
+  uint8 m_rwnd_scale;
+  // Start of the latest out of order segment, reported first in SACK blocks
+  uint32 m_rcv_sack_last;
+  // Receive buffer tuning: round-trip time seen by the receiver, and the
+  // start of the current measurement
+  uint32 m_rcv_rtt, m_rcv_tune_seq, m_rcv_tune_time;
 
   // Outgoing data
   SList m_slist;
-  char m_sbuf[kSndBufSize];
+  // Circular, starting at m_snd_una
+  talk_base::FifoBuffer m_sbuf;
+  uint32 m_sbuf_len, m_sbuf_max;
   uint32 m_snd_nxt, m_snd_wnd, m_slen, m_lastsend, m_snd_una;
+  // Scale factor of the window the peer announces
+  uint8 m_swnd_scale;
+  // Send buffer tuning: start of the current measurement
+  uint32 m_snd_tune_una, m_snd_tune_time;
+  // False once the peer turned out to be without window scaling
+  bool m_support_wnd_scale;
+  // False once the peer turned out to be without selective acks
+  bool m_support_sack;
+  // SACK scoreboard: bytes of m_slist the peer holds, the point below which
+  // holes were retransmitted in this recovery, and below which every hole
+  // counts as lost (after a timeout)
+  uint32 m_sacked, m_sack_rxt, m_sack_lost;
+  // Bytes the peer got, counted as they are acked or sacked
+  uint32 m_delivered;
   // Maximum segment size, estimated protocol level, largest segment sent
   uint32 m_mss, m_msslevel, m_largest, m_mtu_advise;
   // Retransmit timer
   uint32 m_rto_base;
 
+  // Packets built by attemptSend, written together by sendBatch.  The buffer
+  // holds any single packet too.
+  talk_base::scoped_array<char> m_packets;
+  size_t m_batch_lens[kMaxBatch];
+  uint32 m_batch_count, m_batch_len;
+  bool m_batching;
+
   // Timestamp tracking
   uint32 m_ts_recent, m_ts_lastack;
 
   // Round-trip calculation
   uint32 m_rx_rttvar, m_rx_srtt, m_rx_rto;
+  // Smallest round-trip time seen (the path without queueing)
+  uint32 m_rx_minrtt;
+  uint32 m_retransmits;
 
   // Congestion avoidance, Fast retransmit/recovery, Delayed ACKs
-  uint32 m_ssthresh, m_cwnd;
+  CongestionControl m_cc_type;
+  talk_base::scoped_ptr<CongestionController> m_cc;
+  // Pacing: credit in bytes as of m_pace_time, and when sending may resume
+  // (0 if not waiting)
+  int32 m_pace_credit;
+  uint32 m_pace_time, m_pace_wait;
+  bool m_pacing;
+  // Nagle: whether it is off, and until when small writes may be held back
+  // (0 if none are)
+  bool m_nodelay;
+  uint32 m_nagle_wait;
   uint8 m_dup_acks;
   uint32 m_recover;
   uint32 m_t_ack;
+
+  DISALLOW_EVIL_CONSTRUCTORS(PseudoTcp);
 };
 
 }  // namespace cricket
@@ -0,0 +1,435 @@
+/*
+ * libjingle
+ * Copyright 2004--2005, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Runs bulk transfers between PseudoTcp pairs over emulated links, and prints
+// the goodput for several link delays, loss rates, buffer sizes and
+// congestion control algorithms.  Then the bursts, and the queue and losses
+// they cause, at a bottleneck with a short queue, with and without pacing.
+// Acks come back in bunches there, like over Wi-Fi or a cellular link, which
+// is what makes a window based sender burst.
+//
+// The connections and links run on a virtual clock, driven by a queue of the
+// times each transfer needs to run again.  Nothing depends on the real clock,
+// so a run always prints the same results.
+
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "talk/base/basictypes.h"
+#include "talk/base/common.h"
+#include "talk/base/logging.h"
+#include "talk/base/timeutils.h"
+#include "talk/p2p/base/pseudotcp.h"
+
+using namespace cricket;
+
+namespace {
+
+// Virtual time the transfers start at.  PseudoTcp takes a time of 0 as unset
+// in its timers, so the clock starts well away from it.
+const uint32 kStartTime = 1000000;
+
+// One direction of an emulated link: a bottleneck of 'rate' bytes per ms with
+// a drop-tail queue of 'queue_size' bytes, then a fixed delay.  'loss' in
+// 10000 packets are also dropped at random, the same ones in every run.  With
+// aggregation, packets are delivered together every 'aggregate' ms.  Packets
+// sent in the same ms count as one burst.  Times are in ms since the transfer
+// started.
+class BenchmarkPath {
+ public:
+  BenchmarkPath(uint32 rate, uint32 delay, uint32 queue_size, uint32 loss,
+                uint32 seed)
+      : rate_(rate), delay_(delay), queue_size_(queue_size), loss_(loss),
+        random_(seed), aggregate_(0), busy_until_(0), sent_(0), dropped_(0),
+        burst_time_(0), burst_(0), max_burst_(0), max_queued_(0),
+        total_queued_(0) {
+  }
+
+  void SetAggregation(uint32 aggregate) {
+    aggregate_ = aggregate;
+  }
+
+  void Send(const char* data, size_t len, uint32 now) {
+    ++sent_;
+    if (now != burst_time_) {
+      burst_time_ = now;
+      burst_ = 0;
+    }
+    max_burst_ = talk_base::_max(max_burst_, ++burst_);
+    bool lost = (Random() % 10000 < loss_);
+
+    // Times are in microseconds here, a packet takes less than a ms
+    uint64 now_us = static_cast<uint64>(now) * 1000;
+    if (busy_until_ < now_us)
+      busy_until_ = now_us;
+    uint64 queued = (busy_until_ - now_us) * rate_ / 1000;
+    if (lost || (queued + len > queue_size_)) {
+      ++dropped_;
+      return;
+    }
+    busy_until_ += static_cast<uint64>(len) * 1000 / rate_;
+    max_queued_ = talk_base::_max(max_queued_,
+                                  static_cast<uint32>(queued + len));
+    total_queued_ += queued;
+
+    packets_.push_back(Packet());
+    uint32 arrival = static_cast<uint32>((busy_until_ + 999) / 1000) + delay_;
+    if (aggregate_ > 0)
+      arrival = (arrival + aggregate_ - 1) / aggregate_ * aggregate_;
+    packets_.back().arrival = arrival;
+    packets_.back().data.assign(data, len);
+  }
+
+  bool NextArrival(uint32* time) const {
+    if (packets_.empty())
+      return false;
+    *time = packets_.front().arrival;
+    return true;
+  }
+
+  bool Receive(uint32 now, std::string* data) {
+    if (packets_.empty()
+        || (talk_base::TimeDiff(packets_.front().arrival, now) > 0))
+      return false;
+    data->swap(packets_.front().data);
+    packets_.pop_front();
+    return true;
+  }
+
+  uint32 sent() const { return sent_; }
+  uint32 dropped() const { return dropped_; }
+  // Most packets sent at once, and most bytes queued at the bottleneck
+  uint32 max_burst() const { return max_burst_; }
+  uint32 max_queued() const { return max_queued_; }
+  // Bytes a packet which made it found queued ahead of it, on average
+  uint32 mean_queued() const {
+    uint32 queued = sent_ - dropped_;
+    return queued ? static_cast<uint32>(total_queued_ / queued) : 0;
+  }
+
+ private:
+  struct Packet {
+    uint32 arrival;
+    std::string data;
+  };
+
+  uint32 Random() {
+    random_ = random_ * 1103515245 + 12345;
+    return (random_ >> 16) & 0x7FFF;
+  }
+
+  uint32 rate_, delay_, queue_size_, loss_;
+  uint32 random_;
+  uint32 aggregate_;
+  uint64 busy_until_;
+  std::deque<Packet> packets_;
+  uint32 sent_, dropped_;
+  uint32 burst_time_, burst_, max_burst_, max_queued_;
+  uint64 total_queued_;
+};
+
+// A connection over a pair of paths, on the virtual clock 'clock'.  The client
+// sends a counting pattern as fast as the connection takes it, the server
+// reads it as soon as it arrives, and checks it.
+class BenchmarkConnection : public IPseudoTcpNotify {
+ public:
+  BenchmarkConnection(const std::string& name, const uint32* clock,
+                      uint32 rate, uint32 rtt, uint32 queue_size, uint32 loss)
+      : clock_(clock), name_(name), client_(this, 1), server_(this, 1),
+        up_(rate, rtt / 2, queue_size, loss, 1),
+        down_(rate, rtt / 2, queue_size, loss, 2),
+        start_(0), duration_(0), sent_(0), received_(0), errors_(0),
+        closed_(false) {
+    for (size_t i = 0; i < sizeof(pattern_); ++i) {
+      pattern_[i] = static_cast<char>(i);
+    }
+  }
+
+  // Fixed buffers of the given receive buffer size on both sides.
+  void SetBufferSize(uint32 size) {
+    PseudoTcp* tcps[] = { &client_, &server_ };
+    for (size_t i = 0; i < ARRAY_SIZE(tcps); ++i) {
+      tcps[i]->SetOption(PseudoTcp::OPT_RCVBUF, size);
+      tcps[i]->SetOption(PseudoTcp::OPT_MAX_RCVBUF, size);
+      tcps[i]->SetOption(PseudoTcp::OPT_SNDBUF, size + size / 2);
+      tcps[i]->SetOption(PseudoTcp::OPT_MAX_SNDBUF, size + size / 2);
+    }
+  }
+
+  void SetCongestionControl(PseudoTcp::CongestionControl cc) {
+    client_.SetOption(PseudoTcp::OPT_CONGESTION_CONTROL, cc);
+    server_.SetOption(PseudoTcp::OPT_CONGESTION_CONTROL, cc);
+  }
+
+  void SetPacing(bool pacing) {
+    client_.SetOption(PseudoTcp::OPT_PACING, pacing);
+    server_.SetOption(PseudoTcp::OPT_PACING, pacing);
+  }
+
+  // The acks of the transfer come back every 'aggregate' ms
+  void SetAckAggregation(uint32 aggregate) {
+    down_.SetAggregation(aggregate);
+  }
+
+  void Start(uint32 now, uint32 duration) {
+    const uint16 kMtu = 1280;
+    start_ = now;
+    duration_ = duration;
+    client_.NotifyMTU(kMtu);
+    server_.NotifyMTU(kMtu);
+    client_.Connect();
+  }
+
+  bool Done(uint32 now) const {
+    return closed_
+        || (talk_base::TimeDiff(now, start_) >= static_cast<int32>(duration_));
+  }
+
+  // Delivers the packets which arrived, lets both sides send and receive,
+  // and returns when it needs to run again, always later than now.
+  uint32 Step(uint32 now) {
+    uint32 elapsed = now - start_;
+    while (up_.Receive(elapsed, &packet_)) {
+      server_.NotifyPacket(packet_.data(), packet_.size());
+    }
+    while (down_.Receive(elapsed, &packet_)) {
+      client_.NotifyPacket(packet_.data(), packet_.size());
+    }
+    client_.NotifyClock(now);
+    server_.NotifyClock(now);
+
+    while (client_.State() == PseudoTcp::TCP_ESTABLISHED) {
+      int written = client_.Send(pattern_ + sent_ % 256, sizeof(buffer_));
+      if (written <= 0)
+        break;
+      sent_ += written;
+    }
+    int read;
+    while ((read = server_.Recv(buffer_, sizeof(buffer_))) > 0) {
+      for (int i = 0; i < read; ++i) {
+        if (buffer_[i] != static_cast<char>(received_ + i))
+          ++errors_;
+      }
+      received_ += read;
+    }
+
+    uint32 next = start_ + duration_;
+    long timeout;
+    uint32 arrival;
+    if (client_.GetNextClock(now, timeout)
+        && (talk_base::TimeDiff(now + timeout, next) < 0))
+      next = now + timeout;
+    if (server_.GetNextClock(now, timeout)
+        && (talk_base::TimeDiff(now + timeout, next) < 0))
+      next = now + timeout;
+    if (up_.NextArrival(&arrival)
+        && (talk_base::TimeDiff(start_ + arrival, next) < 0))
+      next = start_ + arrival;
+    if (down_.NextArrival(&arrival)
+        && (talk_base::TimeDiff(start_ + arrival, next) < 0))
+      next = start_ + arrival;
+    if (talk_base::TimeDiff(next, now) <= 0)
+      next = now + 1;
+    return next;
+  }
+
+  virtual void OnTcpOpen(PseudoTcp* tcp) {
+  }
+  virtual void OnTcpReadable(PseudoTcp* tcp) {
+  }
+  virtual void OnTcpWriteable(PseudoTcp* tcp) {
+  }
+  virtual void OnTcpClosed(PseudoTcp* tcp, uint32 error) {
+    LOG(LS_WARNING) << "BenchmarkConnection - " << name_
+                    << " closed, error: " << error;
+    closed_ = true;
+  }
+  virtual WriteResult TcpWritePacket(PseudoTcp* tcp, const char* buffer,
+                                     size_t len) {
+    BenchmarkPath* path = (tcp == &client_) ? &up_ : &down_;
+    path->Send(buffer, len, *clock_ - start_);
+    return WR_SUCCESS;
+  }
+  virtual uint32 TcpNow(PseudoTcp* tcp) {
+    return *clock_;
+  }
+
+ private:
+  // Set before client_ and server_, which read the time when they are built
+  const uint32* clock_;
+
+ public:
+  std::string name_;
+  PseudoTcp client_, server_;
+  BenchmarkPath up_, down_;
+  uint32 start_, duration_;
+  uint32 sent_, received_, errors_;
+  bool closed_;
+
+ private:
+  // The pattern repeats every 256 bytes, so any offset is in here
+  char pattern_[16 * 1024 + 256];
+  char buffer_[16 * 1024];
+  std::string packet_;
+};
+
+// Runs the transfers side by side until all of them are done.  Events are the
+// times, in ms since the start, at which a transfer runs again.  Ties go to
+// the transfer added first.
+void RunAll(const std::vector<BenchmarkConnection*>& connections,
+            uint32* clock, uint32 duration) {
+  typedef std::pair<uint32, size_t> Event;
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event> > events;
+
+  *clock = kStartTime;
+  for (size_t i = 0; i < connections.size(); ++i) {
+    connections[i]->Start(*clock, duration);
+    events.push(Event(0, i));
+  }
+  while (!events.empty()) {
+    Event event = events.top();
+    events.pop();
+    *clock = kStartTime + event.first;
+    BenchmarkConnection* connection = connections[event.second];
+    if (connection->Done(*clock))
+      continue;
+    uint32 next = connection->Step(*clock);
+    events.push(Event(next - kStartTime, event.second));
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc > 2) {
+    std::cerr << "usage: pseudotcp_benchmark [seconds]" << std::endl;
+    return 1;
+  }
+  talk_base::LogMessage::LogToDebug(talk_base::LS_WARNING);
+
+  // Read by the connections as their current time
+  uint32 clock = kStartTime;
+
+  // 10 Mbps, with a queue of 100 ms
+  const uint32 kRate = 1250;
+  const uint32 kQueueSize = kRate * 100;
+  const uint32 kDuration = 1000 * ((argc > 1) ? atoi(argv[1]) : 20);
+  const uint32 kRtts[] = { 50, 200, 400 };
+  // In 10000 packets
+  const uint32 kLosses[] = { 0, 10, 100 };
+  // Fixed receive buffer sizes (PseudoTcp's default size), 0 for auto-tuning
+  const uint32 kBuffers[] = { 60 * 1024, 0 };
+  const PseudoTcp::CongestionControl kControls[] = {
+    PseudoTcp::CC_RENO, PseudoTcp::CC_CUBIC, PseudoTcp::CC_BBR
+  };
+  const char* const kControlNames[] = { "reno", "cubic", "bbr" };
+
+  std::vector<BenchmarkConnection*> connections;
+  for (size_t i = 0; i < ARRAY_SIZE(kRtts); ++i) {
+    for (size_t j = 0; j < ARRAY_SIZE(kLosses); ++j) {
+      for (size_t k = 0; k < ARRAY_SIZE(kBuffers); ++k) {
+        for (size_t l = 0; l < ARRAY_SIZE(kControls); ++l) {
+          std::ostringstream name;
+          name << "rtt " << kRtts[i] << " ms, loss " << kLosses[j] / 100.0
+               << "%, buffer ";
+          if (kBuffers[k]) {
+            name << kBuffers[k] / 1024;
+          } else {
+            name << "auto";
+          }
+          name << ", " << kControlNames[l];
+          BenchmarkConnection* connection = new BenchmarkConnection(
+              name.str(), &clock, kRate, kRtts[i], kQueueSize, kLosses[j]);
+          if (kBuffers[k])
+            connection->SetBufferSize(kBuffers[k]);
+          connection->SetCongestionControl(kControls[l]);
+          connections.push_back(connection);
+        }
+      }
+    }
+  }
+  size_t nSweep = connections.size();
+
+  // Bursts and the losses they cause at a bottleneck with a short queue,
+  // with and without pacing, acks coming back every 10 ms
+  const uint32 kShortQueueSize = kRate * 20;
+  const uint32 kAckAggregation = 10;
+  for (size_t i = 0; i < ARRAY_SIZE(kRtts); ++i) {
+    for (size_t l = 0; l < ARRAY_SIZE(kControls); ++l) {
+      for (int pacing = 0; pacing <= 1; ++pacing) {
+        std::ostringstream name;
+        name << "rtt " << kRtts[i] << " ms, queue "
+             << kShortQueueSize / kRate << " ms, acks every "
+             << kAckAggregation << " ms, " << kControlNames[l]
+             << (pacing ? ", paced" : "");
+        BenchmarkConnection* connection = new BenchmarkConnection(
+            name.str(), &clock, kRate, kRtts[i], kShortQueueSize, 0);
+        connection->SetCongestionControl(kControls[l]);
+        connection->SetPacing(pacing != 0);
+        connection->SetAckAggregation(kAckAggregation);
+        connections.push_back(connection);
+      }
+    }
+  }
+
+  RunAll(connections, &clock, kDuration);
+
+  for (size_t i = 0; i < connections.size(); ++i) {
+    BenchmarkConnection* connection = connections[i];
+    std::cout << connection->name_ << ": "
+              << connection->received_ / kDuration << " KB/s, "
+              << connection->up_.dropped() << "/" << connection->up_.sent()
+              << " packets dropped, " << connection->errors_
+              << " bad bytes, largest burst " << connection->up_.max_burst()
+              << " packets";
+    if (i < nSweep) {
+      int rcvbuf, sndbuf;
+      connection->server_.GetOption(PseudoTcp::OPT_RCVBUF, &rcvbuf);
+      connection->client_.GetOption(PseudoTcp::OPT_SNDBUF, &sndbuf);
+      PseudoTcp::Stats stats;
+      connection->client_.GetStats(&stats);
+      std::cout << ", receive/send buffer " << rcvbuf / 1024 << "/"
+                << sndbuf / 1024 << " KB, cwnd " << stats.cwnd / 1024
+                << " KB, srtt " << stats.srtt << "/" << stats.rttvar
+                << " ms, " << stats.retransmits << " retransmits, pacing "
+                << stats.pacing_rate / 1024 << " KB/s";
+    } else {
+      std::cout << ", queue mean/peak " << connection->up_.mean_queued() / 1024
+                << "/" << connection->up_.max_queued() / 1024 << " KB";
+    }
+    std::cout << std::endl;
+    delete connection;
+  }
+  return 0;
+}
@@ -0,0 +1,350 @@
+/*
+ * libjingle
+ * Copyright 2004--2005, Google Inc.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Counts the bytes copied inside PseudoTcp's send and receive buffers, per
+// byte delivered, for the two ways of storing them:
+//
+// - flat: arrays, as PseudoTcp kept them before.  Every ack moves the rest of
+//   the send buffer to the front, every read the rest of the receive buffer.
+// - ring: talk_base::FifoBuffer, as PseudoTcp keeps them now.  Acks and reads
+//   only move the read position.
+//
+// Both run the same transfer: the application keeps the send buffer full,
+// segments go out as the window allows, every second segment is acked, and
+// the application reads what arrives right away.  Lost segments come back
+// three segments later, the others held out of order meanwhile.  Copies into
+// and out of the buffers (the application's data, packets) are counted too,
+// so a ring ends up at 2 per byte on each side, plus retransmits.
+
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "talk/base/basictypes.h"
+#include "talk/base/common.h"
+#include "talk/base/stream.h"
+
+namespace {
+
+// Segment size of a 1280 byte MTU
+const uint32 kMss = 1280 - 80;
+// Application writes and reads
+const uint32 kChunkSize = 16 * 1024;
+
+// The buffers of one connection, sender and receiver side.  Offsets of sent
+// data are from the first unacked byte, offsets of received data from the
+// next byte expected.
+class BufferLayout {
+ public:
+  BufferLayout() : moved_(0) {}
+  virtual ~BufferLayout() {}
+
+  // Stores what fits of len bytes the application writes, returns how much.
+  virtual size_t Write(const char* data, size_t len) = 0;
+  // Copies len bytes at offset into a packet.
+  virtual void Send(char* packet, size_t offset, size_t len) = 0;
+  // Drops len acked bytes.
+  virtual void Ack(size_t len) = 0;
+  // Stores a segment which arrived offset bytes ahead of the next expected.
+  virtual void Receive(const char* data, size_t len, size_t offset) = 0;
+  // Makes len bytes, received in order, readable.
+  virtual void Commit(size_t len) = 0;
+  // Reads up to len bytes, returns how many.
+  virtual size_t Read(char* buffer, size_t len) = 0;
+
+  uint64 moved() const { return moved_; }
+
+ protected:
+  uint64 moved_;
+};
+
+class FlatLayout : public BufferLayout {
+ public:
+  FlatLayout(size_t sbuf_len, size_t rbuf_len)
+      : sbuf_(new char[sbuf_len]), sbuf_len_(sbuf_len), slen_(0),
+        rbuf_(new char[rbuf_len]), rlen_(0), rused_(0) {
+  }
+
+  virtual size_t Write(const char* data, size_t len) {
+    len = talk_base::_min(len, sbuf_len_ - slen_);
+    memcpy(sbuf_.get() + slen_, data, len);
+    slen_ += len;
+    moved_ += len;
+    return len;
+  }
+  virtual void Send(char* packet, size_t offset, size_t len) {
+    memcpy(packet, sbuf_.get() + offset, len);
+    moved_ += len;
+  }
+  virtual void Ack(size_t len) {
+    slen_ -= len;
+    memmove(sbuf_.get(), sbuf_.get() + len, slen_);
+    moved_ += slen_;
+  }
+  virtual void Receive(const char* data, size_t len, size_t offset) {
+    memcpy(rbuf_.get() + rlen_ + offset, data, len);
+    rused_ = talk_base::_max(rused_, rlen_ + offset + len);
+    moved_ += len;
+  }
+  virtual void Commit(size_t len) {
+    rlen_ += len;
+  }
+  virtual size_t Read(char* buffer, size_t len) {
+    len = talk_base::_min(len, rlen_);
+    memcpy(buffer, rbuf_.get(), len);
+    // Everything held after it moves up, out of order segments included
+    size_t used = talk_base::_max(rlen_, rused_);
+    memmove(rbuf_.get(), rbuf_.get() + len, used - len);
+    rlen_ -= len;
+    rused_ = used - len;
+    moved_ += len + used - len;
+    return len;
+  }
+
+ private:
+  talk_base::scoped_array<char> sbuf_;
+  size_t sbuf_len_, slen_;
+  talk_base::scoped_array<char> rbuf_;
+  size_t rlen_, rused_;
+};
+
+class RingLayout : public BufferLayout {
+ public:
+  RingLayout(size_t sbuf_len, size_t rbuf_len)
+      : sbuf_(sbuf_len, NULL), rbuf_(rbuf_len, NULL) {
+  }
+
+  virtual size_t Write(const char* data, size_t len) {
+    size_t written = 0;
+    sbuf_.Write(data, len, &written, NULL);
+    moved_ += written;
+    return written;
+  }
+  virtual void Send(char* packet, size_t offset, size_t len) {
+    size_t read = 0;
+    sbuf_.ReadOffset(packet, len, offset, &read);
+    ASSERT(read == len);
+    moved_ += read;
+  }
+  virtual void Ack(size_t len) {
+    sbuf_.ConsumeReadData(len);
+  }
+  virtual void Receive(const char* data, size_t len, size_t offset) {
+    size_t written = 0;
+    rbuf_.WriteOffset(data, len, offset, &written);
+    ASSERT(written == len);
+    moved_ += written;
+  }
+  virtual void Commit(size_t len) {
+    rbuf_.ConsumeWriteBuffer(len);
+  }
+  virtual size_t Read(char* buffer, size_t len) {
+    size_t read = 0;
+    if (rbuf_.Read(buffer, len, &read, NULL) != talk_base::SR_SUCCESS)
+      return 0;
+    moved_ += read;
+    return read;
+  }
+
+ private:
+  talk_base::FifoBuffer sbuf_, rbuf_;
+};
+
+struct Segment {
+  uint32 seq;
+  std::string data;
+};
+
+struct Result {
+  uint64 delivered;
+  uint64 moved;
+  uint32 retransmits;
+  uint32 errors;
+};
+
+// Transfers total bytes through layout, with a receive buffer (and window) of
+// rbuf_len bytes.  'loss' in 10000 segments are lost, the same ones in every
+// run, one at a time.
+void Transfer(BufferLayout* layout, uint32 rbuf_len, uint64 total,
+              uint32 loss, Result* result) {
+  char pattern[kChunkSize + 256];
+  for (size_t i = 0; i < sizeof(pattern); ++i) {
+    pattern[i] = static_cast<char>(i);
+  }
+  char buffer[kChunkSize];
+  char packet[kMss];
+
+  uint32 random = 1;
+  uint64 written = 0;
+  uint32 snd_una = 0, snd_nxt = 0;
+  uint32 rcv_nxt = 0, unacked = 0;
+  // Bytes in order, not read yet
+  uint32 rlen = 0;
+  std::deque<Segment> network;
+  // The segment lost, and the ones held out of order behind it
+  bool lost = false, resent = false;
+  uint32 lost_seq = 0, lost_len = 0, dup_acks = 0;
+  uint32 held_len = 0;
+
+  memset(result, 0, sizeof(*result));
+  while (result->delivered < total) {
+    // The application fills the send buffer, segments go out as the window
+    // allows
+    size_t len;
+    while ((written < total)
+           && ((len = layout->Write(pattern + written % 256,
+                talk_base::_min<uint64>(kChunkSize, total - written))) > 0)) {
+      written += len;
+    }
+    while (snd_nxt < written) {
+      uint32 nLen = static_cast<uint32>(
+          talk_base::_min<uint64>(kMss, written - snd_nxt));
+      if (snd_nxt - snd_una + nLen > rbuf_len - rlen)
+        break;
+      layout->Send(packet, snd_nxt - snd_una, nLen);
+      network.push_back(Segment());
+      network.back().seq = snd_nxt;
+      network.back().data.assign(packet, nLen);
+      snd_nxt += nLen;
+    }
+
+    // The lost segment goes out again after three duplicate acks, or when
+    // nothing else is left in flight (a timeout)
+    if (lost && !resent && ((dup_acks >= 3) || network.empty())) {
+      layout->Send(packet, lost_seq - snd_una, lost_len);
+      network.push_front(Segment());
+      network.front().seq = lost_seq;
+      network.front().data.assign(packet, lost_len);
+      resent = true;
+      ++result->retransmits;
+    }
+
+    // One segment arrives, or is lost
+    ASSERT(!network.empty());
+    Segment segment;
+    segment.seq = network.front().seq;
+    segment.data.swap(network.front().data);
+    network.pop_front();
+    uint32 nLen = static_cast<uint32>(segment.data.size());
+    random = random * 1103515245 + 12345;
+    if (!lost && (((random >> 16) & 0x7FFF) % 10000 < loss)) {
+      lost = true;
+      resent = false;
+      lost_seq = segment.seq;
+      lost_len = nLen;
+      dup_acks = 0;
+      continue;
+    }
+
+    layout->Receive(segment.data.data(), nLen, segment.seq - rcv_nxt);
+    if (segment.seq != rcv_nxt) {
+      // Held out of order, and acked right away
+      held_len += nLen;
+      ++dup_acks;
+      continue;
+    }
+
+    uint32 nCommit = nLen;
+    if (lost) {
+      // The segments held are in order now, acked right away
+      lost = false;
+      nCommit += held_len;
+      held_len = 0;
+      unacked = 1;
+    }
+    layout->Commit(nCommit);
+    rcv_nxt += nCommit;
+    rlen += nCommit;
+    if (++unacked >= 2) {
+      layout->Ack(rcv_nxt - snd_una);
+      snd_una = rcv_nxt;
+      unacked = 0;
+    }
+
+    // The application reads what is in order
+    size_t read;
+    while ((read = layout->Read(buffer, sizeof(buffer))) > 0) {
+      for (size_t i = 0; i < read; ++i) {
+        if (buffer[i] != static_cast<char>(result->delivered + i))
+          ++result->errors;
+      }
+      result->delivered += read;
+      rlen -= static_cast<uint32>(read);
+    }
+  }
+  result->moved = layout->moved();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc > 2) {
+    std::cerr << "usage: pseudotcp_copy_benchmark [megabytes]" << std::endl;
+    return 1;
+  }
+  const uint64 kTotal = 1024 * 1024 * static_cast<uint64>(
+      (argc > 1) ? atoi(argv[1]) : 64);
+  // PseudoTcp's default receive buffer, and auto-tuned ones up to its limit.
+  // The send buffer is half as large again.
+  const uint32 kBuffers[] = { 60 * 1024, 256 * 1024, 1024 * 1024 };
+  // In 10000 segments
+  const uint32 kLosses[] = { 0, 100 };
+
+  std::cout << "buffer   loss   flat  ring  (bytes moved per byte delivered)"
+            << std::endl;
+  for (size_t i = 0; i < ARRAY_SIZE(kBuffers); ++i) {
+    for (size_t j = 0; j < ARRAY_SIZE(kLosses); ++j) {
+      uint32 sbuf_len = kBuffers[i] + kBuffers[i] / 2;
+      FlatLayout flat(sbuf_len, kBuffers[i]);
+      RingLayout ring(sbuf_len, kBuffers[i]);
+      Result flat_result, ring_result;
+      Transfer(&flat, kBuffers[i], kTotal, kLosses[j], &flat_result);
+      Transfer(&ring, kBuffers[i], kTotal, kLosses[j], &ring_result);
+      if (flat_result.errors || ring_result.errors) {
+        std::cerr << "bad bytes: " << flat_result.errors << " flat, "
+                  << ring_result.errors << " ring" << std::endl;
+        return 1;
+      }
+      std::cout << std::setw(4) << kBuffers[i] / 1024 << " KB "
+                << std::setw(4) << kLosses[j] / 100.0 << "% "
+                << std::fixed << std::setprecision(1)
+                << std::setw(6)
+                << static_cast<double>(flat_result.moved)
+                   / flat_result.delivered
+                << std::setw(6)
+                << static_cast<double>(ring_result.moved)
+                   / ring_result.delivered
+                << "  (" << ring_result.retransmits << " retransmits)"
+                << std::endl;
+      std::cout.unsetf(std::ios::fixed);
+    }
+  }
+  return 0;
+}
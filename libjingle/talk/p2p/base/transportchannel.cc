@@ -39,6 +39,16 @@ std::string TransportChannel::ToString() const {
   return ss.str();
 }
 
+int TransportChannel::SendPackets(const char *data, const size_t *lens,
+                                  int count) {
+  for (int i = 0; i < count; ++i) {
+    if (SendPacket(data, lens[i]) < 0)
+      return i;
+    data += lens[i];
+  }
+  return count;
+}
+
 void TransportChannel::set_readable(bool readable) {
   if (readable_ != readable) {
     readable_ = readable;
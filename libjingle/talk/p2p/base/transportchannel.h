@@ -61,6 +61,11 @@ class TransportChannel: public sigslot::has_slots<> {
   // Attempts to send the given packet.  The return value is < 0 on failure.
   virtual int SendPacket(const char *data, size_t len) = 0;
 
+  // Attempts to send count packets, stored back to back in data, with the
+  // given lengths.  Returns how many were sent; GetError tells why the next
+  // one wasn't.  By default they go one at a time through SendPacket.
+  virtual int SendPackets(const char *data, const size_t *lens, int count);
+
   // Sets a socket option on this channel.  Note that not all options are
   // supported by all transport types.
   virtual int SetOption(talk_base::Socket::Option opt, int value) = 0;
@@ -63,6 +63,11 @@ int TransportChannelProxy::SendPacket(const char *data, size_t len) {
   return (impl_) ? impl_->SendPacket(data, len) : -1;
 }
 
+int TransportChannelProxy::SendPackets(const char *data, const size_t *lens,
+                                       int count) {
+  return (impl_) ? impl_->SendPackets(data, lens, count) : 0;
+}
+
 int TransportChannelProxy::SetOption(talk_base::Socket::Option opt, int value) {
   if (impl_)
     return impl_->SetOption(opt, value);
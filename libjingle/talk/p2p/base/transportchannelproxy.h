@@ -53,6 +53,7 @@ class TransportChannelProxy: public TransportChannel {
   // Implementation of the TransportChannel interface.  These simply forward to
   // the implementation.
   virtual int SendPacket(const char *data, size_t len);
+  virtual int SendPackets(const char *data, const size_t *lens, int count);
   virtual int SetOption(talk_base::Socket::Option opt, int value);
   virtual int GetError();
   virtual P2PTransportChannel* GetP2PChannel();
@@ -17,14 +17,27 @@ extern "C"
 
 #include "VueceLogger.h"
 #include "VueceConstants.h"
+#include "VueceThreadUtil.h"
 
 #include "VueceAACDecoder.h"
+#include "VueceFrameRing.h"
+#include "VueceJitterController.h"
 
 VueceAACDecoder::VueceAACDecoder()
 {
 	VueceLogger::Debug("VueceAACDecoder - Constructor called");
 
 	dec_data = NULL;
+	jitter = NULL;
+
+	memset(decode_hist, 0, sizeof(decode_hist));
+	frame_count = 0;
+	batch_count = 0;
+	max_batch_size = 0;
+	staged_in_count = 0;
+	staged_out_count = 0;
+	total_decode_us = 0;
+	max_decode_us = 0;
 }
 
 
@@ -40,6 +53,7 @@ void VueceAACDecoder::Uninit()
 	if(dec_data != NULL)
 	{
 		av_free(dec_data->outbuf);
+		av_free(dec_data->inbuf);
 		avcodec_close(dec_data->pCodecCtx);
 
 		free(dec_data);
@@ -61,12 +75,14 @@ bool VueceAACDecoder::Init(int sample_rate, int bit_rate, int channel_num)
 	dec_data->pCodecCtx = NULL;
 	dec_data->pCodec = NULL;
 	dec_data->outbuf = NULL;
+	dec_data->inbuf = NULL;
 	dec_data->decoded_raw_pkt_size = 0;
 	dec_data->buf_count = 0;
 
 	VueceAACDecData* d = dec_data;
 
 	d->outbuf =(int16_t*)av_malloc(AVCODEC_MAX_AUDIO_FRAME_SIZE);
+	d->inbuf =(uint8_t*)av_mallocz(VUECE_MAX_FRAME_SIZE + FF_INPUT_BUFFER_PADDING_SIZE);
 
 	// Register all formats and codecs
 	av_register_all();
@@ -127,6 +143,11 @@ bool VueceAACDecoder::Init(int sample_rate, int bit_rate, int channel_num)
 
 }
 
+void VueceAACDecoder::SetJitterController(VueceJitterController* j)
+{
+	jitter = j;
+}
+
 void VueceAACDecoder::set_num_channels(int channels){
 
 	VueceAACDecData* d = dec_data;
@@ -156,68 +177,182 @@ void VueceAACDecoder::set_num_channels(int channels){
 }
 
 
-void VueceAACDecoder::Process(VueceMemQueue* in_q, VueceMemQueue* out_q)
+void VueceAACDecoder::RecordDecodeTime(int us)
+{
+	int i = 0;
+	int bound = VUECE_DECODE_HIST_MIN_US;
+
+	while(i < VUECE_DECODE_HIST_BUCKETS - 1 && us >= bound)
+	{
+		i++;
+		bound <<= 1;
+	}
+
+	decode_hist[i]++;
+
+	total_decode_us += us;
+
+	if(us > max_decode_us)
+	{
+		max_decode_us = us;
+	}
+}
+
+void VueceAACDecoder::LogStats()
 {
+	int i = 0;
+	int bound = VUECE_DECODE_HIST_MIN_US;
 
-	VueceMemBulk 	*im,*om;
+	if(frame_count == 0 || batch_count == 0)
+	{
+		VueceLogger::Info("VUECE AAC DECODER - Stats: no frame decoded");
+		return;
+	}
+
+	VueceLogger::Info("VUECE AAC DECODER - Stats: %ld frames in %ld batches (avg %ld, max %d), avg decode %lld us, max %d us, staged input %ld, staged output %ld",
+			frame_count, batch_count, frame_count / batch_count, max_batch_size,
+			(long long)(total_decode_us / frame_count), max_decode_us, staged_in_count, staged_out_count);
+
+	for(i = 0; i < VUECE_DECODE_HIST_BUCKETS - 1; i++)
+	{
+		VueceLogger::Info("VUECE AAC DECODER - Stats: decode time < %5d us: %ld", bound, decode_hist[i]);
+		bound <<= 1;
+	}
+
+	VueceLogger::Info("VUECE AAC DECODER - Stats: decode time >= %4d us: %ld", VUECE_DECODE_HIST_MAX_US, decode_hist[i]);
+}
+
+/*
+ * All queued frames that fit into output ring are decoded in one batch. Encoded frames are decoded in place (ring storage has tail padding for
+ * frames ending at the end of storage) and PCM data is written straight into
+ * output ring which is read by audio writer, so PCM is copied only once on its
+ * way to the audio sink.
+ *
+ * Staging buffers are only used for an input frame wrapped around the end of
+ * input ring, or if there is not enough contiguous space at the end of output ring.
+ */
+void VueceAACDecoder::Process(VueceFrameRing* in_r, VueceFrameRing* out_r)
+{
+	VueceRingSpan 	in_spans[2];
+	VueceRingSpan 	out_spans[2];
+	VueceTimeSpec 	t0, t1;
+	uint8_t 		*in_data;
+	int16_t 		*out_data;
 	int 	nbytes;
 	int 	resultSize, decLen;
+	int 	batch, room, i;
+	int 	dec_us, batch_us = 0;
 
 	VueceAACDecData *d = dec_data;
 
-//	VueceLogger::Debug("VUECE AAC DECODER - Process: Input queue bulk count: %d", in_q->BulkCount());
+	batch = in_r->FrameCount();
+	room = out_r->WritableBytes() / d->decoded_raw_pkt_size;
 
-	if(in_q->IsEmpty())
+	if(batch > room)
 	{
-//		VueceLogger::Debug("VUECE AAC DECODER - Process - Input queue is empty, do nothing and return");
-		return;
+		batch = room;
 	}
 
-	VueceLogger::Debug("VUECE AAC DECODER - Process: Input queue bulk count: %d", in_q->BulkCount());
+	if(batch <= 0)
+	{
+		return;
+	}
 
-	while ( (im = in_q->Remove()) != NULL)
+	for(i = 0; i < batch; i++)
 	{
 		AVPacket pkt;
 
-		nbytes = im->size_orginal;
+		//a frame decoded through outbuf may not leave the space we counted on
+		if(!out_r->HasRoomFor(d->decoded_raw_pkt_size))
+		{
+			break;
+		}
+
+		nbytes = in_r->PeekFrame(in_spans);
 
 		if (nbytes <= 0)
 		{
-			VueceLogger::Fatal("VUECE AAC DECODER - Process - Got a empty iput bulk, sth is wrong");
+			VueceLogger::Fatal("VUECE AAC DECODER - Process - Got a empty iput frame, sth is wrong");
 			return;
 		}
 
-		om = VueceMemQueue::AllocMemBulk(d->decoded_raw_pkt_size);
+		in_data = in_spans[0].data;
+
+		//frame is wrapped, make it contiguous
+		if(in_spans[1].len > 0)
+		{
+			memcpy(d->inbuf, in_spans[0].data, in_spans[0].len);
+			memcpy(d->inbuf + in_spans[0].len, in_spans[1].data, in_spans[1].len);
+			in_data = d->inbuf;
+
+			staged_in_count++;
+		}
+
+		out_r->PeekWrite(out_spans);
+
+		//decode into ring directly if possible, otherwise use outbuf and copy
+		if(out_spans[0].len >= d->decoded_raw_pkt_size)
+		{
+			out_data = (int16_t *)out_spans[0].data;
+		}
+		else
+		{
+			out_data = d->outbuf;
 
-//		VueceLogger::Debug("VUECE AAC DECODER - processing data, size = %d", nbytes);
+			staged_out_count++;
+		}
 
 		av_init_packet(&pkt);
-		pkt.data = (uint8_t *)im->data;
+		pkt.data = in_data;
 		pkt.size = nbytes;
 
 		resultSize = d->decoded_raw_pkt_size;
 
-		decLen = avcodec_decode_audio3(d->pCodecCtx, (int16_t *)om->data, &resultSize, &pkt);
+		VueceThreadUtil::GetCurTime(&t0);
+
+		decLen = avcodec_decode_audio3(d->pCodecCtx, out_data, &resultSize, &pkt);
+
+		VueceThreadUtil::GetCurTime(&t1);
+
+		dec_us = (int)((t1.tv_sec - t0.tv_sec) * 1000000LL + (t1.tv_nsec - t0.tv_nsec) / 1000);
+
+		RecordDecodeTime(dec_us);
+
+		batch_us += dec_us;
+
+		in_r->ReleaseFrame();
 
 		if(decLen <= 0)
 		{
-			VueceMemQueue::FreeMemBulk(om);
 			VueceLogger::Fatal("VUECE AAC DECODER - avcodec_decode_audio3 returned a negative value: %d", decLen);
 			return;
 		}
 
-		om->size_orginal = resultSize;
-		om->end += resultSize;
-
-//		VueceLogger::Debug("VUECE AAC DECODER -  Number of bytes decompressed: %d, result data size: %d ", decLen, resultSize);
-
-		out_q->Put(om);
+		if(resultSize > 0)
+		{
+			if(out_data == d->outbuf)
+			{
+				out_r->WriteFrame((uint8_t *)d->outbuf, resultSize);
+			}
+			else
+			{
+				out_r->CommitFrame(resultSize);
+			}
+		}
 
 		d->buf_count++;
-
-		VueceMemQueue::FreeMemBulk(im);
+		frame_count++;
 	}
-}
 
+	batch_count++;
 
+	if(i > max_batch_size)
+	{
+		max_batch_size = i;
+	}
 
+	if(jitter != NULL)
+	{
+		jitter->OnDecoded(i, batch_us);
+	}
+}
@@ -11,12 +11,23 @@
 
 #include <libavcodec/avcodec.h>
 
-#include "VueceMemQueue.h"
+class VueceFrameRing;
+class VueceJitterController;
+
+/*
+ * Buckets of per-frame decode time histogram, upper bounds in microseconds,
+ * the last bucket takes everything above VUECE_DECODE_HIST_MAX_US
+ */
+#define VUECE_DECODE_HIST_BUCKETS 8
+#define VUECE_DECODE_HIST_MIN_US 125
+#define VUECE_DECODE_HIST_MAX_US (VUECE_DECODE_HIST_MIN_US << (VUECE_DECODE_HIST_BUCKETS - 2))
 
 typedef struct _VueceAACDecData{
 	AVCodecContext  *pCodecCtx;
 	AVCodec * pCodec;
 	int16_t 	*outbuf;
+	//staging buffer for input frames wrapped around the end of input ring
+	uint8_t 	*inbuf;
 	int decoded_raw_pkt_size;
 	int buf_count;
 }VueceAACDecData;
@@ -29,12 +40,26 @@ public:
 	virtual ~VueceAACDecoder();
 
 	bool Init(int sample_rate, int bit_rate, int channel_num);
-	void Process(VueceMemQueue* in_q, VueceMemQueue* out_q);
+	void Process(VueceFrameRing* in_r, VueceFrameRing* out_r);
 	void Uninit();
+	void SetJitterController(VueceJitterController* j);
+	void LogStats();
 
 private:
 	void set_num_channels(int num);
+	void RecordDecodeTime(int us);
 	VueceAACDecData* dec_data;
+	VueceJitterController* jitter;
+
+	//statistics, touched by decoding thread only
+	long decode_hist[VUECE_DECODE_HIST_BUCKETS];
+	long frame_count;
+	long batch_count;
+	int  max_batch_size;
+	long staged_in_count;
+	long staged_out_count;
+	int64_t total_decode_us;
+	int  max_decode_us;
 };
 
 
@@ -0,0 +1,599 @@
+/*
+ * VueceAudioResampler.cc
+ *
+ *  Created on: Mar 30, 2015
+ *      Author: jingjing
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#define VUECE_RESAMPLER_SSE2 1
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VUECE_RESAMPLER_NEON 1
+#endif
+
+#include "VueceLogger.h"
+#include "VueceAudioResampler.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static inline int16_t clip_s16(int32_t v)
+{
+	if(v > 32767)
+	{
+		return 32767;
+	}
+
+	if(v < -32768)
+	{
+		return -32768;
+	}
+
+	return (int16_t)v;
+}
+
+//input position and filter of output index of the period at pos, then moves on to the next output
+static inline int next_output(const VueceAudioResampler::Period* period, int* pos, int* index, const int16_t** coefs)
+{
+	int p = *pos + period->offsets[*index];
+
+	*coefs = period->coefs + *index * VUECE_RESAMPLER_TAPS;
+
+	if(++*index == period->count)
+	{
+		*index = 0;
+		*pos += period->step;
+	}
+
+	return p;
+}
+
+void VueceAudioResampler::FilterScalar(const int16_t* const* src, int channels, int pos, int index,
+		const Period* period, int n, int16_t* out)
+{
+	const int16_t* c = NULL;
+	int p = 0;
+	int i = 0;
+	int ch = 0;
+	int k = 0;
+
+	for(i = 0; i < n; i++)
+	{
+		p = next_output(period, &pos, &index, &c);
+
+		for(ch = 0; ch < channels; ch++)
+		{
+			const int16_t* s = src[ch] + p;
+			int32_t acc = 1 << (VUECE_RESAMPLER_COEF_SHIFT - 1);
+
+			for(k = 0; k < VUECE_RESAMPLER_TAPS; k++)
+			{
+				acc += s[k] * c[k];
+			}
+
+			out[i * channels + ch] = clip_s16(acc >> VUECE_RESAMPLER_COEF_SHIFT);
+		}
+	}
+}
+
+#ifdef VUECE_RESAMPLER_SSE2
+
+static inline __m128i dot16_sse2(const int16_t* s, const int16_t* c)
+{
+	__m128i lo = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)s), _mm_loadu_si128((const __m128i*)c));
+	__m128i hi = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(s + 8)), _mm_loadu_si128((const __m128i*)(c + 8)));
+
+	return _mm_add_epi32(lo, hi);
+}
+
+/*
+ * Four dot products from the sample at s + p of each, with the filter at c of each. Partial
+ * sums are transposed and added so only one horizontal reduction is needed, leaves [a b c d]
+ * rounded and shifted.
+ */
+static inline __m128i dot16x4_sse2(const int16_t* s, const int* p, const int16_t* const* c)
+{
+	const __m128i round = _mm_set1_epi32(1 << (VUECE_RESAMPLER_COEF_SHIFT - 1));
+	__m128i a = dot16_sse2(s + p[0], c[0]);
+	__m128i b = dot16_sse2(s + p[1], c[1]);
+	__m128i d = dot16_sse2(s + p[2], c[2]);
+	__m128i e = dot16_sse2(s + p[3], c[3]);
+
+	//[a0 b0 a1 b1] + [a2 b2 a3 b3] -> [a02 b02 a13 b13]
+	__m128i ab = _mm_add_epi32(_mm_unpacklo_epi32(a, b), _mm_unpackhi_epi32(a, b));
+	__m128i de = _mm_add_epi32(_mm_unpacklo_epi32(d, e), _mm_unpackhi_epi32(d, e));
+
+	__m128i sum = _mm_add_epi32(_mm_unpacklo_epi64(ab, de), _mm_unpackhi_epi64(ab, de));
+
+	return _mm_srai_epi32(_mm_add_epi32(sum, round), VUECE_RESAMPLER_COEF_SHIFT);
+}
+
+/*
+ * Four output frames per iteration, the frames are stored interleaved with one write
+ */
+static void filter_sse2(const int16_t* const* src, int channels, int pos, int index,
+		const VueceAudioResampler::Period* period, int n, int16_t* out)
+{
+	VueceAudioResampler::Period local = *period;
+	const int16_t* l = src[0];
+	const int16_t* r = src[channels - 1];
+	const int16_t* c[4];
+	int p[4];
+	int i = 0;
+
+	for(i = 0; i + 4 <= n; i += 4)
+	{
+		p[0] = next_output(&local, &pos, &index, &c[0]);
+		p[1] = next_output(&local, &pos, &index, &c[1]);
+		p[2] = next_output(&local, &pos, &index, &c[2]);
+		p[3] = next_output(&local, &pos, &index, &c[3]);
+
+		if(channels == 2)
+		{
+			//[l0 l1 l2 l3 r0 r1 r2 r3] -> [l0 r0 l1 r1 l2 r2 l3 r3]
+			__m128i lr = _mm_packs_epi32(dot16x4_sse2(l, p, c), dot16x4_sse2(r, p, c));
+
+			_mm_storeu_si128((__m128i*)(out + 2 * i), _mm_unpacklo_epi16(lr, _mm_srli_si128(lr, 8)));
+		}
+		else
+		{
+			__m128i sum = dot16x4_sse2(l, p, c);
+
+			_mm_storel_epi64((__m128i*)(out + i), _mm_packs_epi32(sum, sum));
+		}
+	}
+
+	VueceAudioResampler::FilterScalar(src, channels, pos, index, period, n - i, out + i * channels);
+}
+
+#endif
+
+#ifdef VUECE_RESAMPLER_NEON
+
+static inline int32x4_t dot16_neon(const int16_t* s, const int16_t* c)
+{
+	int16x8_t s0 = vld1q_s16(s);
+	int16x8_t s1 = vld1q_s16(s + 8);
+	int16x8_t c0 = vld1q_s16(c);
+	int16x8_t c1 = vld1q_s16(c + 8);
+
+	int32x4_t acc = vmull_s16(vget_low_s16(s0), vget_low_s16(c0));
+
+	acc = vmlal_s16(acc, vget_high_s16(s0), vget_high_s16(c0));
+	acc = vmlal_s16(acc, vget_low_s16(s1), vget_low_s16(c1));
+	acc = vmlal_s16(acc, vget_high_s16(s1), vget_high_s16(c1));
+
+	return acc;
+}
+
+//four dot products, pairwise additions leave [a b c d] rounded and narrowed to S16
+static inline int16x4_t dot16x4_neon(const int16_t* s, const int* p, const int16_t* const* c)
+{
+	int32x4_t a = dot16_neon(s + p[0], c[0]);
+	int32x4_t b = dot16_neon(s + p[1], c[1]);
+	int32x4_t d = dot16_neon(s + p[2], c[2]);
+	int32x4_t e = dot16_neon(s + p[3], c[3]);
+
+	int32x2_t ab = vpadd_s32(vpadd_s32(vget_low_s32(a), vget_high_s32(a)), vpadd_s32(vget_low_s32(b), vget_high_s32(b)));
+	int32x2_t de = vpadd_s32(vpadd_s32(vget_low_s32(d), vget_high_s32(d)), vpadd_s32(vget_low_s32(e), vget_high_s32(e)));
+
+	return vqrshrn_n_s32(vcombine_s32(ab, de), VUECE_RESAMPLER_COEF_SHIFT);
+}
+
+static void filter_neon(const int16_t* const* src, int channels, int pos, int index,
+		const VueceAudioResampler::Period* period, int n, int16_t* out)
+{
+	VueceAudioResampler::Period local = *period;
+	const int16_t* l = src[0];
+	const int16_t* r = src[channels - 1];
+	const int16_t* c[4];
+	int p[4];
+	int i = 0;
+
+	for(i = 0; i + 4 <= n; i += 4)
+	{
+		p[0] = next_output(&local, &pos, &index, &c[0]);
+		p[1] = next_output(&local, &pos, &index, &c[1]);
+		p[2] = next_output(&local, &pos, &index, &c[2]);
+		p[3] = next_output(&local, &pos, &index, &c[3]);
+
+		if(channels == 2)
+		{
+			int16x4x2_t lr;
+
+			lr.val[0] = dot16x4_neon(l, p, c);
+			lr.val[1] = dot16x4_neon(r, p, c);
+
+			vst2_s16(out + 2 * i, lr);
+		}
+		else
+		{
+			vst1_s16(out + i, dot16x4_neon(l, p, c));
+		}
+	}
+
+	VueceAudioResampler::FilterScalar(src, channels, pos, index, period, n - i, out + i * channels);
+}
+
+#endif
+
+static int gcd(int a, int b)
+{
+	while(b != 0)
+	{
+		int t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+VueceAudioResampler::VueceAudioResampler()
+{
+	int i = 0;
+
+	in_rate = 0;
+	out_rate = 0;
+	in_channels = 0;
+	out_channels = 0;
+
+	step_int = 1;
+	step_frac = 0;
+	step_den = 1;
+
+	period_coefs = NULL;
+	period_offsets = NULL;
+	memset(&period, 0, sizeof(period));
+
+	for(i = 0; i < VUECE_RESAMPLER_MAX_CHANNELS; i++)
+	{
+		history[i] = NULL;
+	}
+
+	history_len = 0;
+	history_cap = 0;
+
+	pos = 0;
+	index = 0;
+
+	filter = GetFilterFunc();
+}
+
+VueceAudioResampler::~VueceAudioResampler()
+{
+	int i = 0;
+
+	free(period_coefs);
+	free(period_offsets);
+
+	for(i = 0; i < VUECE_RESAMPLER_MAX_CHANNELS; i++)
+	{
+		free(history[i]);
+	}
+}
+
+VueceAudioResampler::FilterFunc VueceAudioResampler::GetFilterFunc()
+{
+#if defined(VUECE_RESAMPLER_SSE2)
+	return filter_sse2;
+#elif defined(VUECE_RESAMPLER_NEON)
+	return filter_neon;
+#else
+	return FilterScalar;
+#endif
+}
+
+const char* VueceAudioResampler::GetKernelName()
+{
+#if defined(VUECE_RESAMPLER_SSE2)
+	return "SSE2";
+#elif defined(VUECE_RESAMPLER_NEON)
+	return "NEON";
+#else
+	return "scalar";
+#endif
+}
+
+bool VueceAudioResampler::Init(int in_rate_, int in_channels_, int out_rate_, int out_channels_)
+{
+	int g = 0;
+
+	if(in_rate_ <= 0 || out_rate_ <= 0
+			|| in_channels_ < 1 || in_channels_ > VUECE_RESAMPLER_MAX_CHANNELS
+			|| out_channels_ < 1 || out_channels_ > VUECE_RESAMPLER_MAX_CHANNELS)
+	{
+		VueceLogger::Error("VueceAudioResampler::Init - Unsupported conversion: %d Hz/%d ch -> %d Hz/%d ch",
+				in_rate_, in_channels_, out_rate_, out_channels_);
+		return false;
+	}
+
+	in_rate = in_rate_;
+	out_rate = out_rate_;
+	in_channels = in_channels_;
+	out_channels = out_channels_;
+
+	g = gcd(in_rate, out_rate);
+
+	step_int = in_rate / out_rate;
+	step_frac = (in_rate % out_rate) / g;
+	step_den = out_rate / g;
+
+	BuildFilterBank();
+
+	Reset();
+
+	VueceLogger::Debug("VueceAudioResampler::Init - %d Hz/%d ch -> %d Hz/%d ch, kernel: %s",
+			in_rate, in_channels, out_rate, out_channels, GetKernelName());
+
+	return true;
+}
+
+/*
+ * Blackman windowed sinc, cut off just below the lower Nyquist frequency of
+ * input and output, each phase is normalized to unity gain in Q14
+ */
+void VueceAudioResampler::BuildFilterBank()
+{
+	double cutoff = 0.5 * 0.95 * (out_rate < in_rate ? (double)out_rate / in_rate : 1.0);
+	double taps[VUECE_RESAMPLER_TAPS];
+	int16_t filters[VUECE_RESAMPLER_PHASES * VUECE_RESAMPLER_TAPS];
+	int p = 0;
+	int k = 0;
+
+	for(p = 0; p < VUECE_RESAMPLER_PHASES; p++)
+	{
+		int16_t* f = filters + p * VUECE_RESAMPLER_TAPS;
+		double sum = 0;
+		int isum = 0;
+		int peak = 0;
+
+		for(k = 0; k < VUECE_RESAMPLER_TAPS; k++)
+		{
+			//distance from the output position, which is between tap TAPS/2-1 and TAPS/2
+			double t = k - (VUECE_RESAMPLER_TAPS / 2 - 1) - (double)p / VUECE_RESAMPLER_PHASES;
+			double x = 2.0 * M_PI * (t / VUECE_RESAMPLER_TAPS + 0.5);
+			double w = 0.42 - 0.5 * cos(x) + 0.08 * cos(2 * x);
+			double s = (t == 0) ? 2 * cutoff : sin(2 * M_PI * cutoff * t) / (M_PI * t);
+
+			taps[k] = (w > 0 ? w : 0) * s;
+			sum += taps[k];
+		}
+
+		for(k = 0; k < VUECE_RESAMPLER_TAPS; k++)
+		{
+			f[k] = (int16_t)floor(taps[k] / sum * (1 << VUECE_RESAMPLER_COEF_SHIFT) + 0.5);
+			isum += f[k];
+
+			if(f[k] > f[peak])
+			{
+				peak = k;
+			}
+		}
+
+		//rounding error goes into the biggest tap
+		f[peak] += (1 << VUECE_RESAMPLER_COEF_SHIFT) - isum;
+	}
+
+	//filter and input offset of each output of a period, stored in output order so the kernels
+	//read them sequentially and neither divide nor branch per output sample, a period has
+	//out_rate / gcd outputs, 160 for 44.1 -> 48 kHz
+	free(period_coefs);
+	free(period_offsets);
+	period_coefs = (int16_t*)malloc(step_den * VUECE_RESAMPLER_TAPS * sizeof(int16_t));
+	period_offsets = (int*)malloc(step_den * sizeof(int));
+
+	for(k = 0; k < step_den; k++)
+	{
+		int64_t at = (int64_t)k * (step_int * step_den + step_frac);
+
+		p = (int)(((at % step_den) * VUECE_RESAMPLER_PHASES) / step_den);
+
+		memcpy(period_coefs + k * VUECE_RESAMPLER_TAPS, filters + p * VUECE_RESAMPLER_TAPS, VUECE_RESAMPLER_TAPS * sizeof(int16_t));
+		period_offsets[k] = (int)(at / step_den);
+	}
+
+	period.coefs = period_coefs;
+	period.offsets = period_offsets;
+	period.count = step_den;
+	period.step = step_int * step_den + step_frac;
+}
+
+void VueceAudioResampler::Reset()
+{
+	int i = 0;
+
+	//history starts with zeros so the first output is aligned with the first input
+	history_len = VUECE_RESAMPLER_TAPS / 2 - 1;
+
+	EnsureCapacity(VUECE_RESAMPLER_TAPS);
+
+	for(i = 0; i < out_channels; i++)
+	{
+		memset(history[i], 0, history_len * sizeof(int16_t));
+	}
+
+	pos = 0;
+	index = 0;
+}
+
+int VueceAudioResampler::GetMaxOutputFrames(int in_frames)
+{
+	if(in_rate == out_rate)
+	{
+		return in_frames;
+	}
+
+	return (int)(((int64_t)(history_len + in_frames) * out_rate) / in_rate) + 2;
+}
+
+bool VueceAudioResampler::EnsureCapacity(int frames)
+{
+	int i = 0;
+
+	if(frames <= history_cap)
+	{
+		return true;
+	}
+
+	for(i = 0; i < out_channels; i++)
+	{
+		//filter kernels may read 16 samples from the last position
+		int16_t* h = (int16_t*)realloc(history[i], (frames + VUECE_RESAMPLER_TAPS) * sizeof(int16_t));
+
+		if(h == NULL)
+		{
+			VueceLogger::Fatal("VueceAudioResampler - Out of memory!");
+			return false;
+		}
+
+		history[i] = h;
+	}
+
+	history_cap = frames;
+
+	return true;
+}
+
+void VueceAudioResampler::AppendInput(const int16_t* in, int in_frames)
+{
+	int16_t* l = history[0] + history_len;
+	int16_t* r = (out_channels > 1) ? history[1] + history_len : NULL;
+	int i = 0;
+
+	if(in_channels == 2 && out_channels == 1)
+	{
+#if defined(VUECE_RESAMPLER_SSE2)
+		const __m128i ones = _mm_set1_epi16(1);
+
+		for(; i + 8 <= in_frames; i += 8)
+		{
+			__m128i a = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(in + 2 * i)), ones);
+			__m128i b = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(in + 2 * i + 8)), ones);
+
+			_mm_storeu_si128((__m128i*)(l + i), _mm_packs_epi32(_mm_srai_epi32(a, 1), _mm_srai_epi32(b, 1)));
+		}
+#elif defined(VUECE_RESAMPLER_NEON)
+		for(; i + 8 <= in_frames; i += 8)
+		{
+			int16x8x2_t lr = vld2q_s16(in + 2 * i);
+
+			vst1q_s16(l + i, vhaddq_s16(lr.val[0], lr.val[1]));
+		}
+#endif
+		for(; i < in_frames; i++)
+		{
+			l[i] = (int16_t)((in[2 * i] + in[2 * i + 1]) >> 1);
+		}
+	}
+	else if(in_channels == 1 && out_channels == 2)
+	{
+		memcpy(l, in, in_frames * sizeof(int16_t));
+		memcpy(r, in, in_frames * sizeof(int16_t));
+	}
+	else if(out_channels == 2)
+	{
+#if defined(VUECE_RESAMPLER_SSE2)
+		//sign extended low and high halves of each 32 bit frame, packed back to 16 bits
+		for(; i + 8 <= in_frames; i += 8)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i*)(in + 2 * i));
+			__m128i b = _mm_loadu_si128((const __m128i*)(in + 2 * i + 8));
+
+			_mm_storeu_si128((__m128i*)(l + i), _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+					_mm_srai_epi32(_mm_slli_epi32(b, 16), 16)));
+			_mm_storeu_si128((__m128i*)(r + i), _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16)));
+		}
+#elif defined(VUECE_RESAMPLER_NEON)
+		for(; i + 8 <= in_frames; i += 8)
+		{
+			int16x8x2_t lr = vld2q_s16(in + 2 * i);
+
+			vst1q_s16(l + i, lr.val[0]);
+			vst1q_s16(r + i, lr.val[1]);
+		}
+#endif
+		for(; i < in_frames; i++)
+		{
+			l[i] = in[2 * i];
+			r[i] = in[2 * i + 1];
+		}
+	}
+	else
+	{
+		memcpy(l, in, in_frames * sizeof(int16_t));
+	}
+
+	history_len += in_frames;
+}
+
+int VueceAudioResampler::Process(const int16_t* in, int in_frames, int16_t* out)
+{
+	int64_t end = 0;
+	int n = 0;
+	int i = 0;
+
+	//channel conversion only
+	if(in_rate == out_rate)
+	{
+		if(in_channels == out_channels)
+		{
+			memcpy(out, in, in_frames * in_channels * sizeof(int16_t));
+		}
+		else if(out_channels == 1)
+		{
+			for(i = 0; i < in_frames; i++)
+			{
+				out[i] = (int16_t)((in[2 * i] + in[2 * i + 1]) >> 1);
+			}
+		}
+		else
+		{
+			for(i = 0; i < in_frames; i++)
+			{
+				out[2 * i] = in[i];
+				out[2 * i + 1] = in[i];
+			}
+		}
+
+		return in_frames;
+	}
+
+	if(!EnsureCapacity(history_len + in_frames))
+	{
+		return 0;
+	}
+
+	AppendInput(in, in_frames);
+
+	//output index + j is at pos + (index + j) * step / step_den, those whose filter fits in the input are computed
+	end = (((int64_t)(history_len - VUECE_RESAMPLER_TAPS - pos + 1)) * period.count + period.step - 1) / period.step;
+	n = (end > index) ? (int)(end - index) : 0;
+
+	//positions and filter phases are shared by all channels
+	filter(history, out_channels, pos, index, &period, n, out);
+
+	pos += ((index + n) / period.count) * period.step;
+	index = (index + n) % period.count;
+
+	//keep what later outputs still need, from the start of the current period
+	if(pos > 0)
+	{
+		for(i = 0; i < out_channels; i++)
+		{
+			memmove(history[i], history[i] + pos, (history_len - pos) * sizeof(int16_t));
+		}
+
+		history_len -= pos;
+		pos = 0;
+	}
+
+	return n;
+}
@@ -0,0 +1,107 @@
+/*
+ * VueceAudioResampler.h
+ *
+ *  Created on: Mar 30, 2015
+ *      Author: jingjing
+ */
+
+#ifndef VUECEAUDIORESAMPLER_H_
+#define VUECEAUDIORESAMPLER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+//number of taps of each polyphase filter, kernels are written for exactly 16 taps
+#define VUECE_RESAMPLER_TAPS 16
+
+//number of fractional positions between two input samples
+#define VUECE_RESAMPLER_PHASES 128
+
+//filter coefficients are Q14 fixed point
+#define VUECE_RESAMPLER_COEF_SHIFT 14
+
+#define VUECE_RESAMPLER_MAX_CHANNELS 2
+
+/*
+ * Sample rate and channel conversion of interleaved S16 PCM, used between the decoder
+ * and the AAC encoder on hub so a track can be transcoded into the sample rate and
+ * channel number negotiated for the session.
+ *
+ * Channels are converted first (stereo is downmixed by averaging, mono is duplicated),
+ * then each channel is filtered with a 16-tap windowed-sinc polyphase filter bank, four
+ * output frames at a time with SSE2 or NEON when available. Filter history is kept
+ * between calls, so a stream can be fed in packets of any size.
+ */
+class VueceAudioResampler
+{
+public:
+	//outputs repeat the same filters and input offsets every step_den outputs, which advance the
+	//input by step_int * step_den + step_frac samples
+	typedef struct Period
+	{
+		//VUECE_RESAMPLER_TAPS coefficients of each output of the period
+		const int16_t* coefs;
+		//input offset of each output from the start of the period
+		const int* offsets;
+		int count;
+		int step;
+	} Period;
+
+	//computes n interleaved output frames of channels planar inputs, starting with output index
+	//of the period which starts at src[c] + pos
+	typedef void (*FilterFunc)(const int16_t* const* src, int channels, int pos, int index,
+			const Period* period, int n, int16_t* out);
+
+	VueceAudioResampler();
+	virtual ~VueceAudioResampler();
+
+	bool Init(int in_rate, int in_channels, int out_rate, int out_channels);
+
+	//max number of frames Process() can produce for in_frames new input frames
+	int GetMaxOutputFrames(int in_frames);
+
+	//returns number of frames written into out, all input is consumed
+	int Process(const int16_t* in, int in_frames, int16_t* out);
+
+	void Reset();
+
+	//kernel used by Process(), the vectorized one when available, and the portable one
+	static FilterFunc GetFilterFunc();
+	static const char* GetKernelName();
+	static void FilterScalar(const int16_t* const* src, int channels, int pos, int index,
+			const Period* period, int n, int16_t* out);
+
+private:
+	void BuildFilterBank();
+	bool EnsureCapacity(int frames);
+	void AppendInput(const int16_t* in, int in_frames);
+
+private:
+	int in_rate;
+	int out_rate;
+	int in_channels;
+	int out_channels;
+
+	//input advance per output sample is step_int + step_frac/step_den
+	int step_int;
+	int step_frac;
+	int step_den;
+
+	//filters of one period of outputs
+	int16_t* period_coefs;
+	int* period_offsets;
+	Period period;
+
+	//planar input of each output channel, starting with filter history
+	int16_t* history[VUECE_RESAMPLER_MAX_CHANNELS];
+	int history_len;
+	int history_cap;
+
+	//next output is output index of the period starting at pos in history
+	int pos;
+	int index;
+
+	FilterFunc filter;
+};
+
+#endif /* VUECEAUDIORESAMPLER_H_ */
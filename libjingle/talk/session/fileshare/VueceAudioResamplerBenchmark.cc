@@ -0,0 +1,221 @@
+/*
+ * VueceAudioResamplerBenchmark.cc
+ *
+ *  Created on: Mar 30, 2015
+ *      Author: jingjing
+ *
+ * Standalone program, not part of the library build. Converts a recorded raw S16 PCM
+ * file with VueceAudioResampler and prints the time it takes. Then runs the filter kernel
+ * Process() uses and the portable one on the same input, prints time of each and checks
+ * both produce the same output.
+ *
+ * Usage: VueceAudioResamplerBenchmark <pcm file> <in rate> <in channels> <out rate> <out channels>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "VueceAudioResampler.h"
+#include "VueceThreadUtil.h"
+
+#define BENCH_CHUNK_FRAMES 1152
+#define BENCH_PASSES 20
+
+static int gcd(int a, int b)
+{
+	while(b != 0)
+	{
+		int t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+/*
+ * Converts the whole file in decoder sized chunks, BENCH_PASSES times, returns elapsed ms
+ */
+static uint64_t RunProcess(const int16_t* pcm, int total_frames, int in_rate, int in_channels,
+		int out_rate, int out_channels, int16_t* out, int* out_frames)
+{
+	uint64_t start = VueceThreadUtil::GetCurTimeMs();
+	int pass = 0;
+	int i = 0;
+
+	for(pass = 0; pass < BENCH_PASSES; pass++)
+	{
+		VueceAudioResampler r;
+
+		if(!r.Init(in_rate, in_channels, out_rate, out_channels))
+		{
+			return 0;
+		}
+
+		*out_frames = 0;
+
+		for(i = 0; i < total_frames; i += BENCH_CHUNK_FRAMES)
+		{
+			int n = (total_frames - i < BENCH_CHUNK_FRAMES) ? (total_frames - i) : BENCH_CHUNK_FRAMES;
+			*out_frames += r.Process(pcm + i * in_channels, n, out + *out_frames * out_channels);
+		}
+	}
+
+	return VueceThreadUtil::GetCurTimeMs() - start;
+}
+
+/*
+ * Runs a kernel over the planar input in chunks of BENCH_CHUNK_FRAMES output frames,
+ * BENCH_PASSES times, returns elapsed ms
+ */
+static uint64_t RunKernel(VueceAudioResampler::FilterFunc filter, const int16_t* const* src, int channels,
+		const VueceAudioResampler::Period* period, int n, int16_t* out)
+{
+	uint64_t start = VueceThreadUtil::GetCurTimeMs();
+	int pass = 0;
+	int done = 0;
+
+	for(pass = 0; pass < BENCH_PASSES; pass++)
+	{
+		for(done = 0; done < n; done += BENCH_CHUNK_FRAMES)
+		{
+			int chunk = (n - done < BENCH_CHUNK_FRAMES) ? (n - done) : BENCH_CHUNK_FRAMES;
+
+			filter(src, channels, (done / period->count) * period->step, done % period->count, period,
+					chunk, out + done * channels);
+		}
+	}
+
+	return VueceThreadUtil::GetCurTimeMs() - start;
+}
+
+int main(int argc, char* argv[])
+{
+	VueceAudioResampler::Period period;
+	int16_t* coefs = NULL;
+	int* offsets = NULL;
+	int16_t* planar[VUECE_RESAMPLER_MAX_CHANNELS] = {NULL, NULL};
+	FILE* f = NULL;
+	int16_t* pcm = NULL;
+	int16_t* out = NULL;
+	int16_t* out_fast = NULL;
+	int16_t* out_ref = NULL;
+	long pcm_len = 0;
+	int in_rate = 0;
+	int in_channels = 0;
+	int out_rate = 0;
+	int out_channels = 0;
+	int total_frames = 0;
+	int out_frames = 0;
+	int64_t out_cap = 0;
+	int n = 0;
+	int i = 0;
+	int k = 0;
+	uint64_t process_ms = 0;
+	uint64_t fast_ms = 0;
+	uint64_t ref_ms = 0;
+
+	if(argc != 6)
+	{
+		fprintf(stderr, "usage: %s <pcm file> <in rate> <in channels> <out rate> <out channels>\n", argv[0]);
+		return 1;
+	}
+
+	in_rate = atoi(argv[2]);
+	in_channels = atoi(argv[3]);
+	out_rate = atoi(argv[4]);
+	out_channels = atoi(argv[5]);
+
+	f = fopen(argv[1], "rb");
+
+	if(f == NULL)
+	{
+		fprintf(stderr, "Cannot open %s\n", argv[1]);
+		return 1;
+	}
+
+	fseek(f, 0, SEEK_END);
+	pcm_len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	total_frames = (int)(pcm_len / (2 * in_channels));
+
+	pcm = (int16_t*)malloc(total_frames * in_channels * sizeof(int16_t));
+	total_frames = (int)(fread(pcm, 2 * in_channels, total_frames, f));
+	fclose(f);
+
+	out_cap = ((int64_t)total_frames * out_rate / in_rate + 64) * out_channels;
+	out = (int16_t*)malloc(out_cap * sizeof(int16_t));
+	out_fast = (int16_t*)malloc(out_cap * sizeof(int16_t));
+	out_ref = (int16_t*)malloc(out_cap * sizeof(int16_t));
+
+	process_ms = RunProcess(pcm, total_frames, in_rate, in_channels, out_rate, out_channels, out, &out_frames);
+
+	if(process_ms == 0 && out_frames == 0)
+	{
+		fprintf(stderr, "Unsupported conversion %d Hz/%d ch -> %d Hz/%d ch\n", in_rate, in_channels, out_rate, out_channels);
+		return 1;
+	}
+
+	//kernel input: planar channels of the file, and a period of outputs of the same ratio, any
+	//coefficients do since only time and agreement of the kernels are checked
+	period.count = out_rate / gcd(in_rate, out_rate);
+	period.step = in_rate / gcd(in_rate, out_rate);
+
+	coefs = (int16_t*)malloc(period.count * VUECE_RESAMPLER_TAPS * sizeof(int16_t));
+	offsets = (int*)malloc(period.count * sizeof(int));
+
+	srand(1);
+
+	for(i = 0; i < period.count * VUECE_RESAMPLER_TAPS; i++)
+	{
+		coefs[i] = (int16_t)(rand() % 4096 - 2048);
+	}
+
+	for(k = 0; k < period.count; k++)
+	{
+		offsets[k] = (int)((int64_t)k * period.step / period.count);
+	}
+
+	period.coefs = coefs;
+	period.offsets = offsets;
+
+	for(k = 0; k < out_channels; k++)
+	{
+		planar[k] = (int16_t*)malloc((total_frames + VUECE_RESAMPLER_TAPS) * sizeof(int16_t));
+		memset(planar[k], 0, (total_frames + VUECE_RESAMPLER_TAPS) * sizeof(int16_t));
+
+		for(i = 0; i < total_frames; i++)
+		{
+			planar[k][i] = pcm[i * in_channels + (k % in_channels)];
+		}
+	}
+
+	//outputs whose filter fits in the file
+	n = (int)(((int64_t)(total_frames - VUECE_RESAMPLER_TAPS + 1) * period.count + period.step - 1) / period.step);
+
+	fast_ms = RunKernel(VueceAudioResampler::GetFilterFunc(), planar, out_channels, &period, n, out_fast);
+	ref_ms = RunKernel(VueceAudioResampler::FilterScalar, planar, out_channels, &period, n, out_ref);
+
+	printf("%d frames, %d Hz/%d ch -> %d Hz/%d ch, %d passes\n",
+			total_frames, in_rate, in_channels, out_rate, out_channels, BENCH_PASSES);
+	printf("Process: %lu ms, %d frames out\n", (unsigned long)process_ms, out_frames);
+	printf("kernel %s: %lu ms, scalar: %lu ms, output identical: %d\n",
+			VueceAudioResampler::GetKernelName(), (unsigned long)fast_ms, (unsigned long)ref_ms,
+			memcmp(out_fast, out_ref, (size_t)n * out_channels * sizeof(int16_t)) == 0);
+
+	for(k = 0; k < out_channels; k++)
+	{
+		free(planar[k]);
+	}
+
+	free(coefs);
+	free(offsets);
+	free(pcm);
+	free(out);
+	free(out_fast);
+	free(out_ref);
+
+	return 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * VueceAudioSink.h
+ *
+ *  Created on: Mar 26, 2015
+ *      Author: jingjing
+ */
+
+#ifndef VUECEAUDIOSINK_H_
+#define VUECEAUDIOSINK_H_
+
+#include <stdint.h>
+
+/*
+ * Output device of VueceAudioWriter.
+ *
+ * The sink owns the device and an output buffer, the writer thread reads PCM from
+ * decoder output straight into GetBuffer() and hands it to the device with Write(),
+ * so the writer doesn't need a buffer of its own and doesn't know how the device is
+ * reached (AudioTrack through JNI, a file, nothing at all).
+ *
+ * Open() is called by VueceAudioWriter::Init(), Start() and Write() are called on
+ * writer thread only, Pause()/Resume() are called by player control and Stop() is
+ * called after writer thread has exited.
+ */
+class VueceAudioSink
+{
+public:
+	virtual ~VueceAudioSink() {}
+
+	//creates the device for 16 bit PCM and allocates the output buffer, which holds up to
+	//max_write_len bytes, less if the device can't take that much in one write
+	virtual bool Open(int rate, int channels, int max_write_len) = 0;
+
+	virtual bool Start() = 0;
+
+	virtual uint8_t* GetBuffer() = 0;
+	virtual int GetBufferSize() = 0;
+
+	//returns number of bytes accepted by the device, negative value on error
+	virtual int Write(int len) = 0;
+
+	virtual void Pause() = 0;
+	virtual void Resume() = 0;
+	virtual void Stop() = 0;
+
+	virtual void LogStats() = 0;
+};
+
+#endif /* VUECEAUDIOSINK_H_ */
@@ -0,0 +1,334 @@
+/*
+ * VueceAudioTrackSink.cc
+ *
+ *  Created on: Mar 26, 2015
+ *      Author: jingjing
+ */
+
+#include <stdlib.h>
+
+#include "VueceLogger.h"
+#include "VueceJni.h"
+#include "VueceAudioTrackSink.h"
+
+#define THREAD_TAG_AU_TRACK_SINK "VueceAudioTrackSink"
+
+//AudioTrack.WRITE_BLOCKING
+#define AUDIO_TRACK_WRITE_BLOCKING 0
+
+VueceAudioTrackSink::VueceAudioTrackSink(int mode, int config)
+{
+	VueceLogger::Debug("VueceAudioTrackSink - Constructor called, stream mode: %d, channel config: %d", mode, config);
+
+	stream_mode = mode;
+	channel_config = config;
+
+	audio_track = NULL;
+	audio_track_class = NULL;
+	notification_period = 0;
+	writer_env = NULL;
+
+	buffer = NULL;
+	buffer_size = 0;
+
+	direct_buffer = NULL;
+	array_buffer = NULL;
+
+	write_direct_id = 0;
+	write_array_id = 0;
+	clear_id = 0;
+	play_id = 0;
+	pause_id = 0;
+
+	write_count = 0;
+	written_bytes = 0;
+}
+
+VueceAudioTrackSink::~VueceAudioTrackSink()
+{
+	VueceLogger::Debug("VueceAudioTrackSink - Destructor called");
+
+	JNIEnv *jni_env = VueceJni::GetJniEnv(THREAD_TAG_AU_TRACK_SINK);
+
+	if(direct_buffer != NULL)
+	{
+		jni_env->DeleteGlobalRef(direct_buffer);
+	}
+
+	if(array_buffer != NULL)
+	{
+		jni_env->DeleteGlobalRef(array_buffer);
+	}
+
+	if(audio_track != NULL)
+	{
+		jni_env->DeleteGlobalRef(audio_track);
+	}
+
+	if(audio_track_class != NULL)
+	{
+		jni_env->DeleteGlobalRef(audio_track_class);
+	}
+
+	if(buffer != NULL)
+	{
+		free(buffer);
+	}
+}
+
+/*
+ * AudioTrack buffer is four times the minimum buffer size, the output buffer is bounded
+ * by half of it so a blocking write never waits for too long
+ */
+bool VueceAudioTrackSink::Open(int rate, int channels, int max_write_len)
+{
+	jclass local_class = NULL;
+	jobject local_ref = NULL;
+	jmethodID constructor_id = 0;
+	jmethodID min_buff_size_id = 0;
+	int track_size = 0;
+
+	JNIEnv *jni_env = VueceJni::GetJniEnv(THREAD_TAG_AU_TRACK_SINK);
+
+	local_class = jni_env->FindClass("android/media/AudioTrack");
+
+	if(local_class == NULL)
+	{
+		VueceLogger::Fatal("VueceAudioTrackSink::Open - Cannot find android/media/AudioTrack");
+		return false;
+	}
+
+	audio_track_class = (jclass)jni_env->NewGlobalRef(local_class);
+	jni_env->DeleteLocalRef(local_class);
+
+	constructor_id = jni_env->GetMethodID(audio_track_class, "<init>", "(IIIIII)V");
+	min_buff_size_id = jni_env->GetStaticMethodID(audio_track_class, "getMinBufferSize", "(III)I");
+
+	if(constructor_id == 0 || min_buff_size_id == 0)
+	{
+		VueceLogger::Fatal("VueceAudioTrackSink::Open - Cannot find AudioTrack constructor or AudioTrack.getMinBufferSize()");
+		return false;
+	}
+
+	track_size = jni_env->CallStaticIntMethod(audio_track_class, min_buff_size_id, rate, channel_config, 2/*ENCODING_PCM_16BIT*/);
+
+	VueceLogger::Debug("VueceAudioTrackSink::Open - min buffer size is [%i]", track_size);
+
+	if(track_size <= 0)
+	{
+		VueceLogger::Fatal("VueceAudioTrackSink::Open - Cannot configure AudioTrack with rate [%i] channels [%i]", rate, channels);
+		return false;
+	}
+
+	track_size *= 4;
+
+	local_ref = jni_env->NewObject(audio_track_class, constructor_id,
+			stream_mode,
+			rate,
+			channel_config,
+			2/*ENCODING_PCM_16BIT*/,
+			track_size,
+			1/*MODE_STREAM*/);
+
+	if(local_ref == NULL)
+	{
+		VueceLogger::Fatal("VueceAudioTrackSink::Open - Cannot instantiate AudioTrack");
+		return false;
+	}
+
+	audio_track = jni_env->NewGlobalRef(local_ref);
+	jni_env->DeleteLocalRef(local_ref);
+
+	buffer_size = (max_write_len < track_size / 2) ? max_write_len : track_size / 2;
+	buffer = (uint8_t*)malloc(buffer_size);
+
+	//position notification once a second
+	notification_period = rate;
+
+	VueceLogger::Debug("VueceAudioTrackSink::Open - AudioTrack buffer size [%i], output buffer size [%i]", track_size, buffer_size);
+
+	return buffer != NULL;
+}
+
+bool VueceAudioTrackSink::Start()
+{
+	jclass byte_buffer_class = 0;
+	jobject local_ref = NULL;
+	jobject listener_object = 0;
+	int return_code = -1;
+
+	writer_env = VueceJni::GetJniEnv(THREAD_TAG_AU_TRACK_SINK);
+
+	if(buffer == NULL)
+	{
+		VueceLogger::Fatal("VueceAudioTrackSink::Start - Output buffer is not allocated");
+		return false;
+	}
+
+	play_id = writer_env->GetMethodID(audio_track_class, "play", "()V");
+	pause_id = writer_env->GetMethodID(audio_track_class, "pause", "()V");
+
+	if(play_id == 0 || pause_id == 0)
+	{
+		VueceLogger::Fatal("VueceAudioTrackSink::Start - Cannot find AudioTrack.play()/pause()");
+		return false;
+	}
+
+	//write(ByteBuffer, int, int) is only available since API 21, GetMethodID throws if it's not found
+	write_direct_id = writer_env->GetMethodID(audio_track_class, "write", "(Ljava/nio/ByteBuffer;II)I");
+
+	if(write_direct_id == 0)
+	{
+		writer_env->ExceptionClear();
+	}
+	else
+	{
+		byte_buffer_class = writer_env->FindClass("java/nio/ByteBuffer");
+		clear_id = writer_env->GetMethodID(byte_buffer_class, "clear", "()Ljava/nio/Buffer;");
+
+		local_ref = writer_env->NewDirectByteBuffer(buffer, buffer_size);
+
+		if(clear_id == 0 || local_ref == NULL)
+		{
+			writer_env->ExceptionClear();
+			write_direct_id = 0;
+		}
+		else
+		{
+			direct_buffer = writer_env->NewGlobalRef(local_ref);
+			writer_env->DeleteLocalRef(local_ref);
+		}
+
+		writer_env->DeleteLocalRef(byte_buffer_class);
+	}
+
+	if(write_direct_id == 0)
+	{
+		VueceLogger::Info("VueceAudioTrackSink::Start - Direct ByteBuffer write is not supported, use byte array");
+
+		write_array_id = writer_env->GetMethodID(audio_track_class, "write", "([BII)I");
+
+		if(write_array_id == 0)
+		{
+			VueceLogger::Fatal("VueceAudioTrackSink::Start - Cannot find AudioTrack.write()");
+			return false;
+		}
+
+		local_ref = writer_env->NewByteArray(buffer_size);
+		array_buffer = (jbyteArray)writer_env->NewGlobalRef(local_ref);
+		writer_env->DeleteLocalRef(local_ref);
+	}
+	else
+	{
+		VueceLogger::Info("VueceAudioTrackSink::Start - Use direct ByteBuffer write");
+	}
+
+	return_code = writer_env->CallIntMethod(audio_track, writer_env->GetMethodID(audio_track_class, "setPositionNotificationPeriod", "(I)I"), notification_period);
+
+	if(return_code != 0)
+	{
+		VueceLogger::Fatal("VueceAudioTrackSink::Start - setPositionNotificationPeriod failed");
+		return false;
+	}
+
+	writer_env->CallVoidMethod(audio_track, writer_env->GetMethodID(audio_track_class, "setPlaybackPositionUpdateListener", "(Landroid/media/AudioTrack$OnPlaybackPositionUpdateListener;)V"), listener_object);
+
+	//start playing
+	writer_env->CallVoidMethod(audio_track, play_id);
+
+	return true;
+}
+
+uint8_t* VueceAudioTrackSink::GetBuffer()
+{
+	return buffer;
+}
+
+int VueceAudioTrackSink::GetBufferSize()
+{
+	return buffer_size;
+}
+
+int VueceAudioTrackSink::Write(int len)
+{
+	int result = 0;
+	jobject ret_buf = NULL;
+
+	if(len <= 0 || len > buffer_size)
+	{
+		VueceLogger::Error("VueceAudioTrackSink::Write - Invalid length: %d", len);
+		return -1;
+	}
+
+	if(direct_buffer != NULL)
+	{
+		//AudioTrack reads from current position of the buffer and advances it
+		ret_buf = writer_env->CallObjectMethod(direct_buffer, clear_id);
+		writer_env->DeleteLocalRef(ret_buf);
+
+		result = writer_env->CallIntMethod(audio_track, write_direct_id, direct_buffer, len, AUDIO_TRACK_WRITE_BLOCKING);
+	}
+	else
+	{
+		writer_env->SetByteArrayRegion(array_buffer, 0, len, (jbyte*)buffer);
+
+		result = writer_env->CallIntMethod(audio_track, write_array_id, array_buffer, 0, len);
+	}
+
+	write_count++;
+
+	if(result > 0)
+	{
+		written_bytes += result;
+	}
+
+	return result;
+}
+
+void VueceAudioTrackSink::Pause()
+{
+	JNIEnv *jni_env = VueceJni::GetJniEnv(THREAD_TAG_AU_TRACK_SINK);
+
+	jni_env->CallVoidMethod(audio_track, pause_id);
+}
+
+void VueceAudioTrackSink::Resume()
+{
+	JNIEnv *jni_env = VueceJni::GetJniEnv(THREAD_TAG_AU_TRACK_SINK);
+
+	jni_env->CallVoidMethod(audio_track, play_id);
+}
+
+void VueceAudioTrackSink::Stop()
+{
+	jmethodID flush_id = 0;
+	jmethodID stop_id = 0;
+	jmethodID release_id = 0;
+	JNIEnv *jni_env = VueceJni::GetJniEnv(THREAD_TAG_AU_TRACK_SINK);
+
+	if(audio_track == NULL)
+	{
+		return;
+	}
+
+	flush_id = jni_env->GetMethodID(audio_track_class, "flush", "()V");
+	stop_id = jni_env->GetMethodID(audio_track_class, "stop", "()V");
+	release_id = jni_env->GetMethodID(audio_track_class, "release", "()V");
+
+	if(flush_id == 0 || stop_id == 0 || release_id == 0)
+	{
+		VueceLogger::Error("VueceAudioTrackSink::Stop - Cannot find AudioTrack.flush()/stop()/release()");
+		return;
+	}
+
+	jni_env->CallVoidMethod(audio_track, flush_id);
+	jni_env->CallVoidMethod(audio_track, stop_id);
+	jni_env->CallVoidMethod(audio_track, release_id);
+}
+
+void VueceAudioTrackSink::LogStats()
+{
+	VueceLogger::Info("VueceAudioTrackSink - Stats: %s write, %ld writes, %lld bytes, %lld bytes per write",
+			direct_buffer != NULL ? "direct" : "array", write_count, written_bytes,
+			write_count > 0 ? written_bytes / write_count : 0LL);
+}
@@ -0,0 +1,76 @@
+/*
+ * VueceAudioTrackSink.h
+ *
+ *  Created on: Mar 26, 2015
+ *      Author: jingjing
+ */
+
+#ifndef VUECEAUDIOTRACKSINK_H_
+#define VUECEAUDIOTRACKSINK_H_
+
+#include <jni.h>
+
+#include "VueceAudioSink.h"
+
+/*
+ * Plays PCM through android.media.AudioTrack.
+ *
+ * Output buffer is allocated natively and wrapped by a direct ByteBuffer, so
+ * AudioTrack.write(ByteBuffer, int, int) (API 21) reads PCM directly from the
+ * memory the writer has filled, no Java array is involved. On older platforms
+ * the buffer is copied into a byte array and AudioTrack.write(byte[], int, int)
+ * is used.
+ *
+ * AudioTrack object is created by Open() and released by Stop().
+ */
+class VueceAudioTrackSink : public VueceAudioSink
+{
+public:
+	//stream_mode and channel_config are VUECE_ANDROID_AUDIO_STREAM_MODE_* and VUECE_ANDROID_CHANNEL_CONFIGURATION_*
+	VueceAudioTrackSink(int stream_mode, int channel_config);
+	virtual ~VueceAudioTrackSink();
+
+	virtual bool Open(int rate, int channels, int max_write_len);
+	virtual bool Start();
+
+	virtual uint8_t* GetBuffer();
+	virtual int GetBufferSize();
+
+	virtual int Write(int len);
+
+	virtual void Pause();
+	virtual void Resume();
+	virtual void Stop();
+
+	virtual void LogStats();
+
+private:
+	int stream_mode;
+	int channel_config;
+
+	//global refs
+	jobject audio_track;
+	jclass audio_track_class;
+	int notification_period;
+
+	//env of writer thread, set by Start()
+	JNIEnv* writer_env;
+
+	uint8_t* buffer;
+	int buffer_size;
+
+	//global refs, only one of them is used
+	jobject direct_buffer;
+	jbyteArray array_buffer;
+
+	jmethodID write_direct_id;
+	jmethodID write_array_id;
+	jmethodID clear_id;
+	jmethodID play_id;
+	jmethodID pause_id;
+
+	long write_count;
+	int64_t written_bytes;
+};
+
+#endif /* VUECEAUDIOTRACKSINK_H_ */
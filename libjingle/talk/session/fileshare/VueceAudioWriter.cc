@@ -8,14 +8,17 @@
 #include <sys/resource.h>
 
 #include <errno.h>
+#include <string.h>
 
 #include "talk/base/logging.h"
 #include "VueceLogger.h"
-#include "VueceStreamPlayer.h"
 #include "VueceAudioWriter.h"
 #include "VueceConstants.h"
 #include "VueceConfig.h"
 #include "VueceJni.h"
+#include "VueceJitterController.h"
+#include "VueceAudioSink.h"
+#include "VueceAudioWriterObserver.h"
 
 #define MODUE_NAME_AUDIO_WRITER "VueceAudioWriter"
 
@@ -25,6 +28,12 @@
 
 #define WATCHDOG_TIMEOUT 60
 
+/*
+ * Latency budget of one sink write, writer hands up to this much PCM to the sink
+ * at once instead of one write_chunk_size (20ms) block per write
+ */
+#define WRITE_BATCH_MS 80
+
 static const float sndwrite_flush_threshold=0.020;	//ms
 
 
@@ -52,14 +61,23 @@ static void set_high_prio(void){
 	}
 }
 
-static void* audio_write_cb(VueceAndroidSndWriteData* d) {
+static void log_state_transition(const char* event, const char* old_state, const char* new_state)
+{
+	VueceLogger::Info("%s::STATE TRANSTION - Event: [%s], State is switched from [%s] ---> [%s]", MODUE_NAME_AUDIO_WRITER, event, old_state, new_state);
+}
 
-	jbyteArray 	write_buff = 0;
+static void abort_on_invalid_transition(const char* event, const char* current_state)
+{
+	VueceLogger::Fatal("%s::AbortOnInvalidTranstion - Invalid event: [%s], in state: [%s]", MODUE_NAME_AUDIO_WRITER, event, current_state);
+}
 
-	int return_code=-1;
-	jobject listener_object = 0;
+static void log_ignored_event(const char* event, const char* current_state)
+{
+//	VueceLogger::Info("%s::LogIgnoredEvent - Event: [%s] is ignored in state: [%s]", MODUE_NAME_AUDIO_WRITER, event, current_state);
+}
+
+static void* audio_write_cb(VueceAndroidSndWriteData* d) {
 
-	//Vuece - This tmp buffer contains 20ms raw data
 	int min_size=-1;
 	int count;
 	int bufferizer_size = 0;
@@ -70,42 +88,28 @@ static void* audio_write_cb(VueceAndroidSndWriteData* d) {
 
 	set_high_prio();
 
-	int buff_size = d->write_chunk_size;
 	int result = 0;
+	int write_size = 0;
 
-	uint8_t tmpBuff[buff_size];
+	//decoded PCM is read straight into sink buffer
+	uint8_t* sink_buff = d->sink->GetBuffer();
 
 	VueceLogger::Debug("VueceAudioWriter::audio_write_cb - Debug 1");
 
-	VueceJni::AttachCurrentThreadToJniEnv(THREAD_TAG_AU_WRITER);
-
-	JNIEnv *jni_env = VueceJni::GetJniEnv(THREAD_TAG_AU_WRITER);
-
-	VueceLogger::Debug("VueceAudioWriter::audio_write_cb - Debug 2");
-
-	write_buff = jni_env->NewByteArray(buff_size);
-
-    return_code = jni_env->CallIntMethod(d->audio_track,jni_env->GetMethodID(d->audio_track_class,"setPositionNotificationPeriod", "(I)I"), d->rate);
-	if (return_code != 0) {
-		VueceLogger::Fatal("VueceAudioWriter - setPositionNotificationPeriod failed");
+	//start playing
+	if(!d->sink->Start())
+	{
+		VueceLogger::Fatal("VueceAudioWriter - audio sink cannot be started");
 		goto end;
 	}
 
-	VueceLogger::Debug("VueceAudioWriter::audio_write_cb - Debug 3");
-
-
-    jni_env->CallVoidMethod(d->audio_track,jni_env->GetMethodID(d->audio_track_class,"setPlaybackPositionUpdateListener", "(Landroid/media/AudioTrack$OnPlaybackPositionUpdateListener;)V"), listener_object);
-
-
-	VueceLogger::Debug("VueceAudioWriter::audio_write_cb - Debug 4");
-
-	//start playing
-	jni_env->CallVoidMethod(d->audio_track,d->play_id);
-
 	VueceLogger::Debug("VueceAudioWriter::audio_write_cb - Debug 5");
 
 	// notify state
-    jni_env->CallVoidMethod(d->jabber_client_object, d->on_player_state_id,(jint)VueceAudioWriterFsmState_Playing);
+	if(d->observer != NULL)
+	{
+		d->observer->OnPlayerStateChanged(VueceAudioWriterFsmState_Playing);
+	}
 
 	d->player_state = VueceAudioWriterFsmState_Ready;
 
@@ -135,7 +139,7 @@ static void* audio_write_cb(VueceAndroidSndWriteData* d) {
 //				VueceLogger::Debug("audio_write_cb - reading data, consumer_q size: %d, bulk count: %d, requested data size: %d",
 //						d->consumer_q->Size(), d->consumer_q->BulkCount(), d->write_chunk_size);
 
-				bufferizer_size = d->consumer_q->Size();
+				bufferizer_size = d->GetBufferedSize();
 
 
 
@@ -151,6 +155,9 @@ static void* audio_write_cb(VueceAndroidSndWriteData* d) {
 
 						d->waiting_for_new_data = true;
 
+						//let stream engine know in case it's sleeping
+						d->SignalBufferLow();
+
 						VueceThreadUtil::MutexUnlock(&d->audiotrack_mutex);
 
 						//go to sleep now
@@ -165,15 +172,17 @@ static void* audio_write_cb(VueceAndroidSndWriteData* d) {
 				if (min_size==-1) min_size=bufferizer_size;
 				else if (bufferizer_size<min_size) min_size=bufferizer_size;
 
-				d->consumer_q->Read(tmpBuff, d->write_chunk_size);
+				//write everything buffered in one go, up to the batch size, in whole chunks
+				write_size = (bufferizer_size < d->write_batch_size) ? bufferizer_size : d->write_batch_size;
+				write_size -= write_size % d->write_chunk_size;
 
-				VueceThreadUtil::MutexUnlock(&d->mutex);
+				d->ReadBuffered(sink_buff, write_size);
 
-				jni_env->SetByteArrayRegion(write_buff,0,d->write_chunk_size,(jbyte*)tmpBuff);
+				VueceThreadUtil::MutexUnlock(&d->mutex);
 
 				//NOTE(Vuece) - This is where data is written to AudioTrack for playing
 				VueceThreadUtil::MutexLock(&d->audiotrack_mutex);
-				result = jni_env->CallIntMethod(d->audio_track,d->write_id,write_buff,0,d->write_chunk_size);
+				result = d->sink->Write(write_size);
 				VueceThreadUtil::MutexUnlock(&d->audiotrack_mutex);
 
 				d->writtenBytes+=result;
@@ -183,7 +192,7 @@ static void* audio_write_cb(VueceAndroidSndWriteData* d) {
 
 				VueceThreadUtil::MutexLock(&d->mutex);
 
-				count += d->write_chunk_size;
+				count += write_size;
 
 				if (count>check_point_size){
 					if (min_size > max_size) {
@@ -244,13 +253,6 @@ static void* audio_write_cb(VueceAndroidSndWriteData* d) {
 
 	end: {
 
-		if(write_buff != 0)
-		{
-			VueceLogger::Debug("audio_write_cb - delete local ref write_buff");
-
-			jni_env->DeleteLocalRef(write_buff);
-		}
-
 		VueceJni::ThreadExit(NULL, THREAD_TAG_AU_WRITER);
 		return NULL;
 	}
@@ -261,18 +263,13 @@ static void* audio_play_progress_checker_cb(VueceAndroidSndWriteData *d)
 	int current_player_pos = 0;
 	int timer = 0;
 	int buf_win = 0;
+	int buf_win_threshold = VUECE_BUFWIN_THRESHOLD_SEC;
 
 	bool bPlayFinished = false;
 	bool bTriggerNextBufWinDld = false;
 
 	VueceLogger::Debug("Starting AudioTrack checker thread...");
 
-	VueceJni::AttachCurrentThreadToJniEnv(THREAD_TAG_AU_PROGRESS_CHECKER);
-
-	JNIEnv *jni_env = VueceJni::GetJniEnv(THREAD_TAG_AU_PROGRESS_CHECKER);
-
-	VueceLogger::Debug("Starting AudioTrack checker thread, waken up.");
-
 	while(true)
 	{
 		bTriggerNextBufWinDld = false;
@@ -403,7 +400,10 @@ static void* audio_play_progress_checker_cb(VueceAndroidSndWriteData *d)
 		VueceLogger::Debug("audio_play_progress_checker_cb - current_player_pos = %d, resume pos = %d, first frame pos = %d, total duration = %d, termination pos = %d, buffer window = %d seconds",
 				current_player_pos, d->iResumePosSec, d->iFirstFramePosSec, d->totoal_duration_in_sec, d->iStreamTerminationPosSec, buf_win);
 
-		jni_env->CallVoidMethod(d->jabber_client_object,d->on_player_progress_id, current_player_pos);
+		if(d->observer != NULL)
+		{
+			d->observer->OnPlayingProgress(current_player_pos);
+		}
 
 		if(d->totoal_duration_in_sec == -1)
 		{
@@ -412,8 +412,10 @@ static void* audio_play_progress_checker_cb(VueceAndroidSndWriteData *d)
 		}
 
 		//check buffer window
-		//Note - do not use <= to compare otherwise it will trigger multiple duplicated notifications
-		//because we are in a loop here
+		//Note - threshold is adjusted by jitter controller while playing so it may skip a value, <= is
+		//used here, duplicated notifications are avoided because buffer window check is disabled once
+		//notification is fired, see below
+		buf_win_threshold = (d->jitter != NULL) ? d->jitter->GetRefillThresholdSec() : VUECE_BUFWIN_THRESHOLD_SEC;
 
 		if(d->bTriggerNextBufWinDldAfterStart)
 		{
@@ -423,11 +425,11 @@ static void* audio_play_progress_checker_cb(VueceAndroidSndWriteData *d)
 
 			bTriggerNextBufWinDld = true;
 		}
-		//NOTE - I need to handle a special case here, if a local seek succeeds, the buffer window could directly fall into < VUECE_BUFWIN_THRESHOLD_SEC,
+		//NOTE - I need to handle a special case here, if a local seek succeeds, the buffer window could directly fall into < buf_win_threshold,
 		//in this case following code for downloading next buffer window will never be triggered, so we need to use resumed_by_local_seek...
-		else if(buf_win > 0 && buf_win == VUECE_BUFWIN_THRESHOLD_SEC)
+		else if(buf_win > 0 && buf_win <= buf_win_threshold)
 		{
-			VueceLogger::Debug("audio_play_progress_checker_cb: buffer window threshold(%d seconds) reached, trigger notification", VUECE_BUFWIN_THRESHOLD_SEC);
+			VueceLogger::Debug("audio_play_progress_checker_cb: buffer window threshold(%d seconds) reached, trigger notification", buf_win_threshold);
 
 			bTriggerNextBufWinDld = true;
 		}
@@ -437,7 +439,7 @@ static void* audio_play_progress_checker_cb(VueceAndroidSndWriteData *d)
 
 			VueceLogger::Debug("audio_play_progress_checker_cb: resumed_by_local_seek is true, check current buffer window");
 
-			if(buf_win < VUECE_BUFWIN_THRESHOLD_SEC)
+			if(buf_win < buf_win_threshold)
 			{
 				VueceLogger::Debug("audio_play_progress_checker_cb: resumed_by_local_seek is true, buf win is below threshold, trigger download");
 				bTriggerNextBufWinDld = true;
@@ -572,7 +574,6 @@ VueceAndroidSndData::VueceAndroidSndData() : bits(16),rate(8000),nchannels(1),st
 	iResumePosSec = -1;
 	resumed_by_local_seek = false;
 	buffer_win_enabled = false;
-	buff_size = 0;
 	player_state = VueceAudioWriterFsmState_Stopped;
 	iStreamTerminationPosSec = 0;
 
@@ -613,22 +614,11 @@ VueceAndroidSndData::~VueceAndroidSndData() {
 	VueceLogger::Debug("VueceAndroidSndData Destructor - Done");
 }
 
-VueceAndroidSndWriteData::VueceAndroidSndWriteData() :audio_track_class(0),audio_track(0),write_chunk_size(0),writtenBytes(0),last_sample_date(0),jabber_client_class(0)
+VueceAndroidSndWriteData::VueceAndroidSndWriteData() :write_chunk_size(0),writtenBytes(0),last_sample_date(0)
 {
 
 	VueceLogger::Debug("VueceAndroidSndWriteData constructor - Start");
 
-	write_id = 0;
-	play_id = 0;
-	pause_id = 0;
-	flush_id = 0;
-	stop_id = 0;
-	get_header_pos_id = 0;
-	set_header_pos_id = 0;
-	on_player_progress_id = 0;
-	on_player_state_id = 0;
-	get_client_id = 0;
-	jabber_client_object = 0;
 	bPostProcessCalled=false;
 	iResumePosSec=0;
 	iFirstFramePosSec=0;
@@ -639,53 +629,14 @@ VueceAndroidSndWriteData::VueceAndroidSndWriteData() :audio_track_class(0),audio
 	totoal_duration_in_sec = -1; //not set
 	current_player_pos = 0; // if not updated, use 0 as default
 
-	consumer_q = NULL;
-
-	consumer_q = new VueceMemQueue();
+	consumer_r = NULL;
+	buffer_low_watermark = 0;
+	jitter = NULL;
+	sink = NULL;
+	observer = NULL;
+	write_batch_size = 0;
 
 	pthread_cond_init(&cond,0);
-	JNIEnv *jni_env = VueceJni::GetJniEnv("VueceAndroidSndWriteData:Constructor");
-
-	audio_track_class = (jclass)jni_env->NewGlobalRef(jni_env->FindClass("android/media/AudioTrack"));
-	if (audio_track_class == 0) {
-		VueceLogger::Fatal("VueceAndroidSndWriteData - cannot find  android/media/AudioTrack\n");
-		return;
-	}
-
-	jabber_client_class = (jclass)jni_env->NewGlobalRef(jni_env->FindClass("com/vuece/vtalk/android/jni/JabberClient"));
-	if (jabber_client_class == 0) {
-		VueceLogger::Fatal("VueceAndroidSndWriteData - cannot find  com/vuece/vtalk/android/jni/JabberClient\n");
-		return;
-	}
-
-	jmethodID hwrate_id = jni_env->GetStaticMethodID(audio_track_class,"getNativeOutputSampleRate", "(I)I");
-	if (hwrate_id == 0) {
-		VueceLogger::Fatal("VueceAndroidSndWriteData - cannot find  int AudioRecord.getNativeOutputSampleRate(int streamType)");
-		return;
-	}
-
-	rate = jni_env->CallStaticIntMethod(
-			audio_track_class,
-			hwrate_id,
-//				0 /*STREAM_VOICE_CALL*/
-			vuece_current_stream_mode
-			);
-
-	if(vuece_current_stream_mode == VUECE_ANDROID_AUDIO_STREAM_MODE_VOICE_CALL)
-	{
-		VueceLogger::Debug("VueceAndroidSndWriteData - stream mode is VOICE CALL");
-	}
-	else if(vuece_current_stream_mode == VUECE_ANDROID_AUDIO_STREAM_MODE_MUSIC)
-	{
-		VueceLogger::Debug("VueceAndroidSndWriteData - stream mode is MUSIC");
-	}
-	else
-	{
-		VueceLogger::Fatal("VueceAndroidSndWriteData - unknown stream mode: %d",vuece_current_stream_mode);
-	}
-
-	VueceLogger::Debug("VueceAndroidSndWriteData - Hardware sample rate is %i",rate);
-
 }
 
 
@@ -693,30 +644,18 @@ VueceAndroidSndWriteData::~VueceAndroidSndWriteData()
 {
 	VueceLogger::Debug("VueceAndroidSndWriteData - Destructor called");
 
-	if(consumer_q != NULL)
-	{
-		consumer_q->FreeQueue();
-		delete consumer_q;
-
-		consumer_q = NULL;
-	}
-
-
 	pthread_cond_destroy(&cond);
 
-	if (audio_track_class!=0){
-		JNIEnv *env = VueceJni::GetJniEnv("~VueceAndroidSndWriteData");
-
-		VueceLogger::Debug("VueceAndroidSndWriteData - Deleting global JNI refs audio_track_class");
-		env->DeleteGlobalRef(audio_track_class);
-
-		VueceLogger::Debug("VueceAndroidSndWriteData - Deleting global JNI refs jabber_client_class");
-		env->DeleteGlobalRef(jabber_client_class);
-
-		VueceLogger::Debug("VueceAndroidSndWriteData - Deleting global JNI refs jabber_client_object");
-        env->DeleteGlobalRef(jabber_client_object);
+	if(sink != NULL)
+	{
+		delete sink;
+		sink = NULL;
+	}
 
-        VueceLogger::Debug("VueceAndroidSndWriteData - Deleting global JNI refs Done");
+	if(observer != NULL)
+	{
+		delete observer;
+		observer = NULL;
 	}
 
 	SignalWriterEventNotification.disconnect_all();
@@ -757,13 +696,11 @@ VueceAudioWriter::~VueceAudioWriter()
 
 
 
-bool VueceAudioWriter::Init(int channel_mode, int channel_num, int stream_mode, int duration, int sample_rate, int resume_pos)
+bool VueceAudioWriter::Init(int channel_mode, int channel_num, int stream_mode, int duration, int sample_rate, int resume_pos,
+		VueceAudioSink* sink, VueceAudioWriterObserver* observer)
 {
 	bool ret = true;
-
-	jmethodID constructor_id=0;
 	int rc;
-	jmethodID min_buff_size_id;
 
 	VueceLogger::Debug("VueceAudioWriter::Init - Input: channel_mode = %d, nr_channels = %d, stream_mode = %d, duration = %d, sample_rate = %d, resume_pos = %d",
 			channel_mode, channel_num, stream_mode, duration, sample_rate, resume_pos);
@@ -772,6 +709,9 @@ bool VueceAudioWriter::Init(int channel_mode, int channel_num, int stream_mode,
 
 	d = new VueceAndroidSndWriteData();
 
+	d->sink = sink;
+	d->observer = observer;
+
 	SetChannelConfig(channel_mode);
 	SetNchannels(channel_num);
 	SetStreamMode(stream_mode);
@@ -779,174 +719,36 @@ bool VueceAudioWriter::Init(int channel_mode, int channel_num, int stream_mode,
 	SetWriteRate(sample_rate);
 	SetResumePosition(resume_pos);
 
-
-	JNIEnv *jni_env = VueceJni::GetJniEnv("VueceAudioWriter::Init");
-
-	if (d->audio_track_class == 0) {
-
-		VueceLogger::Fatal("VueceAudioWriter::Init - audio_track_class is null, abort now.");
-
-		return false;
-	}
-
-	constructor_id = jni_env->GetMethodID(d->audio_track_class,"<init>", "(IIIIII)V");
-	if (constructor_id == 0) {
-		VueceLogger::Fatal("VueceAudioWriter::Init - cannot find  AudioTrack(int streamType, int sampleRateInHz, \
-		int channelConfig, int audioFormat, int bufferSizeInBytes, int mode)");
-		return false;
-	}
-
-	min_buff_size_id = jni_env->GetStaticMethodID(d->audio_track_class,"getMinBufferSize", "(III)I");
-	if (min_buff_size_id == 0) {
-		VueceLogger::Fatal("VueceAudioWriter::Init - cannot find  AudioTrack.getMinBufferSize(int sampleRateInHz, int channelConfig, int audioFormat)");
-		return false;
-	}
-
-
-	//Vuece - code
-	d->buff_size = jni_env->CallStaticIntMethod(
-			d->audio_track_class,
-			min_buff_size_id,
-			d->rate,
-			vuece_current_channel_config,
-			2/*  ENCODING_PCM_16BIT */);
-
-	VueceLogger::Debug("VueceAudioWriter::Init - min_buff_size  is [%i]", d->buff_size);
-
-	d->buff_size = d->buff_size * 4;
-
 	//Vuece - raw data of 20ms
 	d->write_chunk_size= (d->rate*(d->bits/8)*d->nchannels)*0.02;
 
-	//d->write_chunk_size=d->buff_size;
-	if (d->buff_size > 0) {
-		VueceLogger::Debug("VueceAudioWriter::Init - Configuring player with [%i] bits  rate [%i] nchanels [%i] buff size [%i] chunk size [%i]"
-				,d->bits
-				,d->rate
-				,d->nchannels
-				,d->buff_size
-				,d->write_chunk_size);
-	} else {
-		VueceLogger::Debug("VueceAudioWriter::Init - Cannot configure player with [%i] bits  rate [%i] nchanels [%i] buff size [%i] chunk size [%i]"
+	if(d->sink == NULL || !d->sink->Open(d->rate, d->nchannels, (d->rate*(d->bits/8)*d->nchannels) * WRITE_BATCH_MS / 1000))
+	{
+		VueceLogger::Fatal("VueceAudioWriter::Init - Cannot open audio sink with [%i] bits  rate [%i] nchanels [%i]"
 				,d->bits
 				,d->rate
-				,d->nchannels
-				,d->buff_size
-				,d->write_chunk_size);
-
-		ret = false;
+				,d->nchannels);
 
 		return false;
 	}
 
+	//sink may take less than the latency budget in one write, batches are whole chunks
+	d->write_batch_size = d->sink->GetBufferSize();
+	d->write_batch_size -= d->write_batch_size % d->write_chunk_size;
 
-	d->get_client_id=jni_env->GetStaticMethodID(d->jabber_client_class,"getInstance", "()Lcom/vuece/vtalk/android/jni/JabberClient;");
-	if(d->get_client_id==0) {
-		VueceLogger::Fatal("VueceAudioWriter::Init - cannot find getInstance method");
-
-		ret = false;
-
-		goto end;
-	}
-
-	d->on_player_progress_id = jni_env->GetMethodID(d->jabber_client_class,"onPlayingProgress", "(I)V");
-	if(d->on_player_progress_id==0) {
-		VueceLogger::Fatal("VueceAudioWriter::Init - cannot find onPlayingProgress method");
-
-		ret = false;
-
-		goto end;
-	}
-
-	d->on_player_state_id = jni_env->GetMethodID(d->jabber_client_class,"onStreamPlayerStateChanged", "(I)V");
-	if(d->on_player_state_id==0) {
-		VueceLogger::Fatal("VueceAudioWriter::Init - cannot find onStreamPlayerStateChanged method");
-
-		ret = false;
-
-		goto end;
-	}
-
-	d->write_id = jni_env->GetMethodID(d->audio_track_class,"write", "([BII)I");
-	if(d->write_id==0) {
-		VueceLogger::Fatal("VueceAudioWriter::Init - cannot find AudioTrack.write() method");
-
-		ret = false;
-
-		goto end;
-	}
-	d->play_id = jni_env->GetMethodID(d->audio_track_class,"play", "()V");
-	if(d->play_id==0) {
-		VueceLogger::Fatal("VueceAudioWriter::Init - cannot find AudioTrack.play() method");
-
-		ret = false;
-
-		goto end;
-	}
-
-	d->pause_id = jni_env->GetMethodID(d->audio_track_class,"pause", "()V");
-	if(d->pause_id==0) {
-		VueceLogger::Fatal("VueceAudioWriter::Init - cannot find AudioTrack.pause() method");
-
-		ret = false;
-
-		goto end;
-	}
-
-	d->flush_id = jni_env->GetMethodID(d->audio_track_class,"flush", "()V");
-	if(d->flush_id==0) {
-		VueceLogger::Fatal("VueceAudioWriter::Init - cannot find AudioTrack.flush() method");
-
-		ret = false;
-
-		goto end;
-	}
-
-	d->stop_id = jni_env->GetMethodID(d->audio_track_class,"stop", "()V");
-	if(d->stop_id==0) {
-		VueceLogger::Fatal("VueceAudioWriter::Init - cannot find AudioTrack.stop() method");
-
-		ret = false;
-
-		goto end;
-	}
-
-	d->get_header_pos_id = jni_env->GetMethodID(d->audio_track_class,"getPlaybackHeadPosition", "()I");
-	if(d->get_header_pos_id==0) {
-		VueceLogger::Fatal("VueceAudioWriter::Init - cannot find AudioTrack.getPlaybackHeadPosition() method");
-
-		ret = false;
+	if(d->write_batch_size < d->write_chunk_size)
+	{
+		VueceLogger::Fatal("VueceAudioWriter::Init - sink buffer(%d bytes) is smaller than write chunk(%d bytes)", d->sink->GetBufferSize(), d->write_chunk_size);
 
-		goto end;
+		return false;
 	}
 
-	d->jabber_client_object = jni_env->NewGlobalRef(jni_env->CallStaticObjectMethod(d->jabber_client_class, d->get_client_id));
-    if (d->jabber_client_object==0) {
-		VueceLogger::Fatal("VueceAudioWriter::Init - cannot find jabber_client_object");
-
-		ret = false;
-
-		goto end;
-    }
-
-	//Vuece customizations
-	d->audio_track =  jni_env->NewObject(d->audio_track_class
-			,constructor_id
-			,vuece_current_stream_mode/*STREAM_MUSIC*/
+	VueceLogger::Debug("VueceAudioWriter::Init - Configuring player with [%i] bits  rate [%i] nchanels [%i] chunk size [%i] write batch size [%i]"
+			,d->bits
 			,d->rate
-			,vuece_current_channel_config
-			,2/*  ENCODING_PCM_16BIT */
-			,d->buff_size
-			,1/*MODE_STREAM */);
-
-	d->audio_track = jni_env->NewGlobalRef(d->audio_track);
-	if (d->audio_track == 0) {
-		VueceLogger::Fatal("VueceAudioWriter::Init - cannot instanciate AudioTrack");
-
-		ret = false;
-
-		return false;
-	}
+			,d->nchannels
+			,d->write_chunk_size
+			,d->write_batch_size);
 
 
 	d->bPostProcessCalled=false;
@@ -1013,10 +815,6 @@ bool VueceAudioWriter::Init(int channel_mode, int channel_num, int stream_mode,
 
 	VueceLogger::Debug("VueceAudioWriter::Init - Done");
 
-	end: {
-		return ret;
-	}
-
 	return ret;
 }
 
@@ -1024,11 +822,6 @@ void VueceAudioWriter::Uninit()
 {
 	VueceLogger::Debug("VueceAudioWriter::Uninit - Start, synchronously release all resources");
 
-	jmethodID flush_id=0;
-	jmethodID stop_id=0;
-	jmethodID release_id=0;
-	JNIEnv *jni_env = VueceJni::GetJniEnv("VueceAudioWriter::Uninit");
-
 	VueceLogger::Debug("VueceAudioWriter::Uninit - 1");
 
 	if( !d->StateTranstition(VueceAudioWriterFsmEvent_Stop) )
@@ -1062,46 +855,13 @@ void VueceAudioWriter::Uninit()
 
 	VueceLogger::Debug("VueceAudioWriter::Uninit - 5");
 
-	// flush
-	flush_id = jni_env->GetMethodID(d->audio_track_class,"flush", "()V");
-	if(flush_id==0) {
-		VueceLogger::Error("cannot find AudioTrack.flush() method");
-		goto end;
-	}
-
-	VueceLogger::Debug("VueceAudioWriter::Uninit - 6");
-
-	if (d->audio_track) {
-
-		VueceLogger::Debug("VueceAudioWriter::Uninit - 7");
-
-		jni_env->CallVoidMethod(d->audio_track,flush_id);
-
-		VueceLogger::Debug("VueceAudioWriter::Uninit - 8");
-
-		//stop playing
-		stop_id = jni_env->GetMethodID(d->audio_track_class,"stop", "()V");
-		if(stop_id==0) {
-			VueceLogger::Error("VueceAudioWriter::Uninit - cannot find AudioTrack.stop() method");
-			goto end;
-		}
-
-		VueceLogger::Debug("VueceAudioWriter::Uninit - 9");
+	// flush, stop and release output device
+	if (d->sink != NULL) {
 
-		jni_env->CallVoidMethod(d->audio_track,stop_id);
+		VueceLogger::Debug("VueceAudioWriter::Uninit - 6");
 
-		VueceLogger::Debug("VueceAudioWriter::Uninit - 10");
-
-		//release playing
-		release_id = jni_env->GetMethodID(d->audio_track_class,"release", "()V");
-		if(release_id==0) {
-			VueceLogger::Error("VueceAudioWriter::Uninit -cannot find AudioTrack.release() method");
-			goto end;
-		}
-
-		VueceLogger::Debug("VueceAudioWriter::Uninit - 11");
-
-		jni_env->CallVoidMethod(d->audio_track,release_id);
+		d->sink->Stop();
+		d->sink->LogStats();
 	}
 
 	VueceLogger::Debug("VueceAudioWriter::Uninit - 12");
@@ -1114,31 +874,13 @@ void VueceAudioWriter::Uninit()
 
 	VueceLogger::Debug("VueceAudioWriter::Uninit - - checker thread exited");
 
-	goto end;
-end: {
-
-	VueceLogger::Debug("VueceAudioWriter::Uninit - delete global ref audio_track");
-
-	if (d->audio_track) jni_env->DeleteGlobalRef(d->audio_track);
-
-	VueceLogger::Debug("VueceAudioWriter::Uninit - 15");
-
 	d->StateTranstition(VueceAudioWriterFsmEvent_StopCompleted);
-
-	return;
-	}
 }
 
 void VueceAudioWriter::SetWriteRate(int proposed_rate)
 {
-#ifndef USE_HARDWARE_RATE
 	VueceLogger::Debug("VueceAudioWriter - set_write_rate: %d",proposed_rate);
 	d->rate=proposed_rate;
-#else
-/*audioflingler resampling is really bad
-we prefer do resampling by ourselves if cpu allows it*/
-	VueceLogger::Debug("VueceAudioWriter - set_write_rate: Hardware rate is used. return -1");
-#endif
 }
 
 int VueceAudioWriter::GetRate()
@@ -1203,13 +945,11 @@ void VueceAudioWriter::PausePlayer()
 {
 	VueceLogger::Debug("VueceAudioWriter - PausePlayer");
 
-	JNIEnv *jni_env = VueceJni::GetJniEnv("PausePlayer");
-
 	VueceLogger::Debug("VueceAudioWriter - PausePlayer: call pause() now");
 
 	if(d->StateTranstition(VueceAudioWriterFsmEvent_Pause))
 	{
-		jni_env->CallVoidMethod(d->audio_track, d->pause_id);
+		d->sink->Pause();
 	}
 
 	VueceLogger::Debug("VueceAudioWriter - PausePlayer: pause() called");
@@ -1219,8 +959,6 @@ void VueceAudioWriter::ResumePlayer(int resume_pos, bool resumed_by_local_seek)
 {
 	VueceLogger::Debug("VueceAudioWriter::ResumePlayer");
 
-	JNIEnv *jni_env = VueceJni::GetJniEnv("ResumePlayer");
-
 	if(!d->StateTranstition(VueceAudioWriterFsmEvent_Resume))
 	{
 		VueceLogger::Debug("VueceAudioWriter::ResumePlayer - StateTranstition not allowed");
@@ -1247,10 +985,13 @@ void VueceAudioWriter::ResumePlayer(int resume_pos, bool resumed_by_local_seek)
 
 	VueceLogger::Debug("VueceAudioWriter::ResumePlayer, call play() on audiotrack");
 
-	jni_env->CallVoidMethod(d->audio_track,d->play_id);
+	d->sink->Resume();
 //	d->player_state = VueceAudioWriterFsmState_Playing;
 
-    jni_env->CallVoidMethod(d->jabber_client_object,d->on_player_state_id,(jint)VueceAudioWriterFsmState_Playing);
+	if(d->observer != NULL)
+	{
+		d->observer->OnPlayerStateChanged(VueceAudioWriterFsmState_Playing);
+	}
 
 	VueceThreadUtil::MutexUnlock(&d->audiotrack_mutex);
 
@@ -1418,6 +1159,26 @@ void VueceAudioWriter::EnableBufWinDownloadDuringStart(int enable_flag)
 
 }
 
+void VueceAudioWriter::SetBufferLowWatermark(int bytes)
+{
+	VueceThreadUtil::MutexLock(&d->mutex);
+
+	VueceLogger::Debug("VueceAudioWriter - SetBufferLowWatermark: %d bytes", bytes);
+
+	d->buffer_low_watermark = bytes;
+
+	VueceThreadUtil::MutexUnlock(&d->mutex);
+}
+
+void VueceAudioWriter::SetJitterController(VueceJitterController* j)
+{
+	VueceThreadUtil::MutexLock(&d->mutex);
+
+	d->jitter = j;
+
+	VueceThreadUtil::MutexUnlock(&d->mutex);
+}
+
 
 int VueceAudioWriter::GetCurrentPlayingProgress(void)
 {
@@ -1433,71 +1194,102 @@ int VueceAudioWriter::GetCurrentPlayingProgress(void)
 
 
 
-void VueceAudioWriter::Process(VueceMemQueue* in_q, VueceMemQueue* out_q)
+/*
+ * Nothing is copied here, AudioTrack writing thread reads decoded
+ * data from in_r directly.
+ *
+ * Note - AudioTrack writing thread and this method are both consumers of in_r,
+ * they are serialized by d->mutex
+ */
+void VueceAudioWriter::Process(VueceFrameRing* in_r, VueceFrameRing* out_r)
 {
-	VueceMemBulk* m = NULL;
-
-	if(in_q->IsEmpty())
+	if(in_r->IsEmpty())
 	{
-//		VueceLogger::Debug("VueceAudioWriter:: Process -Input queue is empty, do nothing and return");
 		return;
 	}
 
-	if(in_q->BulkCount() > 0)
-	{
-//		VueceLogger::Debug("VueceAudioWriter:: Process - Input queue bulk count: %d", in_q->BulkCount());
-	}
+	VueceThreadUtil::MutexLock(&d->mutex);
 
-	while ((m = in_q->Remove()) != NULL)
+	if (d->started)
 	{
-		if (d->started)
-		{
-			VueceThreadUtil::MutexLock(&d->mutex);
+		d->consumer_r = in_r;
 
-			d->consumer_q->Put(m);
+		OnNewDataQueued();
+	}
+	else
+	{
+		VueceLogger::Debug("VueceAudioWriter:: Process - Not started yet, abandoning size = %d", in_r->ReadableBytes());
 
-//			VueceLogger::Debug("VueceAudioWriter:: Process - adding bulk to consume_q, current size = %d", d->consumer_q->Size());
+		in_r->CommitRead(in_r->ReadableBytes());
+	}
 
-			//Vuece - wake up AudioTrack writing thread if it's waiting for data
-			if (d->sleeping)
-			{
+	VueceThreadUtil::MutexUnlock(&d->mutex);
+}
 
-				if( d->StateTranstition(VueceAudioWriterFsmEvent_DataReadyForConsumption) )
-				{
-					VueceThreadUtil::MutexLock(&d->audiotrack_mutex);
+/*
+ * Wake up AudioTrack writing thread if it's waiting for data, d->mutex must be held by caller
+ */
+void VueceAudioWriter::OnNewDataQueued()
+{
+	if (d->sleeping)
+	{
 
-					//fire the event
-					VueceStreamAudioWriterExternalEventNotification event;
-					event.id = VueceStreamAudioWriterExternalEvent_Playing;
+		if( d->StateTranstition(VueceAudioWriterFsmEvent_DataReadyForConsumption) )
+		{
+			VueceThreadUtil::MutexLock(&d->audiotrack_mutex);
 
-					d->SignalWriterEventNotification(&event);
+			//fire the event
+			VueceStreamAudioWriterExternalEventNotification event;
+			event.id = VueceStreamAudioWriterExternalEvent_Playing;
 
+			d->SignalWriterEventNotification(&event);
 
-					if(d->waiting_for_new_data)
-					{
-						VueceLogger::Debug("VueceAudioWriter:: Process - currently waiting for new data, wake up player thread now.");
 
-						d->waiting_for_new_data = false;
+			if(d->waiting_for_new_data)
+			{
+				VueceLogger::Debug("VueceAudioWriter:: Process - currently waiting for new data, wake up player thread now.");
 
-						//TODO - Do state transition here.
-						VueceThreadUtil::CondSignal(&d->cond);
-					}
+				d->waiting_for_new_data = false;
 
-					VueceThreadUtil::MutexUnlock(&d->audiotrack_mutex);
-				}
+				//TODO - Do state transition here.
+				VueceThreadUtil::CondSignal(&d->cond);
 			}
 
-//			VueceLogger::Debug("VueceAudioWriter:: Process - added a bulk into consume_q, size = %d", d->consumer_q->Size());
-
-			VueceThreadUtil::MutexUnlock(&d->mutex);
+			VueceThreadUtil::MutexUnlock(&d->audiotrack_mutex);
 		}
-		else
-		{
-			VueceLogger::Debug("VueceAudioWriter:: Process - Not started yet, abandoning size = %d", d->consumer_q->Size());
+	}
+}
 
-			VueceMemQueue::FreeMemBulk(m);
-		}
+/*
+ * Number of decoded bytes waiting to be written into AudioTrack, d->mutex must be held by caller
+ */
+int VueceAndroidSndWriteData::GetBufferedSize()
+{
+	if(consumer_r == NULL)
+	{
+		return 0;
+	}
+
+	return consumer_r->ReadableBytes();
+}
+
+int VueceAndroidSndWriteData::ReadBuffered(uint8_t *buffer, int length)
+{
+	int before = GetBufferedSize();
+	int ret = 0;
+
+	if(consumer_r != NULL)
+	{
+		ret = consumer_r->Read(buffer, length);
+	}
+
+	//only fire when the watermark is crossed, not on every read below it
+	if(buffer_low_watermark > 0 && before >= buffer_low_watermark && before - ret < buffer_low_watermark)
+	{
+		SignalBufferLow();
 	}
+
+	return ret;
 }
 
 bool VueceAndroidSndWriteData::StateTranstition(VueceAudioWriterFsmEvent e)
@@ -1548,7 +1340,7 @@ bool VueceAndroidSndWriteData::StateTranstition(VueceAudioWriterFsmEvent e)
 		}
 		default:
 		{
-			VueceStreamPlayer::AbortOnInvalidTranstion(MODUE_NAME_AUDIO_WRITER, event_s, current_state_s);
+			abort_on_invalid_transition(event_s, current_state_s);
 			break;
 		}
 		}
@@ -1563,7 +1355,7 @@ bool VueceAndroidSndWriteData::StateTranstition(VueceAudioWriterFsmEvent e)
 		{
 			//already buffering, ignore
 			allowed = true;
-			VueceStreamPlayer::LogIgnoredEvent(MODUE_NAME_AUDIO_WRITER, event_s, current_state_s);
+			log_ignored_event(event_s, current_state_s);
 			break;
 		}
 		case VueceAudioWriterFsmEvent_DataReadyForConsumption:
@@ -1576,6 +1368,11 @@ bool VueceAndroidSndWriteData::StateTranstition(VueceAudioWriterFsmEvent e)
 			watchdog_enabled = false;
 			watchdog_timer = 0;
 
+			if(jitter != NULL)
+			{
+				jitter->OnPlaybackStarted(VueceThreadUtil::GetCurTimeMs());
+			}
+
 			break;
 		}
 		case VueceAudioWriterFsmEvent_Pause:
@@ -1598,7 +1395,7 @@ bool VueceAndroidSndWriteData::StateTranstition(VueceAudioWriterFsmEvent e)
 		}
 		default:
 		{
-			VueceStreamPlayer::AbortOnInvalidTranstion(MODUE_NAME_AUDIO_WRITER, event_s, current_state_s);
+			abort_on_invalid_transition(event_s, current_state_s);
 			break;
 		}
 		}
@@ -1628,12 +1425,17 @@ bool VueceAndroidSndWriteData::StateTranstition(VueceAudioWriterFsmEvent e)
 
 			VueceLogger::Debug("StateTranstition - watchdog timer is started.");
 
+			if(jitter != NULL)
+			{
+				jitter->OnUnderrun(VueceThreadUtil::GetCurTimeMs());
+			}
+
 			break;
 		}
 		case VueceAudioWriterFsmEvent_DataReadyForConsumption:
 		{
 			//ignore
-			VueceStreamPlayer::LogIgnoredEvent(MODUE_NAME_AUDIO_WRITER, event_s, current_state_s);
+			log_ignored_event(event_s, current_state_s);
 			break;
 		}
 		case VueceAudioWriterFsmEvent_Pause:
@@ -1650,7 +1452,7 @@ bool VueceAndroidSndWriteData::StateTranstition(VueceAudioWriterFsmEvent e)
 		}
 		default:
 		{
-			VueceStreamPlayer::AbortOnInvalidTranstion(MODUE_NAME_AUDIO_WRITER, event_s, current_state_s);
+			abort_on_invalid_transition(event_s, current_state_s);
 		}
 		}
 
@@ -1664,13 +1466,13 @@ bool VueceAndroidSndWriteData::StateTranstition(VueceAudioWriterFsmEvent e)
 		case VueceAudioWriterFsmEvent_DataNotAvailable:
 		{
 			//ignore
-			VueceStreamPlayer::LogIgnoredEvent(MODUE_NAME_AUDIO_WRITER, event_s, current_state_s);
+			log_ignored_event(event_s, current_state_s);
 			break;
 		}
 		case VueceAudioWriterFsmEvent_DataReadyForConsumption:
 		{
 			//ignore
-			VueceStreamPlayer::LogIgnoredEvent(MODUE_NAME_AUDIO_WRITER, event_s, current_state_s);
+			log_ignored_event(event_s, current_state_s);
 			break;
 		}
 		case VueceAudioWriterFsmEvent_Resume:
@@ -1687,7 +1489,7 @@ bool VueceAndroidSndWriteData::StateTranstition(VueceAudioWriterFsmEvent e)
 		}
 		default:
 		{
-			VueceStreamPlayer::AbortOnInvalidTranstion(MODUE_NAME_AUDIO_WRITER, event_s, current_state_s);
+			abort_on_invalid_transition(event_s, current_state_s);
 		}
 		}
 
@@ -1700,7 +1502,7 @@ bool VueceAndroidSndWriteData::StateTranstition(VueceAudioWriterFsmEvent e)
 		case VueceAudioWriterFsmEvent_DataNotAvailable:
 		{
 			allowed = true;
-			VueceStreamPlayer::LogIgnoredEvent(MODUE_NAME_AUDIO_WRITER, event_s, current_state_s);
+			log_ignored_event(event_s, current_state_s);
 			//ignore
 			break;
 		}
@@ -1712,7 +1514,7 @@ bool VueceAndroidSndWriteData::StateTranstition(VueceAudioWriterFsmEvent e)
 		}
 		default:
 		{
-			VueceStreamPlayer::AbortOnInvalidTranstion(MODUE_NAME_AUDIO_WRITER, event_s, current_state_s);
+			abort_on_invalid_transition(event_s, current_state_s);
 		}
 		}
 
@@ -1721,7 +1523,7 @@ bool VueceAndroidSndWriteData::StateTranstition(VueceAudioWriterFsmEvent e)
 	case VueceAudioWriterFsmState_Stopped:
 	{
 		//this state doesn't accept any event
-		VueceStreamPlayer::AbortOnInvalidTranstion(MODUE_NAME_AUDIO_WRITER, event_s, current_state_s);
+		abort_on_invalid_transition(event_s, current_state_s);
 		break;
 	}
 	default:
@@ -1734,7 +1536,7 @@ bool VueceAndroidSndWriteData::StateTranstition(VueceAudioWriterFsmEvent e)
 	if(allowed)
 	{
 		GetFsmStateString(player_state, new_state_s);
-		VueceStreamPlayer::LogStateTranstion(MODUE_NAME_AUDIO_WRITER, event_s, current_state_s, new_state_s);
+		log_state_transition(event_s, current_state_s, new_state_s);
 	}
 
 	VueceThreadUtil::MutexUnlock(&mutex_fsm_state);
@@ -8,15 +8,16 @@
 #ifndef VUECEAUDIOWRITER_H_
 #define VUECEAUDIOWRITER_H_
 
-#include <jni.h>
-
 #include "talk/base/sigslot.h"
 
 #include "VueceConstants.h"
 
-#include "VueceMemQueue.h"
+#include "VueceFrameRing.h"
 #include "VueceThreadUtil.h"
-#include "VueceJni.h"
+
+class VueceJitterController;
+class VueceAudioSink;
+class VueceAudioWriterObserver;
 
 //mono by default
 static int vuece_current_channel_config = VUECE_ANDROID_CHANNEL_CONFIGURATION_MONO;
@@ -107,8 +108,6 @@ public:
 	 * another position and this position is beyond buffer window threshold
 	 */
 	bool bTriggerNextBufWinDldAfterStart;
-
-	int	buff_size; /*buffer size in bytes*/
 };
 
 
@@ -116,41 +115,42 @@ public:
 class VueceAndroidSndWriteData : public VueceAndroidSndData{
 public:
 
-	jclass 			audio_track_class;
-	jobject			audio_track;
-	VueceMemQueue* consumer_q;
+	//decoder output ring, set by first Process() call, not owned by writer
+	VueceFrameRing* consumer_r;
 	pthread_cond_t		cond;
 	int 			write_chunk_size;
 	unsigned int	writtenBytes;
 	unsigned long 	last_sample_date;
 	bool 			sleeping;
 	int 			totoal_duration_in_sec;
-	jclass 			jabber_client_class;
-	jobject 		jabber_client_object;
-
-	jmethodID 		write_id;
-	jmethodID 		play_id;
-	jmethodID 		pause_id;
-	jmethodID 		flush_id;
-	jmethodID 		stop_id;
-	jmethodID 		get_header_pos_id;
-	jmethodID 		set_header_pos_id;
-	jmethodID       on_player_progress_id;
-	jmethodID       on_player_state_id;
-	jmethodID 		get_client_id;
 
 	int current_player_pos;
 
+	//SignalBufferLow is fired when buffered data drops below this level, 0 means disabled
+	int buffer_low_watermark;
+
+	//adaptive buffering, notified of underruns and provides buffer window threshold, not owned by writer
+	VueceJitterController* jitter;
+
+	//output device, owned by writer
+	VueceAudioSink* sink;
+
+	//receives play progress and player state, owned by writer, can be NULL
+	VueceAudioWriterObserver* observer;
+
+	//max number of bytes handed to sink in one write, multiple of write_chunk_size
+	int write_batch_size;
+
 	sigslot::signal1<VueceStreamAudioWriterExternalEventNotification*> SignalWriterEventNotification;
+	sigslot::signal0<> SignalBufferLow;
 
 public:
 	VueceAndroidSndWriteData();
 	~VueceAndroidSndWriteData();
 
 	bool StateTranstition(VueceAudioWriterFsmEvent event);
-	unsigned int getWriteBuffSize() {
-		return buff_size;
-	}
+	int  GetBufferedSize();
+	int  ReadBuffered(uint8_t *buffer, int length);
 	int getWrittenFrames() {
 		return writtenBytes/(nchannels*(bits/8));
 	}
@@ -169,9 +169,14 @@ public:
 	VueceAudioWriter();
 	virtual ~VueceAudioWriter();
 
-	bool Init(int channel_mode, int nr_channels, int stream_mode, int duration, int sample_rate, int resume_pos);
+	/*
+	 * PCM is played through sink, progress and state are reported to observer, writer takes
+	 * ownership of both, observer can be NULL
+	 */
+	bool Init(int channel_mode, int nr_channels, int stream_mode, int duration, int sample_rate, int resume_pos,
+			VueceAudioSink* sink, VueceAudioWriterObserver* observer);
 	void Uninit();
-	void Process(VueceMemQueue* in_q, VueceMemQueue* out_q);
+	void Process(VueceFrameRing* in_r, VueceFrameRing* out_r);
 
 	void 	SetWriteRate(int proposed_rate);
 	int 	GetRate();
@@ -187,10 +192,15 @@ public:
 	void 	MarkAsAllDataAvailable();
 	void 	EnableBufWin(int enable_flag);
 	void 	EnableBufWinDownloadDuringStart(int enable_flag);
+	void 	SetBufferLowWatermark(int bytes);
+	void 	SetJitterController(VueceJitterController* j);
 	int 	GetCurrentPlayingProgress(void);
 
 	//TODO - give this a proper name later.
 	VueceAndroidSndWriteData* d;
+
+private:
+	void OnNewDataQueued();
 };
 
 
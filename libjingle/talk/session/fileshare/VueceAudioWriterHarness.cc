@@ -0,0 +1,216 @@
+/*
+ * VueceAudioWriterHarness.cc
+ *
+ *  Created on: Mar 27, 2015
+ *      Author: jingjing
+ *
+ * Standalone program, not part of the library build. Runs VueceAudioWriter on a Linux
+ * host with VueceFileAudioSink as output device, no JVM is involved. A raw S16 PCM file
+ * is fed into the writer through a VueceFrameRing in decoder sized frames, the way
+ * VueceStreamEngine does, then the harness waits until everything is written and checks
+ * the sink output is identical to the input.
+ *
+ * It prints the time it takes to push the file through the writer and the number of
+ * progress and state notifications, sink stats (writes, bytes per write) are logged
+ * when the writer is stopped.
+ *
+ * Usage: VueceAudioWriterHarness <pcm file> <rate> <channels> [output file]
+ *
+ * Output goes to VueceAudioWriterHarness.pcm unless another file is given.
+ *
+ * Build on a Linux host, from this folder:
+ *
+ *   g++ -DPOSIX -DLINUX -I. -I../../.. -I../../../../client-core -I../../../../externals/jthread/src
+ *       -I../../../../externals/jthread/src/pthread VueceAudioWriterHarness.cc VueceAudioWriter.cc
+ *       VueceFileAudioSink.cc VueceFrameRing.cc VueceJitterController.cc VueceJni.cc
+ *       ../../../../client-core/VueceThreadUtil.cc ../../../../client-core/VueceLogger.cc
+ *       ../../../../externals/jthread/src/pthread/jmutex.cpp
+ *       ../../base/{logging,stream,fileutils,unixfilesystem,pathutils,thread,messagequeue,
+ *       physicalsocketserver,event,timeutils,stringutils,stringencode,common,asyncsocket,
+ *       socketaddress,nethelpers,messagehandler,signalthread,asyncfile,urlencode}.cc
+ *       -lpthread -o VueceAudioWriterHarness
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "VueceAudioWriter.h"
+#include "VueceAudioWriterObserver.h"
+#include "VueceFileAudioSink.h"
+#include "VueceFrameRing.h"
+#include "VueceThreadUtil.h"
+
+#define HARNESS_OUTPUT_FILE "VueceAudioWriterHarness.pcm"
+
+//AAC decoder output, 1024 samples per channel
+#define HARNESS_FRAME_SAMPLES 1024
+#define HARNESS_RING_FRAMES 64
+
+class VueceHarnessObserver : public VueceAudioWriterObserver
+{
+public:
+	VueceHarnessObserver() : progress_count(0), state_count(0), last_pos_sec(0) {}
+
+	virtual void OnPlayingProgress(int pos_sec)
+	{
+		progress_count++;
+		last_pos_sec = pos_sec;
+	}
+
+	virtual void OnPlayerStateChanged(int state)
+	{
+		state_count++;
+	}
+
+	volatile int progress_count;
+	volatile int state_count;
+	volatile int last_pos_sec;
+};
+
+static uint8_t* LoadFile(const char* path, long* len)
+{
+	FILE* f = NULL;
+	uint8_t* data = NULL;
+
+	f = fopen(path, "rb");
+
+	if(f == NULL)
+	{
+		fprintf(stderr, "Cannot open %s\n", path);
+		return NULL;
+	}
+
+	fseek(f, 0, SEEK_END);
+	*len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	data = (uint8_t*)malloc(*len > 0 ? *len : 1);
+
+	if(data == NULL || (long)fread(data, 1, *len, f) != *len)
+	{
+		fprintf(stderr, "Cannot read %s\n", path);
+		free(data);
+		data = NULL;
+	}
+
+	fclose(f);
+
+	return data;
+}
+
+int main(int argc, char* argv[])
+{
+	VueceAudioWriter writer;
+	VueceHarnessObserver* observer = new VueceHarnessObserver();
+	VueceFrameRing ring;
+	const char* out_file = HARNESS_OUTPUT_FILE;
+	uint8_t* pcm = NULL;
+	uint8_t* out = NULL;
+	long pcm_len = 0;
+	long out_len = 0;
+	long fed = 0;
+	long expected = 0;
+	int rate = 0;
+	int channels = 0;
+	int frame_len = 0;
+	int chunk_size = 0;
+	int progress_count = 0;
+	int state_count = 0;
+	uint64_t start_ms = 0;
+	uint64_t elapsed_ms = 0;
+	bool identical = false;
+
+	if(argc < 4 || argc > 5)
+	{
+		fprintf(stderr, "usage: %s <pcm file> <rate> <channels> [output file]\n", argv[0]);
+		return 1;
+	}
+
+	rate = atoi(argv[2]);
+	channels = atoi(argv[3]);
+
+	if(argc > 4)
+	{
+		out_file = argv[4];
+	}
+
+	if(rate <= 0 || (channels != 1 && channels != 2))
+	{
+		fprintf(stderr, "Unsupported format: %d Hz, %d channel(s)\n", rate, channels);
+		return 1;
+	}
+
+	pcm = LoadFile(argv[1], &pcm_len);
+
+	if(pcm == NULL)
+	{
+		return 1;
+	}
+
+	frame_len = HARNESS_FRAME_SAMPLES * channels * 2;
+
+	if(!ring.Init(frame_len * HARNESS_RING_FRAMES, HARNESS_RING_FRAMES))
+	{
+		fprintf(stderr, "Cannot allocate ring\n");
+		return 1;
+	}
+
+	if(!writer.Init(channels == 1 ? VUECE_ANDROID_CHANNEL_CONFIGURATION_MONO : VUECE_ANDROID_CHANNEL_CONFIGURATION_STEREO,
+			channels, VUECE_ANDROID_AUDIO_STREAM_MODE_MUSIC, (int)(pcm_len / (rate * channels * 2)) + 1, rate, 0,
+			new VueceFileAudioSink(out_file), observer))
+	{
+		fprintf(stderr, "Writer cannot be initialized\n");
+		return 1;
+	}
+
+	chunk_size = writer.d->write_chunk_size;
+
+	start_ms = VueceThreadUtil::GetCurTimeMs();
+
+	while(fed < pcm_len)
+	{
+		int len = (pcm_len - fed < frame_len) ? (int)(pcm_len - fed) : frame_len;
+
+		if(!ring.HasRoomFor(len))
+		{
+			VueceThreadUtil::SleepMs(1);
+			continue;
+		}
+
+		ring.WriteFrame(pcm + fed, len);
+		fed += len;
+
+		writer.Process(&ring, NULL);
+	}
+
+	writer.MarkAsAllDataAvailable();
+
+	//writer only hands whole chunks to the sink, the last partial one stays in the ring
+	while(ring.ReadableBytes() >= chunk_size)
+	{
+		VueceThreadUtil::SleepMs(1);
+	}
+
+	elapsed_ms = VueceThreadUtil::GetCurTimeMs() - start_ms;
+
+	progress_count = observer->progress_count;
+	state_count = observer->state_count;
+
+	writer.Uninit();
+
+	expected = pcm_len - pcm_len % chunk_size;
+
+	out = LoadFile(out_file, &out_len);
+
+	identical = (out != NULL && out_len == expected && memcmp(out, pcm, expected) == 0);
+
+	printf("%ld bytes in, %ld bytes written, %d bytes per write batch, %llu ms, %d progress and %d state notification(s)\n",
+			pcm_len, out_len, writer.d->write_batch_size, (unsigned long long)elapsed_ms, progress_count, state_count);
+	printf("output identical: %d\n", identical ? 1 : 0);
+
+	free(out);
+	free(pcm);
+
+	return identical ? 0 : 1;
+}
@@ -0,0 +1,31 @@
+/*
+ * VueceAudioWriterObserver.h
+ *
+ *  Created on: Mar 27, 2015
+ *      Author: jingjing
+ */
+
+#ifndef VUECEAUDIOWRITEROBSERVER_H_
+#define VUECEAUDIOWRITEROBSERVER_H_
+
+/*
+ * Receives play progress and player state of VueceAudioWriter, the application is
+ * reached through it (JabberClient through JNI on Android).
+ *
+ * OnPlayingProgress() is called once a second on progress checker thread,
+ * OnPlayerStateChanged() is called on writer thread when playing starts and by
+ * player control on resume.
+ */
+class VueceAudioWriterObserver
+{
+public:
+	virtual ~VueceAudioWriterObserver() {}
+
+	//play position in seconds
+	virtual void OnPlayingProgress(int pos_sec) = 0;
+
+	//state is a VueceAudioWriterFsmState value
+	virtual void OnPlayerStateChanged(int state) = 0;
+};
+
+#endif /* VUECEAUDIOWRITEROBSERVER_H_ */
@@ -0,0 +1,115 @@
+/*
+ * VueceChunkFrameIndex.cc
+ *
+ *  Created on: Mar 18, 2015
+ *      Author: jingjing
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "VueceLogger.h"
+#include "VueceConstants.h"
+#include "VueceConfig.h"
+#include "VueceChunkFrameIndex.h"
+#include "VueceSegmentStore.h"
+#include "VueceMmapChunkReader.h"
+
+void VueceChunkFrameIndex::PutInt(uint8_t* b, int v)
+{
+	b[0] = (v >> 24) & 0xFF;
+	b[1] = (v >> 16) & 0xFF;
+	b[2] = (v >> 8) & 0xFF;
+	b[3] = v & 0xFF;
+}
+
+/*
+ * Build the index record of a frame, frame points to the frame header
+ */
+void VueceChunkFrameIndex::MakeRecord(uint8_t* rec, int offset, const uint8_t* frame, int len)
+{
+	PutInt(rec, offset);
+	memcpy(rec + 4, frame + 5, 4);
+	PutInt(rec + 8, len - VUECE_STREAM_FRAME_HEADER_LENGTH);
+}
+
+/*
+ * Binary search the index of a chunk for the first frame whose time stamp
+ * is not less than target_ts.
+ *
+ * Returns true if the target frame is found in the index, otherwise offset/frame_no
+ * point to the frame next to the last indexed one (or the beginning of the chunk if
+ * nothing is indexed), the caller should scan from there.
+ */
+bool VueceChunkFrameIndex::Lookup(VueceSegmentStore* store, int chunk_idx, int target_ts, size_t* offset, int* frame_no)
+{
+	uint8_t* buf = NULL;
+	uint8_t* rec = NULL;
+	int count = 0;
+	int lo = 0;
+	int hi = 0;
+	int mid = 0;
+	bool found = false;
+
+	*offset = 0;
+	*frame_no = 0;
+
+	buf = (uint8_t*)malloc(VUECE_AUDIO_FRAMES_PER_CHUNK * VUECE_CHUNK_INDEX_RECORD_LENGTH);
+
+	if(buf == NULL)
+	{
+		return false;
+	}
+
+	//one read for the whole index, it's only a few KB per chunk
+	count = store->ReadChunkIndex(chunk_idx, buf, VUECE_AUDIO_FRAMES_PER_CHUNK);
+
+	if(count <= 0)
+	{
+		VueceLogger::Warn("VueceChunkFrameIndex::Lookup - No index available for chunk %d", chunk_idx);
+		free(buf);
+		return false;
+	}
+
+	lo = 0;
+	hi = count;
+
+	while(lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+
+		if(VueceMmapChunkReader::ParseInt(buf + mid * VUECE_CHUNK_INDEX_RECORD_LENGTH + 4) < target_ts)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	if(lo < count)
+	{
+		rec = buf + lo * VUECE_CHUNK_INDEX_RECORD_LENGTH;
+
+		*offset = (size_t)VueceMmapChunkReader::ParseInt(rec);
+		*frame_no = lo;
+
+		found = true;
+	}
+	else
+	{
+		//target frame is not downloaded yet, continue after the last indexed frame
+		rec = buf + (count - 1) * VUECE_CHUNK_INDEX_RECORD_LENGTH;
+
+		*offset = (size_t)VueceMmapChunkReader::ParseInt(rec) + VUECE_STREAM_FRAME_HEADER_LENGTH + VueceMmapChunkReader::ParseInt(rec + 8);
+		*frame_no = count;
+	}
+
+	free(buf);
+
+	VueceLogger::Debug("VueceChunkFrameIndex::Lookup - chunk %d, target ts = %d, %d records, found = %d, frame no = %d, offset = %lu",
+			chunk_idx, target_ts, count, found, *frame_no, (unsigned long)*offset);
+
+	return found;
+}
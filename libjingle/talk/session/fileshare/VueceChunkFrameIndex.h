@@ -0,0 +1,42 @@
+/*
+ * VueceChunkFrameIndex.h
+ *
+ *  Created on: Mar 18, 2015
+ *      Author: jingjing
+ */
+
+#ifndef VUECECHUNKFRAMEINDEX_H_
+#define VUECECHUNKFRAMEINDEX_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Size of one index record: [FrameOffset][FrameTS][FrameLen], 4 bytes each,
+ * big-endian like the frame header itself
+ */
+#define VUECE_CHUNK_INDEX_RECORD_LENGTH 12
+
+class VueceSegmentStore;
+
+/*
+ * Frame index of an audio chunk, one record per frame. Records are written
+ * by VueceSegmentStore into the index area of the chunk's segment when a frame
+ * is appended, and used by VueceMediaDataBumper to locate the target frame
+ * of a local seek with a binary search instead of walking all frame headers
+ * of the chunk.
+ *
+ * Offsets are relative to the first frame of the chunk.
+ */
+class VueceChunkFrameIndex
+{
+public:
+	static void MakeRecord(uint8_t* rec, int offset, const uint8_t* frame, int len);
+
+	static bool Lookup(VueceSegmentStore* store, int chunk_idx, int target_ts, size_t* offset, int* frame_no);
+
+private:
+	static void PutInt(uint8_t* b, int v);
+};
+
+#endif /* VUECECHUNKFRAMEINDEX_H_ */
@@ -0,0 +1,140 @@
+/*
+ * VueceFileAudioSink.cc
+ *
+ *  Created on: Mar 26, 2015
+ *      Author: jingjing
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "VueceLogger.h"
+#include "VueceFileAudioSink.h"
+
+VueceFileAudioSink::VueceFileAudioSink(const char* name)
+{
+	VueceLogger::Debug("VueceFileAudioSink - Constructor called, file: %s", name != NULL ? name : "<null>");
+
+	memset(file_name, 0, sizeof(file_name));
+
+	if(name != NULL)
+	{
+		strncpy(file_name, name, sizeof(file_name) - 1);
+	}
+
+	file = NULL;
+
+	buffer = NULL;
+	buffer_size = 0;
+
+	write_count = 0;
+	written_bytes = 0;
+	start_ms = 0;
+}
+
+VueceFileAudioSink::~VueceFileAudioSink()
+{
+	VueceLogger::Debug("VueceFileAudioSink - Destructor called");
+
+	Stop();
+
+	if(buffer != NULL)
+	{
+		free(buffer);
+	}
+}
+
+//a file takes any amount of data in one write
+bool VueceFileAudioSink::Open(int rate, int channels, int max_write_len)
+{
+	VueceLogger::Debug("VueceFileAudioSink::Open - %d Hz, %d channel(s), buffer size: %d", rate, channels, max_write_len);
+
+	buffer_size = max_write_len;
+	buffer = (uint8_t*)malloc(buffer_size);
+
+	return buffer != NULL;
+}
+
+bool VueceFileAudioSink::Start()
+{
+	if(buffer == NULL)
+	{
+		VueceLogger::Fatal("VueceFileAudioSink::Start - Output buffer is not allocated");
+		return false;
+	}
+
+	if(file_name[0] != '\0')
+	{
+		file = fopen(file_name, "wb");
+
+		if(file == NULL)
+		{
+			VueceLogger::Error("VueceFileAudioSink::Start - Cannot open %s: %s", file_name, strerror(errno));
+			return false;
+		}
+	}
+
+	start_ms = VueceThreadUtil::GetCurTimeMs();
+
+	return true;
+}
+
+uint8_t* VueceFileAudioSink::GetBuffer()
+{
+	return buffer;
+}
+
+int VueceFileAudioSink::GetBufferSize()
+{
+	return buffer_size;
+}
+
+int VueceFileAudioSink::Write(int len)
+{
+	if(len <= 0 || len > buffer_size)
+	{
+		VueceLogger::Error("VueceFileAudioSink::Write - Invalid length: %d", len);
+		return -1;
+	}
+
+	if(file != NULL && fwrite(buffer, 1, len, file) != (size_t)len)
+	{
+		VueceLogger::Error("VueceFileAudioSink::Write - fwrite failed: %s", strerror(errno));
+		return -1;
+	}
+
+	write_count++;
+	written_bytes += len;
+
+	return len;
+}
+
+void VueceFileAudioSink::Pause()
+{
+	if(file != NULL)
+	{
+		fflush(file);
+	}
+}
+
+void VueceFileAudioSink::Resume()
+{
+}
+
+void VueceFileAudioSink::Stop()
+{
+	if(file != NULL)
+	{
+		fclose(file);
+		file = NULL;
+	}
+}
+
+void VueceFileAudioSink::LogStats()
+{
+	uint64_t elapsed = VueceThreadUtil::GetCurTimeMs() - start_ms;
+
+	VueceLogger::Info("VueceFileAudioSink - Stats: %ld writes, %lld bytes in %llu ms",
+			write_count, written_bytes, elapsed);
+}
@@ -0,0 +1,55 @@
+/*
+ * VueceFileAudioSink.h
+ *
+ *  Created on: Mar 26, 2015
+ *      Author: jingjing
+ */
+
+#ifndef VUECEFILEAUDIOSINK_H_
+#define VUECEFILEAUDIOSINK_H_
+
+#include <stdio.h>
+
+#include "VueceAudioSink.h"
+#include "VueceThreadUtil.h"
+
+/*
+ * Writes raw PCM into a file, or discards it if no file name is given.
+ *
+ * It does not touch JNI so the writer output path can be exercised and
+ * benchmarked on a desktop build, written data can be checked with any tool
+ * that reads raw 16 bit PCM.
+ */
+class VueceFileAudioSink : public VueceAudioSink
+{
+public:
+	explicit VueceFileAudioSink(const char* file_name);
+	virtual ~VueceFileAudioSink();
+
+	virtual bool Open(int rate, int channels, int max_write_len);
+	virtual bool Start();
+
+	virtual uint8_t* GetBuffer();
+	virtual int GetBufferSize();
+
+	virtual int Write(int len);
+
+	virtual void Pause();
+	virtual void Resume();
+	virtual void Stop();
+
+	virtual void LogStats();
+
+private:
+	char file_name[256];
+	FILE* file;
+
+	uint8_t* buffer;
+	int buffer_size;
+
+	long write_count;
+	int64_t written_bytes;
+	uint64_t start_ms;
+};
+
+#endif /* VUECEFILEAUDIOSINK_H_ */
@@ -0,0 +1,371 @@
+/*
+ * VueceFrameRing.cc
+ *
+ *  Created on: Mar 9, 2015
+ *      Author: jingjing
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "VueceLogger.h"
+#include "VueceFrameRing.h"
+
+/*
+ * Full barrier, make sure payload/frame length writes are visible before
+ * the index that publishes them, and reads are done before the index
+ * that releases them
+ */
+#define RING_BARRIER() __sync_synchronize()
+
+VueceFrameRing::VueceFrameRing()
+{
+	VueceLogger::Debug("VueceFrameRing - Constructor called");
+
+	storage = NULL;
+	frame_len = NULL;
+	byte_mask = 0;
+	frame_mask = 0;
+	byte_head = 0;
+	frame_head = 0;
+	byte_tail = 0;
+	frame_tail = 0;
+	front_frame_consumed = 0;
+	high_water_mark = 0;
+}
+
+VueceFrameRing::~VueceFrameRing()
+{
+	VueceLogger::Debug("VueceFrameRing - Destructor called");
+
+	Uninit();
+}
+
+unsigned int VueceFrameRing::RoundUpToPowerOfTwo(unsigned int v)
+{
+	unsigned int r = 1;
+
+	while(r < v)
+	{
+		r <<= 1;
+	}
+
+	return r;
+}
+
+bool VueceFrameRing::Init(int byte_capacity, int frame_capacity)
+{
+	unsigned int byte_cap = 0;
+	unsigned int frame_cap = 0;
+
+	if(byte_capacity <= 0 || frame_capacity <= 0)
+	{
+		VueceLogger::Fatal("VueceFrameRing::Init - Invalid capacity: %d bytes, %d frames", byte_capacity, frame_capacity);
+		return false;
+	}
+
+	byte_cap = RoundUpToPowerOfTwo((unsigned int)byte_capacity);
+	frame_cap = RoundUpToPowerOfTwo((unsigned int)frame_capacity);
+
+	VueceLogger::Debug("VueceFrameRing::Init - byte capacity: %u, frame capacity: %u", byte_cap, frame_cap);
+
+	storage = (uint8_t*)malloc(byte_cap + VUECE_FRAME_RING_TAIL_PADDING);
+	frame_len = (int*)malloc(frame_cap * sizeof(int));
+
+	if(storage == NULL || frame_len == NULL)
+	{
+		VueceLogger::Fatal("VueceFrameRing::Init - Cannot allocate ring storage");
+		Uninit();
+		return false;
+	}
+
+	memset(storage + byte_cap, 0, VUECE_FRAME_RING_TAIL_PADDING);
+
+	byte_mask = byte_cap - 1;
+	frame_mask = frame_cap - 1;
+	byte_head = byte_tail = 0;
+	frame_head = frame_tail = 0;
+	front_frame_consumed = 0;
+	high_water_mark = 0;
+
+	return true;
+}
+
+void VueceFrameRing::Uninit()
+{
+	if(storage != NULL)
+	{
+		free(storage);
+		storage = NULL;
+	}
+
+	if(frame_len != NULL)
+	{
+		free(frame_len);
+		frame_len = NULL;
+	}
+
+	byte_mask = 0;
+	frame_mask = 0;
+}
+
+int VueceFrameRing::GetSpans(unsigned int start, int len, VueceRingSpan* spans)
+{
+	unsigned int offset = start & byte_mask;
+	int first = (int)(byte_mask + 1 - offset);
+
+	if(first > len)
+	{
+		first = len;
+	}
+
+	spans[0].data = storage + offset;
+	spans[0].len = first;
+	spans[1].data = storage;
+	spans[1].len = len - first;
+
+	return len;
+}
+
+/* ---------------------------- producer side ---------------------------- */
+
+int VueceFrameRing::WritableBytes()
+{
+	unsigned int bt = byte_tail;
+	unsigned int ft = frame_tail;
+
+	if(storage == NULL)
+	{
+		return 0;
+	}
+
+	//no free frame slot left
+	if(frame_head - ft > frame_mask)
+	{
+		return 0;
+	}
+
+	return (int)(byte_mask + 1 - (byte_head - bt));
+}
+
+bool VueceFrameRing::HasRoomFor(int len)
+{
+	return WritableBytes() >= len;
+}
+
+/*
+ * Returns the total number of writable bytes, caller writes its payload
+ * into spans and publishes it with CommitFrame()
+ */
+int VueceFrameRing::PeekWrite(VueceRingSpan* spans)
+{
+	return GetSpans(byte_head, WritableBytes(), spans);
+}
+
+bool VueceFrameRing::CommitFrame(int len)
+{
+	int buffered = 0;
+
+	if(len <= 0 || len > WritableBytes())
+	{
+		VueceLogger::Error("VueceFrameRing::CommitFrame - Invalid frame length: %d, writable: %d", len, WritableBytes());
+		return false;
+	}
+
+	frame_len[frame_head & frame_mask] = len;
+
+	//frame must be visible before its bytes, byte level consumers walk frame lengths
+	RING_BARRIER();
+	frame_head = frame_head + 1;
+	RING_BARRIER();
+	byte_head = byte_head + len;
+
+	buffered = (int)(byte_head - byte_tail);
+
+	if(buffered > high_water_mark)
+	{
+		high_water_mark = buffered;
+	}
+
+	return true;
+}
+
+bool VueceFrameRing::WriteFrame(const uint8_t* data, int len)
+{
+	VueceRingSpan spans[2];
+
+	if(!HasRoomFor(len))
+	{
+		return false;
+	}
+
+	GetSpans(byte_head, len, spans);
+
+	memcpy(spans[0].data, data, spans[0].len);
+
+	if(spans[1].len > 0)
+	{
+		memcpy(spans[1].data, data + spans[0].len, spans[1].len);
+	}
+
+	return CommitFrame(len);
+}
+
+/* ---------------------------- consumer side ---------------------------- */
+
+int VueceFrameRing::ReadableBytes()
+{
+	unsigned int bh = byte_head;
+
+	RING_BARRIER();
+
+	return (int)(bh - byte_tail);
+}
+
+int VueceFrameRing::FrameCount()
+{
+	unsigned int fh = frame_head;
+
+	RING_BARRIER();
+
+	return (int)(fh - frame_tail);
+}
+
+bool VueceFrameRing::IsEmpty()
+{
+	return FrameCount() == 0;
+}
+
+/*
+ * Returns the length of the front frame (or what's left of it if it has been
+ * partially consumed by CommitRead()), 0 if there is no frame
+ */
+int VueceFrameRing::PeekFrame(VueceRingSpan* spans)
+{
+	int len = 0;
+
+	if(FrameCount() == 0)
+	{
+		return 0;
+	}
+
+	len = frame_len[frame_tail & frame_mask] - front_frame_consumed;
+
+	return GetSpans(byte_tail, len, spans);
+}
+
+void VueceFrameRing::ReleaseFrame()
+{
+	int remaining = 0;
+
+	if(FrameCount() == 0)
+	{
+		return;
+	}
+
+	remaining = frame_len[frame_tail & frame_mask] - front_frame_consumed;
+
+	front_frame_consumed = 0;
+
+	//payload must be consumed before producer can reuse the space
+	RING_BARRIER();
+	byte_tail = byte_tail + remaining;
+	frame_tail = frame_tail + 1;
+}
+
+int VueceFrameRing::PeekRead(VueceRingSpan* spans)
+{
+	return GetSpans(byte_tail, ReadableBytes(), spans);
+}
+
+void VueceFrameRing::CommitRead(int len)
+{
+	unsigned int ft = frame_tail;
+	int readable = ReadableBytes();
+	int consumed = front_frame_consumed;
+	int left = 0;
+	int rest = 0;
+
+	if(len > readable)
+	{
+		VueceLogger::Error("VueceFrameRing::CommitRead - Trying to commit %d bytes while only %d bytes are readable", len, readable);
+		len = readable;
+	}
+
+	left = len;
+
+	//advance over all frames covered by this read
+	while(left > 0)
+	{
+		rest = frame_len[ft & frame_mask] - consumed;
+
+		if(left < rest)
+		{
+			consumed += left;
+			break;
+		}
+
+		left -= rest;
+		consumed = 0;
+		ft++;
+	}
+
+	front_frame_consumed = consumed;
+
+	RING_BARRIER();
+	byte_tail = byte_tail + len;
+	frame_tail = ft;
+}
+
+int VueceFrameRing::Read(uint8_t* buffer, int len)
+{
+	VueceRingSpan spans[2];
+	int n = ReadableBytes();
+
+	if(n > len)
+	{
+		n = len;
+	}
+
+	if(n <= 0)
+	{
+		return 0;
+	}
+
+	GetSpans(byte_tail, n, spans);
+
+	memcpy(buffer, spans[0].data, spans[0].len);
+
+	if(spans[1].len > 0)
+	{
+		memcpy(buffer + spans[0].len, spans[1].data, spans[1].len);
+	}
+
+	CommitRead(n);
+
+	return n;
+}
+
+int VueceFrameRing::GetByteCapacity()
+{
+	return (int)(byte_mask + 1);
+}
+
+int VueceFrameRing::GetFrameCapacity()
+{
+	return (int)(frame_mask + 1);
+}
+
+int VueceFrameRing::GetHighWaterMark()
+{
+	return high_water_mark;
+}
+
+/*
+ * Total number of frames committed since Init(), wraps around, it's used
+ * to tell whether producer has made any progress
+ */
+unsigned int VueceFrameRing::GetProducedFrameCount()
+{
+	return frame_head;
+}
@@ -0,0 +1,102 @@
+/*
+ * VueceFrameRing.h
+ *
+ *  Created on: Mar 9, 2015
+ *      Author: jingjing
+ */
+
+#ifndef VUECEFRAMERING_H_
+#define VUECEFRAMERING_H_
+
+#include <stdint.h>
+
+/*
+ * Zeroed bytes allocated after the end of ring storage, a frame ending at the
+ * end of storage can be handed to a decoder in place which reads a bit past the
+ * end of its input (see FF_INPUT_BUFFER_PADDING_SIZE)
+ */
+#define VUECE_FRAME_RING_TAIL_PADDING 64
+
+/*
+ * A contiguous piece of ring storage, a wrapped region is described
+ * by two spans, the second one starts at the beginning of the storage
+ */
+typedef struct VueceRingSpan
+{
+	uint8_t* data;
+	int len;
+} VueceRingSpan;
+
+/*
+ * Single-producer/single-consumer byte ring which also remembers frame
+ * boundaries, it's used to link two stream engine stages together.
+ *
+ * Both byte capacity and frame capacity are rounded up to power of two, head
+ * and tail indices are free-running counters so no lock is needed as long as
+ * there is only one producer thread and one consumer thread.
+ *
+ * Producer side: WritableBytes/HasRoomFor/PeekWrite/CommitFrame/WriteFrame
+ * Consumer side: ReadableBytes/FrameCount/PeekFrame/ReleaseFrame/PeekRead/CommitRead/Read
+ *
+ * A consumer can either consume whole frames (decoder) or an arbitrary number
+ * of bytes regardless of frame boundaries (audio writer).
+ */
+class VueceFrameRing
+{
+public:
+	VueceFrameRing();
+	virtual ~VueceFrameRing();
+
+	bool Init(int byte_capacity, int frame_capacity);
+	void Uninit();
+
+	//producer side
+	int  WritableBytes();
+	bool HasRoomFor(int len);
+	int  PeekWrite(VueceRingSpan* spans);
+	bool CommitFrame(int len);
+	bool WriteFrame(const uint8_t* data, int len);
+
+	//consumer side
+	int  ReadableBytes();
+	int  FrameCount();
+	bool IsEmpty();
+	int  PeekFrame(VueceRingSpan* spans);
+	void ReleaseFrame();
+	int  PeekRead(VueceRingSpan* spans);
+	void CommitRead(int len);
+	int  Read(uint8_t* buffer, int len);
+
+	int  GetByteCapacity();
+	int  GetFrameCapacity();
+	int  GetHighWaterMark();
+	unsigned int GetProducedFrameCount();
+
+	static unsigned int RoundUpToPowerOfTwo(unsigned int v);
+
+private:
+	int  GetSpans(unsigned int start, int len, VueceRingSpan* spans);
+
+private:
+	uint8_t* storage;
+	int* frame_len;
+
+	unsigned int byte_mask;
+	unsigned int frame_mask;
+
+	//written by producer only
+	volatile unsigned int byte_head;
+	volatile unsigned int frame_head;
+
+	//written by consumer only
+	volatile unsigned int byte_tail;
+	volatile unsigned int frame_tail;
+
+	//number of bytes of the front frame that have been consumed by CommitRead(), consumer only
+	int front_frame_consumed;
+
+	//max number of buffered bytes seen by producer, statistics only
+	int high_water_mark;
+};
+
+#endif /* VUECEFRAMERING_H_ */
@@ -0,0 +1,95 @@
+/*
+ * VueceJabberClientObserver.cc
+ *
+ *  Created on: Mar 27, 2015
+ *      Author: jingjing
+ */
+
+#include "VueceLogger.h"
+#include "VueceJni.h"
+#include "VueceJabberClientObserver.h"
+
+#define THREAD_TAG_JABBER_CLIENT_OBSERVER "VueceJabberClientObserver"
+
+VueceJabberClientObserver::VueceJabberClientObserver()
+{
+	jabber_client_class = NULL;
+	jabber_client_object = NULL;
+
+	on_player_progress_id = 0;
+	on_player_state_id = 0;
+}
+
+VueceJabberClientObserver::~VueceJabberClientObserver()
+{
+	VueceLogger::Debug("VueceJabberClientObserver - Destructor called");
+
+	JNIEnv *jni_env = VueceJni::GetJniEnv(THREAD_TAG_JABBER_CLIENT_OBSERVER);
+
+	if(jabber_client_object != NULL)
+	{
+		jni_env->DeleteGlobalRef(jabber_client_object);
+	}
+
+	if(jabber_client_class != NULL)
+	{
+		jni_env->DeleteGlobalRef(jabber_client_class);
+	}
+}
+
+bool VueceJabberClientObserver::Init()
+{
+	jclass local_class = NULL;
+	jobject local_ref = NULL;
+	jmethodID get_client_id = 0;
+
+	JNIEnv *jni_env = VueceJni::GetJniEnv(THREAD_TAG_JABBER_CLIENT_OBSERVER);
+
+	local_class = jni_env->FindClass("com/vuece/vtalk/android/jni/JabberClient");
+
+	if(local_class == NULL)
+	{
+		VueceLogger::Fatal("VueceJabberClientObserver::Init - cannot find com/vuece/vtalk/android/jni/JabberClient");
+		return false;
+	}
+
+	jabber_client_class = (jclass)jni_env->NewGlobalRef(local_class);
+	jni_env->DeleteLocalRef(local_class);
+
+	get_client_id = jni_env->GetStaticMethodID(jabber_client_class, "getInstance", "()Lcom/vuece/vtalk/android/jni/JabberClient;");
+	on_player_progress_id = jni_env->GetMethodID(jabber_client_class, "onPlayingProgress", "(I)V");
+	on_player_state_id = jni_env->GetMethodID(jabber_client_class, "onStreamPlayerStateChanged", "(I)V");
+
+	if(get_client_id == 0 || on_player_progress_id == 0 || on_player_state_id == 0)
+	{
+		VueceLogger::Fatal("VueceJabberClientObserver::Init - cannot find getInstance/onPlayingProgress/onStreamPlayerStateChanged method");
+		return false;
+	}
+
+	local_ref = jni_env->CallStaticObjectMethod(jabber_client_class, get_client_id);
+
+	if(local_ref == NULL)
+	{
+		VueceLogger::Fatal("VueceJabberClientObserver::Init - cannot find jabber_client_object");
+		return false;
+	}
+
+	jabber_client_object = jni_env->NewGlobalRef(local_ref);
+	jni_env->DeleteLocalRef(local_ref);
+
+	return true;
+}
+
+void VueceJabberClientObserver::OnPlayingProgress(int pos_sec)
+{
+	JNIEnv *jni_env = VueceJni::GetJniEnv(THREAD_TAG_JABBER_CLIENT_OBSERVER);
+
+	jni_env->CallVoidMethod(jabber_client_object, on_player_progress_id, (jint)pos_sec);
+}
+
+void VueceJabberClientObserver::OnPlayerStateChanged(int state)
+{
+	JNIEnv *jni_env = VueceJni::GetJniEnv(THREAD_TAG_JABBER_CLIENT_OBSERVER);
+
+	jni_env->CallVoidMethod(jabber_client_object, on_player_state_id, (jint)state);
+}
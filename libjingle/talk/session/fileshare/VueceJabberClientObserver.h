@@ -0,0 +1,40 @@
+/*
+ * VueceJabberClientObserver.h
+ *
+ *  Created on: Mar 27, 2015
+ *      Author: jingjing
+ */
+
+#ifndef VUECEJABBERCLIENTOBSERVER_H_
+#define VUECEJABBERCLIENTOBSERVER_H_
+
+#include <jni.h>
+
+#include "VueceAudioWriterObserver.h"
+
+/*
+ * Forwards audio writer notifications to JabberClient.onPlayingProgress() and
+ * JabberClient.onStreamPlayerStateChanged() on the Java side.
+ */
+class VueceJabberClientObserver : public VueceAudioWriterObserver
+{
+public:
+	VueceJabberClientObserver();
+	virtual ~VueceJabberClientObserver();
+
+	//looks up JabberClient instance and its callbacks, must succeed before writer is started
+	bool Init();
+
+	virtual void OnPlayingProgress(int pos_sec);
+	virtual void OnPlayerStateChanged(int state);
+
+private:
+	//global refs
+	jclass jabber_client_class;
+	jobject jabber_client_object;
+
+	jmethodID on_player_progress_id;
+	jmethodID on_player_state_id;
+};
+
+#endif /* VUECEJABBERCLIENTOBSERVER_H_ */
@@ -0,0 +1,392 @@
+/*
+ * VueceJitterController.cc
+ *
+ *  Created on: Mar 24, 2015
+ *      Author: jingjing
+ */
+
+#include "VueceLogger.h"
+#include "VueceConstants.h"
+#include "VueceConfig.h"
+#include "VueceJitterController.h"
+
+VueceJitterController::VueceJitterController()
+{
+	VueceLogger::Debug("VueceJitterController - Constructor called");
+
+	VueceThreadUtil::InitMutex(&mutex_state);
+
+	Init(0, 0);
+}
+
+VueceJitterController::~VueceJitterController()
+{
+	VueceLogger::Debug("VueceJitterController - Destructor called");
+}
+
+void VueceJitterController::Init(int frame_dur, uint64_t now_ms)
+{
+	VueceThreadUtil::MutexLock(&mutex_state);
+
+	frame_dur_ms = frame_dur;
+	chunk_dur_ms = frame_dur * VUECE_AUDIO_FRAMES_PER_CHUNK;
+
+	//engine is created when first frame arrives, so it's counted as an ongoing download
+	waiting_first_chunk = false;
+	request_ms = now_ms;
+	last_arrival_ms = now_ms;
+	arrival_count = 0;
+	avg_interval_ms = 0;
+	jitter_ms = 0;
+	setup_ms = 0;
+
+	download_rate = 0;
+	decode_rate = 0;
+
+	start_ms = now_ms;
+	stall_start_ms = 0;
+	started = false;
+	stalled = false;
+	startup_latency_ms = -1;
+	underrun_count = 0;
+	total_stall_ms = 0;
+
+	prebuffer_chunks = VUECE_BUFFER_AVAIL_INDICATOR;
+	refill_threshold_sec = VUECE_BUFWIN_THRESHOLD_SEC;
+	window_chunks = VUECE_BUFFER_WINDOW;
+
+	VueceThreadUtil::MutexUnlock(&mutex_state);
+}
+
+int VueceJitterController::Ewma(int avg, int sample)
+{
+	return avg + (sample - avg) / VUECE_JITTER_EWMA_WEIGHT;
+}
+
+/*
+ * Download of a new buffer window is requested, the first chunk of the window
+ * is used to measure session setup latency instead of download rate
+ */
+void VueceJitterController::OnDownloadRequested(uint64_t now_ms)
+{
+	VueceThreadUtil::MutexLock(&mutex_state);
+
+	waiting_first_chunk = true;
+	request_ms = now_ms;
+
+	VueceThreadUtil::MutexUnlock(&mutex_state);
+}
+
+void VueceJitterController::OnChunkArrived(uint64_t now_ms)
+{
+	int interval = 0;
+	int rate = 0;
+
+	VueceThreadUtil::MutexLock(&mutex_state);
+
+	if(chunk_dur_ms <= 0)
+	{
+		VueceThreadUtil::MutexUnlock(&mutex_state);
+		return;
+	}
+
+	if(waiting_first_chunk)
+	{
+		//setup latency includes transfer of the first chunk, take it off if we know the rate
+		interval = (int)(now_ms - request_ms);
+
+		if(download_rate > 0)
+		{
+			interval -= (int)((int64_t)chunk_dur_ms * 1000 / download_rate);
+		}
+
+		if(interval < 0)
+		{
+			interval = 0;
+		}
+
+		setup_ms = (setup_ms == 0) ? interval : Ewma(setup_ms, interval);
+
+		waiting_first_chunk = false;
+	}
+	else
+	{
+		interval = (int)(now_ms - last_arrival_ms);
+
+		if(interval <= 0)
+		{
+			interval = 1;
+		}
+
+		rate = (int)((int64_t)chunk_dur_ms * 1000 / interval);
+
+		if(arrival_count == 0)
+		{
+			avg_interval_ms = interval;
+			download_rate = rate;
+		}
+		else
+		{
+			//mean deviation of chunk inter-arrival time, like RFC 3550 jitter
+			jitter_ms = Ewma(jitter_ms, interval > avg_interval_ms ? interval - avg_interval_ms : avg_interval_ms - interval);
+			avg_interval_ms = Ewma(avg_interval_ms, interval);
+			download_rate = Ewma(download_rate, rate);
+		}
+
+		arrival_count++;
+	}
+
+	last_arrival_ms = now_ms;
+
+	UpdateTargets();
+
+	VueceThreadUtil::MutexUnlock(&mutex_state);
+}
+
+void VueceJitterController::OnDecoded(int frames, int decode_us)
+{
+	int rate = 0;
+
+	if(frames <= 0 || decode_us <= 0)
+	{
+		return;
+	}
+
+	VueceThreadUtil::MutexLock(&mutex_state);
+
+	rate = (int)((int64_t)frames * frame_dur_ms * 1000000 / decode_us);
+
+	decode_rate = (decode_rate == 0) ? rate : Ewma(decode_rate, rate);
+
+	VueceThreadUtil::MutexUnlock(&mutex_state);
+}
+
+/*
+ * Audio writer starts (or resumes) playing after buffering
+ */
+void VueceJitterController::OnPlaybackStarted(uint64_t now_ms)
+{
+	VueceThreadUtil::MutexLock(&mutex_state);
+
+	if(!started)
+	{
+		started = true;
+		startup_latency_ms = (int)(now_ms - start_ms);
+
+		VueceLogger::Info("VueceJitterController - Playback started, startup latency: %d ms", startup_latency_ms);
+	}
+	else if(stalled)
+	{
+		total_stall_ms += now_ms - stall_start_ms;
+
+		VueceLogger::Info("VueceJitterController - Playback resumed after %llu ms stall", now_ms - stall_start_ms);
+	}
+
+	stalled = false;
+
+	VueceThreadUtil::MutexUnlock(&mutex_state);
+}
+
+/*
+ * Audio writer ran out of data while playing
+ */
+void VueceJitterController::OnUnderrun(uint64_t now_ms)
+{
+	VueceThreadUtil::MutexLock(&mutex_state);
+
+	if(started && !stalled)
+	{
+		stalled = true;
+		stall_start_ms = now_ms;
+		underrun_count++;
+
+		UpdateTargets();
+
+		VueceLogger::Warn("VueceJitterController - Underrun #%d, prebuffer target is now %d chunk(s)", underrun_count, prebuffer_chunks);
+	}
+
+	VueceThreadUtil::MutexUnlock(&mutex_state);
+}
+
+/*
+ * Must be called with mutex held.
+ *
+ * Playback consumes 1000 media ms per second while download adds download_rate, with
+ * rate r = min(download rate, decode rate) / 1000:
+ *
+ * - if r >= 1, the next window only needs to be requested early enough to cover setup
+ *   latency, transfer of one chunk and arrival jitter
+ * - if r < 1, playing a whole window without stall needs window * (1/r - 1) of extra
+ *   media buffered ahead
+ *
+ * Every underrun raises the prebuffer target by one chunk.
+ */
+void VueceJitterController::UpdateTargets()
+{
+	int rate = download_rate;
+	int64_t refill_ms = 0;
+	int64_t prebuffer_ms = 0;
+	int64_t window_ms = 0;
+	int max_prebuffer = VUECE_BUFFER_WINDOW - 1;
+	int chunks = 0;
+
+	if(rate <= 0 || chunk_dur_ms <= 0)
+	{
+		return;
+	}
+
+	if(decode_rate > 0 && decode_rate < rate)
+	{
+		rate = decode_rate;
+	}
+
+	//high watermark, download more per window if link can't keep up with playback
+	window_chunks = VUECE_BUFFER_WINDOW;
+
+	if(rate < 1000)
+	{
+		window_chunks = (int)((int64_t)VUECE_BUFFER_WINDOW * 1000 / rate);
+
+		if(window_chunks > VUECE_BUFFER_WINDOW * 2)
+		{
+			window_chunks = VUECE_BUFFER_WINDOW * 2;
+		}
+	}
+
+	window_ms = (int64_t)window_chunks * chunk_dur_ms;
+
+	//low watermark
+	refill_ms = setup_ms + 4 * jitter_ms + (int64_t)chunk_dur_ms * 1000 / rate;
+
+	if(rate < 1000)
+	{
+		refill_ms += window_ms * (1000 - rate) / rate;
+	}
+
+	refill_ms = refill_ms * VUECE_JITTER_SAFETY_PERCENT / 100;
+
+	refill_threshold_sec = (int)(refill_ms / 1000);
+
+	if(refill_threshold_sec < VUECE_JITTER_MIN_REFILL_SEC)
+	{
+		refill_threshold_sec = VUECE_JITTER_MIN_REFILL_SEC;
+	}
+
+	//always leave at least one chunk of current window to play before refill
+	if(refill_threshold_sec > (window_ms - chunk_dur_ms) / 1000)
+	{
+		refill_threshold_sec = (int)((window_ms - chunk_dur_ms) / 1000);
+	}
+
+	//prebuffer target
+	prebuffer_ms = 4 * jitter_ms;
+
+	if(rate < 1000)
+	{
+		prebuffer_ms += window_ms * (1000 - rate) / rate;
+	}
+
+	chunks = (int)((prebuffer_ms + chunk_dur_ms - 1) / chunk_dur_ms);
+
+	if(chunks < VUECE_BUFFER_AVAIL_INDICATOR + underrun_count)
+	{
+		chunks = VUECE_BUFFER_AVAIL_INDICATOR + underrun_count;
+	}
+
+	if(chunks > max_prebuffer)
+	{
+		chunks = max_prebuffer;
+	}
+
+	if(chunks < VUECE_BUFFER_AVAIL_INDICATOR)
+	{
+		chunks = VUECE_BUFFER_AVAIL_INDICATOR;
+	}
+
+	prebuffer_chunks = chunks;
+}
+
+int VueceJitterController::GetPrebufferChunks()
+{
+	int ret = 0;
+
+	VueceThreadUtil::MutexLock(&mutex_state);
+	ret = prebuffer_chunks;
+	VueceThreadUtil::MutexUnlock(&mutex_state);
+
+	return ret;
+}
+
+int VueceJitterController::GetRefillThresholdSec()
+{
+	int ret = 0;
+
+	VueceThreadUtil::MutexLock(&mutex_state);
+	ret = refill_threshold_sec;
+	VueceThreadUtil::MutexUnlock(&mutex_state);
+
+	return ret;
+}
+
+int VueceJitterController::GetBufferWindowChunks()
+{
+	int ret = 0;
+
+	VueceThreadUtil::MutexLock(&mutex_state);
+	ret = window_chunks;
+	VueceThreadUtil::MutexUnlock(&mutex_state);
+
+	return ret;
+}
+
+int VueceJitterController::GetUnderrunCount()
+{
+	int ret = 0;
+
+	VueceThreadUtil::MutexLock(&mutex_state);
+	ret = underrun_count;
+	VueceThreadUtil::MutexUnlock(&mutex_state);
+
+	return ret;
+}
+
+uint64_t VueceJitterController::GetTotalStallMs()
+{
+	uint64_t ret = 0;
+
+	VueceThreadUtil::MutexLock(&mutex_state);
+	ret = total_stall_ms;
+	VueceThreadUtil::MutexUnlock(&mutex_state);
+
+	return ret;
+}
+
+/*
+ * -1 if playback has not started yet
+ */
+int VueceJitterController::GetStartupLatencyMs()
+{
+	int ret = 0;
+
+	VueceThreadUtil::MutexLock(&mutex_state);
+	ret = startup_latency_ms;
+	VueceThreadUtil::MutexUnlock(&mutex_state);
+
+	return ret;
+}
+
+void VueceJitterController::LogStats()
+{
+	VueceThreadUtil::MutexLock(&mutex_state);
+
+	VueceLogger::Info("VueceJitterController - Stats: startup latency %d ms, %d underrun(s), total stall %llu ms",
+			startup_latency_ms, underrun_count, total_stall_ms);
+
+	VueceLogger::Info("VueceJitterController - Stats: download rate %d ms/s (%d chunks), decode rate %d ms/s, setup %d ms, jitter %d ms",
+			download_rate, arrival_count, decode_rate, setup_ms, jitter_ms);
+
+	VueceLogger::Info("VueceJitterController - Stats: prebuffer %d chunk(s), refill threshold %d sec, buffer window %d chunk(s)",
+			prebuffer_chunks, refill_threshold_sec, window_chunks);
+
+	VueceThreadUtil::MutexUnlock(&mutex_state);
+}
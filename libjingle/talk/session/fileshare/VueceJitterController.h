@@ -0,0 +1,115 @@
+/*
+ * VueceJitterController.h
+ *
+ *  Created on: Mar 24, 2015
+ *      Author: jingjing
+ */
+
+#ifndef VUECEJITTERCONTROLLER_H_
+#define VUECEJITTERCONTROLLER_H_
+
+#include "jthread.h"
+
+#include "VueceThreadUtil.h"
+
+/*
+ * Bounds of the refill threshold - remaining play time (in seconds) of current buffer
+ * window when download of next buffer window is triggered
+ */
+#define VUECE_JITTER_MIN_REFILL_SEC 10
+
+//smoothing factor of rate/jitter estimators is 1/VUECE_JITTER_EWMA_WEIGHT
+#define VUECE_JITTER_EWMA_WEIGHT 4
+
+/*
+ * Safety margin applied to estimated refill time, in percent
+ */
+#define VUECE_JITTER_SAFETY_PERCENT 150
+
+/*
+ * Adaptive buffering controller of the stream engine.
+ *
+ * It tracks the download rate (media time received per wall time, measured on
+ * chunk arrivals), the session setup latency of each buffer window download,
+ * the arrival jitter and the decode rate, and derives from them:
+ *
+ * - prebuffer target: number of downloaded chunks ahead of the bumper required
+ *   before playing (re)starts, see VueceMediaDataBumper
+ * - low watermark: remaining play time of current buffer window when download of
+ *   next window is triggered, see audio_play_progress_checker_cb()
+ * - high watermark: number of chunks downloaded in each buffer window, see
+ *   VueceMediaStream::WriteAudioFrameToChunkFile()
+ *
+ * Before any measurement is available, the compile-time defaults are used
+ * (VUECE_BUFFER_AVAIL_INDICATOR, VUECE_BUFWIN_THRESHOLD_SEC, VUECE_BUFFER_WINDOW).
+ *
+ * All inputs take the current time from the caller so a recorded trace can be
+ * replayed deterministically. Inputs come from several threads (session, engine,
+ * audio writer), state is protected by a mutex.
+ */
+class VueceJitterController
+{
+public:
+	VueceJitterController();
+	virtual ~VueceJitterController();
+
+	void Init(int frame_dur_ms, uint64_t now_ms);
+
+	//inputs
+	void OnDownloadRequested(uint64_t now_ms);
+	void OnChunkArrived(uint64_t now_ms);
+	void OnDecoded(int frames, int decode_us);
+	void OnPlaybackStarted(uint64_t now_ms);
+	void OnUnderrun(uint64_t now_ms);
+
+	//outputs
+	int GetPrebufferChunks();
+	int GetRefillThresholdSec();
+	int GetBufferWindowChunks();
+
+	//metrics
+	int GetUnderrunCount();
+	uint64_t GetTotalStallMs();
+	int GetStartupLatencyMs();
+
+	void LogStats();
+
+private:
+	void UpdateTargets();
+	static int Ewma(int avg, int sample);
+
+private:
+	JMutex mutex_state;
+
+	int frame_dur_ms;
+	int chunk_dur_ms;
+
+	//download side
+	bool waiting_first_chunk;
+	uint64_t request_ms;
+	uint64_t last_arrival_ms;
+	int arrival_count;
+	int avg_interval_ms;
+	int jitter_ms;
+	int setup_ms;
+
+	//download and decode speed, media ms per wall second
+	int download_rate;
+	int decode_rate;
+
+	//playback side
+	uint64_t start_ms;
+	uint64_t stall_start_ms;
+	bool started;
+	bool stalled;
+	int startup_latency_ms;
+	int underrun_count;
+	uint64_t total_stall_ms;
+
+	//targets
+	int prebuffer_chunks;
+	int refill_threshold_sec;
+	int window_chunks;
+};
+
+#endif /* VUECEJITTERCONTROLLER_H_ */
@@ -0,0 +1,341 @@
+/*
+ * VueceJitterSimulator.cc
+ *
+ *  Created on: Mar 31, 2015
+ *      Author: jingjing
+ *
+ * Standalone program, not part of the library build. Plays a track against the download
+ * behaviour recorded in a trace and reports startup latency, underruns and stall time.
+ *
+ * The trace gives the session setup latency of every buffer window download (time from
+ * request to first chunk) and the chunk inter-arrival times inside a window. The simulator
+ * models the playback buffer in 10 ms steps:
+ *
+ * - a chunk becomes playable when it arrives, playback consumes media in real time
+ * - playback starts, and resumes after an underrun, once the prebuffer target is reached
+ * - next buffer window is requested once remaining buffered play time drops to the refill
+ *   threshold, its chunks arrive after the next recorded setup latency and gaps
+ *
+ * It runs once with the fixed defaults (VUECE_BUFFER_AVAIL_INDICATOR, VUECE_BUFWIN_THRESHOLD_SEC,
+ * VUECE_BUFFER_WINDOW) and once with the targets of VueceJitterController, so both are compared
+ * on the same trace. Another controller configuration is compared by rebuilding with different
+ * VUECE_JITTER_* values. Same trace always gives same output.
+ *
+ * Usage: VueceJitterSimulator <trace file> [track length sec]
+ *
+ * One event per line, time in ms since trace start, lines starting with '#' are ignored:
+ *
+ *   <ms> init <frame duration ms>
+ *   <ms> request
+ *   <ms> chunk
+ *   <ms> decoded <frames> <decode us>
+ *   <ms> play
+ *   <ms> underrun
+ *
+ * A download is assumed to be requested at 0. 'play' and 'underrun' lines of the recorded
+ * session are ignored, the model derives its own.
+ *
+ * Build on a Linux host, from this folder:
+ *
+ *   g++ -DPOSIX -DLINUX -I. -I../../.. -I../../../../client-core -I../../../../externals/jthread/src
+ *       -I../../../../externals/jthread/src/pthread VueceJitterSimulator.cc VueceJitterController.cc
+ *       ../../../../client-core/VueceThreadUtil.cc ../../../../client-core/VueceLogger.cc
+ *       ../../../../externals/jthread/src/pthread/jmutex.cpp -lpthread -o VueceJitterSimulator
+ */
+
+#include "VueceJitterController.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "VueceConstants.h"
+#include "VueceConfig.h"
+
+#define TRACE_LINE_LEN 256
+#define SIM_TICK_MS 10
+#define DEFAULT_FRAME_DUR_MS 23
+#define DEFAULT_TRACK_SEC 1200
+
+typedef struct VueceJitterTrace
+{
+	int frame_dur_ms;
+	std::vector<int> setup_ms;
+	std::vector<int> gap_ms;
+	std::vector<int> decode_frames;
+	std::vector<int> decode_us;
+} VueceJitterTrace;
+
+typedef struct VueceJitterSimResult
+{
+	int startup_ms;
+	int underrun_count;
+	uint64_t stall_ms;
+	int request_count;
+} VueceJitterSimResult;
+
+static bool LoadTrace(const char* path, VueceJitterTrace* trace)
+{
+	FILE* f = NULL;
+	char line[TRACE_LINE_LEN];
+	char event[32];
+	unsigned long long now_ms = 0;
+	unsigned long long request_ms = 0;
+	unsigned long long last_chunk_ms = 0;
+	bool waiting_first_chunk = true;
+	int arg1 = 0;
+	int arg2 = 0;
+	int line_no = 0;
+	int n = 0;
+
+	f = fopen(path, "r");
+
+	if(f == NULL)
+	{
+		fprintf(stderr, "Cannot open %s\n", path);
+		return false;
+	}
+
+	trace->frame_dur_ms = DEFAULT_FRAME_DUR_MS;
+
+	while(fgets(line, sizeof(line), f) != NULL)
+	{
+		line_no++;
+
+		if(line[0] == '#')
+		{
+			continue;
+		}
+
+		n = sscanf(line, "%llu %31s %d %d", &now_ms, event, &arg1, &arg2);
+
+		if(n < 2)
+		{
+			continue;
+		}
+
+		if(strcmp(event, "init") == 0 && n == 3 && arg1 > 0)
+		{
+			trace->frame_dur_ms = arg1;
+		}
+		else if(strcmp(event, "request") == 0)
+		{
+			request_ms = now_ms;
+			waiting_first_chunk = true;
+		}
+		else if(strcmp(event, "chunk") == 0)
+		{
+			if(waiting_first_chunk)
+			{
+				trace->setup_ms.push_back((int)(now_ms - request_ms));
+				waiting_first_chunk = false;
+			}
+			else
+			{
+				trace->gap_ms.push_back((int)(now_ms - last_chunk_ms));
+			}
+
+			last_chunk_ms = now_ms;
+		}
+		else if(strcmp(event, "decoded") == 0 && n == 4)
+		{
+			trace->decode_frames.push_back(arg1);
+			trace->decode_us.push_back(arg2);
+		}
+		else if(strcmp(event, "play") != 0 && strcmp(event, "underrun") != 0)
+		{
+			fprintf(stderr, "Invalid event at line %d: %s", line_no, line);
+			fclose(f);
+			return false;
+		}
+	}
+
+	fclose(f);
+
+	if(trace->setup_ms.empty() || trace->gap_ms.empty())
+	{
+		fprintf(stderr, "Trace needs at least two chunk arrivals\n");
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Plays track_sec seconds of media, targets come from the controller if adaptive is true,
+ * otherwise the fixed defaults are used
+ */
+static void RunModel(const VueceJitterTrace* trace, bool adaptive, int track_sec, VueceJitterSimResult* result)
+{
+	VueceJitterController controller;
+	std::vector<uint64_t> arrivals;
+	const char* name = adaptive ? "adaptive" : "fixed";
+	const int chunk_dur_ms = trace->frame_dur_ms * VUECE_AUDIO_FRAMES_PER_CHUNK;
+	const int total_chunks = (int)(((int64_t)track_sec * 1000 + chunk_dur_ms - 1) / chunk_dur_ms);
+	const int64_t track_ms = (int64_t)total_chunks * chunk_dur_ms;
+	size_t setup_idx = 0;
+	size_t gap_idx = 0;
+	size_t decode_idx = 0;
+	size_t next_arrival = 0;
+	uint64_t now_ms = 0;
+	uint64_t arrival_ms = 0;
+	uint64_t stall_start_ms = 0;
+	int64_t buffered_ms = 0;
+	int64_t played_ms = 0;
+	int requested_chunks = 0;
+	int prebuffer_chunks = 0;
+	int refill_threshold_sec = 0;
+	int window_chunks = 0;
+	bool playing = false;
+	bool started = false;
+	int i = 0;
+
+	memset(result, 0, sizeof(VueceJitterSimResult));
+	result->startup_ms = -1;
+
+	controller.Init(trace->frame_dur_ms, 0);
+
+	while(played_ms < track_ms)
+	{
+		if(adaptive)
+		{
+			prebuffer_chunks = controller.GetPrebufferChunks();
+			refill_threshold_sec = controller.GetRefillThresholdSec();
+			window_chunks = controller.GetBufferWindowChunks();
+		}
+		else
+		{
+			prebuffer_chunks = VUECE_BUFFER_AVAIL_INDICATOR;
+			refill_threshold_sec = VUECE_BUFWIN_THRESHOLD_SEC;
+			window_chunks = VUECE_BUFFER_WINDOW;
+		}
+
+		//request next window if nothing is being downloaded and buffer runs low
+		if(next_arrival == arrivals.size() && requested_chunks < total_chunks
+				&& buffered_ms <= (int64_t)refill_threshold_sec * 1000)
+		{
+			if(window_chunks > total_chunks - requested_chunks)
+			{
+				window_chunks = total_chunks - requested_chunks;
+			}
+
+			arrival_ms = now_ms + trace->setup_ms[setup_idx++ % trace->setup_ms.size()];
+
+			for(i = 0; i < window_chunks; i++)
+			{
+				arrivals.push_back(arrival_ms);
+				arrival_ms += trace->gap_ms[gap_idx++ % trace->gap_ms.size()];
+			}
+
+			requested_chunks += window_chunks;
+			result->request_count++;
+
+			controller.OnDownloadRequested(now_ms);
+
+			printf("%-8s %10llu request %d chunk(s), prebuffer %d chunk(s), refill %d sec, buffered %lld ms\n",
+					name, (unsigned long long)now_ms, window_chunks, prebuffer_chunks, refill_threshold_sec, (long long)buffered_ms);
+		}
+
+		now_ms += SIM_TICK_MS;
+
+		while(next_arrival < arrivals.size() && arrivals[next_arrival] <= now_ms)
+		{
+			controller.OnChunkArrived(arrivals[next_arrival]);
+
+			if(!trace->decode_frames.empty())
+			{
+				controller.OnDecoded(trace->decode_frames[decode_idx % trace->decode_frames.size()],
+						trace->decode_us[decode_idx % trace->decode_us.size()]);
+				decode_idx++;
+			}
+
+			buffered_ms += chunk_dur_ms;
+			next_arrival++;
+		}
+
+		if(playing)
+		{
+			if(buffered_ms >= SIM_TICK_MS)
+			{
+				buffered_ms -= SIM_TICK_MS;
+				played_ms += SIM_TICK_MS;
+			}
+			else
+			{
+				played_ms += buffered_ms;
+				buffered_ms = 0;
+
+				if(played_ms < track_ms)
+				{
+					playing = false;
+					stall_start_ms = now_ms;
+					result->underrun_count++;
+
+					controller.OnUnderrun(now_ms);
+
+					printf("%-8s %10llu underrun #%d at %lld ms of media\n",
+							name, (unsigned long long)now_ms, result->underrun_count, (long long)played_ms);
+				}
+			}
+		}
+		else if(buffered_ms >= (int64_t)prebuffer_chunks * chunk_dur_ms
+				|| (next_arrival == (size_t)total_chunks && buffered_ms > 0))
+		{
+			playing = true;
+
+			if(!started)
+			{
+				started = true;
+				result->startup_ms = (int)now_ms;
+			}
+			else
+			{
+				result->stall_ms += now_ms - stall_start_ms;
+			}
+
+			controller.OnPlaybackStarted(now_ms);
+
+			printf("%-8s %10llu play, buffered %lld ms\n", name, (unsigned long long)now_ms, (long long)buffered_ms);
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	VueceJitterTrace trace;
+	VueceJitterSimResult fixed;
+	VueceJitterSimResult adaptive;
+	int track_sec = DEFAULT_TRACK_SEC;
+
+	if(argc < 2 || argc > 3)
+	{
+		fprintf(stderr, "usage: %s <trace file> [track length sec]\n", argv[0]);
+		return 1;
+	}
+
+	if(argc > 2)
+	{
+		track_sec = atoi(argv[2]);
+	}
+
+	if(!LoadTrace(argv[1], &trace) || track_sec <= 0)
+	{
+		return 1;
+	}
+
+	printf("%u setup sample(s), %u gap sample(s), %d ms frames, %d sec track\n",
+			(unsigned)trace.setup_ms.size(), (unsigned)trace.gap_ms.size(), trace.frame_dur_ms, track_sec);
+
+	RunModel(&trace, false, track_sec, &fixed);
+	RunModel(&trace, true, track_sec, &adaptive);
+
+	printf("%-8s %10s %9s %12s %8s\n", "", "startup ms", "underruns", "stall ms", "requests");
+	printf("%-8s %10d %9d %12llu %8d\n", "fixed", fixed.startup_ms, fixed.underrun_count,
+			(unsigned long long)fixed.stall_ms, fixed.request_count);
+	printf("%-8s %10d %9d %12llu %8d\n", "adaptive", adaptive.startup_ms, adaptive.underrun_count,
+			(unsigned long long)adaptive.stall_ms, adaptive.request_count);
+
+	return 0;
+}
@@ -0,0 +1,489 @@
+/*
+ * VueceMappedFileStream.cc
+ *
+ *  Created on: Mar 30, 2015
+ *      Author: jingjing
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#include "talk/base/win32.h"
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "VueceLogger.h"
+#include "VueceMappedFileStream.h"
+
+namespace talk_base {
+
+VueceMappedFileStream::VueceMappedFileStream()
+{
+#ifdef WIN32
+	SYSTEM_INFO info;
+
+	file = INVALID_HANDLE_VALUE;
+	mapping = NULL;
+
+	GetSystemInfo(&info);
+	granularity = info.dwAllocationGranularity;
+#else
+	fd = -1;
+
+	granularity = sysconf(_SC_PAGESIZE);
+#endif
+
+	opened = false;
+	file_size = 0;
+	end = 0;
+	pos = 0;
+	window = NULL;
+	window_offset = 0;
+	window_len = 0;
+}
+
+VueceMappedFileStream::~VueceMappedFileStream()
+{
+	Close();
+}
+
+bool VueceMappedFileStream::Open(const std::string& filename, int* error)
+{
+	Close();
+
+#ifdef WIN32
+	std::wstring wfilename;
+	LARGE_INTEGER size;
+
+	if(!Utf8ToWindowsFilename(filename, &wfilename))
+	{
+		if(error) *error = -1;
+		return false;
+	}
+
+	file = CreateFileW(wfilename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		VueceLogger::Error("VueceMappedFileStream::Open - Cannot open file %s, error: %d", filename.c_str(), (int)GetLastError());
+		if(error) *error = GetLastError();
+		return false;
+	}
+
+	if(!GetFileSizeEx(file, &size))
+	{
+		if(error) *error = GetLastError();
+		Close();
+		return false;
+	}
+
+	file_size = (size_t)size.QuadPart;
+
+	//an empty file cannot be mapped, there is nothing to read anyway
+	if(file_size > 0)
+	{
+		mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+		if(mapping == NULL)
+		{
+			VueceLogger::Error("VueceMappedFileStream::Open - Cannot create file mapping of %s, error: %d", filename.c_str(), (int)GetLastError());
+			if(error) *error = GetLastError();
+			Close();
+			return false;
+		}
+	}
+#else
+	struct stat st;
+
+	fd = open(filename.c_str(), O_RDONLY);
+
+	if(fd < 0)
+	{
+		VueceLogger::Error("VueceMappedFileStream::Open - Cannot open file %s: %s", filename.c_str(), strerror(errno));
+		if(error) *error = errno;
+		return false;
+	}
+
+	if(fstat(fd, &st) != 0)
+	{
+		if(error) *error = errno;
+		Close();
+		return false;
+	}
+
+	file_size = st.st_size;
+#endif
+
+	opened = true;
+	end = file_size;
+	pos = 0;
+
+	VueceLogger::Debug("VueceMappedFileStream::Open - File opened: %s, size: %lu", filename.c_str(), (unsigned long)file_size);
+
+	return true;
+}
+
+bool VueceMappedFileStream::SetRange(size_t start, size_t length)
+{
+	if(!opened || start > file_size || length > file_size - start)
+	{
+		return false;
+	}
+
+	pos = start;
+	end = start + length;
+
+	return true;
+}
+
+void VueceMappedFileStream::Close()
+{
+	UnmapWindow();
+
+#ifdef WIN32
+	if(mapping != NULL)
+	{
+		CloseHandle(mapping);
+		mapping = NULL;
+	}
+
+	if(file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+	}
+#else
+	if(fd >= 0)
+	{
+		close(fd);
+		fd = -1;
+	}
+#endif
+
+	opened = false;
+	file_size = 0;
+	end = 0;
+	pos = 0;
+}
+
+void VueceMappedFileStream::UnmapWindow()
+{
+	if(window != NULL)
+	{
+#ifdef WIN32
+		UnmapViewOfFile(window);
+#else
+		munmap(window, window_len);
+#endif
+		window = NULL;
+	}
+
+	window_offset = 0;
+	window_len = 0;
+}
+
+/*
+ * Makes sure current position is inside the mapped window, a new window
+ * starts at the last mapping boundary before the position
+ */
+bool VueceMappedFileStream::MapWindow()
+{
+	size_t offset = 0;
+	size_t len = 0;
+	void* p = NULL;
+
+	if(window != NULL && pos >= window_offset && pos < window_offset + window_len)
+	{
+		return true;
+	}
+
+	UnmapWindow();
+
+	offset = pos - pos % granularity;
+	len = file_size - offset;
+
+	if(len > VUECE_MAPPED_FILE_WINDOW_SIZE)
+	{
+		len = VUECE_MAPPED_FILE_WINDOW_SIZE;
+	}
+
+#ifdef WIN32
+	p = MapViewOfFile(mapping, FILE_MAP_READ, (DWORD)((uint64_t)offset >> 32), (DWORD)(offset & 0xFFFFFFFF), len);
+
+	if(p == NULL)
+	{
+		VueceLogger::Error("VueceMappedFileStream::MapWindow - MapViewOfFile failed(%lu bytes at %lu), error: %d",
+				(unsigned long)len, (unsigned long)offset, (int)GetLastError());
+		return false;
+	}
+#else
+	p = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, offset);
+
+	if(p == MAP_FAILED)
+	{
+		VueceLogger::Error("VueceMappedFileStream::MapWindow - mmap failed(%lu bytes at %lu): %s",
+				(unsigned long)len, (unsigned long)offset, strerror(errno));
+		return false;
+	}
+
+	madvise(p, len, MADV_SEQUENTIAL);
+#endif
+
+	window = (uint8_t*)p;
+	window_offset = offset;
+	window_len = len;
+
+	return true;
+}
+
+StreamState VueceMappedFileStream::GetState() const
+{
+	return opened ? SS_OPEN : SS_CLOSED;
+}
+
+StreamResult VueceMappedFileStream::Read(void* buffer, size_t buffer_len, size_t* read, int* error)
+{
+	StreamIoVec iov;
+	size_t count = 0;
+	StreamResult result = ReadV(&iov, 1, buffer_len, &count, error);
+
+	if(result != SR_SUCCESS)
+	{
+		return result;
+	}
+
+	if(count == 0)
+	{
+		iov.len = 0;
+	}
+
+	memcpy(buffer, iov.base, iov.len);
+
+	ConsumeReadData(iov.len);
+
+	if(read)
+	{
+		*read = iov.len;
+	}
+
+	return SR_SUCCESS;
+}
+
+StreamResult VueceMappedFileStream::Write(const void* data, size_t data_len, size_t* written, int* error)
+{
+	if(error)
+	{
+		*error = -1;
+	}
+
+	return SR_ERROR;
+}
+
+bool VueceMappedFileStream::SupportsReadV() const
+{
+	return true;
+}
+
+/*
+ * The mapped window is contiguous, so at most one piece is returned, it stays
+ * valid until the window is moved by the next Read() or ReadV()
+ */
+StreamResult VueceMappedFileStream::ReadV(StreamIoVec* iov, size_t iov_max, size_t max_len, size_t* iov_count, int* error)
+{
+	size_t len = 0;
+
+	*iov_count = 0;
+
+	if(!opened)
+	{
+		if(error) *error = -1;
+		return SR_ERROR;
+	}
+
+	if(pos >= end)
+	{
+		return SR_EOS;
+	}
+
+	if(iov_max == 0 || max_len == 0)
+	{
+		return SR_SUCCESS;
+	}
+
+	if(!MapWindow())
+	{
+		if(error) *error = -1;
+		return SR_ERROR;
+	}
+
+	len = window_offset + window_len - pos;
+
+	if(len > end - pos)
+	{
+		len = end - pos;
+	}
+
+	if(len > max_len)
+	{
+		len = max_len;
+	}
+
+	iov[0].base = window + (pos - window_offset);
+	iov[0].len = len;
+
+	*iov_count = 1;
+
+	return SR_SUCCESS;
+}
+
+void VueceMappedFileStream::ConsumeReadData(size_t used)
+{
+	if(used > end - pos)
+	{
+		VueceLogger::Fatal("VueceMappedFileStream::ConsumeReadData - %lu bytes consumed but only %lu bytes left",
+				(unsigned long)used, (unsigned long)(end - pos));
+		used = end - pos;
+	}
+
+	pos += used;
+}
+
+bool VueceMappedFileStream::SetPosition(size_t position)
+{
+	if(!opened || position > end)
+	{
+		return false;
+	}
+
+	pos = position;
+
+	return true;
+}
+
+bool VueceMappedFileStream::GetPosition(size_t* position) const
+{
+	if(!opened)
+	{
+		return false;
+	}
+
+	if(position)
+	{
+		*position = pos;
+	}
+
+	return true;
+}
+
+bool VueceMappedFileStream::GetSize(size_t* size) const
+{
+	if(!opened)
+	{
+		return false;
+	}
+
+	if(size)
+	{
+		*size = file_size;
+	}
+
+	return true;
+}
+
+bool VueceMappedFileStream::GetAvailable(size_t* size) const
+{
+	if(!opened)
+	{
+		return false;
+	}
+
+	if(size)
+	{
+		*size = end - pos;
+	}
+
+	return true;
+}
+
+bool VueceMappedFileStream::ParseRange(const std::string& value, size_t file_size, size_t* start, size_t* length)
+{
+	const char* p = value.c_str();
+	char* e = NULL;
+	unsigned long first = 0;
+	unsigned long last = 0;
+
+	if(strncmp(p, "bytes=", 6) != 0 || file_size == 0)
+	{
+		return false;
+	}
+
+	p += 6;
+
+	//several ranges in one request are not supported
+	if(strchr(p, ',') != NULL)
+	{
+		return false;
+	}
+
+	if(*p == '-')
+	{
+		//suffix range, last N bytes of the file
+		last = strtoul(p + 1, &e, 10);
+
+		if(e == p + 1 || last == 0)
+		{
+			return false;
+		}
+
+		if(last > file_size)
+		{
+			last = file_size;
+		}
+
+		*start = file_size - last;
+		*length = last;
+
+		return true;
+	}
+
+	first = strtoul(p, &e, 10);
+
+	if(e == p || *e != '-' || first >= file_size)
+	{
+		return false;
+	}
+
+	p = e + 1;
+
+	if(*p == '\0')
+	{
+		last = file_size - 1;
+	}
+	else
+	{
+		last = strtoul(p, &e, 10);
+
+		if(e == p || last < first)
+		{
+			return false;
+		}
+
+		if(last >= file_size)
+		{
+			last = file_size - 1;
+		}
+	}
+
+	*start = first;
+	*length = last - first + 1;
+
+	return true;
+}
+
+} // namespace talk_base
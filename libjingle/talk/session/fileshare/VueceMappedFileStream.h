@@ -0,0 +1,101 @@
+/*
+ * VueceMappedFileStream.h
+ *
+ *  Created on: Mar 30, 2015
+ *      Author: jingjing
+ */
+
+#ifndef VUECEMAPPEDFILESTREAM_H_
+#define VUECEMAPPEDFILESTREAM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+#include "talk/base/stream.h"
+
+//size of the part of a file which is mapped at a time
+#define VUECE_MAPPED_FILE_WINDOW_SIZE 4 * 1024 * 1024
+
+namespace talk_base {
+
+/*
+ * Read only file stream used by hub to serve non-music items of a file share.
+ *
+ * Instead of copying file data into a caller's buffer, the file is mapped one
+ * window at a time and ReadV() hands out pointers into the mapping, so HttpBase
+ * writes file pages straight to the socket or PseudoTcp stream. The same window
+ * is reused until the position runs past it, then the next one is mapped.
+ * Read() still works as a normal copying read.
+ *
+ * SetRange() limits the stream to part of the file, used to answer a request
+ * with a Range header.
+ */
+class VueceMappedFileStream : public StreamInterface
+{
+public:
+	VueceMappedFileStream();
+	virtual ~VueceMappedFileStream();
+
+	bool Open(const std::string& filename, int* error);
+
+	//limits the stream to bytes [start, start + length) of the file, position is moved to start
+	bool SetRange(size_t start, size_t length);
+
+	virtual StreamState GetState() const;
+	virtual StreamResult Read(void* buffer, size_t buffer_len, size_t* read, int* error);
+	virtual StreamResult Write(const void* data, size_t data_len, size_t* written, int* error);
+	virtual void Close();
+
+	virtual bool SupportsReadV() const;
+	virtual StreamResult ReadV(StreamIoVec* iov, size_t iov_max, size_t max_len, size_t* iov_count, int* error);
+	virtual void ConsumeReadData(size_t used);
+
+	virtual bool SetPosition(size_t position);
+	virtual bool GetPosition(size_t* position) const;
+	virtual bool GetSize(size_t* size) const;
+	virtual bool GetAvailable(size_t* size) const;
+
+	/*
+	 * Parses a single "bytes=first-last", "bytes=first-" or "bytes=-suffix" range,
+	 * returns false if the value is malformed or the range is not inside the file
+	 */
+	static bool ParseRange(const std::string& value, size_t file_size, size_t* start, size_t* length);
+
+private:
+	bool MapWindow();
+	void UnmapWindow();
+
+private:
+#ifdef WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int fd;
+#endif
+
+	bool opened;
+
+	size_t file_size;
+
+	//end of readable range, file_size unless SetRange() is called
+	size_t end;
+
+	//absolute file position of next byte to read
+	size_t pos;
+
+	uint8_t* window;
+	size_t window_offset;
+	size_t window_len;
+
+	//mapping offsets must be a multiple of this
+	size_t granularity;
+};
+
+} // namespace talk_base
+
+#endif /* VUECEMAPPEDFILESTREAM_H_ */
@@ -11,7 +11,10 @@
 #include "VueceConstants.h"
 #include "talk/base/sigslot.h"
 #include "jthread.h"
-#include "VueceMemQueue.h"
+
+class VueceFrameRing;
+class VueceMmapChunkReader;
+class VueceJitterController;
 
 /**
  * FSM states - internal use only
@@ -40,13 +43,14 @@ typedef enum _VueceBumperFsmEvent{
 }VueceBumperFsmEvent;
 
 typedef struct _VueceMediaBumperData{
-	uint8_t* readBuf;
+	//payload of the frame returned by last ReadFrame(), points into chunk mapping
+	uint8_t* pFrameData;
 	int iFrameHeaderLen;
 	int availBufFileCounter;
 	bool bBufferReadable;
 	bool bStandaloneFlag;
 	int iReadCount;
-	FILE* fActiveBufferFile;
+	VueceMmapChunkReader* pChunkReader;
 
 	int iActiveBufFileIdx;
 	int iLastAvailChunkFileIdx;
@@ -54,9 +58,6 @@ typedef struct _VueceMediaBumperData{
 	long iTotoalFrameCounter;
 	VueceBumperFsmState bumperState;
 	bool bIsDowloadCompleted;
-	bool bIsMergingFiles;
-	bool bIsChunkMerged;
-	bool bSaveTestFlag; // a test flag for file save, remove later
 	bool bTestFlag;
 
 	long lAudioChunkDurationInMs;
@@ -80,7 +81,7 @@ public:
 
 	void Uninit();
 
-	void Process(VueceMemQueue* in_q, VueceMemQueue* out_q);
+	void Process(VueceFrameRing* in_r, VueceFrameRing* out_r);
 
 	void SetTerminateInfo(int last_avail_chunk_file_idx, int nr_frame_of_last_chunk);
 	void OnAllDataConsumed();
@@ -96,24 +97,29 @@ public:
 	int MarkAsCompleted();
 	int MarkAsStandalone();
 
+	void SetJitterController(VueceJitterController* j);
+
 public:
 	sigslot::signal1<VueceBumperExternalEventNotification*> SignalBumperNotification;
 
+	//fired when bumper may be able to read more data, e.g. new chunk available or resumed
+	sigslot::signal0<> SignalInputChanged;
+
 private:
 
 	JMutex* mutex_bumper_state;
 	JMutex* mutex_chunk_idx;
 	VueceMediaBumperData* bumper_data;
 
-	VueceMemQueue* out_q;
+	VueceFrameRing* out_r;
+	VueceJitterController* jitter;
 
 private:
-	void GetChunkFileNameFromIdx(int idx, char* fname);
 	bool ActivateBufferFile(VueceMediaBumperData *d);
 	int  ReadFrame(VueceMediaBumperData *d);
-	void ReadAndQueueFrame(VueceMediaBumperData *d);
+	bool ReadAndQueueFrame(VueceMediaBumperData *d);
+	void Bump(VueceMediaBumperData *d);
 
-	int  SaveFile(VueceMediaBumperData *d);
 	int  StreamSeek(VueceMediaBumperData *d);
 
 	bool StateTranstion(VueceBumperFsmEvent e);
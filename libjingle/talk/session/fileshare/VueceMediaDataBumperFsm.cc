@@ -12,13 +12,19 @@
 #include "VueceStreamPlayer.h"
 #include "VueceConstants.h"
 #include "VueceConfig.h"
+#include "VueceFrameRing.h"
+#include "VueceMmapChunkReader.h"
+#include "VueceChunkFrameIndex.h"
+#include "VueceSegmentStore.h"
+#include "VueceJitterController.h"
 
 VueceMediaDataBumper::VueceMediaDataBumper()
 {
 	mutex_bumper_state = NULL;
 	mutex_chunk_idx = NULL;
 	bumper_data = NULL;
-	out_q = NULL;
+	out_r = NULL;
+	jitter = NULL;
 }
 
 bool VueceMediaDataBumper::Init()
@@ -29,17 +35,15 @@ bool VueceMediaDataBumper::Init()
 
 	VueceLogger::Debug("VueceMediaDataBumper - INIT - 1");
 
-	d->readBuf = (uint8_t*)malloc(VUECE_MAX_FRAME_SIZE);
+	d->pFrameData = NULL;
 	d->availBufFileCounter = 0;
 	d->iActiveBufFileIdx = -1;
 	d->iLastAvailChunkFileIdx = -1;
 	d->iFrameCountOfLastChunk = 0;
 	d->bBufferReadable = false;
-	d->fActiveBufferFile = NULL;
+	d->pChunkReader = new VueceMmapChunkReader();
 	d->iReadCount = 0;
 	d->bIsDowloadCompleted = false;
-	d->bIsMergingFiles = false;
-	d->bSaveTestFlag = false;
 	d->bTestFlag = false;
 	d->bStandaloneFlag = false;
 
@@ -95,9 +99,11 @@ void VueceMediaDataBumper::Uninit()
 
 	if(bumper_data != NULL)
 	{
-		if( bumper_data->readBuf != NULL)
+		if( bumper_data->pChunkReader != NULL)
 		{
-			free(bumper_data->readBuf);
+			VueceLogger::Debug("VueceMediaDataBumper::Uninit - chunk reader remapped %ld times", bumper_data->pChunkReader->GetRemapCount());
+
+			delete bumper_data->pChunkReader;
 		}
 
 		free(bumper_data);
@@ -396,15 +402,21 @@ bool VueceMediaDataBumper::StateTranstion(VueceBumperFsmEvent e)
 
 
 
-void VueceMediaDataBumper::Process(VueceMemQueue* in_q, VueceMemQueue* _out_q)
+/*
+ * Frames are pushed into a bounded ring, bumping stops when the ring
+ * cannot take another frame and is resumed in next call
+ */
+void VueceMediaDataBumper::Process(VueceFrameRing* in_r, VueceFrameRing* _out_r)
 {
-	bool do_return = false;
-	//Debug only - This will generate massive trace output
-//	VueceLogger::Debug("VueceMediaDataBumper - Process START");
+	out_r = _out_r;
 
-	VueceMediaBumperData *d = bumper_data;
+	Bump(bumper_data);
+}
 
-	out_q = _out_q;
+void VueceMediaDataBumper::Bump(VueceMediaBumperData *d)
+{
+	//Debug only - This will generate massive trace output
+//	VueceLogger::Debug("VueceMediaDataBumper - Process START");
 
 	//one-time operation
 	if(d->bStandaloneFlag)
@@ -447,7 +459,17 @@ void VueceMediaDataBumper::Process(VueceMemQueue* in_q, VueceMemQueue* _out_q)
 
 		mutex_bumper_state->Unlock();
 
-		ReadAndQueueFrame(d);
+		//downstream ring is full, try again in next round
+		if(!out_r->HasRoomFor(VUECE_MAX_FRAME_SIZE))
+		{
+			return;
+		}
+
+		//active chunk is still being written, try again in next round
+		if(!ReadAndQueueFrame(d))
+		{
+			return;
+		}
 
 //		VueceLogger::Debug("VueceMediaDataBumper - Processing data loop - END");
 	}
@@ -455,36 +477,14 @@ void VueceMediaDataBumper::Process(VueceMemQueue* in_q, VueceMemQueue* _out_q)
 //	VueceLogger::Debug("VueceMediaDataBumper - Process END");
 }
 
-void VueceMediaDataBumper::GetChunkFileNameFromIdx(int idx, char* fname)
-{
-	char tmp[16];
-
-	LOG(LS_VERBOSE) << "VueceMediaDataBumper - bumper_get_chunk_file_name_from_idx: active file idx = " << idx;
-
-	memset(tmp, 0, sizeof(tmp));
-
-	strcpy(fname, VUECE_MEDIA_AUDIO_BUFFER_LOCATION);
-
-	sprintf(tmp, "%d", idx);
-
-	strcat(fname, tmp);
-}
-
 bool VueceMediaDataBumper::ActivateBufferFile(VueceMediaBumperData *d)
 {
-	char cfilename[128];
-	char mode[8];
-	FILE* file_;
-
-	memset(cfilename, 0, sizeof(cfilename));
-	memset(mode, 0, sizeof(mode));
-
 	VueceLogger::Debug("VueceMediaDataBumper - bumper_activate_buffer_file");
 
 
-	if(d->fActiveBufferFile != NULL)
+	if(d->pChunkReader->IsOpen())
 	{
-		VueceLogger::Fatal("VueceMediaDataBumper - bumper_activate_buffer_file: fActiveBufferFile should be null!");
+		VueceLogger::Fatal("VueceMediaDataBumper - bumper_activate_buffer_file: active chunk should be closed!");
 	}
 
 	//NOTE: The initial value of iActiveBufFileIdx is -1, the first buffer file index is 0,
@@ -511,35 +511,13 @@ bool VueceMediaDataBumper::ActivateBufferFile(VueceMediaBumperData *d)
 		}
 	}
 
-	//open buffer file to read
-	GetChunkFileNameFromIdx(d->iActiveBufFileIdx, cfilename);
-
-	LOG(LS_VERBOSE) << "VueceMediaDataBumper - bumper_activate_buffer_file: file name = " << cfilename;
-
-	strcpy(mode, "r");
-
-#ifdef WIN32
-		//NOTE - Empty impl for now because Utf8ToWindowsFilename is defined
-	//in libjingle
-	//std::wstring wfilename;
-  //std::string str(cfilename);
-  //if (Utf8ToWindowsFilename(str, &wfilename)) {
-  //  file_ = _wfopen(wfilename.c_str(), ToUtf16(mode).c_str());
-  //} else {
-  //  file_ = NULL;
-  //}
-#else
-  file_ = fopen(cfilename, mode);
-#endif
-
-  if(file_ == NULL)
-  {
-	  VueceLogger::Fatal("VueceMediaDataBumper - bumper_activate_buffer_file: file open failed!");
-  }
-
-  d->fActiveBufferFile = file_;
+	//open chunk in segment store to read
+	if(!d->pChunkReader->Open(VueceSegmentStore::Instance(), d->iActiveBufFileIdx))
+	{
+		VueceLogger::Fatal("VueceMediaDataBumper - bumper_activate_buffer_file: chunk open failed!");
+	}
 
-  return true;
+	return true;
 }
 
 int VueceMediaDataBumper::ByteArrayToInt(uint8_t* b)
@@ -556,61 +534,56 @@ int VueceMediaDataBumper::ByteArrayToInt(uint8_t* b)
 int VueceMediaDataBumper::ReadFrame(VueceMediaBumperData *d)
 {
 	int frame_len;
-	int sig;
 	int ts;
 
-	size_t result;
+	int result;
 	bool bFileCompleted = false;
 
 //	VueceLogger::Debug("VueceMediaDataBumper - bumper_read_frame");
 
-	if(d->fActiveBufferFile == NULL)
+	if(!d->pChunkReader->IsOpen())
 	{
 		VueceLogger::Fatal ("VueceMediaDataBumper - bumper_read_frame: No active buffer file.");
 		return 0;
 	}
 
-	//read header - [SignalByte][FrameLen][FrameTS][DATA]
-	result = fread(d->readBuf, 1, d->iFrameHeaderLen, d->fActiveBufferFile);
-
-	sig = d->readBuf[0];
+	//header parse is done in place - [SignalByte][FrameLen][FrameTS][DATA]
+	frame_len = d->pChunkReader->NextFrame(&d->pFrameData, &ts);
 
-	frame_len = ByteArrayToInt(d->readBuf+1);
-
-	ts = ByteArrayToInt(d->readBuf+5);
-
-	if(d->bTestFlag == true)
+	if(frame_len < 0)
 	{
-		VueceLogger::Debug("VueceMediaDataBumper - bumper_read_frame: sig = %d, Frame len = %d, ts = %d, file idx = %d", sig, frame_len, ts, d->iActiveBufFileIdx);
+		VueceLogger::Error("FATAL ERROR - iActiveBufFileIdx = %d, iReadCount = %d", d->iActiveBufFileIdx, d->iReadCount);
+		VueceLogger::Error("VueceMediaDataBumper - bumper_read_frame:file position: %lu", (unsigned long)d->pChunkReader->GetPosition());
+		VueceLogger::Fatal("VueceMediaDataBumper - bumper_read_frame: Frame header is corrupted, sth is wrong.");
+		return 0;
 	}
 
-
-	if(frame_len > VUECE_MAX_FRAME_SIZE || frame_len <= 0)
+	if(frame_len == 0)
 	{
-		VueceLogger::Error("FATAL ERROR - iActiveBufFileIdx = %d, iReadCount = %d", d->iActiveBufFileIdx, d->iReadCount);
-		VueceLogger::Error("VueceMediaDataBumper - bumper_read_frame:file position: %ld", ftell(d->fActiveBufferFile));
-		VueceLogger::Fatal("VueceMediaDataBumper - bumper_read_frame: Frame length(%d) is too long?, sth is wrong.", frame_len);
+		//frame is not completely written into chunk file yet
+		VueceLogger::Warn("VueceMediaDataBumper - bumper_read_frame: Frame is not available yet, chunk idx = %d, read count = %d", d->iActiveBufFileIdx, d->iReadCount);
 		return 0;
 	}
 
-	//read actual frame
-	result = fread(d->readBuf, 1, frame_len, d->fActiveBufferFile);
-
-//	VueceLogger::Debug(tmp_buf, "VueceMediaDataBumper - bumper_read_frame: iReadCount = %d", d->iReadCount);
-
-	if(result != frame_len)
+	if(d->bTestFlag == true)
 	{
-		VueceLogger::Fatal("VueceMediaDataBumper - bumper_read_frame: Frame is not read completely, target frame len = %d, actual bytes read = %d", frame_len, result);
-		return 0;
+		VueceLogger::Debug("VueceMediaDataBumper - bumper_read_frame: Frame len = %d, ts = %d, file idx = %d", frame_len, ts, d->iActiveBufFileIdx);
 	}
 
+	result = frame_len;
+
 	d->iReadCount++;
 	d->iTotoalFrameCounter++;
 
-	if (feof(d->fActiveBufferFile) || d->iReadCount == VUECE_AUDIO_FRAMES_PER_CHUNK)
+	if (d->iReadCount == VUECE_AUDIO_FRAMES_PER_CHUNK)
 	{
 		bFileCompleted = true;
 	}
+	else if(d->iActiveBufFileIdx < d->iLastAvailChunkFileIdx && d->pChunkReader->AtEnd())
+	{
+		//a closed chunk with less frames than expected
+		bFileCompleted = true;
+	}
 	else if(d->bIsDowloadCompleted)
 	{
 		if(d->iActiveBufFileIdx == d->iLastAvailChunkFileIdx)
@@ -627,8 +600,7 @@ int VueceMediaDataBumper::ReadFrame(VueceMediaBumperData *d)
     if (bFileCompleted)
     {
 //    	VueceLogger::Debug ("VueceMediaDataBumper - bumper_read_frame: Buffer file end OR read count reached, close file now.");
-    	fclose(d->fActiveBufferFile);
-        d->fActiveBufferFile = NULL;
+    	d->pChunkReader->Close();
         d->iReadCount = 0;
 
         d->availBufFileCounter--;
@@ -637,12 +609,6 @@ int VueceMediaDataBumper::ReadFrame(VueceMediaBumperData *d)
         {
  			VueceLogger::Debug("VueceMediaDataBumper - bumper_read_frame: Download is completed");
 
- 			if(d->bIsMergingFiles)
- 			{
- 				d->bIsChunkMerged = true;
- 				return result;
- 			}
-
  			//All data consumed and transfered to decoder module, so now we can
  			//calculate the actual duration
  			//TODO
@@ -674,16 +640,18 @@ int VueceMediaDataBumper::ReadFrame(VueceMediaBumperData *d)
 	return result;
 }
 
-void VueceMediaDataBumper::ReadAndQueueFrame(VueceMediaBumperData *d){
+/*
+ * Returns false if active chunk has no complete frame to read yet
+ */
+bool VueceMediaDataBumper::ReadAndQueueFrame(VueceMediaBumperData *d){
 
 //	VueceLogger::Debug("VueceMediaDataBumper - bumper_read_and_queue_frame");
 
 	if(d->bBufferReadable)
 	{
-		VueceMemBulk *om;
-		size_t result_frame_len;
+		int result_frame_len;
 
-		if(d->fActiveBufferFile == NULL)
+		if(!d->pChunkReader->IsOpen())
 		{
 			VueceLogger::Debug("VueceMediaDataBumper - Buffer is readable but there is no active buffer now, last active file idx: %d, last file idx: %d",
 					d->iActiveBufFileIdx, d->iLastAvailChunkFileIdx);
@@ -698,7 +666,7 @@ void VueceMediaDataBumper::ReadAndQueueFrame(VueceMediaBumperData *d){
 
 					OnAllDataConsumed();
 
-					return;
+					return true;
 				}
 			}
 
@@ -707,7 +675,7 @@ void VueceMediaDataBumper::ReadAndQueueFrame(VueceMediaBumperData *d){
 
 			if(	d->bumperState == VueceBumperState_Completed)
 			{
-				return;
+				return true;
 			}
 		}
 
@@ -716,17 +684,15 @@ void VueceMediaDataBumper::ReadAndQueueFrame(VueceMediaBumperData *d){
 
 //		VueceLogger::Debug("VueceMediaDataBumper - One frame has been read from buffer file, length = %d", result_frame_len);
 
-		if(result_frame_len > 0)
+		if(result_frame_len <= 0)
 		{
-			om = VueceMemQueue::AllocMemBulk(result_frame_len);
-
-			memcpy(om->data, d->readBuf, result_frame_len);
-
-			om->size_orginal = result_frame_len;
-
-			out_q->Put(om);
+			return false;
+		}
 
-//			VueceLogger::Debug("bumper_read_and_queue_frame - buffer successfully queued, size = %d", result_frame_len);
+		//this is the only copy of encoded data, straight from chunk mapping into next module
+		if(!out_r->WriteFrame(d->pFrameData, result_frame_len))
+		{
+			VueceLogger::Fatal("VueceMediaDataBumper - Frame(%d bytes) cannot be written into output ring, sth is wrong", result_frame_len);
 		}
 
 	}
@@ -734,6 +700,8 @@ void VueceMediaDataBumper::ReadAndQueueFrame(VueceMediaBumperData *d){
 	{
 //		VueceLogger::Debug("bumper_read_and_queue_frame - buffer is not readable yet.");
 	}
+
+	return true;
 }
 
 void VueceMediaDataBumper::OnAllDataConsumed()
@@ -784,12 +752,15 @@ void VueceMediaDataBumper::SetTerminateInfo(int last_avail_chunk_file_idx, int n
 
 	mutex_chunk_idx->Unlock();
 
+	SignalInputChanged();
+
 }
 
 //inject last available chunk file index
 int VueceMediaDataBumper::SetLastAvailChunkFileIdx(int i){
 
 	VueceMediaBumperData *d = bumper_data;
+	int threshold = VUECE_BUFFER_AVAIL_INDICATOR;
 
 	VueceLogger::Debug("VueceMediaDataBumper::SetLastAvailChunkFileIdx with value: %d", i);
 
@@ -819,9 +790,20 @@ int VueceMediaDataBumper::SetLastAvailChunkFileIdx(int i){
 	VueceLogger::Debug("VueceMediaDataBumper::SetLastAvailChunkFileIdx - availBufFileCounter is updated to: %d", d->availBufFileCounter );
 
 
-    if(d->availBufFileCounter < VUECE_BUFFER_AVAIL_INDICATOR)
+	/*
+	 * Once buffering, bumping is resumed only when the prebuffer target of jitter controller
+	 * is reached, it's enlarged on slow or unstable links so we don't stall again right after
+	 * resuming. Buffering is entered again only when buffer falls below VUECE_BUFFER_AVAIL_INDICATOR,
+	 * see ReadFrame()
+	 */
+	if(!d->bBufferReadable && jitter != NULL)
+	{
+		threshold = jitter->GetPrebufferChunks();
+	}
+
+    if(d->availBufFileCounter < threshold)
     {
-    	VueceLogger::Debug("VueceMediaDataBumper::SetLastAvailChunkFileIdx - Buffer still below threshold, not readable");
+    	VueceLogger::Debug("VueceMediaDataBumper::SetLastAvailChunkFileIdx - Buffer still below threshold(%d), not readable", threshold);
     	d->bBufferReadable = false;
     }
     else
@@ -844,6 +826,8 @@ int VueceMediaDataBumper::SetLastAvailChunkFileIdx(int i){
 
 	mutex_chunk_idx->Unlock();
 
+	SignalInputChanged();
+
 	return 0;
 }
 
@@ -909,11 +893,11 @@ int VueceMediaDataBumper::SetFirstFramePosition(int i)
 
 int VueceMediaDataBumper::StreamSeek(VueceMediaBumperData *d){
 
-	size_t result = 0;
 	int frame_len;
 	int ts;
 	bool bTargetFrameFound = false;
-	long ltmp = 0;
+	size_t frame_pos = 0;
+	uint8_t* frame_data = NULL;
 	int frame_counter = 0;
 
 	VueceBumperExternalEventNotification external_notify;
@@ -945,10 +929,9 @@ int VueceMediaDataBumper::StreamSeek(VueceMediaBumperData *d){
 	//chunk file located, locate the target frame now
 	VueceLogger::Debug("Close current active file");
 
-	if(d->fActiveBufferFile != NULL)
+	if(d->pChunkReader->IsOpen())
 	{
-		fclose(d->fActiveBufferFile);
-		d->fActiveBufferFile = NULL;
+		d->pChunkReader->Close();
 //		d->iActiveBufFileIdx = -1;
 	}
 
@@ -971,47 +954,46 @@ int VueceMediaDataBumper::StreamSeek(VueceMediaBumperData *d){
 	//reset read/frame count
 	d->iReadCount = 0;
 
+	//jump to the target frame with the frame index of this chunk, if the index is missing
+	//or target frame is not indexed yet, the scan below starts from the last indexed frame
+	VueceChunkFrameIndex::Lookup(VueceSegmentStore::Instance(), d->iActiveBufFileIdx, targetTimePosMs, &frame_pos, &frame_counter);
+
+	if(frame_counter > 0)
+	{
+		if(d->pChunkReader->SetPosition(frame_pos))
+		{
+			d->iReadCount = frame_counter;
+		}
+		else
+		{
+			VueceLogger::Warn("VueceMediaDataBumper - SEEK: Indexed frame is not in chunk file yet, scan from the beginning.");
+			frame_counter = 0;
+		}
+	}
+
 	while(true)
 	{
-		if(feof(d->fActiveBufferFile))
+		frame_pos = d->pChunkReader->GetPosition();
+
+		//frame headers are parsed in the mapping, no read/seek syscall per frame
+		frame_len = d->pChunkReader->NextFrame(&frame_data, &ts);
+
+		if(frame_len <= 0)
 		{
 			VueceLogger::Debug("End of file reached, break loop now.");
 			break;
 		}
 
-		//read header
-		result = fread(d->readBuf, 1, d->iFrameHeaderLen, d->fActiveBufferFile);
-
-		//get timestamp
-		ts = ByteArrayToInt(d->readBuf+5);
 		VueceLogger::Debug("Read one frame, ts = %d, target ts = %d", ts, targetTimePosMs);
 
-//		VueceLogger::Debug("VueceMediaDataBumper - stream_seek:file position: %ld", ftell(d->fActiveBufferFile));
-
 		if(ts >= targetTimePosMs)
 		{
 			VueceLogger::Debug("Target frame located.");
 			bTargetFrameFound = true;
 			break;
 		}
-		else
-		{
-			//skip to the next frame
-			frame_len = ByteArrayToInt(d->readBuf+1);
-
-			if(fseek(d->fActiveBufferFile, frame_len, SEEK_CUR) == 0)
-			{
-//				VueceLogger::Debug("Skipped to next frame: %d", frame_len);
-//				VueceLogger::Debug("VueceMediaDataBumper - stream_seek:file position: %ld", ftell(d->fActiveBufferFile));
-			}
-			else
-			{
-				VueceLogger::Fatal("FATAL ERROR - Skipping to next frame failed, frame len = %d", frame_len);
-				return -1;
-			}
 
-			d->iReadCount++;
-		}
+		d->iReadCount++;
 
 		frame_counter++;
 
@@ -1038,18 +1020,13 @@ int VueceMediaDataBumper::StreamSeek(VueceMediaBumperData *d){
 	VueceLogger::Debug("VueceMediaDataBumper - stream_seek: iLastAvailChunkFileIdx=%d, iActiveBufFileIdx=%d, availBufFileCounter=%d",
 			d->iLastAvailChunkFileIdx, d->iActiveBufFileIdx, d->availBufFileCounter);
 
-	//move file position indicator back by frame header length because bumper_read_frame will read
+	//move position back to start of target frame because bumper_read_frame will read
 	//frame again
-	ltmp = ftell(d->fActiveBufferFile);
-	ltmp -= d->iFrameHeaderLen;
-
-	VueceLogger::Debug("VueceMediaDataBumper - stream_seek: new file position is: %ld", ltmp);
+	VueceLogger::Debug("VueceMediaDataBumper - stream_seek: new file position is: %lu", (unsigned long)frame_pos);
 
-	if(fseek(d->fActiveBufferFile, ltmp, SEEK_SET) == 0)
+	if(d->pChunkReader->SetPosition(frame_pos))
 	{
 		VueceLogger::Debug("VueceMediaDataBumper - stream_seek: position indicator moved back to start of frame, ready to resume bumper now.");
-
-		VueceLogger::Debug("VueceMediaDataBumper - stream_seek:file position: %ld", ftell(d->fActiveBufferFile));
 	}
 	else
 	{
@@ -1096,6 +1073,8 @@ int VueceMediaDataBumper::ResumeBumper()
 
 	StateTranstion(VueceBumperFsmEvent_Resume);
 
+	SignalInputChanged();
+
 	return 0;
 }
 
@@ -1117,6 +1096,8 @@ int VueceMediaDataBumper::MarkAsCompleted()
 	VueceLogger::Debug("VueceMediaDataBumper - mark_as_completed:last chunk id = %d, active chunk id = %d", d->iLastAvailChunkFileIdx, d->iActiveBufFileIdx);
 	mutex_chunk_idx->Unlock();
 
+	SignalInputChanged();
+
 	return 0;
 }
 
@@ -1132,79 +1113,9 @@ int VueceMediaDataBumper::MarkAsStandalone()
 	return 0;
 }
 
-
-int VueceMediaDataBumper::SaveFile(VueceMediaBumperData *d)
+void VueceMediaDataBumper::SetJitterController(VueceJitterController* j)
 {
-	char cfilename[128];
-	char mode[8];
-	FILE* fTargetFile = NULL;
-	int i = 0;
-	size_t result_frame_len = 0;
-	size_t result_write = 0;
-
-	VueceLogger::Debug("VueceMediaDataBumper - -------------------------------");
-	VueceLogger::Debug("VueceMediaDataBumper - save_file");
-	VueceLogger::Debug("VueceMediaDataBumper - -------------------------------");
-
-	if(!d->bIsDowloadCompleted)
-	{
-		VueceLogger::Fatal("VueceMediaDataBumper - save_file: Fatal error! File is not completed.");
-		return -1;
-	}
-
-	if(d->fActiveBufferFile != NULL)
-	{
-		VueceLogger::Fatal("VueceMediaDataBumper - save_file: fActiveBufferFile should be null!");
-	}
-
-	d->bIsMergingFiles = true;
-
-	memset(cfilename, 0, sizeof(cfilename));
-	memset(mode, 0, sizeof(mode));
-
-	strcpy(mode, "w");
-	strcpy(cfilename, VUECE_MEDIA_AUDIO_BUFFER_LOCATION);
-	strcat(cfilename, "result.aac");
-
-	VueceLogger::Debug("VueceMediaDataBumper - save_file: file name is: %s", cfilename);
-	VueceLogger::Debug("VueceMediaDataBumper - save_file: Last available chunk idx = %d", d->iLastAvailChunkFileIdx);
-
-	fTargetFile = fopen(cfilename, mode);
-
-	if(fTargetFile == NULL)
-	{
-	  VueceLogger::Fatal("VueceMediaStream - bumper_activate_buffer_file: file open failed!");
-	  return -1;
-	}
-
-	VueceLogger::Debug("VueceMediaDataBumper - save_file: file opened, save data now");
-
-	//start from the 0th chunk file
-	d->iActiveBufFileIdx = -1;
-
-	for(i = 0; i < d->iLastAvailChunkFileIdx; i++)
-	{
-		d->bIsChunkMerged = false;
-
-		//open chunk file
-		ActivateBufferFile(d);
-
-		//start reading and saving frames
-		while(!d->bIsChunkMerged)
-		{
-			result_frame_len = ReadFrame(d);
-			result_write = fwrite(d->readBuf, 1, result_frame_len, fTargetFile);
-		}
-
-		VueceLogger::Debug("VueceMediaDataBumper - save_file: One chunk successfully merged, idx = %d", d->iActiveBufFileIdx);
-	}
-
-	VueceLogger::Debug("VueceMediaDataBumper - save_file: All chunks successfully merged, idx = %d", d->iActiveBufFileIdx);
-
-  	fclose(fTargetFile);
-  	fTargetFile = NULL;
-
-  	return 0;
+	jitter = j;
 }
 
 void VueceMediaDataBumper::LogFsmEvent(VueceBumperFsmEvent e)
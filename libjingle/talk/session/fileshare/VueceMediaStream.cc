@@ -25,19 +25,35 @@
 #include "talk/base/pathutils.h"
 #include "talk/base/fileutils.h"
 #include "talk/session/fileshare/VueceMediaStream.h"
+#include "talk/session/fileshare/VueceTranscodeCache.h"
+#include "talk/session/fileshare/VueceSeekIndex.h"
+#include "talk/session/fileshare/VueceAudioResampler.h"
+#include "talk/session/fileshare/VueceStreamFrameQueue.h"
 
 #ifndef VUECE_APP_ROLE_HUB
 #include "talk/session/fileshare/VueceStreamEngine.h"
 #include "talk/session/fileshare/VueceMediaDataBumper.h"
 #include "talk/session/fileshare/VueceStreamPlayer.h"
+#include "talk/session/fileshare/VueceSegmentStore.h"
 #endif
 
 #include "VueceGlobalSetting.h"
 #include "VueceConstants.h"
 #include "VueceLogger.h"
+#include "VueceThreadUtil.h"
 
 static char cVueceFFmpegLogBuf[1024];
 
+/*
+ * Number of hub server streams serving clients, pre-transcoding streams
+ * are not counted, see VUECE_STREAM_MODE_PRETRANSCODE
+ */
+static talk_base::CriticalSection crit_active_server_streams;
+static int iActiveServerStreamNum = 0;
+
+//number of hub server streams which sent AAC source without transcoding, protected by the same lock
+static long lPassthroughSessionNum = 0;
+
 //#define LOCAL_DECODE_TEST 1
 
 #ifdef LOCAL_DECODE_TEST
@@ -83,12 +99,87 @@ static void VueceFFmpgeLogCallBack(void* avcl, int level, const char*fmt, va_lis
 	//	}
 }
 
+/*
+ * Writes frame header (length = 9 bytes) in following format:
+ * [SignalByte][FrameLen][FrameTS][DATA]
+ */
+static void write_frame_header(uint8_t* p, int type, int len, int ts)
+{
+	int pos = 0;
+
+	p[pos++] = type;
+
+	//4 bytes header for frame length
+	p[pos++] = (len >> 24) & 0xFF;
+	p[pos++] = (len >> 16) & 0xFF;
+	p[pos++] = (len >> 8) & 0xFF;
+	p[pos++] = len & 0xFF;
+
+	//timestamp
+	p[pos++] = (ts >> 24) & 0xFF;
+	p[pos++] = (ts >> 16) & 0xFF;
+	p[pos++] = (ts >> 8) & 0xFF;
+	p[pos++] = ts & 0xFF;
+}
+
+/*
+ * Writes a signal packet telling hub client that the stream has ended,
+ * returns its length
+ */
+static int write_eof_packet(uint8_t* p)
+{
+	//send a signal/empty packet with frame len = 1
+	write_frame_header(p, VUECE_STREAM_PACKET_TYPE_EOF, 1, 0);
+
+	p[VUECE_STREAM_FRAME_HEADER_LENGTH] = 0;
+
+	return VUECE_STREAM_FRAME_HEADER_LENGTH + 1;
+}
+
+/*
+ * Codecs are opened/closed by streaming sessions and pre-transcoding workers
+ * at the same time, avcodec_open() and avcodec_close() need a lock
+ */
+static int ffmpeg_lock_manager(void** mutex, enum AVLockOp op)
+{
+	JMutex* m = NULL;
+
+	switch(op)
+	{
+	case AV_LOCK_CREATE:
+		m = new JMutex();
+		if(m->Init() != 0)
+		{
+			delete m;
+			*mutex = NULL;
+			return 1;
+		}
+		*mutex = m;
+		return 0;
+	case AV_LOCK_OBTAIN:
+		return ((JMutex*)*mutex)->Lock() != 0;
+	case AV_LOCK_RELEASE:
+		return ((JMutex*)*mutex)->Unlock() != 0;
+	case AV_LOCK_DESTROY:
+		delete (JMutex*)*mutex;
+		*mutex = NULL;
+		return 0;
+	}
+
+	return 1;
+}
+
 static void ffmpeg_init() {
 	static bool done=FALSE;
 	VueceLogger::Debug("VueceMediaStream - ffmpeg_init");
 	if (!done) {
 		VueceLogger::Debug("VueceMediaStream - ffmpeg_init - 1");
 		av_log_set_callback(VueceFFmpgeLogCallBack);
+
+		if(av_lockmgr_register(ffmpeg_lock_manager) != 0)
+		{
+			VueceLogger::Error("VueceMediaStream - ffmpeg_init : av_lockmgr_register failed");
+		}
 		// Register all formats and codecs
 		VueceLogger::Debug("VueceMediaStream - ffmpeg_init : av_register_all");
 		av_register_all();
@@ -133,40 +224,22 @@ static void generate_chunk_file_name_from_number(int num, char* fname, bool isVi
 
 static void activate_audio_chunk_file(VueceStreamData* d)
 {
-	char cfilename[128];
-	char mode[8];
-	FILE* file_ = NULL;
-
 	VueceLogger::Debug("VueceMediaStream - activate_audio_chunk_file");
 
-	if(d->fActiveAudioChunkFile != NULL)
+	if(d->bAudioChunkActive)
 	{
-//		VueceLogger::Debug("VueceMediaStream - activate_audio_chunk_file: Activate file is not null, close it at first.");
-//		fclose(d->fActiveAudioChunkFile);
-//        d->fActiveAudioChunkFile = NULL;
-
-		VueceLogger::Fatal("VueceMediaStream - activate_audio_chunk_file: Fatal error - d->fActiveAudioChunkFile should be NULL!");
+		VueceLogger::Fatal("VueceMediaStream - activate_audio_chunk_file: Fatal error - previous chunk is still active!");
 		return;
 	}
 
-	memset(cfilename, 0, sizeof(cfilename));
-	memset(mode, 0, sizeof(mode));
-
-	strcpy(mode, "w");
-
-	generate_chunk_file_name_from_number(d->iLastAvailableAudioChunkFileIdx, cfilename, false);
-
-	VueceLogger::Debug("VueceMediaStream - activate_audio_chunk_file: file name created: %s", cfilename);
-
-	file_ = fopen(cfilename, mode);
-
-	if(file_ == NULL)
+	//chunks are stored in segments of one preallocated file, no file is created here
+	if(!VueceSegmentStore::Instance()->BeginChunk(d->iLastAvailableAudioChunkFileIdx))
 	{
-	  VueceLogger::Fatal("VueceMediaStream - bumper_activate_buffer_file: file open failed!");
+	  VueceLogger::Fatal("VueceMediaStream - activate_audio_chunk_file: Cannot allocate segment for chunk %d!", d->iLastAvailableAudioChunkFileIdx);
+	  return;
 	}
 
-	d->fActiveAudioChunkFile = file_;
-
+	d->bAudioChunkActive = true;
 }
 
 static void activate_video_chunk_file(VueceStreamData* d)
@@ -204,26 +277,37 @@ static void activate_video_chunk_file(VueceStreamData* d)
 }
 
 /**
- * Write one frame into current chunk file and check the number of frames in current chunk file
- * if frame number reaches the threshold value defined by VUECE_AUDIO_FRAMES_PER_CHUNK, close
- * current chunk file, increase the index of last available chunk file and activate a new chunk file
- * for next write operation.
+ * Write len bytes at offset pos of the frame being received into current chunk file,
+ * the frame is not visible to the reader until CommitAudioFrameToChunkFile() is called
  */
-void VueceMediaStream::WriteAudioFrameToChunkFile(uint8_t* frame, size_t len, VueceStreamData* d)
+bool VueceMediaStream::WriteAudioFrameDataToChunkFile(const uint8_t* data, size_t pos, size_t len, VueceStreamData* d)
 {
-	size_t result;
+	if(!d->bAudioChunkActive)
+	{
+		VueceLogger::Fatal("VueceMediaStream::WriteAudioFrameDataToChunkFile - no active chunk!");
+		return false;
+	}
 
-	if(d->fActiveAudioChunkFile == NULL)
+	if(!VueceSegmentStore::Instance()->WriteFrameData(d->iLastAvailableAudioChunkFileIdx, (int)pos, data, (int)len))
 	{
-		VueceLogger::Fatal("VueceMediaStream::WriteAudioFrameToChunkFile - active chunk file is NULL!");
-		return;
+		VueceLogger::Fatal("VueceMediaStream::WriteAudioFrameDataToChunkFile - Write failed!");
+		return false;
 	}
 
-	result = fwrite(frame, 1, len, d->fActiveAudioChunkFile);
+	return true;
+}
 
-	if(result != len)
+/**
+ * Publish one frame written into current chunk file and check the number of frames in current chunk file
+ * if frame number reaches the threshold value defined by VUECE_AUDIO_FRAMES_PER_CHUNK, close
+ * current chunk file, increase the index of last available chunk file and activate a new chunk file
+ * for next write operation.
+ */
+void VueceMediaStream::CommitAudioFrameToChunkFile(const uint8_t* header, size_t len, VueceStreamData* d)
+{
+	if(!VueceSegmentStore::Instance()->CommitFrame(d->iLastAvailableAudioChunkFileIdx, header, (int)len))
 	{
-		VueceLogger::Fatal("VueceMediaStream::WriteAudioFrameToChunkFile - Write failed!");
+		VueceLogger::Fatal("VueceMediaStream::CommitAudioFrameToChunkFile - Commit failed!");
 		return;
 	}
 
@@ -232,10 +316,10 @@ void VueceMediaStream::WriteAudioFrameToChunkFile(uint8_t* frame, size_t len, Vu
 
 	if(d->iAudioFrameCounterInCurrentChunk == VUECE_AUDIO_FRAMES_PER_CHUNK)
 	{
-		fclose(d->fActiveAudioChunkFile);
-		d->fActiveAudioChunkFile = NULL;
+		VueceSegmentStore::Instance()->EndChunk(d->iLastAvailableAudioChunkFileIdx);
+		d->bAudioChunkActive = false;
 
-		VueceLogger::Debug("VueceMediaStream::WriteAudioFrameToChunkFile - chunk file completed with index: %d", d->iLastAvailableAudioChunkFileIdx);
+		VueceLogger::Debug("VueceMediaStream::CommitAudioFrameToChunkFile - chunk file completed with index: %d", d->iLastAvailableAudioChunkFileIdx);
 
 		VueceGlobalContext::SetLastAvailableAudioChunkFileIdx(d->iLastAvailableAudioChunkFileIdx);
 
@@ -252,7 +336,7 @@ void VueceMediaStream::WriteAudioFrameToChunkFile(uint8_t* frame, size_t len, Vu
 
 		mediaDur = iStreamData->iCurrentFramePositionSec + iStreamData->iFirstFramePosSec;
 
-		LOG(LS_VERBOSE) << "VueceMediaStream::WriteAudioFrameToChunkFile - current chunk is full, inject stream termination position: " << mediaDur;
+		LOG(LS_VERBOSE) << "VueceMediaStream::CommitAudioFrameToChunkFile - current chunk is full, inject stream termination position: " << mediaDur;
 
 		//update terminate position in audio writer
 		VueceStreamPlayer::InjectStreamTerminationPosition(mediaDur, false);
@@ -264,12 +348,12 @@ void VueceMediaStream::WriteAudioFrameToChunkFile(uint8_t* frame, size_t len, Vu
 		{
 			int window_width = d->iLastAvailableAudioChunkFileIdx - d->iFirstAudioChunkFileIdxInBufWindow + 1;
 
-			VueceLogger::Debug("VueceMediaStream::WriteAudioFrameToChunkFile - Calculate current buffer window width, last chunk id = %d, first chunk id = %d, width = %d",
+			VueceLogger::Debug("VueceMediaStream::CommitAudioFrameToChunkFile - Calculate current buffer window width, last chunk id = %d, first chunk id = %d, width = %d",
 					d->iLastAvailableAudioChunkFileIdx, d->iFirstAudioChunkFileIdxInBufWindow, window_width);
 
-			if(window_width >= VUECE_BUFFER_WINDOW)
+			if(window_width >= VueceStreamPlayer::GetBufferWindowChunks())
 			{
-				LOG(LS_VERBOSE) << "VueceMediaStream::WriteAudioFrameToChunkFile - Current buffer window is full, stream will be terminated.";
+				LOG(LS_VERBOSE) << "VueceMediaStream::CommitAudioFrameToChunkFile - Current buffer window is full, stream will be terminated.";
 
 				//we need to remember the last downloaded chunk file ID as a global variable because VueceMediaStream will be destroyed once we
 				//return EOS, it triggers session termination
@@ -285,10 +369,10 @@ void VueceMediaStream::WriteAudioFrameToChunkFile(uint8_t* frame, size_t len, Vu
 
 				VueceStreamPlayer::LogCurrentStreamingParams();
 
-				LOG(LS_VERBOSE) << "VueceMediaStream::WriteAudioFrameToChunkFile - Activate audio writer buffer window check.";
+				LOG(LS_VERBOSE) << "VueceMediaStream::CommitAudioFrameToChunkFile - Activate audio writer buffer window check.";
 				VueceStreamPlayer::EnableBufWinCheckInAudioWriter();
 
-				VueceLogger::Debug("VueceMediaStream::WriteAudioFrameToChunkFile - ----------------------------------------------");
+				VueceLogger::Debug("VueceMediaStream::CommitAudioFrameToChunkFile - ----------------------------------------------");
 
 				return;
 			}
@@ -303,31 +387,40 @@ void VueceMediaStream::WriteAudioFrameToChunkFile(uint8_t* frame, size_t len, Vu
 
 		activate_audio_chunk_file(d);
 
-		VueceLogger::Debug("VueceMediaStream::WriteAudioFrameToChunkFile - next chunk file activated with index: %d", d->iLastAvailableAudioChunkFileIdx);
+		VueceLogger::Debug("VueceMediaStream::CommitAudioFrameToChunkFile - next chunk file activated with index: %d", d->iLastAvailableAudioChunkFileIdx);
 		VueceLogger::Debug("TROUBLESHOOTING 5 - iStreamData V = %d, Global V = %d", d->iLastAvailableAudioChunkFileIdx, VueceGlobalContext::GetLastAvailableAudioChunkFileIdx());
 
 	}
 
 }
 
-static void write_video_frame_to_chunk_file(uint8_t* frame, size_t len, VueceStreamData* d)
+/*
+ * Video chunk files are written sequentially, a frame received in pieces is
+ * appended piece by piece
+ */
+static bool write_video_frame_data_to_chunk_file(const uint8_t* data, size_t len, VueceStreamData* d)
 {
 	size_t result;
 
 	if(d->fActiveVideoChunkFile == NULL)
 	{
-		VueceLogger::Fatal("write_video_frame_to_chunk_file - active chunk file is NULL!");
-		return;
+		VueceLogger::Fatal("write_video_frame_data_to_chunk_file - active chunk file is NULL!");
+		return false;
 	}
 
-	result = fwrite(frame, 1, len, d->fActiveVideoChunkFile);
+	result = fwrite(data, 1, len, d->fActiveVideoChunkFile);
 
 	if(result != len)
 	{
-		VueceLogger::Fatal("write_video_frame_to_chunk_file - Write failed!");
-		return;
+		VueceLogger::Fatal("write_video_frame_data_to_chunk_file - Write failed!");
+		return false;
 	}
 
+	return true;
+}
+
+static void commit_video_frame_to_chunk_file(VueceStreamData* d)
+{
 	d->lTotoalVideoFrameCounter++;
 	d->iReceivedVideoFrameCounter++;
 
@@ -336,7 +429,7 @@ static void write_video_frame_to_chunk_file(uint8_t* frame, size_t len, VueceStr
 		fclose(d->fActiveVideoChunkFile);
 		d->fActiveVideoChunkFile = NULL;
 
-		VueceLogger::Debug("write_video_frame_to_chunk_file - chunk file completed with index: %d", d->iCurrentVideoChunkFileIdx);
+		VueceLogger::Debug("commit_video_frame_to_chunk_file - chunk file completed with index: %d", d->iCurrentVideoChunkFileIdx);
 
 		//increase chunk file idx and create a new chunk file
 		d->iCurrentVideoChunkFileIdx++;
@@ -344,7 +437,7 @@ static void write_video_frame_to_chunk_file(uint8_t* frame, size_t len, VueceStr
 
 		activate_video_chunk_file(d);
 
-		VueceLogger::Debug("write_video_frame_to_chunk_file - next chunk file activated with index: %d", d->iCurrentVideoChunkFileIdx);
+		VueceLogger::Debug("commit_video_frame_to_chunk_file - next chunk file activated with index: %d", d->iCurrentVideoChunkFileIdx);
 	}
 }
 #endif
@@ -378,10 +471,11 @@ bool VueceMediaStream::InternalInit(bool isServer)
 	iStreamData->iAACRawFrameBytes = 4096;
 	iStreamData->iMP3RawFrameBytes = -1;//4608;
 
-	iStreamData->iBufferLen = 0;
 	iStreamData->iFileSize = 0;
 	iStreamData->iAudioBytesRead = 0;
-	iStreamData->iFrameHeaderStartPos = 0;
+	iStreamData->iFrameHeaderPos = 0;
+	iStreamData->iFramePayloadLen = 0;
+	iStreamData->iFramePayloadPos = 0;
 	iStreamData->iCurrentFramePositionSec = 0;
 
 	iStreamData->iAudioFrameCounterInCurrentChunk = 0;
@@ -398,16 +492,24 @@ bool VueceMediaStream::InternalInit(bool isServer)
 	iStreamData->iCurrentVideoChunkFileIdx = 0;
 	iStreamData->iFrameDurationInMs = 0;
 
-	iStreamData->fActiveAudioChunkFile = NULL;
+	iStreamData->bAudioChunkActive = false;
 	iStreamData->fActiveVideoChunkFile = NULL;
 
 	iStreamData->bIsDownloadCompleted = false;
 	iStreamData->bIsReceivingAudioPacket = true;
 
+	iStreamData->pTranscodeCacheEntry = NULL;
+	iStreamData->bTranscodeCacheWriter = false;
+	iStreamData->fTranscodeCacheFile = NULL;
+	iStreamData->iTranscodeCacheFrameNo = 0;
+
+	iStreamData->pSeekIndex = NULL;
+	iStreamData->pSeekIndexBuilder = NULL;
+
+	iStreamData->bAudioPassthrough = false;
 
-	iStreamData->bIsReadingBigAudioFrame = false;
-	iStreamData->bIsReadingBigVideoFrame = false;
-	iStreamData->lCurrentBigFrameReadPos = 0;
+	iStreamData->pResampler = NULL;
+	iStreamData->pResampleOutBuf = NULL;
 
 	//NOTE - Following fields are hard-coded in order to give the some default values
 	//actual values will be populated when the codec is open for the target audio file
@@ -465,23 +567,13 @@ bool VueceMediaStream::InternalInit(bool isServer)
 
 	VueceLogger::Debug("VueceMediaStream::InternalInit - 2");
 
-	//allocate memory for buffers
-	//TODO Note this can be avoided if we don't need transcode
-	iStreamData->pAudioDecOutBuf = (int16_t*)av_malloc(AVCODEC_MAX_AUDIO_FRAME_SIZE);
-
-	VueceLogger::Debug("VueceMediaStream::InternalInit - 3");
-
-	iStreamData->pAudioOutBufTranscoded = (uint8_t*)av_malloc(AVCODEC_MAX_AUDIO_FRAME_SIZE);
-
-	VueceLogger::Debug("VueceMediaStream::InternalInit - 4");
-
-	iStreamData->pAudioEncodeFifo = av_fifo_alloc(AVCODEC_MAX_AUDIO_FRAME_SIZE);
-
-	VueceLogger::Debug("VueceMediaStream::InternalInit - 5");
+	//NOTE - transcoding buffers are allocated in Open() only if the source needs transcoding, see AllocTranscodeBuffers()
+	iStreamData->pAudioDecOutBuf = NULL;
+	iStreamData->pAudioOutBufTranscoded = NULL;
+	iStreamData->pAudioEncodeFifo = NULL;
 
-	iStreamData->iBigFrameBuf 	= (uint8_t*)malloc(VUECE_MAX_PACKET_SIZE);
-
-	iStreamData->pTmpBuf = (uint8_t*)av_malloc(VUECE_ENCODE_OUTPUT_BUFFER_SIZE);
+	//output of hub server stream, frame buffers are allocated when frames are produced
+	iStreamData->pFrameQueue = new VueceStreamFrameQueue();
 
 	VueceLogger::Debug("VueceMediaStream::InternalInit - 6");
 
@@ -491,10 +583,6 @@ bool VueceMediaStream::InternalInit(bool isServer)
 
 		LOG(INFO) << "VueceMediaStream::InternalInit - In hub client mode,  creating audio stream as a media hub client.";
 
-		iStreamData->iBuffer 		= (uint8_t*)malloc(VUECE_MAX_BUFFER_SIZE);
-
-		memset(iStreamData->iBuffer, 0, VUECE_MAX_BUFFER_SIZE);
-
 		////////////////////////////////////////////////////////////////////////////////////////////////////
 		// Determine frame duration - Start
 		// This is very important because SEEK operation won't succeed if the frame duration is not accurate
@@ -562,10 +650,16 @@ bool VueceMediaStream::InternalInit(bool isServer)
 			VueceLogger::Debug("VueceMediaStream::Open(Hub client mode) - First chunk file id in buffer window is updated to %d",
 					iStreamData->iFirstAudioChunkFileIdxInBufWindow);
 
+			//buffered chunks before the new window can be recycled by segment store from now on
+			VueceSegmentStore::Instance()->SetBufferWindow(iStreamData->iFirstAudioChunkFileIdxInBufWindow, idx);
+
 			activate_audio_chunk_file(iStreamData);
 		}
 		else
 		{
+			//new song, chunks of previous song are dropped from segment store
+			VueceSegmentStore::Instance()->Reset();
+
 			//create and open the first audio chunk file
 			activate_audio_chunk_file(iStreamData);
 
@@ -653,11 +747,12 @@ void VueceMediaStream::InternalRelease()
 
 	LOG(LS_VERBOSE) << "VueceMediaStream - InternalRelease 1c";
 
-	av_free(iStreamData->pTmpBuf);
+	delete iStreamData->pFrameQueue;
 
 	LOG(LS_VERBOSE) << "VueceMediaStream - InternalRelease 1d";
 
-	free(iStreamData->iBigFrameBuf);
+	delete iStreamData->pResampler;
+	av_free(iStreamData->pResampleOutBuf);
 
 	LOG(LS_VERBOSE) << "VueceMediaStream - InternalRelease 2";
 
@@ -672,6 +767,16 @@ void VueceMediaStream::InternalRelease()
 	if(bIsServer)
 	{
 		LOG(LS_VERBOSE) << "VueceMediaStream - InternalRelease 5";
+
+		if(bCountedAsActive)
+		{
+			talk_base::CritScope lock(&crit_active_server_streams);
+			iActiveServerStreamNum--;
+			bCountedAsActive = false;
+		}
+
+		ReleaseTranscodeCache();
+		ReleaseSeekIndex();
 		av_close_input_file(iStreamData->pFormatCtx);
 	}
 	else
@@ -679,13 +784,11 @@ void VueceMediaStream::InternalRelease()
 #ifndef VUECE_APP_ROLE_HUB
 		LOG(LS_VERBOSE) << "VueceMediaStream - InternalRelease 6";
 
-		free(iStreamData->iBuffer);
-
-		if(iStreamData->fActiveAudioChunkFile != NULL)
+		if(iStreamData->bAudioChunkActive)
 		{
 			LOG(LS_VERBOSE) << "VueceMediaStream - InternalRelease 7";
-			fclose(iStreamData->fActiveAudioChunkFile);
-			iStreamData->fActiveAudioChunkFile = NULL;
+			VueceSegmentStore::Instance()->EndChunk(iStreamData->iLastAvailableAudioChunkFileIdx);
+			iStreamData->bAudioChunkActive = false;
 
 		}
 		else
@@ -721,8 +824,11 @@ VueceMediaStream::VueceMediaStream(const std::string& session_id_, int sample_ra
 
 	bIsServer = false;
 	bIsAllDataConsumed = false;
+	bIsSourceEnded = false;
 	iStartPosSec = 0;
 	bAllowWrite = false;
+	bIsBackground = false;
+	bCountedAsActive = false;
 
 #ifdef ANDROID
 	VueceThreadUtil::InitMutex(&mutex_wait_session_release);
@@ -775,6 +881,8 @@ bool VueceMediaStream::Open(const std::string& filename, const char* mode) {
 
 	LOG(LS_VERBOSE) << "VueceMediaStream::Open - In hub server mode.";
 
+	bIsBackground = (strcmp(mode, VUECE_STREAM_MODE_PRETRANSCODE) == 0);
+
 	bret = InternalInit(true);
 
 	if (stat(filename.c_str(), &file_stats) != 0)
@@ -926,6 +1034,31 @@ channels = %d, time base(num) = %d, time base(den) = %d",
 	if(iStreamData->pAudioCodecCtx->codec_id == CODEC_ID_AAC)
 	{
 		VueceLogger::Debug("VueceMediaStream::Open - Stream is in AAC format.");
+
+		iStreamData->bAudioPassthrough = CheckAACPassthrough();
+
+		//1024 samples per frame, only used if packets don't have time stamp
+		if(iStreamData->pAudioCodecCtx->sample_rate > 0)
+		{
+			iStreamData->iFrameDurationInMs = 1024 * 1000 / iStreamData->pAudioCodecCtx->sample_rate;
+		}
+
+		if(iStreamData->bAudioPassthrough)
+		{
+			long n = 0;
+
+			if(!bIsBackground)
+			{
+				talk_base::CritScope lock(&crit_active_server_streams);
+				n = ++lPassthroughSessionNum;
+			}
+
+			LOG(INFO) << "VueceMediaStream::Open - AAC-LC source, frames are sent without transcoding, passthrough session count: " << n;
+		}
+		else
+		{
+			LOG(LS_WARNING) << "VueceMediaStream::Open - AAC source cannot be decoded by client as it is, frames are sent without any change.";
+		}
 	}
 	else if(iStreamData->pAudioCodecCtx->codec_id == CODEC_ID_MP3)
 	{
@@ -939,44 +1072,62 @@ channels = %d, time base(num) = %d, time base(den) = %d",
 	if(iStreamData->pAudioCodecCtx->codec_id == CODEC_ID_MP3 || iStreamData->pAudioCodecCtx->codec_id == CODEC_ID_MP2)
 	{
 		int tmp;
+		int enc_sample_rate = iStreamData->pAudioCodecCtx->sample_rate;
+		int enc_nchannels = iStreamData->pAudioCodecCtx->channels;
 
 		VueceLogger::Debug("VueceMediaStream::Open - Stream is MP3/MP2 format, we need transcoding.");
 
+		if(!AllocTranscodeBuffers())
+		{
+			return false;
+		}
+
 		//why???
 //		iStreamData->iMP3RawFrameBytes = iStreamData->pAudioCodecCtx->frame_size * 2 * 2;
 		iStreamData->iMP3RawFrameBytes = iStreamData->pAudioCodecCtx->frame_size * 2 * iStreamData->pAudioCodecCtx->channels;
 
 		VueceLogger::Debug("VueceMediaStream::Open - Stream is MP3 format, raw frame length is: %d", iStreamData->iMP3RawFrameBytes);
 
-		if(iStreamData->iMP3RawFrameBytes == 2304)
-		{
-			iStreamData->iAACRawFrameBytes = 2048;//2048;
-		}
-		else if(iStreamData->iMP3RawFrameBytes == 4608)
+		//AAC is encoded with sample rate and channel number negotiated for this session
+		if(sample_rate > 0)
 		{
-			iStreamData->iAACRawFrameBytes = 4096;
+			enc_sample_rate = sample_rate;
 		}
-		else
+
+		if(nchannels == 1 || nchannels == 2)
 		{
-			VueceLogger::Fatal("VueceMediaStream::Open - This raw frame length is not supported!Abort now.");
-//			return false;
+			enc_nchannels = nchannels;
 		}
 
-		//handle special cases
-		if(iStreamData->pAudioCodecCtx->sample_rate == 22050 && iStreamData->pAudioCodecCtx->channels == 2)
+		if(enc_sample_rate != iStreamData->pAudioCodecCtx->sample_rate || enc_nchannels != iStreamData->pAudioCodecCtx->channels)
 		{
-			iStreamData->iAACRawFrameBytes = 4096;
+			iStreamData->pResampler = new VueceAudioResampler();
+			iStreamData->pResampleOutBuf = (int16_t*)av_malloc(AVCODEC_MAX_AUDIO_FRAME_SIZE);
 
-			LOG(LS_VERBOSE) << "VueceMediaStream::Open - Sample rate is 22050 and nchannel is 2, iAACRawFrameBytes is set to 4096";
-		}
+			if(iStreamData->pResampleOutBuf == NULL
+					|| !iStreamData->pResampler->Init(iStreamData->pAudioCodecCtx->sample_rate, iStreamData->pAudioCodecCtx->channels,
+							enc_sample_rate, enc_nchannels))
+			{
+				VueceLogger::Error("VueceMediaStream::Open - Cannot convert %d Hz/%d ch source into %d Hz/%d ch",
+						iStreamData->pAudioCodecCtx->sample_rate, iStreamData->pAudioCodecCtx->channels, enc_sample_rate, enc_nchannels);
+				return false;
+			}
 
-		if(iStreamData->pAudioCodecCtx->sample_rate == 22050 && iStreamData->pAudioCodecCtx->channels == 1)
-		{
-			iStreamData->iAACRawFrameBytes = 2048;
+			LOG(INFO) << "VueceMediaStream::Open - Source is resampled from " << iStreamData->pAudioCodecCtx->sample_rate << " Hz/"
+					<< iStreamData->pAudioCodecCtx->channels << " ch to " << enc_sample_rate << " Hz/" << enc_nchannels << " ch";
 
-			LOG(LS_VERBOSE) << "VueceMediaStream::Open - Sample rate is 22050 and nchannel is 1, iAACRawFrameBytes is set to 2048";
+			iStreamData->iAudioSampleRate = enc_sample_rate;
+			iStreamData->iNChannels = enc_nchannels;
+
+			iStreamData->lTotalAudioBytesConsumedPerSecond =
+					iStreamData->iAudioSampleRate *
+					iStreamData->iBitDepth *
+					iStreamData->iNChannels / 8;
 		}
 
+		//one AAC frame is 1024 samples of each channel
+		iStreamData->iAACRawFrameBytes = 1024 * 2 * enc_nchannels;
+
 		VueceLogger::Debug("VueceMediaStream::Open - Stream is MP3 format, AAC raw frame length is updated to: %d", iStreamData->iAACRawFrameBytes);
 
 		double tmp2 = (double)iStreamData->iAACRawFrameBytes / iStreamData->lTotalAudioBytesConsumedPerSecond;
@@ -1022,9 +1173,16 @@ channels = %d, time base(num) = %d, time base(den) = %d",
 		}
 
 		//assign encoder parameters based on the original codec context
-		iStreamData->pAudioTranscodeEncCtx->sample_rate = iStreamData->pAudioCodecCtx->sample_rate;
-		iStreamData->pAudioTranscodeEncCtx->channels = iStreamData->pAudioCodecCtx->channels;
+		iStreamData->pAudioTranscodeEncCtx->sample_rate = enc_sample_rate;
+		iStreamData->pAudioTranscodeEncCtx->channels = enc_nchannels;
 		iStreamData->pAudioTranscodeEncCtx->bit_rate = iStreamData->pAudioCodecCtx->bit_rate;
+
+		//a lower rendition requested by client, see VueceMediaStreamSession::SelectRendition()
+		if(bit_rate > 0 && bit_rate < iStreamData->pAudioCodecCtx->bit_rate)
+		{
+			VueceLogger::Debug("VueceMediaStream::Open - Transcode at rendition bit rate: %d", bit_rate);
+			iStreamData->pAudioTranscodeEncCtx->bit_rate = bit_rate;
+		}
 		iStreamData->pAudioTranscodeEncCtx->sample_fmt = iStreamData->pAudioCodecCtx->sample_fmt;
 		iStreamData->pAudioTranscodeEncCtx->profile = FF_PROFILE_AAC_MAIN;//iStreamData->pAudioCodecCtx->profile;
 		iStreamData->pAudioTranscodeEncCtx->codec_id = CODEC_ID_AAC;
@@ -1039,19 +1197,15 @@ channels = %d, time base(num) = %d, time base(den) = %d",
 
 		tmp = av_samples_get_buffer_size( NULL,
 				iStreamData->pAudioTranscodeEncCtx->channels,
-				iStreamData->pAudioCodecCtx->frame_size,
+				1024,
 				iStreamData->pAudioTranscodeEncCtx->sample_fmt,
 				1);
 
 		LOG(LS_VERBOSE) << "VueceMediaStream::Open - av_samples_get_buffer_size returnedd frame size = " << tmp;
 
-		//TODO - We need to make it adaptable in the future, currently simply
-		//return false then terminate the session if buffer size is not 4096.
-		//When a song has mono configuration, the buffer size is 2048, 64kb/s
-		//we need to let both size know the audio config before streaming is started
-		if(tmp != 4096)
+		if(tmp != iStreamData->iAACRawFrameBytes)
 		{
-			VueceLogger::Error("VueceMediaStream::Open - AAC sample size is not 4096 actual sample size: %d", tmp);
+			VueceLogger::Error("VueceMediaStream::Open - AAC sample size is not %d actual sample size: %d", iStreamData->iAACRawFrameBytes, tmp);
 
 //			av_free(iStreamData->pAudioTranscodeEncCtx);
 //
@@ -1072,39 +1226,30 @@ channels = %d, time base(num) = %d, time base(den) = %d",
 
 	LOG(INFO) << "VueceMediaStream::Open operation was successful.";
 
-	//NOTE - We only seek audio frame for now
-	if(iStartPosSec > 0)
+	//Transcoded output of this track may be served from cache
+	if(iStreamData->pAudioTranscodeEncCtx != NULL)
 	{
-		LOG(INFO) << "VueceMediaStream::Open - Start position is > 0, seek target frame at first, call av_rescale now.";
-
-		// Convert time into frame number
-
-		int64_t	desiredFrameNumber = av_rescale(
-				iStartPosSec*1000,
-				iStreamData->pTargetAudioStream->time_base.den,
-				iStreamData->pTargetAudioStream->time_base.num);
+		OpenTranscodeCache(filename, (long)file_stats.st_mtime);
+	}
 
-		LOG(INFO) << "VueceMediaStream::Open - av_rescale returned with frame number: " << desiredFrameNumber;
+	OpenSeekIndex(filename, (long)file_stats.st_mtime, (size_t)file_stats.st_size);
 
-		desiredFrameNumber/=1000;
+	//NOTE - We only seek audio frame for now, no need to seek if frames are read from cache
+	if(iStartPosSec > 0 && iStreamData->fTranscodeCacheFile == NULL)
+	{
+		LOG(INFO) << "VueceMediaStream::Open - Start position is > 0, seek target frame at first.";
 
-		if(avformat_seek_file(
-				iStreamData->pFormatCtx,
-				iStreamData->targetAudioStreamIdx,
-				0,
-				desiredFrameNumber,
-				desiredFrameNumber,
-				AVSEEK_FLAG_ANY)<0
-				)
+		if(!SeekAudio(iStartPosSec*1000, &iStreamData->iCurrentTimeStamp))
 		{
-			VueceLogger::Fatal("FATAL ERROR!!! VueceMediaStream::Open - avformat_seek_file failed, sth is wrong!");
 			return false;
 		}
-		else
-		{
-			LOG(INFO) << "VueceMediaStream::Open - avformat_seek_file returned OK.";
-		}
+	}
 
+	if(!bIsBackground)
+	{
+		talk_base::CritScope lock(&crit_active_server_streams);
+		iActiveServerStreamNum++;
+		bCountedAsActive = true;
 	}
 
 	iStreamState = SS_OPEN;
@@ -1112,853 +1257,1128 @@ channels = %d, time base(num) = %d, time base(den) = %d",
 	return true;
 }
 
-bool VueceMediaStream::OpenShare(const std::string& filename, const char* mode,
-		int shflag) {
-
-	VueceLogger::Fatal( "VueceMediaStream::OpenShare - Not supported!");
-
-	return false;
-}
+/*
+ * Seeks to the audio packet of ts_ms, the exact packet is located with the seek index
+ * if there is one, actual_ts_ms (optional) is updated with time stamp of that packet
+ */
+bool VueceMediaStream::SeekAudio(int ts_ms, int* actual_ts_ms)
+{
+	int64_t pos = 0;
+	int ts = 0;
 
-bool VueceMediaStream::DisableBuffering() {
+	//packets are no longer read in file order
+	if(iStreamData->pSeekIndexBuilder != NULL)
+	{
+		delete iStreamData->pSeekIndexBuilder;
+		iStreamData->pSeekIndexBuilder = NULL;
+	}
 
-	LOG(LS_ERROR) << "VueceMediaStream::DisableBuffering - Not supported";
+	if(iStreamData->pSeekIndex != NULL && iStreamData->pSeekIndex->FindPacket(ts_ms, &pos, &ts))
+	{
+		if(av_seek_frame(iStreamData->pFormatCtx, iStreamData->targetAudioStreamIdx, pos, AVSEEK_FLAG_BYTE) >= 0)
+		{
+			LOG(INFO) << "VueceMediaStream::SeekAudio - Seek index located packet at " << pos << ", ts = " << ts << " ms";
 
-	return false;
-}
+			if(actual_ts_ms != NULL)
+			{
+				*actual_ts_ms = ts;
+			}
 
-StreamState VueceMediaStream::GetState() const {
+			return true;
+		}
 
-	VueceLogger::Fatal( "VueceMediaStream::GetState - Note supported.");
+		LOG(LS_WARNING) << "VueceMediaStream::SeekAudio - Byte seek failed, use avformat_seek_file instead.";
+	}
 
-	return iStreamState;
-}
+	// Convert time into frame number
+	int64_t	desiredFrameNumber = av_rescale(
+			ts_ms,
+			iStreamData->pTargetAudioStream->time_base.den,
+			iStreamData->pTargetAudioStream->time_base.num);
 
+	LOG(INFO) << "VueceMediaStream::SeekAudio - av_rescale returned with frame number: " << desiredFrameNumber;
 
+	desiredFrameNumber/=1000;
 
-StreamResult VueceMediaStream::Read(
-		void* buffer,
-		size_t buffer_len,
-		size_t* read,
-		int* error
-		)
-{
+	if(avformat_seek_file(
+			iStreamData->pFormatCtx,
+			iStreamData->targetAudioStreamIdx,
+			0,
+			desiredFrameNumber,
+			desiredFrameNumber,
+			AVSEEK_FLAG_ANY)<0
+			)
+	{
+		VueceLogger::Fatal("FATAL ERROR!!! VueceMediaStream::SeekAudio - avformat_seek_file failed, sth is wrong!");
+		return false;
+	}
 
-	AVPacket packet;
-	int encodedAACFrameLen = 0;
-	int pos = 0;
-	int threshold = 1024;
-	int decLen, resultSizeBytes, i;
+	LOG(INFO) << "VueceMediaStream::SeekAudio - avformat_seek_file returned OK.";
 
-	char* p = (char*)buffer;
+	return true;
+}
 
-//	VueceLogger::Debug("VueceMediaStream::Read[SID: %s] - Target length: %d", session_id.c_str(), buffer_len);
+/*
+ * Loads seek index of current file. If there is none, it's built by scanning
+ * all packets when a seek is needed right now, otherwise it's collected while
+ * this stream reads the file from the beginning, and saved at the end of file
+ */
+void VueceMediaStream::OpenSeekIndex(const std::string& filename, long mtime, size_t file_size)
+{
+	VueceSeekIndex* index = new VueceSeekIndex(filename, mtime, file_size);
 
-	//NOTE - the buffer length MUST be bigger than header length, this is
-	//the minimum requirement, we should not split header itself into chunks
-	if(buffer_len < iStreamData->iFrameHeaderLen)
+	if(index->Load())
 	{
-//		LOG(LS_VERBOSE) << "VueceMediaStream::Read - Available buffer is smaller than header length, return 0 bytes read.";
-		*read = 0;
-		return SR_SUCCESS;
+		iStreamData->pSeekIndex = index;
+		return;
 	}
 
-	if(bIsAllDataConsumed)
+	if(iStreamData->fTranscodeCacheFile != NULL)
 	{
-		*read = 0;
-		VueceLogger::Debug("********** VueceMediaStream::Read - All data consumed!");
-		return SR_EOS;
+		//frames are read from transcode cache
+		delete index;
+		return;
 	}
 
-	if(iStreamData->bIsReadingBigVideoFrame && iStreamData->bIsReadingBigAudioFrame)
+	if(iStartPosSec == 0)
 	{
-		VueceLogger::Fatal("VueceMediaStream - FATAL ERROR!!! Read - Impossible case!");
-		return SR_ERROR;
+		iStreamData->pSeekIndexBuilder = index;
+		return;
 	}
 
-	//we don't read next frame from file unless we finish writing current big frame
-	if(iStreamData->bIsReadingBigVideoFrame || iStreamData->bIsReadingBigAudioFrame)
+	if(BuildSeekIndex(index))
 	{
-		size_t restDataLen = iStreamData->lBigFrameLen - iStreamData->lCurrentBigFrameReadPos;
+		index->Save();
+		iStreamData->pSeekIndex = index;
+		return;
+	}
+
+	delete index;
+}
 
-//		LOG(LS_VERBOSE)
-//		<< "VueceMediaStream::Read - Copying big frame, big frame len = " << iStreamData->lBigFrameLen
-//		<< ", lCurrentBigFrameReadPos = " << iStreamData->lCurrentBigFrameReadPos
-//		<< ", data remaining = " << restDataLen;
+bool VueceMediaStream::BuildSeekIndex(VueceSeekIndex* index)
+{
+	AVPacket packet;
+	uint64_t start_ms = VueceThreadUtil::GetCurTimeMs();
+	bool ret = true;
 
-		if(restDataLen <= buffer_len)
+	while(ret && av_read_frame(iStreamData->pFormatCtx, &packet) >= 0)
+	{
+		if(packet.stream_index == iStreamData->targetAudioStreamIdx)
 		{
-//			LOG(LS_VERBOSE) << "VueceMediaStream::Read - Copy of this frame can be finished, buffer is big enough";
+			ret = IndexAudioPacket(&packet, index);
+		}
 
-			memcpy(p, iStreamData->iBigFrameBuf + iStreamData->lCurrentBigFrameReadPos, restDataLen);
-			*read = restDataLen;
+		av_free_packet(&packet);
+	}
 
-			iStreamData->lCurrentBigFrameReadPos = 0;
-			iStreamData->lBigFrameLen = 0;
+	ret = ret && index->IsValid();
 
-			if(iStreamData->bIsReadingBigVideoFrame)
-			{
-				iStreamData->bIsReadingBigVideoFrame = false;
-				iStreamData->lTotoalVideoFrameCounter++;
-			}
+	LOG(INFO) << "VueceMediaStream::BuildSeekIndex - Result: " << ret << ", " << index->GetPacketCount()
+			<< " packet(s) indexed in " << (VueceThreadUtil::GetCurTimeMs() - start_ms) << " ms";
 
-			if(iStreamData->bIsReadingBigAudioFrame)
-			{
-				iStreamData->bIsReadingBigAudioFrame = false;
-				iStreamData->iTotalAudioFrameCounter++;
-			}
+	return ret;
+}
 
-			return SR_SUCCESS;
-		}
-		else
-		{
-//			LOG(LS_VERBOSE) << "VueceMediaStream::Read - Buffer is not big enough, send next chunk.";
+bool VueceMediaStream::IndexAudioPacket(AVPacket* packet, VueceSeekIndex* index)
+{
+	int ts = GetPacketTimeStamp(packet);
 
-			//send next chunk
-			memcpy(p, iStreamData->iBigFrameBuf + iStreamData->lCurrentBigFrameReadPos, buffer_len);
-			*read = buffer_len;
+	if(ts < 0)
+	{
+		index->Invalidate();
+		return false;
+	}
 
-			iStreamData->lCurrentBigFrameReadPos += buffer_len;
+	return index->AddPacket(packet->pos, ts);
+}
 
-//			LOG(LS_VERBOSE) << "VueceMediaStream::Read - One chunk copied, lCurrentBigFrameReadPos = " << iStreamData->lCurrentBigFrameReadPos;
+/*
+ * Time stamp of an audio packet in ms from start of the track, -1 if the packet has none
+ */
+int VueceMediaStream::GetPacketTimeStamp(AVPacket* packet)
+{
+	AVStream* st = iStreamData->pTargetAudioStream;
+	int64_t ts = (packet->pts != (int64_t)AV_NOPTS_VALUE) ? packet->pts : packet->dts;
 
-			return SR_SUCCESS;
-		}
+	if(ts == (int64_t)AV_NOPTS_VALUE)
+	{
+		return -1;
 	}
 
-	//start reading frame
-	while(true)
+	if(st->start_time != (int64_t)AV_NOPTS_VALUE)
 	{
-//		LOG(LS_VERBOSE) << "VueceMediaStream::Reading frame loop 1.";
+		ts -= st->start_time;
+	}
 
-		//Note the video frame/packet could be very big!
-		if(av_read_frame(iStreamData->pFormatCtx, &packet)>=0)
-		{
+	return (int)av_rescale(ts, 1000 * (int64_t)st->time_base.num, st->time_base.den);
+}
 
-//			LOG(LS_VERBOSE) << "VueceMediaStream::Reading frame loop 2";
+/*
+ * Client side VueceAACDecoder is opened without decoder specific config, only with sample
+ * rate and channel number of the session, so the source can be sent as it is only if it's
+ * AAC-LC with the same parameters and 1024 samples per frame (no SBR)
+ */
+bool VueceMediaStream::CheckAACPassthrough()
+{
+	AVCodecContext* c = iStreamData->pAudioCodecCtx;
 
-//			VueceLogger::Debug("One packet has been read, size = %d, idx = %d, dts = %lld, duration = %d, pts = %lld",
-//					packet.size, packet.stream_index ,
-//					packet.dts, packet.duration ,
-//					packet.pts);
+	//AudioSpecificConfig of MP4/M4A: [audioObjectType:5][samplingFrequencyIndex:4][channelConfiguration:4]
+	//ADTS sources don't have it, profile is carried by ADTS headers
+	if(c->extradata != NULL && c->extradata_size >= 2 && (c->extradata[0] >> 3) != 2)
+	{
+		LOG(LS_WARNING) << "VueceMediaStream::CheckAACPassthrough - Not AAC-LC, object type: " << (c->extradata[0] >> 3);
+		return false;
+	}
 
+	if(c->frame_size != 0 && c->frame_size != 1024)
+	{
+		LOG(LS_WARNING) << "VueceMediaStream::CheckAACPassthrough - Unexpected frame size: " << c->frame_size;
+		return false;
+	}
 
-			if(packet.stream_index == iStreamData->targetAudioStreamIdx)
-			{
+	if(c->sample_rate <= 0 || c->channels < 1 || c->channels > 2)
+	{
+		LOG(LS_WARNING) << "VueceMediaStream::CheckAACPassthrough - Audio parameters not supported, sample rate: "
+				<< c->sample_rate << ", channels: " << c->channels;
+		return false;
+	}
 
-				//this cannot happen because (we suppose) audio frame is always smaller then 1024 bytes
-				if(packet.size > buffer_len)
-				{
-					//This is warning, not an error, because at this point we don't know how big the transacoded frame is
-//					VueceLogger::Warn("VueceMediaStream - Warning!!! Audio frame size(%d) is bigger than target read length(%d)",
-//							packet.size, buffer_len);
-
-					//NOTE(JJ) - set *read -> 0 and return SR_SUCCESS will not work here, in this case we only need to
-					//decode and this packet and send part of it.
-					//DO NOT ENABLE FOLLOWING CODE!
-//					*read = 0;
-//					return SR_SUCCESS;
-				}
-
-				//double check this flag, we assume audio packet will only be written once, we NEVER write audio packet
-				//by multiple chunks
-				if(iStreamData->bIsReadingBigVideoFrame)
-				{
-					VueceLogger::Fatal("VueceMediaStream - FATAL ERROR!!! - Still reading big frame but we got a audio packet, abort now.");
-					return SR_ERROR;
-				}
-
-//				LOG(LS_VERBOSE) << "VueceMediaStream::Reading frame loop 3";
-
-				//If codec context for transcode is not empty, then we need to do transcode
-				if(iStreamData->pAudioTranscodeEncCtx != NULL )
-				{
-					resultSizeBytes = AVCODEC_MAX_AUDIO_FRAME_SIZE;
-
-//					LOG(LS_VERBOSE) << "VueceMediaStream::Calling avcodec_decode_audio3";
-
-					/**
-					 * Expected decoded data size:
-					 * Mono 		- 2304 bytes (1 channel)
-					 * Stereo 	- 4608 bytes (2 channels)
-					 */
-					decLen = avcodec_decode_audio3(iStreamData->pAudioCodecCtx,  (int16_t*) (iStreamData->pAudioDecOutBuf), &resultSizeBytes, &packet);
-
-//					LOG(LS_VERBOSE) << "VueceMediaStream::Calling avcodec_decode_audio3 returned with result size: " << resultSizeBytes;
-
-					//resultSize must be 4608/2304 for MP3 stream
-					if(resultSizeBytes != iStreamData->iMP3RawFrameBytes)
-					{
-						VueceLogger::Error("VueceMediaStream - ERROR!!! Decode resultSize is not (%d)! Actual value: %d, continue and read next packet", iStreamData->iMP3RawFrameBytes, resultSizeBytes);
-//						return SR_ERROR;
-//						continue;
-					}
-
-//					LOG(LS_VERBOSE) << "VueceMediaStream::Reading frame loop 4";
-
-					i = av_fifo_generic_write(iStreamData->pAudioEncodeFifo, iStreamData->pAudioDecOutBuf, resultSizeBytes, NULL);
-					//comment out to avoid massive trace output - enable for debugging only
-//					VueceLogger::Debug("TRANSCODE av_fifo_generic_write returned: %d", i);
-
-//					LOG(LS_VERBOSE) << "VueceMediaStream::Start transcoding to AAC with chunk size: " << iStreamData->iAACRawFrameBytes;
-
-					while(av_fifo_size(iStreamData->pAudioEncodeFifo) >= iStreamData->iAACRawFrameBytes) //2048/4096
-					{
-
-						av_fifo_generic_read(   iStreamData->pAudioEncodeFifo,
-												iStreamData->pAudioOutBufTranscoded,
-												iStreamData->iAACRawFrameBytes,
-												NULL);
-
-						resultSizeBytes -= iStreamData->iAACRawFrameBytes;
-
-						encodedAACFrameLen = avcodec_encode_audio(
-								iStreamData->pAudioTranscodeEncCtx, //the codec context
-								iStreamData->pTmpBuf, // the output buffer
-								1024, //the output buffer size
-								(short*)iStreamData->pAudioOutBufTranscoded // the input buffer containing the samples
-						);
-
-						//comment this out to avoid massive trace output
-//						VueceLogger::Debug("TRANSCODE - Encoded AAC frame length: %d", encodedAACFrameLen);
+	//parameters from media DB are the ones sent to client
+	if((sample_rate > 0 && c->sample_rate != sample_rate) || (nchannels > 0 && c->channels != nchannels))
+	{
+		LOG(LS_WARNING) << "VueceMediaStream::CheckAACPassthrough - Audio parameters don't match session, sample rate: "
+				<< c->sample_rate << "/" << sample_rate << ", channels: " << c->channels << "/" << nchannels;
+		return false;
+	}
 
-#ifdef LOCAL_DECODE_TEST
-						AVPacket pkt;
-						av_init_packet(&pkt);
-						pkt.data = iStreamData->pTmpBuf;
-						pkt.size = encodedAACFrameLen;
-						int decLen = -1;
-						int resultSize = AVCODEC_MAX_AUDIO_FRAME_SIZE;//iStreamData->iAACRawFrameBytes;
+	return true;
+}
 
-						decLen = avcodec_decode_audio3(pTestCodecCtx, (int16_t *)test_outbuf, &resultSize, &pkt);
+bool VueceMediaStream::AllocTranscodeBuffers()
+{
+	iStreamData->pAudioDecOutBuf = (int16_t*)av_malloc(AVCODEC_MAX_AUDIO_FRAME_SIZE);
+	iStreamData->pAudioOutBufTranscoded = (uint8_t*)av_malloc(AVCODEC_MAX_AUDIO_FRAME_SIZE);
+	iStreamData->pAudioEncodeFifo = av_fifo_alloc(AVCODEC_MAX_AUDIO_FRAME_SIZE);
 
-						if(decLen <= 0)
-						{
-//							VueceLogger::Fatal("VUECE AAC DECODER - avcodec_decode_audio3 returned a negative value: %d", decLen);
-						}
+	if(iStreamData->pAudioDecOutBuf == NULL || iStreamData->pAudioOutBufTranscoded == NULL
+			|| iStreamData->pAudioEncodeFifo == NULL)
+	{
+		VueceLogger::Fatal("VueceMediaStream::AllocTranscodeBuffers - Out of memory!");
+		return false;
+	}
 
-						VueceLogger::Debug("VUECE AAC DECODER -  Number of bytes decompressed: %d, result data size: %d ", decLen, resultSize);
-#endif
+	return true;
+}
 
+void VueceMediaStream::ReleaseSeekIndex()
+{
+	if(iStreamData->pSeekIndex != NULL)
+	{
+		delete iStreamData->pSeekIndex;
+		iStreamData->pSeekIndex = NULL;
+	}
 
-						//create frame header (length = 9 bytes) in following format:
-						//[SignalByte][FrameLen][FrameTS][DATA]
+	if(iStreamData->pSeekIndexBuilder != NULL)
+	{
+		delete iStreamData->pSeekIndexBuilder;
+		iStreamData->pSeekIndexBuilder = NULL;
+	}
+}
 
-						if(encodedAACFrameLen <= 0)
-						{
-							VueceLogger::Fatal("VueceMediaStream - TRANSCODE - FATAL ERROR!!  - No data was encoded.");
-						}
-						else
-						{
+/*
+ * Looks up transcode cache for current track, a stream starting from the beginning
+ * becomes the writer if the track is not cached yet, so time stamps in cache are
+ * always absolute. A stream reads from cache if its start position has been transcoded
+ */
+void VueceMediaStream::OpenTranscodeCache(const std::string& filename, long mtime)
+{
+	VueceStreamData* d = iStreamData;
+	VueceTranscodeCacheRecord rec;
+	bool is_writer = false;
+	int frame_no = -1;
+
+	d->pTranscodeCacheEntry = VueceTranscodeCache::Instance()->Acquire(
+			filename,
+			mtime,
+			d->pAudioTranscodeEncCtx->sample_rate,
+			d->pAudioTranscodeEncCtx->bit_rate,
+			d->pAudioTranscodeEncCtx->channels,
+			iStartPosSec == 0,
+			&is_writer);
+
+	if(d->pTranscodeCacheEntry == NULL)
+	{
+		return;
+	}
 
-							//NOTE - We don't actually know what the maximum encoded frame length is
-							//the value of VUECE_ENCODE_OUTPUT_BUFFER_SIZE is determined based on
-							//tests
+	if(is_writer)
+	{
+		LOG(INFO) << "VueceMediaStream::OpenTranscodeCache - Track is not cached, transcoded frames will be cached.";
+		d->bTranscodeCacheWriter = true;
+		return;
+	}
 
-							if(encodedAACFrameLen >= VUECE_ENCODE_OUTPUT_BUFFER_SIZE)
-							{
-								VueceLogger::Fatal("VueceMediaStream - TRANSCODE - FATAL ERROR!! Encoded AAC frame is too long: %d.", encodedAACFrameLen);
-							}
+	frame_no = d->pTranscodeCacheEntry->FindFrame(iStartPosSec*1000);
 
-							p[pos++] = VUECE_STREAM_PACKET_TYPE_AUDIO;
+	if(frame_no >= 0 && d->pTranscodeCacheEntry->GetRecord(frame_no, &rec))
+	{
+		d->fTranscodeCacheFile = d->pTranscodeCacheEntry->OpenReader();
+	}
 
-							//4 bytes header for frame length
-							p[pos++] = (encodedAACFrameLen >> 24) & 0xFF;
-							p[pos++] = (encodedAACFrameLen >> 16) & 0xFF;
-							p[pos++] = (encodedAACFrameLen >> 8) & 0xFF;
-							p[pos++] = encodedAACFrameLen & 0xFF;
+	if(d->fTranscodeCacheFile == NULL || fseek(d->fTranscodeCacheFile, (long)rec.offset, SEEK_SET) != 0)
+	{
+		LOG(INFO) << "VueceMediaStream::OpenTranscodeCache - Start position is not cached yet, transcode it.";
+		ReleaseTranscodeCache();
+		return;
+	}
 
-							p[pos++] = (iStreamData->iCurrentTimeStamp >> 24) & 0xFF;
-							p[pos++] = (iStreamData->iCurrentTimeStamp >> 16) & 0xFF;
-							p[pos++] = (iStreamData->iCurrentTimeStamp >> 8) & 0xFF;
-							p[pos++] = iStreamData->iCurrentTimeStamp & 0xFF;
+	d->iTranscodeCacheFrameNo = frame_no;
+	d->iCurrentTimeStamp = rec.ts;
 
-							if(encodedAACFrameLen > buffer_len - pos)
-							{
-//								VueceLogger::Warn("-------------------------------- WARNING ---------------------------------------");
-//								VueceLogger::Warn("Reading audio frame(transcode), encodedAACFrameLen = %d, availableBufLen = %d, need to send by chunks", encodedAACFrameLen, (buffer_len - pos));
-//								VueceLogger::Warn("-------------------------------- WARNING ---------------------------------------");
-
-								ASSERT(!iStreamData->bIsReadingBigAudioFrame);
+	LOG(INFO) << "VueceMediaStream::OpenTranscodeCache - Reading from cache, first frame: " << frame_no << ", ts = " << rec.ts;
+}
 
-								//reset related flags
-								iStreamData->bIsReadingBigAudioFrame = true;
-								iStreamData->lCurrentBigFrameReadPos = 0;
-								iStreamData->lBigFrameLen = encodedAACFrameLen;
+void VueceMediaStream::ReleaseTranscodeCache()
+{
+	VueceStreamData* d = iStreamData;
 
-								memcpy(iStreamData->iBigFrameBuf, iStreamData->pTmpBuf, encodedAACFrameLen);
+	if(d->fTranscodeCacheFile != NULL)
+	{
+		fclose(d->fTranscodeCacheFile);
+		d->fTranscodeCacheFile = NULL;
+	}
 
-								memcpy(p + pos, iStreamData->pTmpBuf, (buffer_len - pos));
+	if(d->pTranscodeCacheEntry == NULL)
+	{
+		return;
+	}
 
-								iStreamData->lCurrentBigFrameReadPos += (buffer_len - pos);
+	//stream is closed before the end of track, or cache cannot be written
+	if(d->bTranscodeCacheWriter)
+	{
+		d->pTranscodeCacheEntry->Abandon();
+		VueceTranscodeCache::Instance()->Detach(d->pTranscodeCacheEntry);
+		d->bTranscodeCacheWriter = false;
+	}
 
-								*read = buffer_len;
+	VueceTranscodeCache::Instance()->Unref(d->pTranscodeCacheEntry);
+	d->pTranscodeCacheEntry = NULL;
+}
 
-//								VueceLogger::Debug("Reading audio frame, lCurrentBigFrameReadPos = %ld", iStreamData->lCurrentBigFrameReadPos);
+/*
+ * Queues as many whole cached frames as max_len can hold, a frame bigger than max_len
+ * is queued on its own. Returns false if there is no more cached frame for now and
+ * the caller should continue with live transcoding from current time stamp.
+ *
+ * A tailing reader never waits for the writer, HttpBase doesn't expect a document
+ * stream to block when it has nothing buffered
+ */
+bool VueceMediaStream::ReadFromTranscodeCache(size_t max_len)
+{
+	VueceStreamData* d = iStreamData;
+	VueceTranscodeCacheEntry* e = d->pTranscodeCacheEntry;
+	VueceTranscodeCacheRecord rec;
+	bool complete = false;
+	uint8_t* p = NULL;
+	int total = 0;
+	int n = 0;
 
-								iStreamData->iCurrentTimeStamp += iStreamData->iFrameDurationInMs;
+	//check state at first, all frames are published before the entry is completed
+	complete = (e->GetState() == VueceTranscodeCacheState_Complete);
 
-								//return from here, no further work to do because the buffer is already consumed completely
-								return SR_SUCCESS;
-							}
-							else
-							{
-								
-								if(pos + encodedAACFrameLen > buffer_len)
-								{
-									LOG(LERROR) << "VueceMediaStream - FATAL ERROR! - Buffer overflow occurred, pos = "
-											<< pos << ", encodedAACFrameLen = " << encodedAACFrameLen
-											<< ", buffer_len = " << buffer_len;
-								}
+	n = e->CountFramesFitting(d->iTranscodeCacheFrameNo, (int)max_len, &total);
 
-								memcpy(p + pos, iStreamData->pTmpBuf, encodedAACFrameLen);
+	if(n == 0 && e->GetRecord(d->iTranscodeCacheFrameNo, &rec))
+	{
+		n = 1;
+		total = VUECE_STREAM_FRAME_HEADER_LENGTH + rec.len;
+	}
 
-								pos += encodedAACFrameLen;
+	if(n > 0)
+	{
+		p = d->pFrameQueue->Reserve(total);
 
-								iStreamData->iAudioBytesRead += encodedAACFrameLen;
-								iStreamData->iTotalAudioFrameCounter++;
-								iStreamData->iCurrentTimeStamp += iStreamData->iFrameDurationInMs;
+		if(p != NULL && fread(p, 1, total, d->fTranscodeCacheFile) == (size_t)total
+				&& e->GetRecord(d->iTranscodeCacheFrameNo + n - 1, &rec))
+		{
+			d->pFrameQueue->Commit(total);
 
-								//enable for debugging only
-//								VueceLogger::Debug("One transcoded frame has been written into target buffer, current length = %d, buffer size = %d", pos, buffer_len);
+			d->iTranscodeCacheFrameNo += n;
+			d->iTotalAudioFrameCounter += n;
+			d->iAudioBytesRead += total - n * VUECE_STREAM_FRAME_HEADER_LENGTH;
+			d->iCurrentTimeStamp = rec.ts + d->iFrameDurationInMs;
 
-								if(pos > buffer_len)
-								{
-									VueceLogger::Fatal("VueceMediaStream - FATAL ERROR! - Sth is wrong, buffer overflow occurred.");
-								}
+			return true;
+		}
+	}
+	else if(complete)
+	{
+		LOG(LS_INFO) << "VueceMediaStream::ReadFromTranscodeCache - End of cached track reached, total audio frame count = "
+				<< d->iTotalAudioFrameCounter;
 
-								if(buffer_len - pos <= 1024)
-								{
-//									LOG(LS_VERBOSE) << "VueceMediaStream::Audio Read - Threshold reached, stop read frame now.";
+		QueueEOFPacket();
 
-									*read = pos;
-									return SR_SUCCESS;
-								}
-							}
+		ReleaseTranscodeCache();
 
-						}
-					}//end while loop transcoding
-				}
-				else
-				{
-					//copy original data if transcode is not needed
+		return true;
+	}
 
-					if(pos != 0)
-					{
-						LOG(LS_WARNING) << "VueceMediaStream::Audio Read - Sth is wrong, pos = " << pos << ", should be zero";
-						//abort
-						ASSERT(pos == 0);
-					}
+	LOG(LS_INFO) << "VueceMediaStream::ReadFromTranscodeCache - No more cached frame, continue with live transcoding from "
+			<< d->iCurrentTimeStamp << " ms";
 
-					p[pos++] = VUECE_STREAM_PACKET_TYPE_AUDIO;
+	ReleaseTranscodeCache();
 
-					//4 bytes header for frame length
-					p[pos++] = (packet.size >> 24) & 0xFF;
-					p[pos++] = (packet.size >> 16) & 0xFF;
-					p[pos++] = (packet.size >> 8) & 0xFF;
-					p[pos++] = packet.size & 0xFF;
+	SeekAudio(d->iCurrentTimeStamp, NULL);
 
-					//timestamp
-					p[pos++] = (iStreamData->iCurrentTimeStamp >> 24) & 0xFF;
-					p[pos++] = (iStreamData->iCurrentTimeStamp >> 16) & 0xFF;
-					p[pos++] = (iStreamData->iCurrentTimeStamp >> 8) & 0xFF;
-					p[pos++] = iStreamData->iCurrentTimeStamp & 0xFF;
+	avcodec_flush_buffers(d->pAudioCodecCtx);
+	av_fifo_reset(d->pAudioEncodeFifo);
 
-					if(packet.size > buffer_len)
-					{
-						VueceLogger::Debug("Reading audio frame, packet size = %d, availableBufLen = %d, need to send by chunks", packet.size, (buffer_len - pos));
+	if(d->pResampler != NULL)
+	{
+		d->pResampler->Reset();
+	}
 
-						ASSERT(!iStreamData->bIsReadingBigAudioFrame);
+	return false;
+}
 
-						//reset related flags
-						iStreamData->bIsReadingBigAudioFrame = true;
-						iStreamData->lCurrentBigFrameReadPos = 0;
+bool VueceMediaStream::OpenShare(const std::string& filename, const char* mode,
+		int shflag) {
 
-						if(packet.size > VUECE_MAX_PACKET_SIZE)
-						{
-							VueceLogger::Fatal("VueceMediaStream - audio packet size is too big, abort now!");
-							return SR_EOS;
-						}
+	VueceLogger::Fatal( "VueceMediaStream::OpenShare - Not supported!");
 
-						iStreamData->lBigFrameLen = packet.size;
+	return false;
+}
 
-						memcpy(iStreamData->iBigFrameBuf, packet.data, packet.size);
+bool VueceMediaStream::DisableBuffering() {
 
-						memcpy(p + pos, packet.data, (buffer_len - pos));
+	LOG(LS_ERROR) << "VueceMediaStream::DisableBuffering - Not supported";
 
-						iStreamData->lCurrentBigFrameReadPos += (buffer_len - pos);
+	return false;
+}
 
-						*read = buffer_len;
+StreamState VueceMediaStream::GetState() const {
 
-						VueceLogger::Debug("Reading audio frame, lCurrentBigFrameReadPos = %ld", iStreamData->lCurrentBigFrameReadPos);
+	VueceLogger::Fatal( "VueceMediaStream::GetState - Note supported.");
 
-						iStreamData->iCurrentTimeStamp += iStreamData->iFrameDurationInMs;
+	return iStreamState;
+}
 
-						//return from here, no further work to do because the buffer is already consumed completely
-						return SR_SUCCESS;
-					}
-					else
-					{
-						//copy the whole frame data because the buffer is sufficient
-						memcpy(p + pos, packet.data, packet.size);
 
-						pos += packet.size;
 
-						iStreamData->iAudioBytesRead += packet.size;
-						iStreamData->iTotalAudioFrameCounter++;
-						iStreamData->iCurrentTimeStamp += iStreamData->iFrameDurationInMs;
+StreamResult VueceMediaStream::Read(
+		void* buffer,
+		size_t buffer_len,
+		size_t* read,
+		int* error
+		)
+{
+//	VueceLogger::Debug("VueceMediaStream::Read[SID: %s] - Target length: %d", session_id.c_str(), buffer_len);
 
-	//    				VueceLogger::Debug("VueceMediaStream::Read - One audio frame copied into buffer, pos = %d, ts = %u", pos, iStreamData->iCurrentTimeStamp);
-					}
+	//NOTE - the buffer length MUST be bigger than header length, this is
+	//the minimum requirement, we should not split header itself into chunks
+	if(buffer_len < iStreamData->iFrameHeaderLen)
+	{
+//		LOG(LS_VERBOSE) << "VueceMediaStream::Read - Available buffer is smaller than header length, return 0 bytes read.";
+		*read = 0;
+		return SR_SUCCESS;
+	}
 
-				}
+	if(bIsAllDataConsumed)
+	{
+		*read = 0;
+		VueceLogger::Debug("********** VueceMediaStream::Read - All data consumed!");
+		return SR_EOS;
+	}
 
-//				LOG(LS_VERBOSE) << "VueceMediaStream::Audio Read - available Buf Len = " << (buffer_len - pos);
+	if(!FillFrameQueue(buffer_len))
+	{
+		return SR_ERROR;
+	}
 
-				//Note we suppose an audio packet is not bigger than 1024 bytes, we NEVER send chunked audio frame
-				if(buffer_len - pos <= 1024)
-				{
-//					LOG(LS_VERBOSE) << "VueceMediaStream::Audio Read - Threshold reached, stop read frame now.";
+	//a frame which doesn't fit stays in the queue, the rest of it is returned by next read
+	*read = iStreamData->pFrameQueue->Read((uint8_t*)buffer, (int)buffer_len);
 
-					*read = pos;
-					return SR_SUCCESS;
-				}
+	if(bIsSourceEnded && iStreamData->pFrameQueue->IsEmpty())
+	{
+		bIsAllDataConsumed = true;
+	}
 
-			}
-			else if(packet.stream_index == iStreamData->targetVideoStreamIdx)
-			{
+	return SR_SUCCESS;
+}
 
-				bool testFlag = true;
+bool VueceMediaStream::SupportsReadV() const
+{
+	return bIsServer;
+}
 
-				if(testFlag)
-				{
-					continue;
-				}
+/*
+ * Same as Read() but frames are not copied, iov points into the frame queue,
+ * see HttpBase::flush_document_v()
+ */
+StreamResult VueceMediaStream::ReadV(StreamIoVec* iov, size_t iov_max, size_t max_len, size_t* iov_count, int* error)
+{
+	if(bIsAllDataConsumed)
+	{
+		*iov_count = 0;
+		VueceLogger::Debug("********** VueceMediaStream::ReadV - All data consumed!");
+		return SR_EOS;
+	}
 
+	if(!FillFrameQueue(max_len))
+	{
+		return SR_ERROR;
+	}
 
-				if(iStreamData->bIsReadingBigVideoFrame)
-				{
-					VueceLogger::Fatal("VueceMediaStream - FATAL ERROR!!! - Just read an video packet but bIsReadingBigVideoFrame is still true, abort now!");
-					return SR_ERROR;
-				}
+	*iov_count = iStreamData->pFrameQueue->GetIoVecs(iov, NULL, (int)iov_max, max_len, NULL);
 
-				//write frame header at first
-				p[pos++] = VUECE_STREAM_PACKET_TYPE_VIDEO;
+	return SR_SUCCESS;
+}
 
-				//two bytes header for frame length
-				p[pos++] = (packet.size >> 24) & 0xFF;
-				p[pos++] = (packet.size >> 16) & 0xFF;
-				p[pos++] = (packet.size >> 8) & 0xFF;
-				p[pos++] = packet.size & 0xFF;
+void VueceMediaStream::ConsumeReadData(size_t used)
+{
+	iStreamData->pFrameQueue->Consume(used);
 
-				//timestamp
-				p[pos++] = (iStreamData->iCurrentTimeStamp >> 24) & 0xFF;
-				p[pos++] = (iStreamData->iCurrentTimeStamp >> 16) & 0xFF;
-				p[pos++] = (iStreamData->iCurrentTimeStamp >> 8) & 0xFF;
-				p[pos++] = iStreamData->iCurrentTimeStamp & 0xFF;
+	if(bIsSourceEnded && iStreamData->pFrameQueue->IsEmpty())
+	{
+		bIsAllDataConsumed = true;
+	}
+}
 
-				//if video packet is bigger than available buffer, we need to send it
-				//via multiple chunks
+/*
+ * Reads source packets until target_len bytes are queued (less than VUECE_STREAM_READ_THRESHOLD
+ * bytes would be left in caller's buffer) or the end of the source is reached, the end of
+ * stream is queued as an EOF packet
+ */
+bool VueceMediaStream::FillFrameQueue(size_t target_len)
+{
+	VueceStreamFrameQueue* q = iStreamData->pFrameQueue;
+	AVPacket packet;
+	bool ret = true;
 
-				LOG(LS_VERBOSE) << "VueceMediaStream::Read a video frame - available buf len = " << (buffer_len - pos);
+	while(!bIsSourceEnded && q->GetSize() + VUECE_STREAM_READ_THRESHOLD < (int)target_len)
+	{
+		if(iStreamData->fTranscodeCacheFile != NULL)
+		{
+			size_t max_len = target_len - q->GetSize();
 
-				if(packet.size > buffer_len - pos)
-				{
-					VueceLogger::Debug("Reading video frame, packet size = %d, availableBufLen = %d, need to send by chunks", packet.size, (buffer_len - pos));
+			if(max_len > VUECE_STREAM_FRAME_BUF_SIZE)
+			{
+				max_len = VUECE_STREAM_FRAME_BUF_SIZE;
+			}
 
-					ASSERT(!iStreamData->bIsReadingBigVideoFrame);
+			if(ReadFromTranscodeCache(max_len))
+			{
+				continue;
+			}
+		}
 
-					//reset related flags
-					iStreamData->bIsReadingBigVideoFrame = true;
-					iStreamData->lCurrentBigFrameReadPos = 0;
+		//Note the video frame/packet could be very big!
+		if(av_read_frame(iStreamData->pFormatCtx, &packet) < 0)
+		{
+			OnSourceEnded();
+			break;
+		}
 
-					if(packet.size > VUECE_MAX_PACKET_SIZE)
-					{
-						VueceLogger::Fatal("VueceMediaStream - video packet size is too big, abort now!");
-						return SR_EOS;
-					}
+//		VueceLogger::Debug("One packet has been read, size = %d, idx = %d, dts = %lld, duration = %d, pts = %lld",
+//				packet.size, packet.stream_index ,
+//				packet.dts, packet.duration ,
+//				packet.pts);
 
-					iStreamData->lBigFrameLen = packet.size;
+		if(packet.stream_index == iStreamData->targetAudioStreamIdx)
+		{
+			if(iStreamData->pSeekIndexBuilder != NULL && !IndexAudioPacket(&packet, iStreamData->pSeekIndexBuilder))
+			{
+				delete iStreamData->pSeekIndexBuilder;
+				iStreamData->pSeekIndexBuilder = NULL;
+			}
 
-					memcpy(iStreamData->iBigFrameBuf, packet.data, packet.size);
+			//If codec context for transcode is not empty, then we need to do transcode
+			if(iStreamData->pAudioTranscodeEncCtx != NULL )
+			{
+				ret = TranscodeAudioPacket(&packet);
+			}
+			else
+			{
+				ret = QueueAudioPacket(&packet);
+			}
+		}
 
-					memcpy(p + pos, packet.data, (buffer_len - pos));
+		//NOTE - video packets are not streamed for now
 
-					iStreamData->lCurrentBigFrameReadPos += (buffer_len - pos);
+		av_free_packet(&packet);
 
-					*read = buffer_len;
+		if(!ret)
+		{
+			break;
+		}
+	}
 
-					VueceLogger::Debug("Reading video frame, lCurrentBigFrameReadPos = %ld", iStreamData->lCurrentBigFrameReadPos);
+	return ret;
+}
 
-					//return from here, no further work to do because the buffer is already consumed completely
-					return SR_SUCCESS;
-				}
-				else
-				{
-					VueceLogger::Debug("Available buffer is big engouh, the whole video frame can be copied");
+/*
+ * Decodes an MP3/MP2 packet, every complete AAC frame in the encoder fifo is encoded
+ * straight into the frame queue
+ */
+bool VueceMediaStream::TranscodeAudioPacket(AVPacket* packet)
+{
+	int encodedAACFrameLen = 0;
+	int decLen, resultSizeBytes, i;
+	uint8_t* p = NULL;
 
-					memcpy(p + pos, packet.data, packet.size);
+	resultSizeBytes = AVCODEC_MAX_AUDIO_FRAME_SIZE;
 
-					pos += packet.size;
+//	LOG(LS_VERBOSE) << "VueceMediaStream::Calling avcodec_decode_audio3";
 
-					iStreamData->lTotoalVideoFrameCounter++;
+	/**
+	 * Expected decoded data size:
+	 * Mono 		- 2304 bytes (1 channel)
+	 * Stereo 	- 4608 bytes (2 channels)
+	 */
+	decLen = avcodec_decode_audio3(iStreamData->pAudioCodecCtx,  (int16_t*) (iStreamData->pAudioDecOutBuf), &resultSizeBytes, packet);
 
-					if(buffer_len - pos <= 1024)
-					{
-						LOG(LS_VERBOSE) << "VueceMediaStream::Read - Threshold reached, stop read frame now, avalaible buf len = " << (buffer_len - pos);
+//	LOG(LS_VERBOSE) << "VueceMediaStream::Calling avcodec_decode_audio3 returned with result size: " << resultSizeBytes;
 
-						*read = pos;
-						return SR_SUCCESS;
-					}
-				}
+	//decoded size may vary (first frames, free format, mid-stream format changes), fifo takes any size
+	if(decLen < 0 || resultSizeBytes <= 0)
+	{
+		VueceLogger::Debug("VueceMediaStream - Nothing decoded from packet, decLen = %d, continue and read next packet", decLen);
+	}
+	else if(iStreamData->pResampler != NULL)
+	{
+		int in_frames = resultSizeBytes / (2 * iStreamData->pAudioCodecCtx->channels);
 
-			}
-			else
-			{
-				continue;
-			}
+		if(iStreamData->pResampler->GetMaxOutputFrames(in_frames) * 2 * iStreamData->iNChannels > AVCODEC_MAX_AUDIO_FRAME_SIZE)
+		{
+			VueceLogger::Error("VueceMediaStream - Decoded frame is too big to be resampled: %d bytes", resultSizeBytes);
 		}
 		else
 		{
-			LOG(LS_INFO) << "VueceMediaStream::Read - Stream end reached, total audio frame count = "
-					<< iStreamData->iTotalAudioFrameCounter << ", total video frame count = " << iStreamData->lTotoalVideoFrameCounter;
+			resultSizeBytes = iStreamData->pResampler->Process(iStreamData->pAudioDecOutBuf, in_frames, iStreamData->pResampleOutBuf)
+					* 2 * iStreamData->iNChannels;
+
+			av_fifo_generic_write(iStreamData->pAudioEncodeFifo, iStreamData->pResampleOutBuf, resultSizeBytes, NULL);
+		}
+	}
+	else
+	{
+		i = av_fifo_generic_write(iStreamData->pAudioEncodeFifo, iStreamData->pAudioDecOutBuf, resultSizeBytes, NULL);
+	}
+	//comment out to avoid massive trace output - enable for debugging only
+//	VueceLogger::Debug("TRANSCODE av_fifo_generic_write returned: %d", i);
+
+//	LOG(LS_VERBOSE) << "VueceMediaStream::Start transcoding to AAC with chunk size: " << iStreamData->iAACRawFrameBytes;
+
+	while(av_fifo_size(iStreamData->pAudioEncodeFifo) >= iStreamData->iAACRawFrameBytes) //2048/4096
+	{
+		av_fifo_generic_read(   iStreamData->pAudioEncodeFifo,
+								iStreamData->pAudioOutBufTranscoded,
+								iStreamData->iAACRawFrameBytes,
+								NULL);
+
+		//NOTE - We don't actually know what the maximum encoded frame length is
+		//the value of VUECE_ENCODE_OUTPUT_BUFFER_SIZE is determined based on
+		//tests
+		p = iStreamData->pFrameQueue->Reserve(VUECE_STREAM_FRAME_HEADER_LENGTH + VUECE_ENCODE_OUTPUT_BUFFER_SIZE);
+
+		if(p == NULL)
+		{
+			return false;
+		}
+
+		encodedAACFrameLen = avcodec_encode_audio(
+				iStreamData->pAudioTranscodeEncCtx, //the codec context
+				p + VUECE_STREAM_FRAME_HEADER_LENGTH, // the output buffer
+				1024, //the output buffer size
+				(short*)iStreamData->pAudioOutBufTranscoded // the input buffer containing the samples
+		);
 
-			//send a signal packet with frame len = 1
-			int len = 1;
+		//comment this out to avoid massive trace output
+//		VueceLogger::Debug("TRANSCODE - Encoded AAC frame length: %d", encodedAACFrameLen);
 
-			//send a signal/empty packet
-			p[pos++] = VUECE_STREAM_PACKET_TYPE_EOF;
+#ifdef LOCAL_DECODE_TEST
+		AVPacket pkt;
+		av_init_packet(&pkt);
+		pkt.data = p + VUECE_STREAM_FRAME_HEADER_LENGTH;
+		pkt.size = encodedAACFrameLen;
+		int decLen = -1;
+		int resultSize = AVCODEC_MAX_AUDIO_FRAME_SIZE;//iStreamData->iAACRawFrameBytes;
 
-			p[pos++] = (len >> 24) &0xFF;
-			p[pos++] = (len >> 16) &0xFF;
-			p[pos++] = (len >> 8) &0xFF;
-			p[pos++] = len & 0xFF;
+		decLen = avcodec_decode_audio3(pTestCodecCtx, (int16_t *)test_outbuf, &resultSize, &pkt);
 
-			p[pos++] = 0;
-			p[pos++] = 0;
-			p[pos++] = 0;
-			p[pos++] = 0;
+		if(decLen <= 0)
+		{
+//			VueceLogger::Fatal("VUECE AAC DECODER - avcodec_decode_audio3 returned a negative value: %d", decLen);
+		}
 
-			p[pos++] = 0;
+		VueceLogger::Debug("VUECE AAC DECODER -  Number of bytes decompressed: %d, result data size: %d ", decLen, resultSize);
+#endif
 
-			*read = pos;
+		if(encodedAACFrameLen <= 0)
+		{
+			VueceLogger::Fatal("VueceMediaStream - TRANSCODE - FATAL ERROR!!  - No data was encoded.");
+			continue;
+		}
 
-			bIsAllDataConsumed = true;
-			return SR_SUCCESS;
+		if(encodedAACFrameLen >= VUECE_ENCODE_OUTPUT_BUFFER_SIZE)
+		{
+			VueceLogger::Fatal("VueceMediaStream - TRANSCODE - FATAL ERROR!! Encoded AAC frame is too long: %d.", encodedAACFrameLen);
 		}
 
-	} //end of while
+		write_frame_header(p, VUECE_STREAM_PACKET_TYPE_AUDIO, encodedAACFrameLen, iStreamData->iCurrentTimeStamp);
 
-	VueceLogger::Fatal("VueceMediaStream::Read - Something must be wrong!");
+		if(iStreamData->bTranscodeCacheWriter &&
+				!iStreamData->pTranscodeCacheEntry->AppendFrame(
+						p,
+						p + VUECE_STREAM_FRAME_HEADER_LENGTH,
+						encodedAACFrameLen,
+						iStreamData->iCurrentTimeStamp))
+		{
+			//stop caching this track, streaming goes on
+			ReleaseTranscodeCache();
+		}
 
-	//Something must be wrong if this line is reached.
-	return SR_ERROR;
-}
+		iStreamData->pFrameQueue->Commit(VUECE_STREAM_FRAME_HEADER_LENGTH + encodedAACFrameLen);
 
-static int byteArrayToInt(uint8_t* b)
-{
-	int i = 0;
-    int value = 0;
-    for (i = 0; i < 4; i++) {
-        int shift = (4 - 1 - i) * 8;
-        value += (b[i] & 0x000000FF) << shift;
-    }
-    return value;
+		iStreamData->iAudioBytesRead += encodedAACFrameLen;
+		iStreamData->iTotalAudioFrameCounter++;
+		iStreamData->iCurrentTimeStamp += iStreamData->iFrameDurationInMs;
+	}//end while loop transcoding
+
+	return true;
 }
 
 /*
- * Note -
- * 1. This is an interface method, it's called from HttpBase::ProcessData(),
- * which is from another thread, so the resource must be protected by mutex
- * 2. it's possible that when this method is being called, VueceMediaStream is being destroyed
- * by another thread, in this case we must use a flag to avoid being called
- * if the class instance is being finalized.
+ * Queues original data of an audio packet if transcode is not needed, see CheckAACPassthrough()
  */
-StreamResult VueceMediaStream::Write(const void* data, size_t data_len,
-		size_t* written, int* error) {
+bool VueceMediaStream::QueueAudioPacket(AVPacket* packet)
+{
+	uint8_t* frame = packet->data;
+	int frame_len = packet->size;
+	int ts = GetPacketTimeStamp(packet);
+	uint8_t* p = NULL;
 
-#ifdef ANDROID
+	if(ts >= 0)
+	{
+		iStreamData->iCurrentTimeStamp = ts;
+	}
 
-	int pos = 0;
-	int frame_len = 0;
-	int sig = 0;
-	unsigned long ts = 0;
+	//ADTS header is removed if the frame holds a single raw data block
+	if(iStreamData->bAudioPassthrough && frame_len > 9
+			&& frame[0] == 0xFF && (frame[1] & 0xF6) == 0xF0 && (frame[6] & 0x03) == 0)
+	{
+		int adts_len = (frame[1] & 0x01) ? 7 : 9;
 
-//	VueceLogger::Debug("VueceMediaStream::Write - START");
+		frame += adts_len;
+		frame_len -= adts_len;
+	}
 
-//	LOG(LS_VERBOSE) << "VueceMediaStream::Write:Input buffer len = "
-//			<< data_len << ", current internal buffer write pos = " << iStreamData->iBufferLen;
+	p = iStreamData->pFrameQueue->Reserve(VUECE_STREAM_FRAME_HEADER_LENGTH + frame_len);
 
-	if(iStreamData->bIsDownloadCompleted)
+	if(p == NULL)
 	{
-		LOG(LS_VERBOSE) << "VueceMediaStream::Write:Download is completed, no more data is needed, return SR_EOS.";
-		return SR_EOS;
+		return false;
 	}
 
-	if(data_len + iStreamData->iBufferLen > VUECE_MAX_BUFFER_SIZE)
+	write_frame_header(p, VUECE_STREAM_PACKET_TYPE_AUDIO, frame_len, iStreamData->iCurrentTimeStamp);
+
+	memcpy(p + VUECE_STREAM_FRAME_HEADER_LENGTH, frame, frame_len);
+
+	iStreamData->pFrameQueue->Commit(VUECE_STREAM_FRAME_HEADER_LENGTH + frame_len);
+
+	iStreamData->iAudioBytesRead += frame_len;
+	iStreamData->iTotalAudioFrameCounter++;
+	iStreamData->iCurrentTimeStamp += iStreamData->iFrameDurationInMs;
+
+//	VueceLogger::Debug("VueceMediaStream::QueueAudioPacket - One audio frame queued, ts = %u", iStreamData->iCurrentTimeStamp);
+
+	return true;
+}
+
+void VueceMediaStream::OnSourceEnded()
+{
+	LOG(LS_INFO) << "VueceMediaStream::Read - Stream end reached, total audio frame count = "
+			<< iStreamData->iTotalAudioFrameCounter << ", total video frame count = " << iStreamData->lTotoalVideoFrameCounter;
+
+	//whole file has been read in order, later streams can seek with the index
+	if(iStreamData->pSeekIndexBuilder != NULL)
 	{
-		VueceLogger::Fatal( "VueceMediaStream::Write:Cannot copy input buffer because internal buffer will overflow!" );
-		return SR_ERROR;
+		iStreamData->pSeekIndexBuilder->Save();
 	}
 
-	VueceThreadUtil::MutexLock(&mutex_wait_session_release);
-
-	if(!bAllowWrite)
+	//whole track is transcoded, cached frames can be served to other streams now
+	if(iStreamData->bTranscodeCacheWriter)
 	{
-		LOG(LS_WARNING) << "VueceMediaStream::Write - Note allowed now.";
+		if(!iStreamData->pTranscodeCacheEntry->Complete())
+		{
+			VueceTranscodeCache::Instance()->Detach(iStreamData->pTranscodeCacheEntry);
+		}
 
-		VueceThreadUtil::MutexUnlock(&mutex_wait_session_release);
+		iStreamData->bTranscodeCacheWriter = false;
 
-		return SR_ERROR;
+		ReleaseTranscodeCache();
 	}
 
-	VueceThreadUtil::MutexUnlock(&mutex_wait_session_release);
+	QueueEOFPacket();
+}
 
-	//copy data into buffer at first
-	memcpy(iStreamData->iBuffer + iStreamData->iBufferLen, data, data_len);
-	iStreamData->iBufferLen += data_len;
+void VueceMediaStream::QueueEOFPacket()
+{
+	uint8_t* p = iStreamData->pFrameQueue->Reserve(VUECE_STREAM_FRAME_HEADER_LENGTH + 1);
 
-	//then read data frame by frame, write frames into chunk file
-	while(true)
+	if(p != NULL)
 	{
+		iStreamData->pFrameQueue->Commit(write_eof_packet(p));
+	}
 
-//		LOG(LS_VERBOSE)
-//				<< "VueceMediaStream::Write:Current header start position = "
-//				<< iStreamData->iFrameHeaderStartPos << ", input buffer len = " << data_len;
+	bIsSourceEnded = true;
+}
 
-		//check length at first, return if buffer is full and frame is not complete
-		if(iStreamData->iFrameHeaderStartPos + iStreamData->iFrameHeaderLen >= iStreamData->iBufferLen)
-		{
-//			LOG(LS_WARNING) << "VueceMediaStream::Write:Frame is not complete (A), wait for next write";
-//			LOG(LS_WARNING) << "VueceMediaStream::iFrameHeaderStartPos = " << iStreamData->iFrameHeaderStartPos;
-//			LOG(LS_WARNING) << "VueceMediaStream::iBufferLen = " << iStreamData->iBufferLen;
+static int byteArrayToInt(const uint8_t* b)
+{
+	int i = 0;
+    int value = 0;
+    for (i = 0; i < 4; i++) {
+        int shift = (4 - 1 - i) * 8;
+        value += (b[i] & 0x000000FF) << shift;
+    }
+    return value;
+}
 
-		    memmove(iStreamData->iBuffer,
-		    		iStreamData->iBuffer + iStreamData->iFrameHeaderStartPos,
-		    		iStreamData->iBufferLen - iStreamData->iFrameHeaderStartPos);
+#ifdef ANDROID
+/*
+ * Called once a complete frame header has been received, returns SR_EOS
+ * if it's the termination signal, SR_ERROR if the header is invalid
+ */
+StreamResult VueceMediaStream::OnFrameHeader(const uint8_t* header)
+{
+	int sig = header[0];
+	int frame_len = byteArrayToInt(header + 1);
+	unsigned long ts = byteArrayToInt(header + 5);
 
-		    iStreamData->iBufferLen -= iStreamData->iFrameHeaderStartPos;
+	if(sig == VUECE_STREAM_PACKET_TYPE_EOF)
+	{
+		size_t mediaDur = -1;
+		GetTimePositionInSecond(&mediaDur);
 
-		    //remember the position of the frame header so we can find it at the next write
-			iStreamData->iFrameHeaderStartPos = 0;
 
-		    //we need to tell the caller all input buffer has been written
-		    *written = data_len;
+		LOG(LS_VERBOSE) << "//////////////////////////////////////////////////////////////";
+		LOG(LS_VERBOSE) << "//////////////////////////////////////////////////////////////";
+		LOG(LS_VERBOSE) << "VueceMediaStream::OnFrameHeader - received termination signal, mediaDur = " << mediaDur << ",  download is finished.";
+		LOG(LS_VERBOSE) << "VueceMediaStream::OnFrameHeader - Total audio frames = " <<  iStreamData->iTotalAudioFrameCounter;
+		LOG(LS_VERBOSE) << "//////////////////////////////////////////////////////////////";
+		LOG(LS_VERBOSE) << "//////////////////////////////////////////////////////////////";
 
-		    return SR_SUCCESS;
-		}
+		iStreamData->bIsDownloadCompleted = true;
 
-		//otherwise we got at least a complete frame header
-		sig = iStreamData->iBuffer[iStreamData->iFrameHeaderStartPos];
+		//BBB close file handle
+		LOG(LS_VERBOSE) << "VueceMediaStream::OnFrameHeader - Close active chunk file handle now.";
 
-		if(sig == VUECE_STREAM_PACKET_TYPE_EOF)
+#ifndef VUECE_APP_ROLE_HUB
+		if(iStreamData->bAudioChunkActive)
 		{
-			size_t mediaDur = -1;
-			int l = -1;
-			GetTimePositionInSecond(&mediaDur);
+			VueceSegmentStore::Instance()->EndChunk(iStreamData->iLastAvailableAudioChunkFileIdx);
+			iStreamData->bAudioChunkActive = false;
 
+			LOG(LS_VERBOSE) << "VueceMediaStream::OnFrameHeader - Active chunk file closed";
+		}
+#endif
 
-			LOG(LS_VERBOSE) << "//////////////////////////////////////////////////////////////";
-			LOG(LS_VERBOSE) << "//////////////////////////////////////////////////////////////";
-			LOG(LS_VERBOSE) << "VueceMediaStream::Write - received termination signal, mediaDur = " << mediaDur << ",  download is finished.";
-			LOG(LS_VERBOSE) << "VueceMediaStream::Write - Total audio frames = " <<  iStreamData->iTotalAudioFrameCounter;
-			LOG(LS_VERBOSE) << "//////////////////////////////////////////////////////////////";
-			LOG(LS_VERBOSE) << "//////////////////////////////////////////////////////////////";
 
-			*written = data_len;
-			iStreamData->bIsDownloadCompleted = true;
+		//////
+#ifndef VUECE_APP_ROLE_HUB
+		LOG(LS_VERBOSE) << "VueceMediaStream::OnFrameHeader - Stream is finished,  populate stream data termination info.";
 
-			//BBB close file handle
-			LOG(LS_VERBOSE) << "VueceMediaStream::Write - Close active chunk file handle now.";
+		VueceGlobalContext::SetLastAvailableAudioChunkFileIdx(iStreamData->iLastAvailableAudioChunkFileIdx);
 
-			if(iStreamData->fActiveAudioChunkFile != NULL)
-			{
-				fclose(iStreamData->fActiveAudioChunkFile);
-				iStreamData->fActiveAudioChunkFile = NULL;
+		VueceGlobalContext::SetAudioFrameCounterInCurrentChunk(iStreamData->iAudioFrameCounterInCurrentChunk);
 
-				LOG(LS_VERBOSE) << "VueceMediaStream::Write - Active chunk file closed";
-			}
+		VueceGlobalContext::SetDownloadCompleted(true);
 
+		VueceLogger::Debug("TROUBLESHOOTING 3 - iStreamData V = %d, Global V = %d", iStreamData->iLastAvailableAudioChunkFileIdx,
+				VueceGlobalContext::GetLastAvailableAudioChunkFileIdx());
 
-			//////
-#ifndef VUECE_APP_ROLE_HUB
-			LOG(LS_VERBOSE) << "VueceMediaStream::Write - Stream is finished,  populate stream data termination info.";
+		//notify vuece bumper that the last index of the available chunk file
+		if(VueceStreamPlayer::HasStreamEngine())
+		{
+			VueceStreamPlayer::InjectBumperTerminationInfo(
+					iStreamData->iLastAvailableAudioChunkFileIdx,
+					VueceGlobalContext::GetAudioFrameCounterInCurrentChunk()
+					);
 
-			VueceGlobalContext::SetLastAvailableAudioChunkFileIdx(iStreamData->iLastAvailableAudioChunkFileIdx);
+			//inject the final duration of this meida file
+			//Note - Need to update the value of the total duration queried because they might not match
+			VueceStreamPlayer::InjectStreamTerminationPosition(mediaDur, true);
 
-			VueceGlobalContext::SetAudioFrameCounterInCurrentChunk(iStreamData->iAudioFrameCounterInCurrentChunk);
+			//trigger some post-processing when current streaming is completed
+			VueceStreamPlayer::OnStreamingCompleted();
+		}
 
-			VueceGlobalContext::SetDownloadCompleted(true);
+#endif
+		return SR_EOS;
+	}
+	else if(sig == VUECE_STREAM_PACKET_TYPE_AUDIO)
+	{
+//			VueceLogger::Debug("Receiving an audio packet.");
+		iStreamData->bIsReceivingAudioPacket = true;
+	}
+	else if(sig == VUECE_STREAM_PACKET_TYPE_VIDEO)
+	{
+		VueceLogger::Debug("Receiving a video packet.");
+		iStreamData->bIsReceivingAudioPacket = false;
+	}
+	else
+	{
+		VueceLogger::Fatal("VueceMediaStream::OnFrameHeader - unknown vuece stream packet type: %d, abort now.", sig);
+	}
 
-			VueceLogger::Debug("TROUBLESHOOTING 3 - iStreamData V = %d, Global V = %d", iStreamData->iLastAvailableAudioChunkFileIdx,
-					VueceGlobalContext::GetLastAvailableAudioChunkFileIdx());
+	//set the start time
+	if(iStreamData->bReceivingFirstFrame)
+	{
+		iStreamData->bReceivingFirstFrame = false;
+		VueceLogger::Debug("VueceMediaStream::OnFrameHeader - we got the first frame header, start position is: %lu ms", ts);
 
-			//notify vuece bumper that the last index of the available chunk file
-			if(VueceStreamPlayer::HasStreamEngine())
-			{
-				VueceStreamPlayer::InjectBumperTerminationInfo(
-						iStreamData->iLastAvailableAudioChunkFileIdx,
-						VueceGlobalContext::GetAudioFrameCounterInCurrentChunk()
-						);
+		ASSERT( ts > 0 );
 
-				//inject the final duration of this meida file
-				//Note - Need to update the value of the total duration queried because they might not match
-				VueceStreamPlayer::InjectStreamTerminationPosition(mediaDur, true);
+		VueceLogger::Debug("VueceMediaStream::OnFrameHeader - first frame's timestamp is %lu ms > 0", ts);
 
-				//trigger some post-processing when current streaming is completed
-				VueceStreamPlayer::OnStreamingCompleted();
-			}
+		iStreamData->iFirstFramePosSec = ts/1000;
 
-#endif
-			return SR_EOS;
-		}
-		else if(sig == VUECE_STREAM_PACKET_TYPE_AUDIO)
-		{
-//			VueceLogger::Debug("Receiving an audio packet.");
-			iStreamData->bIsReceivingAudioPacket = true;
-		}
-		else if(sig == VUECE_STREAM_PACKET_TYPE_VIDEO)
+		// DO NOT trigger InjectFirstFramePosition() if we are still in the same PLAY SESSION
+		if(VueceStreamPlayer::StillInTheSamePlaySession())
 		{
-			VueceLogger::Debug("Receiving a video packet.");
-			iStreamData->bIsReceivingAudioPacket = false;
+			VueceLogger::Debug("VueceMediaStream::OnFrameHeader - We are streaming a buffer window now, and we are still in the same play session, no need to inject first frame position into audio writer in current session.");
 		}
 		else
 		{
-			VueceLogger::Fatal("VueceMediaStream::Write - unknown vuece stream packet type: %d, abort now.", sig);
+
+			VueceLogger::Debug("VueceMediaStream::OnFrameHeader - Update first frame position because we are in a new play session now.");
+
+			VueceGlobalContext::SetFirstFramePositionSec(iStreamData->iFirstFramePosSec);
+
+			VueceStreamPlayer::LogCurrentStreamingParams();
+
+			VueceStreamPlayer::InjectFirstFramePosition(iStreamData->iFirstFramePosSec);
 		}
 
-		frame_len = byteArrayToInt(iStreamData->iBuffer + iStreamData->iFrameHeaderStartPos+1);
+	}
 
-		ts = byteArrayToInt(iStreamData->iBuffer + iStreamData->iFrameHeaderStartPos+5);
+	//a frame should not be bigger than VUECE_MAX_FRAME_SIZE bytes
+	if(iStreamData->bIsReceivingAudioPacket && frame_len > VUECE_MAX_FRAME_SIZE)
+	{
+		VueceLogger::Fatal("VueceMediaStream::OnFrameHeader - Audio frame is too long(%d), sth must wrong.", frame_len);
+		return SR_ERROR;
+	}
 
-		//set the start time
-		if(iStreamData->bReceivingFirstFrame)
-		{
-			iStreamData->bReceivingFirstFrame = false;
-			VueceLogger::Debug("VueceMediaStream::Write - we got the first frame header, start position is: %lu ms", ts);
+	if(frame_len <= 0)
+	{
+		VueceLogger::Fatal("VueceMediaStream::OnFrameHeader - Wrong frame length!");
+		return SR_ERROR;
+	}
 
-			ASSERT( ts > 0 );
 
-			VueceLogger::Debug("VueceMediaStream::Write - first frame's timestamp is %lu ms > 0", ts);
 
-			iStreamData->iFirstFramePosSec = ts/1000;
+	iStreamData->iFramePayloadLen = frame_len;
+	iStreamData->iFramePayloadPos = 0;
 
-			// DO NOT trigger InjectFirstFramePosition() if we are still in the same PLAY SESSION
-			if(VueceStreamPlayer::StillInTheSamePlaySession())
-			{
-				VueceLogger::Debug("VueceMediaStream::Write - We are streaming a buffer window now, and we are still in the same play session, no need to inject first frame position into audio writer in current session.");
-			}
-			else
-			{
+	return SR_SUCCESS;
+}
 
-				VueceLogger::Debug("VueceMediaStream::Write - Update first frame position because we are in a new play session now.");
+/*
+ * Write len bytes at offset pos of current frame (header included) into the active chunk
+ */
+StreamResult VueceMediaStream::OnFrameData(const uint8_t* data, size_t pos, size_t len)
+{
+	bool ok = false;
 
-				VueceGlobalContext::SetFirstFramePositionSec(iStreamData->iFirstFramePosSec);
+	if(iStreamData->bIsReceivingAudioPacket)
+	{
+		ok = WriteAudioFrameDataToChunkFile(data, pos, len, iStreamData);
+	}
+	else
+	{
+		ok = write_video_frame_data_to_chunk_file(data, len, iStreamData);
+	}
 
-				VueceStreamPlayer::LogCurrentStreamingParams();
+	return ok ? SR_SUCCESS : SR_ERROR;
+}
 
-				VueceStreamPlayer::InjectFirstFramePosition(iStreamData->iFirstFramePosSec);
-			}
+/*
+ * Publish current frame and get ready for the next frame header
+ */
+StreamResult VueceMediaStream::OnFrameCompleted()
+{
+	size_t len = iStreamData->iFrameHeaderLen + iStreamData->iFramePayloadLen;
 
-		}
+	if(iStreamData->bIsReceivingAudioPacket)
+	{
+		CommitAudioFrameToChunkFile(iStreamData->iFrameHeader, len, iStreamData);
+	}
+	else
+	{
+		commit_video_frame_to_chunk_file(iStreamData);
+	}
 
-		//a frame should not be bigger than VUECE_MAX_FRAME_SIZE bytes
-		if(iStreamData->bIsReceivingAudioPacket && frame_len > VUECE_MAX_FRAME_SIZE)
-		{
-			VueceLogger::Fatal("VueceMediaStream::Write:Audio frame is too long(%d), sth must wrong.", frame_len);
-			*written = 0;
-			return SR_ERROR;
-		}
+	iStreamData->iFrameHeaderPos = 0;
+	iStreamData->iFramePayloadLen = 0;
+	iStreamData->iFramePayloadPos = 0;
 
-		if(frame_len <= 0)
+	if(BUFFER_WINDOW_ENABLED)
+	{
+		if(iStreamData->bBufWindowFull)
 		{
-			VueceLogger::Fatal("VueceMediaStream::Write:Wrong frame length!");
-			*written = 0;
-			return SR_ERROR;
+			//UUUUUUUUU
+			LOG(LS_VERBOSE) << "VueceMediaStream::~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~";
+			LOG(LS_VERBOSE) << "VueceMediaStream::Write:Buffer window is full, return SR_EOS, current session will be terminated.";
+			LOG(LS_VERBOSE) << "VueceMediaStream::~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~";
+
+			iStreamData->bBufWindowFull = false;
+
+			return SR_EOS;
 		}
+	}
 
+	return SR_SUCCESS;
+}
+#endif
 
-//		LOG(LS_VERBOSE) << "VueceMediaStream::Write:Current header position = " << iStreamData->iFrameHeaderStartPos << ", Next frame len = " << frame_len;
+/*
+ * Note -
+ * 1. This is an interface method, it's called from HttpBase::ProcessData(),
+ * which is from another thread, so the resource must be protected by mutex
+ * 2. it's possible that when this method is being called, VueceMediaStream is being destroyed
+ * by another thread, in this case we must use a flag to avoid being called
+ * if the class instance is being finalized.
+ */
+StreamResult VueceMediaStream::Write(const void* data, size_t data_len,
+		size_t* written, int* error) {
 
-		//forward write position by iStreamData->iFrameHeaderLen bytes
-		iStreamData->iFrameHeaderStartPos += iStreamData->iFrameHeaderLen;
+#ifdef ANDROID
 
-		//check if we can get a complete frame
-		if(iStreamData->iFrameHeaderStartPos + frame_len > iStreamData->iBufferLen)
-		{
-//			LOG(LS_VERBOSE) << "VueceMediaStream::Write:Frame is not complete (B), wait for next write";
+	const uint8_t* in = (const uint8_t*)data;
+	const uint8_t* frame = NULL;
+	size_t remaining = data_len;
+	size_t header_len = iStreamData->iFrameHeaderLen;
+	size_t n = 0;
+	StreamResult res = SR_SUCCESS;
 
-			iStreamData->iFrameHeaderStartPos -= iStreamData->iFrameHeaderLen;
+//	VueceLogger::Debug("VueceMediaStream::Write - START");
 
-		    memmove(iStreamData->iBuffer,
-		    		iStreamData->iBuffer + iStreamData->iFrameHeaderStartPos,
-		    		iStreamData->iBufferLen - iStreamData->iFrameHeaderStartPos);
+	if(iStreamData->bIsDownloadCompleted)
+	{
+		LOG(LS_VERBOSE) << "VueceMediaStream::Write:Download is completed, no more data is needed, return SR_EOS.";
+		return SR_EOS;
+	}
 
-		    iStreamData->iBufferLen -= iStreamData->iFrameHeaderStartPos;
-		    iStreamData->iFrameHeaderStartPos =  0;
+	VueceThreadUtil::MutexLock(&mutex_wait_session_release);
 
-		    *written = data_len;
+	if(!bAllowWrite)
+	{
+		LOG(LS_WARNING) << "VueceMediaStream::Write - Note allowed now.";
 
-			return SR_SUCCESS;
-		}
+		VueceThreadUtil::MutexUnlock(&mutex_wait_session_release);
 
+		return SR_ERROR;
+	}
 
-		//Enable this when receiving and decoding are both OK
-		//////////////////////////////////////////////////////////////////////////////////////
+	VueceThreadUtil::MutexUnlock(&mutex_wait_session_release);
 
-		//write the whole frame including the length header to the active chunk file
-		if(iStreamData->bIsReceivingAudioPacket)
-		{
-			WriteAudioFrameToChunkFile(
-							iStreamData->iBuffer + iStreamData->iFrameHeaderStartPos - iStreamData->iFrameHeaderLen,
-							frame_len + iStreamData->iFrameHeaderLen,
-							iStreamData);
-		}
-		else
+	/*
+	 * Frames are parsed incrementally, input may end anywhere in a frame header or payload.
+	 * Nothing is buffered here except the header of current frame, payload goes into the
+	 * active chunk as it arrives and the frame is published once it's complete.
+	 */
+	while(remaining > 0)
+	{
+		if(iStreamData->iFrameHeaderPos < (int)header_len)
 		{
-			write_video_frame_to_chunk_file(
-							iStreamData->iBuffer + iStreamData->iFrameHeaderStartPos - iStreamData->iFrameHeaderLen,
-							frame_len + iStreamData->iFrameHeaderLen,
-							iStreamData);
-		}
+			//remember where the frame starts if the whole header is in input
+			frame = (iStreamData->iFrameHeaderPos == 0 && remaining >= header_len) ? in : NULL;
 
-		if(BUFFER_WINDOW_ENABLED)
-		{
-			if(iStreamData->bBufWindowFull)
+			n = header_len - iStreamData->iFrameHeaderPos;
+
+			if(n > remaining)
 			{
-				//UUUUUUUUU
-				LOG(LS_VERBOSE) << "VueceMediaStream::~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~";
-				LOG(LS_VERBOSE) << "VueceMediaStream::Write:Buffer window is full, return SR_EOS, current session will be terminated.";
-				LOG(LS_VERBOSE) << "VueceMediaStream::~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~";
+				n = remaining;
+			}
 
-				iStreamData->bBufWindowFull = false;
+			memcpy(iStreamData->iFrameHeader + iStreamData->iFrameHeaderPos, in, n);
 
+			iStreamData->iFrameHeaderPos += n;
+			in += n;
+			remaining -= n;
+
+			if(iStreamData->iFrameHeaderPos < (int)header_len)
+			{
+				break;
+			}
+
+			res = OnFrameHeader(iStreamData->iFrameHeader);
+
+			if(res == SR_EOS)
+			{
+				*written = data_len;
 				return SR_EOS;
 			}
+
+			if(res != SR_SUCCESS)
+			{
+				*written = 0;
+				return res;
+			}
+
+			if(frame != NULL && remaining >= (size_t)iStreamData->iFramePayloadLen)
+			{
+				//whole frame is in input, write it straight from there
+				res = OnFrameData(frame, 0, header_len + iStreamData->iFramePayloadLen);
+
+				in += iStreamData->iFramePayloadLen;
+				remaining -= iStreamData->iFramePayloadLen;
+				iStreamData->iFramePayloadPos = iStreamData->iFramePayloadLen;
+			}
+			else
+			{
+				res = OnFrameData(iStreamData->iFrameHeader, 0, header_len);
+			}
+
+			if(res != SR_SUCCESS)
+			{
+				*written = 0;
+				return res;
+			}
 		}
 
-		//move to the next frame
-		iStreamData->iFrameHeaderStartPos += frame_len;
+		n = iStreamData->iFramePayloadLen - iStreamData->iFramePayloadPos;
 
-		//check if we have reached the end of the buffer
-		if(iStreamData->iFrameHeaderStartPos == iStreamData->iBufferLen)
+		if(n > remaining)
 		{
-//			LOG(LS_VERBOSE) << "VueceMediaStream::Write:Buffer end reached, internal buffer has been totally consumed.";
+			n = remaining;
+		}
 
-			iStreamData->iFrameHeaderStartPos 	= 0;
-			iStreamData->iBufferLen = 0;
+		if(n > 0)
+		{
+			res = OnFrameData(in, header_len + iStreamData->iFramePayloadPos, n);
 
-			 *written = data_len;
+			if(res != SR_SUCCESS)
+			{
+				*written = 0;
+				return res;
+			}
 
-			return SR_SUCCESS;
+			iStreamData->iFramePayloadPos += n;
+			in += n;
+			remaining -= n;
 		}
 
-		//just double check but this should not happen
-		if(iStreamData->iFrameHeaderStartPos > iStreamData->iBufferLen)
+		if(iStreamData->iFramePayloadPos == iStreamData->iFramePayloadLen)
 		{
-			VueceLogger::Fatal("VueceMediaStream::Write:Something is wrong, write position is beyond buffer boundary!");
-			*written = 0;
-			return SR_ERROR;
+			res = OnFrameCompleted();
+
+			if(res != SR_SUCCESS)
+			{
+				return res;
+			}
 		}
 	}
 
@@ -2003,6 +2423,23 @@ bool VueceMediaStream::GetTimePositionInSecond(size_t* position) const
 	return true;
 }
 
+bool VueceMediaStream::IsWritingTranscodeCache() const
+{
+	return iStreamData != NULL && iStreamData->bTranscodeCacheWriter;
+}
+
+int VueceMediaStream::GetActiveServerStreamCount()
+{
+	talk_base::CritScope lock(&crit_active_server_streams);
+	return iActiveServerStreamNum;
+}
+
+long VueceMediaStream::GetPassthroughSessionCount()
+{
+	talk_base::CritScope lock(&crit_active_server_streams);
+	return lPassthroughSessionNum;
+}
+
 bool VueceMediaStream::SetPosition(size_t position) {
 	VueceLogger::Fatal( "VueceMediaStream::SetPosition - Not supported.");
 	return false;
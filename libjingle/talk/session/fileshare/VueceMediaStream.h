@@ -17,6 +17,7 @@
 #ifdef ANDROID
 #include "VueceThreadUtil.h"
 #endif
+#include "VueceConstants.h"
 
 extern "C" {
 #include "libavformat/avformat.h"
@@ -25,6 +26,19 @@ extern "C" {
 #include "libavcodec/avcodec.h"
 }
 
+class VueceTranscodeCacheEntry;
+class VueceSeekIndex;
+class VueceStreamFrameQueue;
+class VueceAudioResampler;
+
+/*
+ * Open mode of a hub server stream which pre-transcodes a track into transcode
+ * cache in background, such a stream is not counted as an active streaming session
+ */
+#define VUECE_STREAM_MODE_PRETRANSCODE "pretranscode"
+
+//a read returns once less than this number of bytes are left in reader's buffer
+#define VUECE_STREAM_READ_THRESHOLD 1024
 
 namespace talk_base {
 
@@ -48,17 +62,21 @@ typedef struct _VueceStreamData {
 	AVCodec *pAudioTranscodeDec;
 	int16_t *pAudioDecOutBuf;
 	uint8_t *pAudioOutBufTranscoded;
-	uint8_t *pTmpBuf;
 
 	AVFifoBuffer *pAudioEncodeFifo;
 
 	size_t iFileSize;
 	size_t iAudioBytesRead;
 
-	//current length of the buffer
-	int iBufferLen;
-
-	int iFrameHeaderStartPos;
+	/*
+	 * State of the incremental frame parser of client stream, see VueceMediaStream::Write().
+	 * Header bytes are collected in iFrameHeader until iFrameHeaderPos reaches iFrameHeaderLen,
+	 * then iFramePayloadLen bytes of payload follow, iFramePayloadPos of them are written so far.
+	 */
+	uint8_t iFrameHeader[VUECE_STREAM_FRAME_HEADER_LENGTH];
+	int iFrameHeaderPos;
+	int iFramePayloadLen;
+	int iFramePayloadPos;
 
 	/*
 	 * a counter used to count the number of received frames, if it
@@ -83,10 +101,17 @@ typedef struct _VueceStreamData {
 	int iReceivedVideoFrameCounter;
 	int iCurrentVideoChunkFileIdx;
 
-	uint8_t* iBuffer;
-	uint8_t* iBigFrameBuf;
+	/*
+	 * Frames produced by hub server stream and not sent yet, see VueceStreamFrameQueue.
+	 * A frame which doesn't fit into the reader's buffer stays queued for next read.
+	 */
+	VueceStreamFrameQueue* pFrameQueue;
 
-	FILE* fActiveAudioChunkFile;
+	/*
+	 * True if audio chunk iLastAvailableAudioChunkFileIdx is being written
+	 * into segment store, see VueceSegmentStore
+	 */
+	bool bAudioChunkActive;
 	FILE* fActiveVideoChunkFile;
 
 	/*
@@ -111,12 +136,6 @@ typedef struct _VueceStreamData {
 	bool bIsDownloadCompleted;
 	bool bIsReceivingAudioPacket;
 
-	bool bIsReadingBigAudioFrame;
-	bool bIsReadingBigVideoFrame;
-
-	long lCurrentBigFrameReadPos;
-	long lBigFrameLen;
-
 	bool bReceivingFirstFrame;
 
 	/*
@@ -129,6 +148,39 @@ typedef struct _VueceStreamData {
 	 */
 	int iFirstFramePosSec;
 
+	/*
+	 * Transcode cache entry of current track, hub server mode only, see VueceTranscodeCache.
+	 * If bTranscodeCacheWriter is true, frames encoded by this stream are appended to
+	 * the entry, otherwise frames are read from fTranscodeCacheFile until this stream
+	 * catches up with the writer, then it continues with live transcoding.
+	 */
+	VueceTranscodeCacheEntry* pTranscodeCacheEntry;
+	bool bTranscodeCacheWriter;
+	FILE* fTranscodeCacheFile;
+	int iTranscodeCacheFrameNo;
+
+	/*
+	 * Packet index of current source file, hub server mode only, see VueceSeekIndex.
+	 * pSeekIndex is a loaded index used for seeking, pSeekIndexBuilder collects packets
+	 * while this stream reads the file from the beginning without any seek.
+	 */
+	VueceSeekIndex* pSeekIndex;
+	VueceSeekIndex* pSeekIndexBuilder;
+
+	/*
+	 * True if source is AAC-LC which can be decoded by the client as it is, demuxed
+	 * packets are sent in stream frames without transcoding, ADTS headers are removed
+	 * so the client receives raw AAC frames, same as transcoded ones
+	 */
+	bool bAudioPassthrough;
+
+	/*
+	 * Converts decoded PCM into sample rate and channel number negotiated for the session
+	 * before it's fed to the AAC encoder, NULL if the source already has that format.
+	 * Converted PCM is written into pResampleOutBuf.
+	 */
+	VueceAudioResampler* pResampler;
+	int16_t* pResampleOutBuf;
 
 } VueceStreamData;
 
@@ -148,6 +200,9 @@ public:
 
 	virtual StreamState GetState() const;
 	virtual StreamResult Read(void* buffer, size_t buffer_len, size_t* read, int* error);
+	virtual bool SupportsReadV() const;
+	virtual StreamResult ReadV(StreamIoVec* iov, size_t iov_max, size_t max_len, size_t* iov_count, int* error);
+	virtual void ConsumeReadData(size_t used);
 	virtual StreamResult Write(const void* data, size_t data_len, size_t* written, int* error);
 	virtual void Close();
 	virtual bool SetPosition(size_t position);
@@ -170,6 +225,11 @@ public:
 
 	bool GetTimePositionInSecond(size_t* position) const;
 
+	bool IsWritingTranscodeCache() const;
+
+	static int GetActiveServerStreamCount();
+	static long GetPassthroughSessionCount();
+
 
 protected:
 	virtual void DoClose();
@@ -177,18 +237,41 @@ protected:
 private:
 	bool InternalInit(bool isServer);
 	void InternalRelease();
-	void WriteAudioFrameToChunkFile(uint8_t* frame, size_t len, VueceStreamData* d);
+	StreamResult OnFrameHeader(const uint8_t* header);
+	StreamResult OnFrameData(const uint8_t* data, size_t pos, size_t len);
+	StreamResult OnFrameCompleted();
+	bool WriteAudioFrameDataToChunkFile(const uint8_t* data, size_t pos, size_t len, VueceStreamData* d);
+	void CommitAudioFrameToChunkFile(const uint8_t* header, size_t len, VueceStreamData* d);
+	bool SeekAudio(int ts_ms, int* actual_ts_ms);
+	void OpenSeekIndex(const std::string& filename, long mtime, size_t file_size);
+	bool BuildSeekIndex(VueceSeekIndex* index);
+	bool IndexAudioPacket(AVPacket* packet, VueceSeekIndex* index);
+	int  GetPacketTimeStamp(AVPacket* packet);
+	bool CheckAACPassthrough();
+	bool AllocTranscodeBuffers();
+	void ReleaseSeekIndex();
+	void OpenTranscodeCache(const std::string& filename, long mtime);
+	bool ReadFromTranscodeCache(size_t max_len);
+	void ReleaseTranscodeCache();
+	bool FillFrameQueue(size_t target_len);
+	bool TranscodeAudioPacket(AVPacket* packet);
+	bool QueueAudioPacket(AVPacket* packet);
+	void OnSourceEnded();
+	void QueueEOFPacket();
 
 private:
 	StreamState iStreamState;
 	bool bIsServer;
 	bool bIsAllDataConsumed;
+	bool bIsSourceEnded;
 	int iStartPosSec;
 	int sample_rate;
 	int bit_rate;
 	int nchannels;
 	int duration;
 	bool bAllowWrite;
+	bool bIsBackground;
+	bool bCountedAsActive;
 	std::string session_id;
 	VueceStreamData* iStreamData;
 
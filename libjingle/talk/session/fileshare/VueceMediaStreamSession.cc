@@ -7,6 +7,8 @@
 
 #include "talk/session/fileshare/VueceMediaStreamSession.h"
 
+#include <algorithm>
+
 #include "talk/base/httpcommon-inl.h"
 #include "talk/base/base64.h"
 #include "talk/base/fileutils.h"
@@ -23,6 +25,7 @@
 #include "talk/base/stringutils.h"
 #include "talk/base/tarstream.h"
 #include "talk/base/thread.h"
+#include "talk/base/timeutils.h"
 #include "talk/session/tunnel/pseudotcpchannel.h"
 #include "talk/session/tunnel/tunnelsessionclient.h"
 #include "talk/base/scoped_ptr.h"
@@ -31,6 +34,7 @@
 
 #include "talk/session/fileshare/VueceFileShareSessionClient.h"
 #include "talk/session/fileshare/VueceMediaStream.h"
+#include "talk/session/fileshare/VueceMappedFileStream.h"
 
 #include "VueceGlobalSetting.h"
 #include "VueceConstants.h"
@@ -148,6 +152,9 @@ VueceMediaStreamSession::VueceMediaStreamSession(cricket::Session* session, cons
 	bit_rate = 128;
 	nchannels = 2;
 
+	rendition_bit_rate = 0;
+	transfer_start_time = 0;
+
 	bPreviewNeeded = bPreviewNeeded_;
 
 	preview_path_ = "";
@@ -428,8 +435,16 @@ SessionDescription* VueceMediaStreamSession::CreateOffer( FileShareManifest* man
 			}
 			else if (item.type == FileShareManifest::T_MUSIC)
 			{
+				std::vector<int> renditions;
+
 				fd->manifest.AddMusic(name, item.size, item.width, item.height,
 						item.bit_rate, item.sample_rate, item.nchannels, item.duration);
+
+				//offer lower bit rates as well, client picks one based on its measured throughput
+				FileShareManifest::MakeRenditions(item.bit_rate, &renditions);
+				fd->manifest.SetRenditions(fd->manifest.size() - 1, renditions);
+
+				LOG(INFO) << "VueceMediaStreamSession::CreateOffer:Number of renditions offered: " << renditions.size();
 			}
 			else
 			{
@@ -478,6 +493,8 @@ void VueceMediaStreamSession::Accept(const std::string & target_download_folder_
 	bit_rate = 0;
 	nchannels = 0;
 
+	rendition_bit_rate = SelectRendition(manifest_->item(item_transferring_));
+
 	receiver_target_download_folder = target_download_folder_;
 	receiver_target_download_file_name = target_file_name_;
 
@@ -1317,6 +1334,9 @@ void VueceMediaStreamSession::OnHttpClientComplete(talk_base::HttpClient* http,
 
 //	LOG(INFO) << " VueceMediaStreamSession::OnHttpClientComplete - D 3";
 
+	//a stream ends when the buffer window is full as well, so measure it regardless of the result
+	UpdateStreamThroughput();
+
 	counter_ = NULL; // counter_ is deleted by HttpClient
 
 	//NOTE!!! - This reset() call will destroy stream instance
@@ -1715,6 +1735,9 @@ void VueceMediaStreamSession::OnHttpRequest(talk_base::HttpServer* server, talk_
 		}
 	}
 
+	//set if a non-music item is served partially because of a Range header
+	std::string content_range;
+
 	if ( (item->type == FileShareManifest::T_MUSIC))
 	{
 		talk_base::Pathname local_path;
@@ -1733,10 +1756,33 @@ void VueceMediaStreamSession::OnHttpRequest(talk_base::HttpServer* server, talk_
 		/**
 		 * Notes
 		 * 1. if app role is wrong, stream will be NULL, a 404 response will be sent back
-		 * 2. For hub node, sample_rate, bit_rate, nchannels and duration are not used here, they will be updated
+		 * 2. For hub node, sample rate and channel number of the item in manifest are the format client decoder
+		 *    is configured with, transcoded audio is converted into that format, other attributes are updated
 		 *    when the stream is opened, see VueceMediaStream::Open(const std::string& filename, const char* mode)
 		 */
-		talk_base::VueceMediaStream* file = new talk_base::VueceMediaStream(GetSessionId(), sample_rate, bit_rate, nchannels, duration);
+		int rendition = item->bit_rate;
+		int requested_rendition = 0;
+
+		//client may ask for one of the renditions offered in CreateOffer(), see SelectRendition()
+		if(!query.empty() && sscanf(query.c_str(), "bitrate=%d", &requested_rendition) == 1)
+		{
+			std::vector<int> renditions;
+
+			FileShareManifest::MakeRenditions(item->bit_rate, &renditions);
+
+			if(std::find(renditions.begin(), renditions.end(), requested_rendition) != renditions.end())
+			{
+				rendition = requested_rendition;
+			}
+			else
+			{
+				LOG(LS_WARNING) << "VueceMediaStreamSession:OnHttpRequest - Rendition not offered: " << requested_rendition << ", use " << rendition;
+			}
+		}
+
+		LOG(LS_INFO) << "VueceMediaStreamSession:OnHttpRequest - Rendition bit rate: " << rendition;
+
+		talk_base::VueceMediaStream* file = new talk_base::VueceMediaStream(GetSessionId(), item->sample_rate, rendition, item->nchannels, duration);
 
 		LOG(LS_INFO) << "VueceMediaStreamSession:OnHttpRequest - create vuece media stream as hub server with start position: " << start_pos;
 
@@ -1784,13 +1830,41 @@ void VueceMediaStreamSession::OnHttpRequest(talk_base::HttpServer* server, talk_
 
 		LOG(LS_INFO) << "VueceMediaStreamSession:OnHttpRequest:actual file path is: " << local_path.pathname();
 
-		talk_base::FileStream* file = new talk_base::FileStream;
+		//file pages are mapped and written to the http stream directly, see VueceMappedFileStream
+		talk_base::VueceMappedFileStream* file = new talk_base::VueceMappedFileStream;
 
 		LOG(LS_INFO) << "VueceMediaStreamSession:OnHttpRequest:In non-streaming mode - opening file " << local_path.pathname();
 
-		if (file->Open(local_path.pathname().c_str(), "rb", NULL))
+		if (file->Open(local_path.pathname(), NULL))
 		{
+			std::string range;
+			size_t file_size = 0;
+			size_t range_start = 0;
+			size_t range_len = 0;
+
 			LOG(LS_INFO) << "VueceMediaStreamSession:OnHttpRequest:File opened";
+
+			file->GetSize(&file_size);
+
+			if (transaction->request()->hasHeader(talk_base::HH_RANGE, &range))
+			{
+				if (talk_base::VueceMappedFileStream::ParseRange(range, file_size, &range_start, &range_len)
+						&& file->SetRange(range_start, range_len))
+				{
+					char buf[64];
+					talk_base::sprintfn(buf, ARRAY_SIZE(buf), "bytes %lu-%lu/%lu",
+							(unsigned long)range_start, (unsigned long)(range_start + range_len - 1), (unsigned long)file_size);
+					content_range = buf;
+
+					LOG(LS_INFO) << "VueceMediaStreamSession:OnHttpRequest:Serving range: " << content_range;
+				}
+				else
+				{
+					//a server may ignore a range it cannot satisfy, the whole file is sent
+					LOG(LS_WARNING) << "VueceMediaStreamSession:OnHttpRequest:Range ignored: " << range;
+				}
+			}
+
 			stream = file;
 		}
 		else
@@ -1812,7 +1886,15 @@ void VueceMediaStreamSession::OnHttpRequest(talk_base::HttpServer* server, talk_
 		counter->SignalUpdateByteCount.connect(this, &VueceMediaStreamSession::OnUpdateBytes);
 
 		//JJ - Note this is the place where filestream is injected into the response
-		transaction->response()->set_success(mime_type.c_str(), counter);
+		if (content_range.empty())
+		{
+			transaction->response()->set_success(mime_type.c_str(), counter);
+		}
+		else
+		{
+			transaction->response()->set_success(mime_type.c_str(), counter, talk_base::HC_PARTIAL_CONTENT);
+			transaction->response()->setHeader(talk_base::HH_CONTENT_RANGE, content_range);
+		}
 
 		transfer_connection_id_ = transaction->connection_id();
 		item_transferring_ = item_index;
@@ -2584,7 +2666,7 @@ void VueceMediaStreamSession::NextDownload() {
 				 * This is where music attributes get populated by remote share request message
 				 */
 				sample_rate = item.sample_rate;
-				bit_rate = item.bit_rate;
+				bit_rate = (rendition_bit_rate > 0) ? rendition_bit_rate : item.bit_rate;
 				nchannels = item.nchannels;
 				duration = item.duration;
 
@@ -2636,8 +2718,19 @@ void VueceMediaStreamSession::NextDownload() {
 	std::string remote_path;
 	GetItemNetworkPath(item_transferring_, false, &remote_path);
 
+	if(item.type == FileShareManifest::T_MUSIC && rendition_bit_rate > 0)
+	{
+		char query[32];
+
+		sprintf(query, "?bitrate=%d", rendition_bit_rate);
+
+		remote_path = remote_path.append(query);
+	}
+
 	LOG(INFO) << "VueceMediaStreamSession:NextDownload:remote_path: " << remote_path;
 
+	transfer_start_time = talk_base::Time();
+
 	StreamCounter* counter = new StreamCounter(stream);
 	counter->SignalUpdateByteCount.connect(this, &VueceMediaStreamSession::OnUpdateBytes);
 	counter_ = counter;
@@ -2682,6 +2775,90 @@ void VueceMediaStreamSession::NextDownload() {
 				nchannels = item.nchannels;
  */
 
+/*
+ * Picks the rendition of a music item for this session (client), the highest one whose bit rate
+ * leaves VUECE_STREAM_RENDITION_HEADROOM_PERCENT in the measured throughput, or the lowest one.
+ * The item's own bit rate is used until throughput is measured. Each buffer window is a new
+ * session, so the choice is revisited whenever a window is requested.
+ *
+ * Returns 0 if hub doesn't offer renditions.
+ */
+int VueceMediaStreamSession::SelectRendition(const FileShareManifest::Item& item)
+{
+	int throughput = VueceGlobalContext::GetStreamThroughput();
+	int selected = 0;
+
+	if(item.type != FileShareManifest::T_MUSIC || item.renditions.empty())
+	{
+		return 0;
+	}
+
+	if(throughput <= 0)
+	{
+		selected = item.renditions.back();
+	}
+	else
+	{
+		selected = item.renditions.front();
+
+		for(size_t i = 0; i < item.renditions.size(); i++)
+		{
+			if((int64)item.renditions[i] * VUECE_STREAM_RENDITION_HEADROOM_PERCENT / 100 <= throughput)
+			{
+				selected = item.renditions[i];
+			}
+		}
+	}
+
+	LOG(INFO) << "VueceMediaStreamSession::SelectRendition - measured throughput: " << throughput
+			<< " bps, renditions offered: " << item.renditions.size() << ", selected: " << selected;
+
+	return selected;
+}
+
+/*
+ * Takes the average download rate of current music item as a throughput sample (client),
+ * it's smoothed with previous samples, see VUECE_STREAM_THROUGHPUT_SAMPLE_WEIGHT
+ */
+void VueceMediaStreamSession::UpdateStreamThroughput()
+{
+	int32 elapsed = 0;
+	int sample = 0;
+	int smoothed = 0;
+
+	if(counter_ == NULL || transfer_start_time == 0 || bInPreviewMode || current_file_type != FileShareManifest::T_MUSIC)
+	{
+		return;
+	}
+
+	elapsed = talk_base::TimeSince(transfer_start_time);
+	transfer_start_time = 0;
+
+	if(elapsed < VUECE_STREAM_THROUGHPUT_MIN_SAMPLE_MS)
+	{
+		LOG(LS_VERBOSE) << "VueceMediaStreamSession::UpdateStreamThroughput - Download is too short to measure: " << elapsed << " ms";
+		return;
+	}
+
+	sample = (int)((int64)counter_->GetByteCount() * 8 * 1000 / elapsed);
+	smoothed = VueceGlobalContext::GetStreamThroughput();
+
+	if(smoothed <= 0)
+	{
+		smoothed = sample;
+	}
+	else
+	{
+		smoothed = (int)(((int64)sample * VUECE_STREAM_THROUGHPUT_SAMPLE_WEIGHT
+				+ (int64)smoothed * (100 - VUECE_STREAM_THROUGHPUT_SAMPLE_WEIGHT)) / 100);
+	}
+
+	LOG(INFO) << "VueceMediaStreamSession::UpdateStreamThroughput - " << counter_->GetByteCount() << " bytes in "
+			<< elapsed << " ms, sample: " << sample << " bps, smoothed: " << smoothed << " bps";
+
+	VueceGlobalContext::SetStreamThroughput(smoothed);
+}
+
 void VueceMediaStreamSession::RetrieveUsedMusicAttributes(int* bitrate, int* samplerate, int* nchannels, int* duration)
 {
 	LOG(LS_VERBOSE) << "VueceMediaStreamSession:RetrieveUsedMusicAttributes";
@@ -168,6 +168,8 @@ private:
   void SetState(FileShareState state, bool prevent_close);
   void OnInitiate();
   void NextDownload();
+  int  SelectRendition(const FileShareManifest::Item& item);
+  void UpdateStreamThroughput();
 //  const FileShareDescription* description() const;
   const FileContentDescription* GetFileContentDescription() const;
   void DoClose(bool terminate);
@@ -254,6 +256,12 @@ private:
   int nchannels;
   int duration;
 
+  //AAC bit rate picked from the renditions offered by hub, 0 if hub doesn't offer any (client)
+  int rendition_bit_rate;
+
+  //when the download of current music item started, used to measure throughput (client)
+  uint32 transfer_start_time;
+
   bool bPreviewNeeded;
 
   bool bCancelled;
@@ -1222,6 +1222,7 @@ bool VueceMediaStreamSessionClient::CreatesFileContentDescription(const buzz::Xm
 		{
 
 		    int bit_rate=0, sample_rate=0, nchannels=0, duration=0;
+		    std::vector<int> renditions;
 
 			 if( item->Name() == QN_SHARE_MUSIC )
 			 {
@@ -1233,6 +1234,19 @@ bool VueceMediaStreamSessionClient::CreatesFileContentDescription(const buzz::Xm
 				 LOG(LS_VERBOSE) << "VueceMediaStreamSessionClient::CreatesFileContentDescription - Found music attributes:";
 				 LOG(LS_VERBOSE) << "bit_rate = " << bit_rate << ", sample_rate = " << sample_rate
 						 << ", nchannels = " << nchannels<< ", duration = " << duration;
+
+				 //a hub without renditions support doesn't send any
+				 for (const buzz::XmlElement* r = item->FirstNamed(QN_SHARE_RENDITION); r != NULL; r = r->NextNamed(QN_SHARE_RENDITION))
+				 {
+					 int rendition = atoi( r->Attr(QN_BITRATE).c_str());
+
+					 if (rendition > 0)
+					 {
+						 renditions.push_back(rendition);
+					 }
+				 }
+
+				 LOG(LS_VERBOSE) << "VueceMediaStreamSessionClient::CreatesFileContentDescription - Number of renditions: " << renditions.size();
 			 }
 
 			// Check if there is a valid image description for this file.
@@ -1259,6 +1273,7 @@ bool VueceMediaStreamSessionClient::CreatesFileContentDescription(const buzz::Xm
 									;
 							share_desc->manifest.AddMusic(name, size, width, height,
 									bit_rate, sample_rate, nchannels, duration);
+							share_desc->manifest.SetRenditions(share_desc->manifest.size() - 1, renditions);
 						}
 
 						continue;
@@ -1276,6 +1291,7 @@ bool VueceMediaStreamSessionClient::CreatesFileContentDescription(const buzz::Xm
 				LOG(LS_VERBOSE) << "VueceMediaStreamSessionClient::CreatesFileContentDescription - This is a music file without image preview";
 				share_desc->manifest.AddMusic(name, size, 0, 0,
 						bit_rate, sample_rate, nchannels, duration);
+				share_desc->manifest.SetRenditions(share_desc->manifest.size() - 1, renditions);
 			}
 
 		}
@@ -1490,6 +1506,17 @@ buzz::XmlElement* VueceMediaStreamSessionClient::TranslateSessionDescription(con
 			talk_base::sprintfn(buffer, sizeof(buffer), "%d", item.duration);
 
 			el->AddAttr(QN_DURATION, buffer, 2);
+
+			//renditions the item can be streamed at, see FileShareManifest::MakeRenditions()
+			for (size_t r = 0; r < item.renditions.size(); ++r)
+			{
+				buzz::XmlElement* el_rendition = new buzz::XmlElement(QN_SHARE_RENDITION);
+
+				talk_base::sprintfn(buffer, sizeof(buffer), "%d", item.renditions[r]);
+
+				el_rendition->SetAttr(QN_BITRATE, buffer);
+				el->AddElement(el_rendition, 2);
+			}
 		}
 
 
@@ -0,0 +1,233 @@
+/*
+ * VueceMmapChunkReader.cc
+ *
+ *  Created on: Mar 16, 2015
+ *      Author: jingjing
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "VueceLogger.h"
+#include "VueceConstants.h"
+#include "VueceMmapChunkReader.h"
+#include "VueceSegmentStore.h"
+
+VueceMmapChunkReader::VueceMmapChunkReader()
+{
+	store = NULL;
+	chunk_idx = -1;
+	opened = false;
+	base = NULL;
+	mapped_len = 0;
+	pos = 0;
+	remap_count = 0;
+}
+
+VueceMmapChunkReader::~VueceMmapChunkReader()
+{
+	Close();
+	Unmap();
+}
+
+int VueceMmapChunkReader::ParseInt(const uint8_t* b)
+{
+	return (b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+}
+
+bool VueceMmapChunkReader::Open(VueceSegmentStore* st, int idx)
+{
+	if(opened)
+	{
+		VueceLogger::Fatal("VueceMmapChunkReader::Open - A chunk is already open, close it at first");
+		return false;
+	}
+
+	Unmap();
+
+	if(!st->HasChunk(idx))
+	{
+		VueceLogger::Error("VueceMmapChunkReader::Open - Chunk %d is not in segment store", idx);
+		return false;
+	}
+
+	store = st;
+	chunk_idx = idx;
+	opened = true;
+	pos = 0;
+
+	//previous chunk is unmapped, store may recycle it
+	store->SetReadChunk(idx);
+
+	//an empty chunk is fine, it will be mapped when data arrives
+	Remap();
+
+	return true;
+}
+
+void VueceMmapChunkReader::Close()
+{
+	opened = false;
+}
+
+void VueceMmapChunkReader::Unmap()
+{
+	if(base != NULL)
+	{
+		munmap(base, mapped_len);
+		base = NULL;
+	}
+
+	mapped_len = 0;
+	pos = 0;
+}
+
+bool VueceMmapChunkReader::IsOpen()
+{
+	return opened;
+}
+
+/*
+ * Map the chunk again if more frames have been stored since last mapping,
+ * returns true if more data is mapped
+ */
+bool VueceMmapChunkReader::Remap()
+{
+	int len = 0;
+	off_t offset = 0;
+	void* p = NULL;
+
+	if(!opened)
+	{
+		return false;
+	}
+
+	len = store->GetChunkDataLength(chunk_idx);
+
+	if(len <= 0 || (size_t)len <= mapped_len)
+	{
+		return false;
+	}
+
+	offset = store->GetChunkDataOffset(chunk_idx);
+
+	p = mmap(NULL, len, PROT_READ, MAP_SHARED, store->GetFd(), offset);
+
+	if(p == MAP_FAILED)
+	{
+		VueceLogger::Error("VueceMmapChunkReader::Remap - mmap failed(%d bytes of chunk %d): %s", len, chunk_idx, strerror(errno));
+		return false;
+	}
+
+	madvise(p, len, MADV_SEQUENTIAL);
+
+	if(base != NULL)
+	{
+		munmap(base, mapped_len);
+		remap_count++;
+	}
+
+	base = (uint8_t*)p;
+	mapped_len = len;
+
+	return true;
+}
+
+/*
+ * Returns frame length and points data to frame payload, 0 if there is no complete frame
+ * available yet, -1 if frame header is corrupted
+ */
+int VueceMmapChunkReader::NextFrame(uint8_t** data, int* ts)
+{
+	const int header_len = VUECE_STREAM_FRAME_HEADER_LENGTH;
+	uint8_t* p = NULL;
+	int frame_len = 0;
+
+	if(pos + header_len > mapped_len)
+	{
+		Remap();
+
+		if(pos + header_len > mapped_len)
+		{
+			return 0;
+		}
+	}
+
+	p = base + pos;
+
+	frame_len = ParseInt(p + 1);
+
+	if(frame_len > VUECE_MAX_FRAME_SIZE || frame_len <= 0)
+	{
+		VueceLogger::Error("VueceMmapChunkReader::NextFrame - Invalid frame length: %d at position: %lu", frame_len, (unsigned long)pos);
+		return -1;
+	}
+
+	if(pos + header_len + frame_len > mapped_len)
+	{
+		Remap();
+
+		//frame is still being written
+		if(pos + header_len + frame_len > mapped_len)
+		{
+			return 0;
+		}
+
+		p = base + pos;
+	}
+
+	if(ts != NULL)
+	{
+		*ts = ParseInt(p + 5);
+	}
+
+	*data = p + header_len;
+
+	pos += header_len + frame_len;
+
+	return frame_len;
+}
+
+bool VueceMmapChunkReader::AtEnd()
+{
+	if(pos >= mapped_len)
+	{
+		Remap();
+	}
+
+	return pos >= mapped_len;
+}
+
+size_t VueceMmapChunkReader::GetPosition()
+{
+	return pos;
+}
+
+bool VueceMmapChunkReader::SetPosition(size_t p)
+{
+	if(p > mapped_len)
+	{
+		Remap();
+	}
+
+	if(p > mapped_len)
+	{
+		VueceLogger::Error("VueceMmapChunkReader::SetPosition - Position %lu is beyond file end %lu", (unsigned long)p, (unsigned long)mapped_len);
+		return false;
+	}
+
+	pos = p;
+
+	return true;
+}
+
+size_t VueceMmapChunkReader::GetMappedSize()
+{
+	return mapped_len;
+}
+
+long VueceMmapChunkReader::GetRemapCount()
+{
+	return remap_count;
+}
@@ -0,0 +1,66 @@
+/*
+ * VueceMmapChunkReader.h
+ *
+ *  Created on: Mar 16, 2015
+ *      Author: jingjing
+ */
+
+#ifndef VUECEMMAPCHUNKREADER_H_
+#define VUECEMMAPCHUNKREADER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+class VueceSegmentStore;
+
+/*
+ * Reads frames of an audio chunk from VueceSegmentStore through a memory mapping
+ * of the chunk's segment, frame layout is [SignalByte][FrameLen][FrameTS][DATA],
+ * see VUECE_STREAM_FRAME_HEADER_LENGTH.
+ *
+ * NextFrame() hands out a pointer into the mapping, no data is copied and
+ * no syscall is made per frame. If the chunk is still being appended
+ * by VueceMediaStream, the segment is re-mapped when the reader runs past the
+ * end of current mapping.
+ *
+ * The pointer returned by NextFrame() is only valid until next call of
+ * NextFrame(), SetPosition() or Open(), Close() keeps the last mapping so the
+ * last frame of a chunk can still be consumed after the chunk is closed.
+ */
+class VueceMmapChunkReader
+{
+public:
+	VueceMmapChunkReader();
+	virtual ~VueceMmapChunkReader();
+
+	bool Open(VueceSegmentStore* store, int chunk_idx);
+	void Close();
+	bool IsOpen();
+
+	int  NextFrame(uint8_t** data, int* ts);
+	bool AtEnd();
+
+	size_t GetPosition();
+	bool   SetPosition(size_t p);
+	size_t GetMappedSize();
+
+	long GetRemapCount();
+
+	static int ParseInt(const uint8_t* b);
+
+private:
+	bool Remap();
+	void Unmap();
+
+private:
+	VueceSegmentStore* store;
+	int chunk_idx;
+	bool opened;
+	uint8_t* base;
+	size_t mapped_len;
+	size_t pos;
+	long remap_count;
+};
+
+#endif /* VUECEMMAPCHUNKREADER_H_ */
@@ -0,0 +1,316 @@
+/*
+ * VueceSeekIndex.cc
+ *
+ *  Created on: Mar 30, 2015
+ *      Author: jingjing
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "talk/base/fileutils.h"
+#include "talk/base/pathutils.h"
+
+#include "VueceLogger.h"
+#include "VueceGlobalSetting.h"
+#include "VueceThreadUtil.h"
+#include "VueceSeekIndex.h"
+
+VueceSeekIndex::VueceSeekIndex(const std::string& file_path, long mtime_, size_t file_size_)
+{
+	talk_base::Pathname path;
+	const char* user_data_dir = VueceGlobalContext::GetAppUserDataDir();
+
+	if(user_data_dir != NULL && user_data_dir[0] != 0)
+	{
+		path.SetFolder(user_data_dir);
+	}
+	else
+	{
+		talk_base::Filesystem::GetTemporaryFolder(path, true, NULL);
+	}
+
+	path.AppendFolder(VUECE_SEEK_INDEX_FOLDER);
+
+	folder = path.pathname();
+	index_path = folder + MakeFileName(file_path);
+
+	mtime = mtime_;
+	file_size = file_size_;
+
+	bValid = true;
+}
+
+VueceSeekIndex::~VueceSeekIndex()
+{
+}
+
+void VueceSeekIndex::PutInt(uint8_t* b, uint32_t v)
+{
+	b[0] = (v >> 24) & 0xFF;
+	b[1] = (v >> 16) & 0xFF;
+	b[2] = (v >> 8) & 0xFF;
+	b[3] = v & 0xFF;
+}
+
+uint32_t VueceSeekIndex::GetInt(const uint8_t* b)
+{
+	return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | (uint32_t)b[3];
+}
+
+std::string VueceSeekIndex::MakeFileName(const std::string& file_path)
+{
+	char tmp[32];
+	uint64_t h = 14695981039346656037ULL;
+	size_t i = 0;
+
+	for(i = 0; i < file_path.length(); i++)
+	{
+		h ^= (uint8_t)file_path[i];
+		h *= 1099511628211ULL;
+	}
+
+	sprintf(tmp, "%08x%08x", (unsigned int)(h >> 32), (unsigned int)(h & 0xFFFFFFFF));
+
+	return std::string(tmp) + VUECE_SEEK_INDEX_EXT;
+}
+
+/*
+ * Index file is read with two reads, returns false if it doesn't exist, has
+ * a different version or belongs to an older revision of the source file
+ */
+bool VueceSeekIndex::Load()
+{
+	uint8_t header[VUECE_SEEK_INDEX_HEADER_LENGTH];
+	uint8_t* buf = NULL;
+	size_t index_len = 0;
+	size_t count = 0;
+	size_t i = 0;
+	FILE* f = NULL;
+	bool ret = true;
+
+	records.clear();
+
+	if(!talk_base::Filesystem::GetFileSize(talk_base::Pathname(index_path), &index_len)
+			|| index_len < VUECE_SEEK_INDEX_HEADER_LENGTH)
+	{
+		return false;
+	}
+
+	f = fopen(index_path.c_str(), "rb");
+
+	if(f == NULL)
+	{
+		return false;
+	}
+
+	if(fread(header, 1, VUECE_SEEK_INDEX_HEADER_LENGTH, f) != VUECE_SEEK_INDEX_HEADER_LENGTH
+			|| GetInt(header) != VUECE_SEEK_INDEX_MAGIC
+			|| GetInt(header + 4) != VUECE_SEEK_INDEX_VERSION
+			|| GetInt(header + 8) != (uint32_t)mtime
+			|| GetInt(header + 12) != (uint32_t)file_size)
+	{
+		VueceLogger::Debug("VueceSeekIndex::Load - Index is outdated: %s", index_path.c_str());
+		fclose(f);
+		return false;
+	}
+
+	count = GetInt(header + 16);
+
+	if(count == 0 || index_len != VUECE_SEEK_INDEX_HEADER_LENGTH + count * VUECE_SEEK_INDEX_RECORD_LENGTH)
+	{
+		VueceLogger::Warn("VueceSeekIndex::Load - Index file is corrupted: %s", index_path.c_str());
+		fclose(f);
+		return false;
+	}
+
+	buf = (uint8_t*)malloc(count * VUECE_SEEK_INDEX_RECORD_LENGTH);
+
+	if(fread(buf, VUECE_SEEK_INDEX_RECORD_LENGTH, count, f) != count)
+	{
+		ret = false;
+	}
+
+	fclose(f);
+
+	if(ret)
+	{
+		records.resize(count);
+
+		for(i = 0; i < count; i++)
+		{
+			records[i].offset = GetInt(buf + i * VUECE_SEEK_INDEX_RECORD_LENGTH);
+			records[i].ts = (int)GetInt(buf + i * VUECE_SEEK_INDEX_RECORD_LENGTH + 4);
+		}
+
+		bValid = true;
+	}
+
+	free(buf);
+
+	VueceLogger::Debug("VueceSeekIndex::Load - %lu packet(s) loaded from %s", (unsigned long)records.size(), index_path.c_str());
+
+	return ret;
+}
+
+bool VueceSeekIndex::Save()
+{
+	uint8_t header[VUECE_SEEK_INDEX_HEADER_LENGTH];
+	uint8_t* buf = NULL;
+	char tmp[32];
+	std::string tmp_path;
+	FILE* f = NULL;
+	size_t i = 0;
+	bool ret = true;
+
+	if(!bValid || records.empty())
+	{
+		VueceLogger::Debug("VueceSeekIndex::Save - Index is not usable, not saved.");
+		return false;
+	}
+
+	if(!talk_base::Filesystem::IsFolder(talk_base::Pathname(folder))
+			&& !talk_base::Filesystem::CreateFolder(talk_base::Pathname(folder)))
+	{
+		VueceLogger::Error("VueceSeekIndex::Save - Cannot create index folder: %s", folder.c_str());
+		return false;
+	}
+
+	//several streams may save index of the same file at the same time
+	sprintf(tmp, ".%u.tmp", (unsigned int)VueceThreadUtil::GetCurTimeMs());
+	tmp_path = index_path + tmp;
+
+	f = fopen(tmp_path.c_str(), "wb");
+
+	if(f == NULL)
+	{
+		VueceLogger::Error("VueceSeekIndex::Save - Cannot create index file: %s", tmp_path.c_str());
+		return false;
+	}
+
+	PutInt(header, VUECE_SEEK_INDEX_MAGIC);
+	PutInt(header + 4, VUECE_SEEK_INDEX_VERSION);
+	PutInt(header + 8, (uint32_t)mtime);
+	PutInt(header + 12, (uint32_t)file_size);
+	PutInt(header + 16, (uint32_t)records.size());
+
+	buf = (uint8_t*)malloc(records.size() * VUECE_SEEK_INDEX_RECORD_LENGTH);
+
+	for(i = 0; i < records.size(); i++)
+	{
+		PutInt(buf + i * VUECE_SEEK_INDEX_RECORD_LENGTH, records[i].offset);
+		PutInt(buf + i * VUECE_SEEK_INDEX_RECORD_LENGTH + 4, (uint32_t)records[i].ts);
+	}
+
+	if(fwrite(header, 1, VUECE_SEEK_INDEX_HEADER_LENGTH, f) != VUECE_SEEK_INDEX_HEADER_LENGTH
+			|| fwrite(buf, VUECE_SEEK_INDEX_RECORD_LENGTH, records.size(), f) != records.size())
+	{
+		ret = false;
+	}
+
+	free(buf);
+
+	if(fclose(f) != 0)
+	{
+		ret = false;
+	}
+
+	if(ret)
+	{
+		//an index saved by another stream is replaced
+		remove(index_path.c_str());
+	}
+
+	if(!ret || rename(tmp_path.c_str(), index_path.c_str()) != 0)
+	{
+		VueceLogger::Error("VueceSeekIndex::Save - Cannot save index file: %s", index_path.c_str());
+		remove(tmp_path.c_str());
+		return false;
+	}
+
+	VueceLogger::Debug("VueceSeekIndex::Save - %lu packet(s) saved into %s", (unsigned long)records.size(), index_path.c_str());
+
+	return true;
+}
+
+/*
+ * Packets must be added in file order, anything which cannot be indexed
+ * makes the whole index unusable, false is returned in that case
+ */
+bool VueceSeekIndex::AddPacket(int64_t pos, int ts)
+{
+	if(!bValid)
+	{
+		return false;
+	}
+
+	if(pos < 0 || pos > 0xFFFFFFFFLL || ts < 0
+			|| (!records.empty() && (pos <= (int64_t)records.back().offset || ts < records.back().ts)))
+	{
+		VueceLogger::Debug("VueceSeekIndex::AddPacket - Packet cannot be indexed, pos = %lld, ts = %d", (long long)pos, ts);
+		Invalidate();
+		return false;
+	}
+
+	VueceSeekIndexRecord rec;
+
+	rec.offset = (uint32_t)pos;
+	rec.ts = ts;
+
+	records.push_back(rec);
+
+	return true;
+}
+
+void VueceSeekIndex::Invalidate()
+{
+	bValid = false;
+	records.clear();
+}
+
+bool VueceSeekIndex::IsValid()
+{
+	return bValid && !records.empty();
+}
+
+int VueceSeekIndex::GetPacketCount()
+{
+	return (int)records.size();
+}
+
+/*
+ * Locates the last packet which starts at or before target_ts
+ */
+bool VueceSeekIndex::FindPacket(int target_ts, int64_t* pos, int* ts)
+{
+	int lo = 0;
+	int hi = (int)records.size() - 1;
+	int mid = 0;
+	int found = 0;
+
+	if(!IsValid())
+	{
+		return false;
+	}
+
+	while(lo <= hi)
+	{
+		mid = lo + (hi - lo) / 2;
+
+		if(records[mid].ts <= target_ts)
+		{
+			found = mid;
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid - 1;
+		}
+	}
+
+	*pos = records[found].offset;
+	*ts = records[found].ts;
+
+	return true;
+}
@@ -0,0 +1,86 @@
+/*
+ * VueceSeekIndex.h
+ *
+ *  Created on: Mar 30, 2015
+ *      Author: jingjing
+ */
+
+#ifndef VUECESEEKINDEX_H_
+#define VUECESEEKINDEX_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+//sub folder of user data folder, next to media DB
+#define VUECE_SEEK_INDEX_FOLDER "vuece_seek_index"
+
+#define VUECE_SEEK_INDEX_EXT ".vsi"
+
+#define VUECE_SEEK_INDEX_MAGIC 0x56534958 //"VSIX"
+
+/*
+ * Must be increased whenever index file layout changes, files with
+ * a different version are ignored and rebuilt
+ */
+#define VUECE_SEEK_INDEX_VERSION 1
+
+//[magic][version][file mtime][file size][record count]
+#define VUECE_SEEK_INDEX_HEADER_LENGTH 20
+
+//[byte offset][time stamp in ms]
+#define VUECE_SEEK_INDEX_RECORD_LENGTH 8
+
+typedef struct VueceSeekIndexRecord
+{
+	uint32_t offset;
+	int ts;
+} VueceSeekIndexRecord;
+
+/*
+ * Byte offset and time stamp of every audio packet of a source file on hub, so
+ * a stream can be started at the exact packet of a given position with a byte
+ * seek, instead of relying on avformat_seek_file() which is slow and imprecise
+ * for VBR MP3 files without TOC.
+ *
+ * An index is built while a stream reads a file from the beginning, or by
+ * scanning packets when a seek is needed and there is no index yet. It's saved
+ * into a small binary file keyed by file path, and is only valid as long as
+ * modification time and size of the source file are not changed.
+ */
+class VueceSeekIndex
+{
+public:
+	VueceSeekIndex(const std::string& file_path, long mtime, size_t file_size);
+	virtual ~VueceSeekIndex();
+
+	bool Load();
+	bool Save();
+
+	bool AddPacket(int64_t pos, int ts);
+	void Invalidate();
+	bool IsValid();
+
+	int  GetPacketCount();
+	bool FindPacket(int target_ts, int64_t* pos, int* ts);
+
+private:
+	static std::string MakeFileName(const std::string& file_path);
+
+	static void PutInt(uint8_t* b, uint32_t v);
+	static uint32_t GetInt(const uint8_t* b);
+
+private:
+	std::string folder;
+	std::string index_path;
+
+	long mtime;
+	size_t file_size;
+
+	std::vector<VueceSeekIndexRecord> records;
+
+	bool bValid;
+};
+
+#endif /* VUECESEEKINDEX_H_ */
@@ -0,0 +1,674 @@
+/*
+ * VueceSegmentStore.cc
+ *
+ *  Created on: Mar 20, 2015
+ *      Author: jingjing
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "VueceLogger.h"
+#include "VueceThreadUtil.h"
+#include "VueceSegmentStore.h"
+
+#define VUECE_SEGMENT_STORE_MAGIC 0x56534547 //"VSEG"
+#define VUECE_SEGMENT_STORE_VERSION 2
+
+VueceSegmentStore* VueceSegmentStore::instance = NULL;
+
+VueceSegmentStore* VueceSegmentStore::Instance()
+{
+	char cfilename[128];
+
+	if(instance == NULL)
+	{
+		memset(cfilename, 0, sizeof(cfilename));
+
+		strcpy(cfilename, VUECE_MEDIA_AUDIO_BUFFER_LOCATION);
+		strcat(cfilename, VUECE_SEGMENT_STORE_FILE_NAME);
+
+		instance = new VueceSegmentStore();
+
+		if(!instance->Open(cfilename))
+		{
+			VueceLogger::Fatal("VueceSegmentStore::Instance - Cannot open segment store: %s", cfilename);
+		}
+	}
+
+	return instance;
+}
+
+void VueceSegmentStore::Release()
+{
+	if(instance != NULL)
+	{
+		delete instance;
+		instance = NULL;
+	}
+}
+
+VueceSegmentStore::VueceSegmentStore()
+{
+	VueceLogger::Debug("VueceSegmentStore - Constructor called");
+
+	fd = -1;
+	recycle_count = 0;
+
+	VueceThreadUtil::InitMutex(&mutex_table);
+
+	Reset();
+}
+
+VueceSegmentStore::~VueceSegmentStore()
+{
+	VueceLogger::Debug("VueceSegmentStore - Destructor called, %ld segment(s) recycled", recycle_count);
+
+	Close();
+}
+
+void VueceSegmentStore::PutInt(uint8_t* b, int v)
+{
+	b[0] = (v >> 24) & 0xFF;
+	b[1] = (v >> 16) & 0xFF;
+	b[2] = (v >> 8) & 0xFF;
+	b[3] = v & 0xFF;
+}
+
+bool VueceSegmentStore::Open(const char* path)
+{
+	fd = open(path, O_RDWR | O_CREAT, 0644);
+
+	if(fd < 0)
+	{
+		VueceLogger::Error("VueceSegmentStore::Open - Cannot open %s: %s", path, strerror(errno));
+		return false;
+	}
+
+	VueceLogger::Debug("VueceSegmentStore::Open - %s opened, max segment size: %d bytes",
+			path, VUECE_SEGMENT_STORE_SEGMENT_LENGTH);
+
+	//nothing is kept from previous run
+	Reset();
+
+	return true;
+}
+
+void VueceSegmentStore::Close()
+{
+	if(fd >= 0)
+	{
+		//don't leave buffered chunks on sdcard once player is gone
+		Truncate(0);
+
+		close(fd);
+		fd = -1;
+	}
+}
+
+/*
+ * Forget all chunks of previous song, the file is truncated to the table
+ */
+void VueceSegmentStore::Reset()
+{
+	int i = 0;
+
+	VueceThreadUtil::MutexLock(&mutex_table);
+
+	for(i = 0; i < VUECE_SEGMENT_STORE_MAX_SEGMENTS; i++)
+	{
+		entries[i].chunk_idx = -1;
+		entries[i].data_len = 0;
+		entries[i].frame_count = 0;
+		entries[i].offset = 0;
+		entries[i].length = 0;
+	}
+
+	window_first = 0;
+	window_last = -1;
+	read_chunk = 0;
+
+	VueceThreadUtil::MutexUnlock(&mutex_table);
+
+	if(fd >= 0)
+	{
+		Truncate(VUECE_SEGMENT_STORE_TABLE_LENGTH);
+
+		WriteTableHeader();
+
+		for(i = 0; i < VUECE_SEGMENT_STORE_MAX_SEGMENTS; i++)
+		{
+			WriteTableEntry(i);
+		}
+	}
+
+	VueceLogger::Debug("VueceSegmentStore::Reset - Done");
+}
+
+void VueceSegmentStore::Truncate(off_t len)
+{
+	if(ftruncate(fd, len) != 0)
+	{
+		VueceLogger::Error("VueceSegmentStore::Truncate - Cannot truncate store to %ld bytes: %s", (long)len, strerror(errno));
+	}
+}
+
+void VueceSegmentStore::WriteTableHeader()
+{
+	uint8_t b[VUECE_SEGMENT_STORE_TABLE_HEADER_LENGTH];
+
+	PutInt(b, VUECE_SEGMENT_STORE_MAGIC);
+	PutInt(b + 4, VUECE_SEGMENT_STORE_VERSION);
+	PutInt(b + 8, VUECE_SEGMENT_STORE_SEGMENT_LENGTH);
+	PutInt(b + 12, VUECE_SEGMENT_STORE_MAX_SEGMENTS);
+	PutInt(b + 16, window_first);
+	PutInt(b + 20, window_last);
+
+	if(pwrite(fd, b, sizeof(b), 0) != sizeof(b))
+	{
+		VueceLogger::Error("VueceSegmentStore::WriteTableHeader - Write failed: %s", strerror(errno));
+	}
+}
+
+void VueceSegmentStore::WriteTableEntry(int seg)
+{
+	uint8_t b[VUECE_SEGMENT_STORE_ENTRY_LENGTH];
+
+	PutInt(b, entries[seg].chunk_idx);
+	PutInt(b + 4, (int)entries[seg].offset);
+	PutInt(b + 8, entries[seg].data_len);
+	PutInt(b + 12, entries[seg].frame_count);
+
+	if(pwrite(fd, b, sizeof(b), VUECE_SEGMENT_STORE_TABLE_HEADER_LENGTH + seg * VUECE_SEGMENT_STORE_ENTRY_LENGTH) != sizeof(b))
+	{
+		VueceLogger::Error("VueceSegmentStore::WriteTableEntry - Write failed: %s", strerror(errno));
+	}
+}
+
+/*
+ * Must be called with table mutex held
+ */
+int VueceSegmentStore::FindSegment(int chunk_idx)
+{
+	int i = 0;
+
+	for(i = 0; i < VUECE_SEGMENT_STORE_MAX_SEGMENTS; i++)
+	{
+		if(entries[i].chunk_idx == chunk_idx)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * End of the last segment in use, end of the table if there is none
+ *
+ * Must be called with table mutex held
+ */
+off_t VueceSegmentStore::GetStoreEnd()
+{
+	off_t end = VUECE_SEGMENT_STORE_TABLE_LENGTH;
+	int i = 0;
+
+	for(i = 0; i < VUECE_SEGMENT_STORE_MAX_SEGMENTS; i++)
+	{
+		if(entries[i].chunk_idx != -1 && entries[i].offset + entries[i].length > end)
+		{
+			end = entries[i].offset + entries[i].length;
+		}
+	}
+
+	return end;
+}
+
+/*
+ * Lowest position where a segment of max size doesn't overlap any segment in use,
+ * candidates are the beginning of data area and the end of each segment in use
+ *
+ * Must be called with table mutex held
+ */
+off_t VueceSegmentStore::FindSpace()
+{
+	off_t best = -1;
+	off_t pos = 0;
+	int i = 0;
+	int j = 0;
+
+	for(i = -1; i < VUECE_SEGMENT_STORE_MAX_SEGMENTS; i++)
+	{
+		if(i == -1)
+		{
+			pos = VUECE_SEGMENT_STORE_TABLE_LENGTH;
+		}
+		else if(entries[i].chunk_idx != -1)
+		{
+			pos = entries[i].offset + entries[i].length;
+		}
+		else
+		{
+			continue;
+		}
+
+		if(best != -1 && pos >= best)
+		{
+			continue;
+		}
+
+		for(j = 0; j < VUECE_SEGMENT_STORE_MAX_SEGMENTS; j++)
+		{
+			if(entries[j].chunk_idx != -1 && entries[j].offset < pos + VUECE_SEGMENT_STORE_SEGMENT_LENGTH &&
+					pos < entries[j].offset + entries[j].length)
+			{
+				break;
+			}
+		}
+
+		if(j == VUECE_SEGMENT_STORE_MAX_SEGMENTS)
+		{
+			best = pos;
+		}
+	}
+
+	return best;
+}
+
+/*
+ * Recycle segments of chunks which are behind both the buffer window and the reader,
+ * then pick a free table entry and place its segment in the first gap which can
+ * take a full chunk, the file only grows if there is no such gap.
+ *
+ * Must be called with table mutex held
+ */
+int VueceSegmentStore::AllocSegment(int chunk_idx)
+{
+	int i = 0;
+	int seg = -1;
+
+	for(i = 0; i < VUECE_SEGMENT_STORE_MAX_SEGMENTS; i++)
+	{
+		if(entries[i].chunk_idx != -1 && entries[i].chunk_idx < window_first && entries[i].chunk_idx < read_chunk)
+		{
+			VueceLogger::Debug("VueceSegmentStore::AllocSegment - Segment %d of chunk %d is recycled", i, entries[i].chunk_idx);
+
+			entries[i].chunk_idx = -1;
+			WriteTableEntry(i);
+
+			recycle_count++;
+		}
+
+		if(entries[i].chunk_idx == -1 && seg == -1)
+		{
+			seg = i;
+		}
+	}
+
+	if(seg == -1)
+	{
+		VueceLogger::Warn("VueceSegmentStore::AllocSegment - Store is full, no segment for chunk %d", chunk_idx);
+		return -1;
+	}
+
+	entries[seg].offset = FindSpace();
+	entries[seg].length = VUECE_SEGMENT_STORE_SEGMENT_LENGTH;
+
+	return seg;
+}
+
+bool VueceSegmentStore::BeginChunk(int chunk_idx)
+{
+	struct stat st;
+	int seg = -1;
+	off_t end = 0;
+
+	VueceThreadUtil::MutexLock(&mutex_table);
+
+	//a chunk which is downloaded again (e.g. resumed download) is rewritten from its start
+	//in a new segment, its old one may have been shrunk already
+	seg = FindSegment(chunk_idx);
+
+	if(seg != -1)
+	{
+		entries[seg].chunk_idx = -1;
+	}
+
+	seg = AllocSegment(chunk_idx);
+
+	if(seg == -1)
+	{
+		VueceThreadUtil::MutexUnlock(&mutex_table);
+		VueceLogger::Fatal("VueceSegmentStore::BeginChunk - No segment available for chunk %d", chunk_idx);
+		return false;
+	}
+
+	entries[seg].chunk_idx = chunk_idx;
+	entries[seg].data_len = 0;
+	entries[seg].frame_count = 0;
+
+	if(chunk_idx > window_last)
+	{
+		window_last = chunk_idx;
+	}
+
+	end = GetStoreEnd();
+
+	VueceThreadUtil::MutexUnlock(&mutex_table);
+
+	//give back segments recycled at the end of file
+	if(fstat(fd, &st) == 0 && st.st_size > end)
+	{
+		Truncate(end);
+	}
+
+	WriteTableEntry(seg);
+	WriteTableHeader();
+
+	VueceLogger::Debug("VueceSegmentStore::BeginChunk - chunk %d is stored in segment %d at %ld",
+			chunk_idx, seg, (long)entries[seg].offset);
+
+	return true;
+}
+
+/*
+ * Returns the segment of a chunk with its offset, published data length and frame count,
+ * -1 if the chunk is not in store
+ */
+int VueceSegmentStore::GetSegmentTail(int chunk_idx, off_t* offset, int* data_len, int* frame_no)
+{
+	int seg = -1;
+
+	VueceThreadUtil::MutexLock(&mutex_table);
+
+	seg = FindSegment(chunk_idx);
+
+	if(seg != -1)
+	{
+		*offset = entries[seg].offset;
+		*data_len = entries[seg].data_len;
+		*frame_no = entries[seg].frame_count;
+	}
+
+	VueceThreadUtil::MutexUnlock(&mutex_table);
+
+	if(seg == -1)
+	{
+		VueceLogger::Fatal("VueceSegmentStore - Chunk %d is not in store", chunk_idx);
+	}
+
+	return seg;
+}
+
+/*
+ * Append one frame (including frame header) to a chunk, its index record
+ * is written to the index area of the segment
+ */
+bool VueceSegmentStore::AppendFrame(int chunk_idx, const uint8_t* frame, int len)
+{
+	if(!WriteFrameData(chunk_idx, 0, frame, len))
+	{
+		return false;
+	}
+
+	return CommitFrame(chunk_idx, frame, len);
+}
+
+/*
+ * Write len bytes at offset pos of the frame being appended to a chunk, the frame
+ * is not visible to the reader until CommitFrame() is called. A frame received in
+ * pieces is written by one call per piece.
+ */
+bool VueceSegmentStore::WriteFrameData(int chunk_idx, int pos, const uint8_t* data, int len)
+{
+	int seg = -1;
+	off_t offset = 0;
+	int data_len = 0;
+	int frame_no = 0;
+
+	seg = GetSegmentTail(chunk_idx, &offset, &data_len, &frame_no);
+
+	if(seg == -1)
+	{
+		return false;
+	}
+
+	if(data_len + pos + len > VUECE_SEGMENT_STORE_DATA_LENGTH || frame_no >= VUECE_AUDIO_FRAMES_PER_CHUNK)
+	{
+		VueceLogger::Fatal("VueceSegmentStore::WriteFrameData - Segment of chunk %d is full", chunk_idx);
+		return false;
+	}
+
+	if(pwrite(fd, data, len, offset + VUECE_SEGMENT_STORE_INDEX_LENGTH + data_len + pos) != len)
+	{
+		VueceLogger::Fatal("VueceSegmentStore::WriteFrameData - Write failed: %s", strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Publish a frame of len bytes written by WriteFrameData(), header is a copy of
+ * its frame header which is used to make the index record
+ */
+bool VueceSegmentStore::CommitFrame(int chunk_idx, const uint8_t* header, int len)
+{
+	uint8_t rec[VUECE_CHUNK_INDEX_RECORD_LENGTH];
+	int seg = -1;
+	off_t offset = 0;
+	int data_len = 0;
+	int frame_no = 0;
+
+	seg = GetSegmentTail(chunk_idx, &offset, &data_len, &frame_no);
+
+	if(seg == -1)
+	{
+		return false;
+	}
+
+	if(data_len + len > VUECE_SEGMENT_STORE_DATA_LENGTH || frame_no >= VUECE_AUDIO_FRAMES_PER_CHUNK)
+	{
+		VueceLogger::Fatal("VueceSegmentStore::CommitFrame - Segment of chunk %d is full", chunk_idx);
+		return false;
+	}
+
+	VueceChunkFrameIndex::MakeRecord(rec, data_len, header, len);
+
+	if(pwrite(fd, rec, sizeof(rec), offset + frame_no * VUECE_CHUNK_INDEX_RECORD_LENGTH) != sizeof(rec))
+	{
+		VueceLogger::Fatal("VueceSegmentStore::CommitFrame - Index write failed: %s", strerror(errno));
+		return false;
+	}
+
+	//publish the frame, reader maps the data area up to data_len
+	VueceThreadUtil::MutexLock(&mutex_table);
+	entries[seg].data_len = data_len + len;
+	entries[seg].frame_count = frame_no + 1;
+	VueceThreadUtil::MutexUnlock(&mutex_table);
+
+	return true;
+}
+
+/*
+ * Persist final length of a chunk, table entries are not written per frame.
+ * Room reserved for the rest of chunk is given back.
+ */
+void VueceSegmentStore::EndChunk(int chunk_idx)
+{
+	int seg = -1;
+
+	VueceThreadUtil::MutexLock(&mutex_table);
+
+	seg = FindSegment(chunk_idx);
+
+	if(seg != -1)
+	{
+		entries[seg].length = VUECE_SEGMENT_STORE_INDEX_LENGTH + VUECE_SEGMENT_STORE_ALIGN((off_t)entries[seg].data_len);
+	}
+
+	VueceThreadUtil::MutexUnlock(&mutex_table);
+
+	if(seg != -1)
+	{
+		WriteTableEntry(seg);
+	}
+}
+
+void VueceSegmentStore::SetBufferWindow(int first_chunk_idx, int last_chunk_idx)
+{
+	VueceThreadUtil::MutexLock(&mutex_table);
+	window_first = first_chunk_idx;
+	window_last = last_chunk_idx;
+	VueceThreadUtil::MutexUnlock(&mutex_table);
+
+	WriteTableHeader();
+}
+
+/*
+ * Called by the reader when it opens a chunk, chunks before it can be recycled
+ * once they are behind the buffer window too
+ */
+void VueceSegmentStore::SetReadChunk(int chunk_idx)
+{
+	VueceThreadUtil::MutexLock(&mutex_table);
+	read_chunk = chunk_idx;
+	VueceThreadUtil::MutexUnlock(&mutex_table);
+}
+
+bool VueceSegmentStore::HasChunk(int chunk_idx)
+{
+	int seg = -1;
+
+	VueceThreadUtil::MutexLock(&mutex_table);
+	seg = FindSegment(chunk_idx);
+	VueceThreadUtil::MutexUnlock(&mutex_table);
+
+	return seg != -1;
+}
+
+/*
+ * Number of bytes of complete frames in a chunk, -1 if chunk is not in store
+ */
+int VueceSegmentStore::GetChunkDataLength(int chunk_idx)
+{
+	int seg = -1;
+	int len = -1;
+
+	VueceThreadUtil::MutexLock(&mutex_table);
+
+	seg = FindSegment(chunk_idx);
+
+	if(seg != -1)
+	{
+		len = entries[seg].data_len;
+	}
+
+	VueceThreadUtil::MutexUnlock(&mutex_table);
+
+	return len;
+}
+
+int VueceSegmentStore::GetChunkFrameCount(int chunk_idx)
+{
+	int seg = -1;
+	int count = -1;
+
+	VueceThreadUtil::MutexLock(&mutex_table);
+
+	seg = FindSegment(chunk_idx);
+
+	if(seg != -1)
+	{
+		count = entries[seg].frame_count;
+	}
+
+	VueceThreadUtil::MutexUnlock(&mutex_table);
+
+	return count;
+}
+
+/*
+ * File offset of the first frame of a chunk, it's aligned to VUECE_SEGMENT_STORE_ALIGNMENT
+ * so it can be used as mmap offset, -1 if chunk is not in store
+ */
+off_t VueceSegmentStore::GetChunkDataOffset(int chunk_idx)
+{
+	int seg = -1;
+	off_t offset = -1;
+
+	VueceThreadUtil::MutexLock(&mutex_table);
+
+	seg = FindSegment(chunk_idx);
+
+	if(seg != -1)
+	{
+		offset = entries[seg].offset + VUECE_SEGMENT_STORE_INDEX_LENGTH;
+	}
+
+	VueceThreadUtil::MutexUnlock(&mutex_table);
+
+	return offset;
+}
+
+/*
+ * Read index records of all frames stored so far in a chunk with one pread,
+ * returns the number of records read, -1 if chunk is not in store
+ */
+int VueceSegmentStore::ReadChunkIndex(int chunk_idx, uint8_t* buf, int max_records)
+{
+	int seg = -1;
+	int count = 0;
+	int len = 0;
+	off_t offset = 0;
+
+	VueceThreadUtil::MutexLock(&mutex_table);
+
+	seg = FindSegment(chunk_idx);
+
+	if(seg != -1)
+	{
+		count = entries[seg].frame_count;
+		offset = entries[seg].offset;
+	}
+
+	VueceThreadUtil::MutexUnlock(&mutex_table);
+
+	if(seg == -1)
+	{
+		return -1;
+	}
+
+	if(count > max_records)
+	{
+		count = max_records;
+	}
+
+	if(count == 0)
+	{
+		return 0;
+	}
+
+	len = count * VUECE_CHUNK_INDEX_RECORD_LENGTH;
+
+	if(pread(fd, buf, len, offset) != len)
+	{
+		VueceLogger::Error("VueceSegmentStore::ReadChunkIndex - Read failed: %s", strerror(errno));
+		return -1;
+	}
+
+	return count;
+}
+
+int VueceSegmentStore::GetFd()
+{
+	return fd;
+}
+
+long VueceSegmentStore::GetRecycleCount()
+{
+	return recycle_count;
+}
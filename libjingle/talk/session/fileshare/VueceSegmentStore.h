@@ -0,0 +1,155 @@
+/*
+ * VueceSegmentStore.h
+ *
+ *  Created on: Mar 20, 2015
+ *      Author: jingjing
+ */
+
+#ifndef VUECESEGMENTSTORE_H_
+#define VUECESEGMENTSTORE_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "jthread.h"
+
+#include "VueceConstants.h"
+#include "VueceConfig.h"
+#include "VueceChunkFrameIndex.h"
+
+#define VUECE_SEGMENT_STORE_FILE_NAME "segments.dat"
+
+/*
+ * Max number of segments tracked by the header table, a segment holds one
+ * audio chunk (VUECE_AUDIO_FRAMES_PER_CHUNK frames). The jitter controller
+ * downloads up to two times VUECE_BUFFER_WINDOW chunks per window, spare segments
+ * hold chunks of previous window which are still being played.
+ */
+#define VUECE_SEGMENT_STORE_SPARE_SEGMENTS 4
+#define VUECE_SEGMENT_STORE_MAX_SEGMENTS (2 * VUECE_BUFFER_WINDOW + VUECE_SEGMENT_STORE_SPARE_SEGMENTS)
+
+/*
+ * Header table, segments and the data area of a segment are aligned to this
+ * value so a chunk can be mmap'ed directly, 64K covers all page sizes we know of
+ */
+#define VUECE_SEGMENT_STORE_ALIGNMENT (64*1024)
+
+#define VUECE_SEGMENT_STORE_ALIGN(v) (((v) + VUECE_SEGMENT_STORE_ALIGNMENT - 1) & ~(VUECE_SEGMENT_STORE_ALIGNMENT - 1))
+
+//[magic][version][max segment size][segment count][window first][window last]
+#define VUECE_SEGMENT_STORE_TABLE_HEADER_LENGTH 24
+
+//[chunk idx][offset][data length][frame count]
+#define VUECE_SEGMENT_STORE_ENTRY_LENGTH 16
+
+#define VUECE_SEGMENT_STORE_TABLE_LENGTH VUECE_SEGMENT_STORE_ALIGN(VUECE_SEGMENT_STORE_TABLE_HEADER_LENGTH + \
+		VUECE_SEGMENT_STORE_MAX_SEGMENTS * VUECE_SEGMENT_STORE_ENTRY_LENGTH)
+
+/*
+ * A segment starts with the frame index of its chunk, see VueceChunkFrameIndex,
+ * followed by the frames in stream layout: [SignalByte][FrameLen][FrameTS][DATA]
+ *
+ * Room for the largest possible chunk is reserved while a chunk is written, the
+ * segment shrinks to the data actually stored when the chunk ends.
+ */
+#define VUECE_SEGMENT_STORE_INDEX_LENGTH VUECE_SEGMENT_STORE_ALIGN(VUECE_AUDIO_FRAMES_PER_CHUNK * VUECE_CHUNK_INDEX_RECORD_LENGTH)
+#define VUECE_SEGMENT_STORE_DATA_LENGTH VUECE_SEGMENT_STORE_ALIGN(VUECE_AUDIO_FRAMES_PER_CHUNK * (VUECE_MAX_FRAME_SIZE + VUECE_STREAM_FRAME_HEADER_LENGTH))
+#define VUECE_SEGMENT_STORE_SEGMENT_LENGTH (VUECE_SEGMENT_STORE_INDEX_LENGTH + VUECE_SEGMENT_STORE_DATA_LENGTH)
+
+typedef struct VueceSegmentEntry
+{
+	//-1 if segment is free
+	int chunk_idx;
+	int data_len;
+	int frame_count;
+
+	//file position and size of the segment, both aligned to VUECE_SEGMENT_STORE_ALIGNMENT
+	off_t offset;
+	off_t length;
+} VueceSegmentEntry;
+
+/*
+ * Buffers downloaded audio chunks in one file which is divided into variable-length
+ * segments, a header table at the beginning of the file maps segments to chunk
+ * indices and remembers the buffer window.
+ *
+ * It replaces the numbered chunk files under VUECE_MEDIA_AUDIO_BUFFER_LOCATION,
+ * there is no create/unlink churn on flash storage. Segments of chunks which
+ * are behind both the buffer window and the reader are recycled before the
+ * file grows, a new segment goes to the first gap large enough for a full chunk,
+ * the file is shrunk when segments at its end are recycled and truncated when
+ * a new song starts. Played chunks are gone, so the store is only a playback buffer,
+ * a song can't be saved from it.
+ *
+ * Chunks are written by VueceMediaStream and read by VueceMediaDataBumper via
+ * VueceMmapChunkReader from another thread, the table is shared by both threads
+ * and protected by a mutex, frame data is written with pwrite() before the data
+ * length is published so a reader never sees a partial frame.
+ *
+ * The store outlives media streams because the bumper keeps playing buffered
+ * chunks after a stream is closed, it's released by VueceStreamPlayer::UnInit().
+ */
+class VueceSegmentStore
+{
+public:
+	static VueceSegmentStore* Instance();
+	static void Release();
+
+	void Reset();
+
+	//writer side
+	bool BeginChunk(int chunk_idx);
+	bool AppendFrame(int chunk_idx, const uint8_t* frame, int len);
+	bool WriteFrameData(int chunk_idx, int pos, const uint8_t* data, int len);
+	bool CommitFrame(int chunk_idx, const uint8_t* header, int len);
+	void EndChunk(int chunk_idx);
+	void SetBufferWindow(int first_chunk_idx, int last_chunk_idx);
+
+	//reader side
+	void SetReadChunk(int chunk_idx);
+	bool HasChunk(int chunk_idx);
+	int  GetChunkDataLength(int chunk_idx);
+	int  GetChunkFrameCount(int chunk_idx);
+	off_t GetChunkDataOffset(int chunk_idx);
+	int  ReadChunkIndex(int chunk_idx, uint8_t* buf, int max_records);
+
+	int  GetFd();
+	long GetRecycleCount();
+
+private:
+	VueceSegmentStore();
+	virtual ~VueceSegmentStore();
+
+	bool Open(const char* path);
+	void Close();
+
+	int  FindSegment(int chunk_idx);
+	int  GetSegmentTail(int chunk_idx, off_t* offset, int* data_len, int* frame_no);
+	int  AllocSegment(int chunk_idx);
+	off_t FindSpace();
+	off_t GetStoreEnd();
+	void Truncate(off_t len);
+	void WriteTableHeader();
+	void WriteTableEntry(int seg);
+
+	static void PutInt(uint8_t* b, int v);
+
+private:
+	static VueceSegmentStore* instance;
+
+	int fd;
+
+	VueceSegmentEntry entries[VUECE_SEGMENT_STORE_MAX_SEGMENTS];
+
+	int window_first;
+	int window_last;
+
+	//chunk currently open by the reader, chunks before it have been played
+	int read_chunk;
+
+	long recycle_count;
+
+	JMutex mutex_table;
+};
+
+#endif /* VUECESEGMENTSTORE_H_ */
@@ -8,6 +8,7 @@
 #include "talk/session/fileshare/VueceShareCommon.h"
 
 #include "VueceLogger.h"
+#include "VueceConstants.h"
 
 extern "C" {
 #include "libavformat/avformat.h"
@@ -41,6 +42,30 @@ void FileShareManifest::AddFolder(const std::string& name, size_t size) {
 	items_.push_back(i);
 }
 
+void FileShareManifest::SetRenditions(size_t index, const std::vector<int>& renditions) {
+	items_[index].renditions = renditions;
+}
+
+/*
+ * Renditions a hub offers for a music item with the given bit rate, the ladder
+ * entries below it followed by the item's own bit rate, see VUECE_STREAM_RENDITION_LADDER
+ */
+void FileShareManifest::MakeRenditions(int bit_rate, std::vector<int>* renditions) {
+	static const int ladder[] = VUECE_STREAM_RENDITION_LADDER;
+
+	renditions->clear();
+
+	if (bit_rate <= 0)
+		return;
+
+	for (size_t i = 0; i < sizeof(ladder) / sizeof(ladder[0]); ++i) {
+		if (ladder[i] < bit_rate)
+			renditions->push_back(ladder[i]);
+	}
+
+	renditions->push_back(bit_rate);
+}
+
 size_t FileShareManifest::GetItemCount(FileType t) const {
 	size_t count = 0;
 	for (size_t i = 0; i < items_.size(); ++i) {
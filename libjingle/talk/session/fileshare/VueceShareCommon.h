@@ -11,6 +11,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 #include "talk/base/stringutils.h"
 #include "talk/base/messagequeue.h"
 #include "talk/p2p/base/sessiondescription.h"
@@ -50,6 +51,13 @@ public:
     std::string name;
     size_t size, width, height;
     int bit_rate, sample_rate, nchannels, duration;
+
+    /*
+     * AAC bit rates (bps) a music item can be streamed at, ascending, the last
+     * one is bit_rate. Empty if the hub doesn't offer renditions, the item is
+     * streamed at its own bit rate then.
+     */
+    std::vector<int> renditions;
   };
 
   typedef std::vector<Item> ItemList;
@@ -75,6 +83,10 @@ public:
 			int nchannels,
 			int duration);
 
+  void SetRenditions(size_t index, const std::vector<int>& renditions);
+
+  static void MakeRenditions(int bit_rate, std::vector<int>* renditions);
+
   size_t GetItemCount(FileType t) const;
   inline size_t GetFileCount() const { return GetItemCount(T_FILE); }
   inline size_t GetImageCount() const { return GetItemCount(T_IMAGE); }
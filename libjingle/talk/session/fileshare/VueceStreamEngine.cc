@@ -12,13 +12,37 @@
 #include "VueceMediaDataBumper.h"
 #include "VueceAACDecoder.h"
 #include "VueceAudioWriter.h"
+#include "VueceAudioTrackSink.h"
+#include "VueceJabberClientObserver.h"
+#include "VueceFrameRing.h"
+#include "VueceJitterController.h"
 #include "VueceStreamPlayer.h"
+#include "VueceJni.h"
 
 #ifndef VUECE_APP_ROLE_HUB
 #include "VueceGlobalSetting.h"
 #endif
 
 #define THREAD_TAG_STREAM_ENGINE "VueceStreamEngine"
+#define THREAD_TAG_STREAM_BUMPER "VueceStreamBumper"
+
+/*
+ * Upper bound of an idle wait, stages are normally woken up by events, this is
+ * only a safety net in case an event is missed
+ */
+#define ENGINE_IDLE_WAIT_MAX_MS 1000
+
+//interval of scheduler statistics output
+#define ENGINE_STATS_INTERVAL_MS 30000
+
+/*
+ * Ring sizes between stages, encoded ring holds a few seconds of AAC frames,
+ * PCM ring holds about 1.5 seconds of 44.1KHz stereo data
+ */
+#define BUMPER_RING_SIZE (64*1024)
+#define BUMPER_RING_FRAMES 256
+#define DECODER_RING_SIZE (256*1024)
+#define DECODER_RING_FRAMES 128
 
 VueceStreamEngine::VueceStreamEngine()
 {
@@ -26,9 +50,22 @@ VueceStreamEngine::VueceStreamEngine()
 	bumper = NULL;
 	decoder = NULL;
 	writer = NULL;
+	jitter = NULL;
+	engine_mode = VueceStreamEngineMode_SingleThread;
+	bumper_r = NULL;
+	decoder_r = NULL;
 	running = false;
 	released = false;
 	stop_cmd_issued = false;
+
+	event_seq = 0;
+	wakeup_count = 0;
+	idle_time_ms = 0;
+	sched_start_ms = 0;
+	last_stats_ms = 0;
+
+	pthread_cond_init(&cond_event, NULL);
+	pthread_cond_init(&cond_released, NULL);
 }
 
 VueceStreamEngine::~VueceStreamEngine()
@@ -44,6 +81,18 @@ VueceStreamEngine::~VueceStreamEngine()
 	if(writer != NULL) delete writer;
 	LOG(LS_VERBOSE) << "VueceStreamEngine - writer deleted";
 
+	//Note - rings must be deleted after writer because writer thread
+	//reads from decoder ring directly
+	if(bumper_r != NULL) delete bumper_r;
+	if(decoder_r != NULL) delete decoder_r;
+	LOG(LS_VERBOSE) << "VueceStreamEngine - rings deleted";
+
+	if(jitter != NULL) delete jitter;
+	LOG(LS_VERBOSE) << "VueceStreamEngine - jitter controller deleted";
+
+	pthread_cond_destroy(&cond_event);
+	pthread_cond_destroy(&cond_released);
+
 	LOG(LS_VERBOSE) << "VueceStreamEngine - Destructor Done";
 
 }
@@ -58,12 +107,27 @@ bool VueceStreamEngine::Init(
 		bool download_finished,
 		int last_avail_chunk_idx,
 		int last_chunk_frame_count,
-		int resume_pos
+		int resume_pos,
+		VueceStreamEngineMode mode
 		)
 {
 	bool ret = true;
 
-	VueceLogger::Info("VueceStreamEngine::Init - Start");
+	VueceLogger::Info("VueceStreamEngine::Init - Start, mode = %d", mode);
+
+	engine_mode = mode;
+
+	jitter = new VueceJitterController();
+	jitter->Init(frame_dur_ms, VueceThreadUtil::GetCurTimeMs());
+
+	bumper_r = new VueceFrameRing();
+	decoder_r = new VueceFrameRing();
+
+	if(!bumper_r->Init(BUMPER_RING_SIZE, BUMPER_RING_FRAMES) || !decoder_r->Init(DECODER_RING_SIZE, DECODER_RING_FRAMES))
+	{
+		VueceLogger::Fatal("VueceStreamEngine::Init - rings cannot be initialized.");
+		return false;
+	}
 
 	bumper = new VueceMediaDataBumper();
 	if(!bumper->Init())
@@ -84,6 +148,9 @@ bool VueceStreamEngine::Init(
 
 	bumper->SetFrameDuration(frame_dur_ms);
 
+	bumper->SetJitterController(jitter);
+	decoder->SetJitterController(jitter);
+
 	if(startup_standalone)
 	{
 		VueceLogger::Debug("VueceStreamEngine::Init - Started up as a standalone module, last_avail_chunk_idx = %d", last_avail_chunk_idx);
@@ -111,6 +178,7 @@ bool VueceStreamEngine::Init(
 
 	//set state notification callback
 	bumper->SignalBumperNotification.connect(this, &VueceStreamEngine::OnBumperExternalEventNotification);
+	bumper->SignalInputChanged.connect(this, &VueceStreamEngine::OnBumperInputChanged);
 
 	VueceLogger::Debug("VueceStreamEngine::Init - Setting up bumper - Done");
 
@@ -120,8 +188,17 @@ bool VueceStreamEngine::Init(
 
 	LOG(LS_VERBOSE) << "VueceStreamEngine::Create  - channel_mode is determined: " << channel_mode;
 
+	VueceJabberClientObserver* observer = new VueceJabberClientObserver();
+	if(!observer->Init())
+	{
+		VueceLogger::Fatal("VueceStreamEngine::Init - JabberClient callbacks cannot be found.");
+		delete observer;
+		return false;
+	}
+
 	writer = new VueceAudioWriter();
-	if(!writer->Init(channel_mode, channel_num, VUECE_ANDROID_AUDIO_STREAM_MODE_MUSIC, duration, sample_rate, resume_pos))
+	if(!writer->Init(channel_mode, channel_num, VUECE_ANDROID_AUDIO_STREAM_MODE_MUSIC, duration, sample_rate, resume_pos,
+			new VueceAudioTrackSink(VUECE_ANDROID_AUDIO_STREAM_MODE_MUSIC, channel_mode), observer))
 	{
 		VueceLogger::Fatal("VueceStreamEngine::Init - writer cannot be initialized.");
 		return false;
@@ -130,10 +207,17 @@ bool VueceStreamEngine::Init(
 	LOG(LS_VERBOSE) << "VueceStreamEngine::Create - setting callback on player";
 	writer->d->SignalWriterEventNotification.connect(this, &VueceStreamEngine::OnAudioWriterExternalEventNotification);
 
+	//wake up decoder when writer has consumed half of decoded data
+	writer->SetBufferLowWatermark(decoder_r->GetByteCapacity() / 2);
+	writer->d->SignalBufferLow.connect(this, &VueceStreamEngine::OnWriterBufferLow);
+
+	writer->SetJitterController(jitter);
+
 	VueceLogger::Info("VueceStreamEngine::Init - Writer configuration  - Done.");
 
 	VueceThreadUtil::InitMutex(&mutex_running);
 	VueceThreadUtil::InitMutex(&mutex_release);
+	VueceThreadUtil::InitMutex(&mutex_event);
 
 	released = false;
 
@@ -144,28 +228,12 @@ void* VueceStreamEngine::Thread()
 {
 	VueceLogger::Debug("VueceStreamEngine::Thread - Start");
 
-	VueceMemQueue bumper_q;
-	VueceMemQueue decoder_q;
-	VueceMemQueue writer_q;
-
-	uint64_t orig = 0;
-	int interval = 10; /* in miliseconds*/
-	int64_t diff = 0;
-	uint64_t realtime = 0;
-	uint64_t time = 0;	/* a time since the start of the ticker expressed in milisec*/
-
-	int lastlate = 0;
-	int late = 0;
-	int loop_counter = 1;
-
 	VueceJni::AttachCurrentThreadToJniEnv(THREAD_TAG_STREAM_ENGINE);
 
 	ThreadStarted();
 
 	VueceLogger::Debug("VueceStreamEngine::Thread - Started");
 
-	orig = VueceThreadUtil::GetCurTimeMs();
-
 	mutex_running.Lock();
 
 	if(stop_cmd_issued)
@@ -179,65 +247,33 @@ void* VueceStreamEngine::Thread()
 		running = true;
 	}
 
-	VueceLogger::Debug("VueceStreamEngine::Thread - GetCurTimeMs(orig) = %llu", orig);
-
-	while (running)
-	{
-		mutex_running.Unlock();
-
-//		VueceLogger::Debug("--------------- VueceStreamEngine PROCESS LOOP %d START ---------------", loop_counter);
-
-		bumper->Process(NULL, &bumper_q);
-		decoder->Process(&bumper_q, &decoder_q);
-		writer->Process(&decoder_q, NULL);
-
-		time += interval;
-		while(1){
-			realtime = VueceThreadUtil::GetCurTimeMs() - orig;
-
-			diff = time-realtime;
-
-//			VueceLogger::Debug("VueceStreamEngine::Thread - GetCurTimeMs(realtime) = %llu, time = %llu, diff = %lld", realtime, time, diff);
-
-			if (diff>0)
-			{
-				/* sleep until next tick */
-				VueceThreadUtil::SleepMs((int)diff);
-			}
-			else
-			{
-				late = (int) -diff;
-				if (late > interval * 5 && late > lastlate)
-				{
-					VueceLogger::Warn("We are late of %d miliseconds.", late);
-				}
-
-				lastlate = late;
-				break; /*exit the while loop */
-			}
-		}
+	mutex_running.Unlock();
 
-//		VueceLogger::Debug("--------------- VueceStreamEngine PROCESS LOOP %d END ---------------", loop_counter++);
+	sched_start_ms = last_stats_ms = VueceThreadUtil::GetCurTimeMs();
 
-		mutex_running.Lock();
+	if(engine_mode == VueceStreamEngineMode_Pipelined)
+	{
+		PipelinedLoop();
+	}
+	else
+	{
+		EventLoop();
 	}
-
-	mutex_running.Unlock();
 
 	VueceLogger::Debug("VueceStreamEngine::Thread - Loop exited, releasing resources");
-	VueceLogger::Debug("VueceStreamEngine::Thread - bumer_q bulk count: %d", bumper_q.BulkCount());
-	VueceLogger::Debug("VueceStreamEngine::Thread - decoder_q bulk count: %d", decoder_q.BulkCount());
-	VueceLogger::Debug("VueceStreamEngine::Thread - writer_q bulk count: %d", writer_q.BulkCount());
-
-	//make all memory bulks are release in all queues
-	bumper_q.FreeQueue();
-	decoder_q.FreeQueue();
-	writer_q.FreeQueue();
+	VueceLogger::Debug("VueceStreamEngine::Thread - bumper_r frame count: %d, high water mark: %d bytes", bumper_r->FrameCount(), bumper_r->GetHighWaterMark());
+	VueceLogger::Debug("VueceStreamEngine::Thread - decoder_r frame count: %d, high water mark: %d bytes", decoder_r->FrameCount(), decoder_r->GetHighWaterMark());
 
 	bumper->Uninit();
 	decoder->Uninit();
 	writer->Uninit();
 
+	decoder->LogStats();
+
+	jitter->LogStats();
+
+	LogSchedulerStats();
+
 //	VueceLogger::Debug("VueceStreamEngine::Thread - Deleting bumper");
 //	if(bumper != NULL) delete bumper;
 //	LOG(LS_VERBOSE) << "VueceStreamEngine - bumper deleted";
@@ -259,6 +295,7 @@ void* VueceStreamEngine::Thread()
 
 	mutex_release.Lock();
 	released = true;
+	VueceThreadUtil::CondSignal(&cond_released);
 	mutex_release.Unlock();
 
 #ifdef ANDROID
@@ -279,7 +316,234 @@ void* VueceStreamEngine::Thread()
 	return NULL;
 }
 
+/*
+ * Single thread mode, all stages are processed on engine thread as long as any of
+ * them makes progress, then engine thread sleeps until next event
+ */
+void VueceStreamEngine::EventLoop()
+{
+	unsigned int seq = 0;
+	unsigned int bumper_produced = 0;
+	unsigned int decoder_produced = 0;
+
+	VueceLogger::Debug("VueceStreamEngine::EventLoop - Start");
+
+	while(IsEngineRunning())
+	{
+		seq = GetEventSeq();
+
+		bumper_produced = bumper_r->GetProducedFrameCount();
+		decoder_produced = decoder_r->GetProducedFrameCount();
+
+		bumper->Process(NULL, bumper_r);
+		decoder->Process(bumper_r, decoder_r);
+		writer->Process(decoder_r, NULL);
+
+		//nothing to do - bumper has no input or its ring is full, and decoder ring is full
+		if(bumper_produced == bumper_r->GetProducedFrameCount() && decoder_produced == decoder_r->GetProducedFrameCount())
+		{
+			WaitForEvent(seq);
+		}
+	}
+
+	VueceLogger::Debug("VueceStreamEngine::EventLoop - Done");
+}
+
+/*
+ * Pipelined mode, bumper reads disk data on its own thread while engine thread keeps
+ * decoding and feeding writer, rings between them provide backpressure
+ */
+void VueceStreamEngine::PipelinedLoop()
+{
+	unsigned int seq = 0;
+	unsigned int decoder_produced = 0;
+	int rc = 0;
+
+	VueceLogger::Debug("VueceStreamEngine::PipelinedLoop - Start");
+
+	rc = VueceThreadUtil::CreateThread(&bumper_thread_id, 0, &VueceStreamEngine::BumperThread, this);
+
+	if(rc != 0)
+	{
+		VueceLogger::Error("VueceStreamEngine::PipelinedLoop - Cannot create bumper thread: %d, fall back to single thread mode", rc);
+		EventLoop();
+		return;
+	}
+
+	while(IsEngineRunning())
+	{
+		seq = GetEventSeq();
+
+		decoder_produced = decoder_r->GetProducedFrameCount();
+
+		decoder->Process(bumper_r, decoder_r);
+		writer->Process(decoder_r, NULL);
+
+		if(decoder_produced == decoder_r->GetProducedFrameCount())
+		{
+			WaitForEvent(seq);
+		}
+		else
+		{
+			//space is freed in bumper ring
+			WakeUp();
+		}
+	}
+
+	VueceLogger::Debug("VueceStreamEngine::PipelinedLoop - Loop exited, waiting for bumper thread");
+
+	VueceThreadUtil::ThreadJoin(bumper_thread_id);
+
+	VueceLogger::Debug("VueceStreamEngine::PipelinedLoop - Done");
+}
+
+void* VueceStreamEngine::BumperThread(void* arg)
+{
+	VueceStreamEngine* e = (VueceStreamEngine*)arg;
+	unsigned int seq = 0;
+	unsigned int produced = 0;
+
+	VueceJni::AttachCurrentThreadToJniEnv(THREAD_TAG_STREAM_BUMPER);
+
+	VueceLogger::Debug("VueceStreamEngine::BumperThread - Started");
+
+	while(e->IsEngineRunning())
+	{
+		seq = e->GetEventSeq();
+
+		produced = e->bumper_r->GetProducedFrameCount();
+
+		//bumper returns when output ring is full or there is nothing to read
+		e->bumper->Process(NULL, e->bumper_r);
+
+		if(produced == e->bumper_r->GetProducedFrameCount())
+		{
+			e->WaitForEvent(seq);
+		}
+		else
+		{
+			//new data for decoder
+			e->WakeUp();
+		}
+	}
+
+	VueceLogger::Debug("VueceStreamEngine::BumperThread - Stopped");
+
+	VueceJni::ThreadExit(NULL, THREAD_TAG_STREAM_BUMPER);
+
+	return NULL;
+}
+
+bool VueceStreamEngine::IsEngineRunning()
+{
+	bool ret = false;
 
+	mutex_running.Lock();
+	ret = running;
+	mutex_running.Unlock();
+
+	return ret;
+}
+
+unsigned int VueceStreamEngine::GetEventSeq()
+{
+	unsigned int ret = 0;
+
+	mutex_event.Lock();
+	ret = event_seq;
+	mutex_event.Unlock();
+
+	return ret;
+}
+
+/*
+ * Wake up all stage threads, safe to call from any thread
+ */
+void VueceStreamEngine::WakeUp()
+{
+	mutex_event.Lock();
+	event_seq++;
+	VueceThreadUtil::CondBroadcast(&cond_event);
+	mutex_event.Unlock();
+}
+
+/*
+ * Sleep until WakeUp() is called, returns immediately if it has been called since seq
+ * was taken
+ */
+void VueceStreamEngine::WaitForEvent(unsigned int seq)
+{
+	uint64_t start = 0;
+	uint64_t now = 0;
+
+	mutex_event.Lock();
+
+	if(seq == event_seq)
+	{
+		start = VueceThreadUtil::GetCurTimeMs();
+
+		VueceThreadUtil::CondTimedWait(&cond_event, &mutex_event, ENGINE_IDLE_WAIT_MAX_MS);
+
+		now = VueceThreadUtil::GetCurTimeMs();
+
+		wakeup_count++;
+		idle_time_ms += (now - start);
+
+		if(now - last_stats_ms >= ENGINE_STATS_INTERVAL_MS)
+		{
+			last_stats_ms = now;
+			mutex_event.Unlock();
+
+			LogSchedulerStats();
+			return;
+		}
+	}
+
+	mutex_event.Unlock();
+}
+
+void VueceStreamEngine::LogSchedulerStats()
+{
+	uint64_t elapsed = 0;
+	long wakeups = 0;
+	uint64_t idle = 0;
+
+	mutex_event.Lock();
+	elapsed = VueceThreadUtil::GetCurTimeMs() - sched_start_ms;
+	wakeups = wakeup_count;
+	idle = idle_time_ms;
+	mutex_event.Unlock();
+
+	if(elapsed == 0)
+	{
+		return;
+	}
+
+	VueceLogger::Info("VueceStreamEngine - Scheduler stats: %ld wakeups in %llu ms (%.2f/s), idle %llu ms (%d%%)",
+			wakeups, elapsed, (float)wakeups * 1000 / elapsed, idle, (int)(idle * 100 / elapsed));
+}
+
+long VueceStreamEngine::GetWakeupCount()
+{
+	long ret = 0;
+
+	mutex_event.Lock();
+	ret = wakeup_count;
+	mutex_event.Unlock();
+
+	return ret;
+}
+
+uint64_t VueceStreamEngine::GetIdleTimeMs()
+{
+	uint64_t ret = 0;
+
+	mutex_event.Lock();
+	ret = idle_time_ms;
+	mutex_event.Unlock();
+
+	return ret;
+}
 
 void VueceStreamEngine::StopSync()
 {
@@ -290,20 +554,31 @@ void VueceStreamEngine::StopSync()
 	running = false;
 	mutex_running.Unlock();
 
+	//stage threads may be waiting for events
+	WakeUp();
+
 	VueceLogger::Debug("VueceStreamEngine::Thread - StopSync - wait until all resources are released");
 
 	mutex_release.Lock();
 	while (!released)
 	{
-		mutex_release.Unlock();
-		VueceThreadUtil::SleepSec(1);
-		mutex_release.Lock();
+		VueceThreadUtil::CondWait(&cond_released, &mutex_release);
 	}
 	mutex_release.Unlock();
 
 	VueceLogger::Debug("VueceStreamEngine::Thread - StopSync - Done");
 }
 
+void VueceStreamEngine::OnBumperInputChanged()
+{
+	WakeUp();
+}
+
+void VueceStreamEngine::OnWriterBufferLow()
+{
+	WakeUp();
+}
+
 void VueceStreamEngine::OnAudioWriterExternalEventNotification(VueceStreamAudioWriterExternalEventNotification *event)
 {
 	VueceLogger::Debug("VueceStreamEngine - -------------------------------------");
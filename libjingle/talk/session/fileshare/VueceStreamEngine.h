@@ -17,7 +17,22 @@
 class VueceMediaDataBumper;
 class VueceAACDecoder;
 class VueceAudioWriter;
-class VueceMemQueue;
+class VueceFrameRing;
+class VueceJitterController;
+
+/*
+ * How stream engine drives its stages
+ * SingleThread - bumper, decoder and writer are processed on engine thread
+ * Pipelined - bumper runs on its own thread, decoder runs on engine thread, they are linked
+ * by bounded rings, audio output runs on writer thread in both modes
+ *
+ * In both modes a stage thread sleeps until it's woken up by an event (new data, writer
+ * buffer low, control command or stop), there is no fixed polling tick.
+ */
+typedef enum _VueceStreamEngineMode{
+	VueceStreamEngineMode_SingleThread = 0,
+	VueceStreamEngineMode_Pipelined
+}VueceStreamEngineMode;
 
 class VueceStreamEngine : public JThread, public sigslot::has_slots<>
 {
@@ -36,7 +51,8 @@ public:
 			bool download_finished,
 			int last_avail_chunk_idx,
 			int last_chunk_frame_count,
-			int resume_pos
+			int resume_pos,
+			VueceStreamEngineMode mode
 			);
 
 	void* Thread();
@@ -45,13 +61,53 @@ public:
 
 	void OnBumperExternalEventNotification(VueceBumperExternalEventNotification *event);
 	void OnAudioWriterExternalEventNotification(VueceStreamAudioWriterExternalEventNotification *event);
+	void OnBumperInputChanged();
+	void OnWriterBufferLow();
+
+	void WakeUp();
+
+	long GetWakeupCount();
+	uint64_t GetIdleTimeMs();
 
 public:
 	VueceMediaDataBumper* 	bumper;
 	VueceAACDecoder* 		decoder;
 	VueceAudioWriter* 		writer;
 
+	//adaptive buffering, fed by session (chunk arrivals) and all stages
+	VueceJitterController*	jitter;
+
 private:
+	void EventLoop();
+	void PipelinedLoop();
+	bool IsEngineRunning();
+
+	unsigned int GetEventSeq();
+	void WaitForEvent(unsigned int seq);
+	void LogSchedulerStats();
+
+	static void* BumperThread(void* arg);
+
+private:
+
+	VueceStreamEngineMode	engine_mode;
+	pthread_t				bumper_thread_id;
+
+	//scheduler, event_seq is bumped on every WakeUp() so a waiter won't miss an event
+	//fired between its last check and the wait
+	JMutex					mutex_event;
+	pthread_cond_t			cond_event;
+	unsigned int			event_seq;
+
+	//scheduler statistics, protected by mutex_event
+	long					wakeup_count;
+	uint64_t				idle_time_ms;
+	uint64_t				sched_start_ms;
+	uint64_t				last_stats_ms;
+
+	//bumper -> decoder (encoded frames) and decoder -> writer (PCM) links
+	VueceFrameRing*			bumper_r;
+	VueceFrameRing*			decoder_r;
 
 	//TODO - Maybe we don't need class variables here, just put every
 	//int the thread loop as local variable because they will be destroyed
@@ -60,6 +116,7 @@ private:
 	JMutex mutex_running;
 	JMutex mutex_release;
 	bool released;
+	pthread_cond_t cond_released;
 	bool stop_cmd_issued;
 
 };
@@ -0,0 +1,321 @@
+/*
+ * VueceStreamFrameQueue.cc
+ *
+ *  Created on: Mar 30, 2015
+ *      Author: jingjing
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <windows.h>
+#define FRAME_BUF_ATOMIC_INC(p) InterlockedIncrement(p)
+#define FRAME_BUF_ATOMIC_DEC(p) InterlockedDecrement(p)
+#else
+#define FRAME_BUF_ATOMIC_INC(p) __sync_add_and_fetch(p, 1)
+#define FRAME_BUF_ATOMIC_DEC(p) __sync_sub_and_fetch(p, 1)
+#endif
+
+#include "VueceLogger.h"
+#include "VueceStreamFrameQueue.h"
+
+VueceStreamFrameQueue::VueceStreamFrameQueue()
+{
+	front = NULL;
+	rear = NULL;
+	front_pos = 0;
+	reserved = 0;
+	size = 0;
+	free_list = NULL;
+	free_count = 0;
+}
+
+VueceStreamFrameQueue::~VueceStreamFrameQueue()
+{
+	VueceStreamFrameBuf* f = NULL;
+
+	Clear();
+
+	while(free_list != NULL)
+	{
+		f = free_list;
+		free_list = f->next;
+		free(f);
+	}
+}
+
+void VueceStreamFrameQueue::RefFrameBuf(VueceStreamFrameBuf* f)
+{
+	FRAME_BUF_ATOMIC_INC(&f->ref_count);
+}
+
+/*
+ * Used by holders other than the queue, the buffer is freed by whoever drops
+ * the last reference
+ */
+void VueceStreamFrameQueue::UnrefFrameBuf(VueceStreamFrameBuf* f)
+{
+	if(f != NULL && FRAME_BUF_ATOMIC_DEC(&f->ref_count) == 0)
+	{
+		free(f);
+	}
+}
+
+VueceStreamFrameBuf* VueceStreamFrameQueue::AllocFrameBuf(int capacity)
+{
+	VueceStreamFrameBuf* f = NULL;
+
+	if(capacity <= VUECE_STREAM_FRAME_BUF_SIZE && free_list != NULL)
+	{
+		f = free_list;
+		free_list = f->next;
+		free_count--;
+	}
+	else
+	{
+		if(capacity < VUECE_STREAM_FRAME_BUF_SIZE)
+		{
+			capacity = VUECE_STREAM_FRAME_BUF_SIZE;
+		}
+
+		f = (VueceStreamFrameBuf*)malloc(sizeof(VueceStreamFrameBuf) + capacity);
+
+		if(f == NULL)
+		{
+			VueceLogger::Fatal("VueceStreamFrameQueue - Cannot allocate frame buffer with capacity: %d", capacity);
+			return NULL;
+		}
+
+		f->data = (uint8_t*)(f + 1);
+		f->capacity = capacity;
+	}
+
+	f->next = NULL;
+	f->ref_count = 1;
+	f->len = 0;
+
+	return f;
+}
+
+/*
+ * Drops the queue's reference, a buffer nobody else holds is kept for reuse
+ */
+void VueceStreamFrameQueue::ReleaseFrameBuf(VueceStreamFrameBuf* f)
+{
+	if(FRAME_BUF_ATOMIC_DEC(&f->ref_count) != 0)
+	{
+		return;
+	}
+
+	if(f->capacity == VUECE_STREAM_FRAME_BUF_SIZE && free_count < VUECE_STREAM_FRAME_BUF_MAX_FREE)
+	{
+		f->next = free_list;
+		free_list = f;
+		free_count++;
+		return;
+	}
+
+	free(f);
+}
+
+uint8_t* VueceStreamFrameQueue::Reserve(int len)
+{
+	VueceStreamFrameBuf* f = NULL;
+
+	//frames are never split between buffers
+	if(rear != NULL && rear->capacity - rear->len >= len)
+	{
+		reserved = len;
+		return rear->data + rear->len;
+	}
+
+	f = AllocFrameBuf(len);
+
+	if(f == NULL)
+	{
+		return NULL;
+	}
+
+	if(rear == NULL)
+	{
+		front = f;
+		front_pos = 0;
+	}
+	else
+	{
+		rear->next = f;
+	}
+
+	rear = f;
+	reserved = len;
+
+	return f->data;
+}
+
+void VueceStreamFrameQueue::Commit(int len)
+{
+	if(rear == NULL || len > reserved)
+	{
+		VueceLogger::Fatal("VueceStreamFrameQueue::Commit - %d bytes committed but only %d bytes reserved", len, reserved);
+		return;
+	}
+
+	rear->len += len;
+	size += len;
+	reserved = 0;
+}
+
+int VueceStreamFrameQueue::GetSize()
+{
+	return size;
+}
+
+bool VueceStreamFrameQueue::IsEmpty()
+{
+	return size == 0;
+}
+
+void VueceStreamFrameQueue::RemoveFront()
+{
+	VueceStreamFrameBuf* f = front;
+
+	front = f->next;
+	front_pos = 0;
+
+	if(front == NULL)
+	{
+		rear = NULL;
+	}
+
+	ReleaseFrameBuf(f);
+}
+
+int VueceStreamFrameQueue::Read(uint8_t* buffer, int len)
+{
+	int copied = 0;
+
+	while(copied < len && size > 0)
+	{
+		int n = front->len - front_pos;
+
+		if(n > len - copied)
+		{
+			n = len - copied;
+		}
+
+		memcpy(buffer + copied, front->data + front_pos, n);
+
+		copied += n;
+
+		Consume(n);
+	}
+
+	return copied;
+}
+
+int VueceStreamFrameQueue::GetIoVecs(talk_base::StreamIoVec* iov, VueceStreamFrameBuf** bufs, int iov_max, size_t max_len, size_t* total)
+{
+	VueceStreamFrameBuf* f = front;
+	int pos = front_pos;
+	size_t sum = 0;
+	int n = 0;
+
+	while(f != NULL && n < iov_max && sum < max_len)
+	{
+		size_t len = f->len - pos;
+
+		if(len > max_len - sum)
+		{
+			len = max_len - sum;
+		}
+
+		if(len > 0)
+		{
+			iov[n].base = f->data + pos;
+			iov[n].len = len;
+
+			if(bufs != NULL)
+			{
+				RefFrameBuf(f);
+				bufs[n] = f;
+			}
+
+			sum += len;
+			n++;
+		}
+
+		f = f->next;
+		pos = 0;
+	}
+
+	if(total != NULL)
+	{
+		*total = sum;
+	}
+
+	return n;
+}
+
+void VueceStreamFrameQueue::Consume(size_t len)
+{
+	if((int)len > size)
+	{
+		VueceLogger::Fatal("VueceStreamFrameQueue::Consume - %d bytes consumed but only %d bytes queued", (int)len, size);
+		len = size;
+	}
+
+	size -= (int)len;
+
+	while(len > 0)
+	{
+		size_t n = front->len - front_pos;
+
+		if(len < n)
+		{
+			front_pos += (int)len;
+			break;
+		}
+
+		len -= n;
+		front_pos = front->len;
+
+		SkipConsumed();
+	}
+
+	SkipConsumed();
+}
+
+/*
+ * Fully consumed buffers are released, except the rear one which may still take
+ * more frames, it starts over from the beginning if nobody else holds it
+ */
+void VueceStreamFrameQueue::SkipConsumed()
+{
+	while(front != NULL && front_pos == front->len)
+	{
+		if(front == rear)
+		{
+			if(reserved == 0 && front->ref_count == 1)
+			{
+				front->len = 0;
+				front_pos = 0;
+			}
+
+			return;
+		}
+
+		RemoveFront();
+	}
+}
+
+void VueceStreamFrameQueue::Clear()
+{
+	while(front != NULL)
+	{
+		RemoveFront();
+	}
+
+	size = 0;
+	reserved = 0;
+}
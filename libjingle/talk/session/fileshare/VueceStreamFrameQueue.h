@@ -0,0 +1,101 @@
+/*
+ * VueceStreamFrameQueue.h
+ *
+ *  Created on: Mar 30, 2015
+ *      Author: jingjing
+ */
+
+#ifndef VUECESTREAMFRAMEQUEUE_H_
+#define VUECESTREAMFRAMEQUEUE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "talk/base/stream.h"
+
+//default capacity of a frame buffer, a bigger frame gets a buffer of its own size
+#define VUECE_STREAM_FRAME_BUF_SIZE 16 * 1024
+
+//maximum number of consumed frame buffers kept for reuse by one queue
+#define VUECE_STREAM_FRAME_BUF_MAX_FREE 4
+
+/*
+ * A reference counted buffer holding one or more complete stream frames
+ * ([type][len][ts][data], see VUECE_STREAM_FRAME_HEADER_LENGTH), the header
+ * and the payload are allocated as one block.
+ *
+ * Bytes [0, len) are published, they are never moved or modified, so they can
+ * be handed out by pointer while more frames are appended behind them.
+ */
+typedef struct VueceStreamFrameBuf
+{
+	struct VueceStreamFrameBuf* next;
+	volatile long ref_count;
+	int capacity;
+	int len;
+	uint8_t* data;
+} VueceStreamFrameBuf;
+
+/*
+ * Output queue of a hub server stream. Frames are encoded straight into the
+ * tail buffer (Reserve/Commit), and read out either by copy (Read) or as a
+ * list of pointers into the queued buffers (GetIoVecs/Consume), so a sender
+ * can write them to the network without any staging copy.
+ *
+ * A frame which doesn't fit the caller's buffer simply stays in the queue and
+ * is picked up by the next read. Consumed buffers are recycled unless someone
+ * else still holds a reference (RefFrameBuf/UnrefFrameBuf), in that case the
+ * last holder frees it.
+ *
+ * Not thread safe, a queue is accessed by the thread reading the stream only.
+ */
+class VueceStreamFrameQueue
+{
+public:
+	VueceStreamFrameQueue();
+	virtual ~VueceStreamFrameQueue();
+
+	//returns a pointer where len bytes can be written, published by Commit()
+	uint8_t* Reserve(int len);
+	void Commit(int len);
+
+	int  GetSize();
+	bool IsEmpty();
+
+	int  Read(uint8_t* buffer, int len);
+
+	/*
+	 * Describes up to max_len queued bytes in at most iov_max entries without consuming them,
+	 * if bufs is not NULL, it receives the buffer of each entry with a reference taken for the caller
+	 */
+	int  GetIoVecs(talk_base::StreamIoVec* iov, VueceStreamFrameBuf** bufs, int iov_max, size_t max_len, size_t* total);
+	void Consume(size_t len);
+
+	void Clear();
+
+	static void RefFrameBuf(VueceStreamFrameBuf* f);
+	static void UnrefFrameBuf(VueceStreamFrameBuf* f);
+
+private:
+	VueceStreamFrameBuf* AllocFrameBuf(int capacity);
+	void ReleaseFrameBuf(VueceStreamFrameBuf* f);
+	void RemoveFront();
+	void SkipConsumed();
+
+private:
+	VueceStreamFrameBuf* front;
+	VueceStreamFrameBuf* rear;
+
+	//consumed bytes of front buffer
+	int front_pos;
+
+	//reserved but not committed bytes of rear buffer
+	int reserved;
+
+	int size;
+
+	VueceStreamFrameBuf* free_list;
+	int free_count;
+};
+
+#endif /* VUECESTREAMFRAMEQUEUE_H_ */
@@ -16,11 +16,14 @@
 #include "VueceStreamPlayer.h"
 #include "VueceGlobalSetting.h"
 #include "VueceConstants.h"
+#include "VueceConfig.h"
 #include "VueceLogger.h"
 #include "VueceStreamEngine.h"
 
 #include "VueceMediaDataBumper.h"
+#include "VueceSegmentStore.h"
 #include "VueceAudioWriter.h"
+#include "VueceJitterController.h"
 
 #include "VueceNetworkPlayerFsm.h"
 
@@ -109,6 +112,12 @@ void VueceStreamPlayer::OnAudioWriterStateNotification(VueceStreamAudioWriterExt
 
 			LOG(LS_INFO) << "VueceStreamPlayer - Current buffer start portion is updated to: " << start_pos_current_buf_win;
 
+			//first chunk of next buffer window measures session setup latency
+			if(stream_engine != NULL)
+			{
+				stream_engine->jitter->OnDownloadRequested(VueceThreadUtil::GetCurTimeMs());
+			}
+
 			//TODO - Continue your work here...
 //			SignalStreamPlayerNotification(&notification);
 
@@ -249,6 +258,10 @@ void VueceStreamPlayer::UnInit()
 		mutex_allow_streaming.Unlock();
 	}
 
+	LOG(LS_INFO) << "VueceStreamPlayer::UnInit - Release segment store";
+
+	VueceSegmentStore::Release();
+
 	LOG(LS_INFO) << "VueceStreamPlayer::UnInit - Done";
 }
 
@@ -414,7 +427,8 @@ bool VueceStreamPlayer::CreateStreamEngine(
 			download_finished,
 			last_avail_chunk_idx,
 			last_chunk_frame_count,
-			resume_pos);
+			resume_pos,
+			VUECE_STREAM_ENGINE_PIPELINED ? VueceStreamEngineMode_Pipelined : VueceStreamEngineMode_SingleThread);
 
 	if(!ret)
 	{
@@ -1089,6 +1103,8 @@ void VueceStreamPlayer::InjectLastAvailChunkIdIntoBumper(int idx)
 
 	if(VueceStreamPlayer::HasStreamEngine())
 	{
+		//feed download rate estimation before bumper checks its prebuffer target
+		stream_engine->jitter->OnChunkArrived(VueceThreadUtil::GetCurTimeMs());
 		stream_engine->bumper->SetLastAvailChunkFileIdx(idx);
 	}
 	else
@@ -1164,6 +1180,20 @@ int VueceStreamPlayer::GetCurrentPlayingProgress(void)
 	return 0;
 }
 
+/*
+ * Number of chunks downloaded in one buffer window, it's enlarged by jitter controller
+ * if download can't keep up with playing
+ */
+int VueceStreamPlayer::GetBufferWindowChunks()
+{
+	if(VueceStreamPlayer::HasStreamEngine())
+	{
+		return stream_engine->jitter->GetBufferWindowChunks();
+	}
+
+	return VUECE_BUFFER_WINDOW;
+}
+
 void VueceStreamPlayer::EnableBufWinCheckInAudioWriter()
 {
 	VueceLogger::Debug("VueceStreamPlayer::EnableBufWinCheckInAudioWriter");
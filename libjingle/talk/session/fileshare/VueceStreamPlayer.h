@@ -138,6 +138,8 @@ public:
 //	static void FireNetworkPlayerStateChangeNotification(vuece::NetworkPlayerEvent e, vuece::NetworkPlayerState s);
 //  static void SetNetworkPlayerState(vuece::NetworkPlayerState state);
 
+	static int GetBufferWindowChunks();
+
 	static void EnableBufWinCheckInAudioWriter();
 
 	static void DisableBufWinCheckInAudioWriter();
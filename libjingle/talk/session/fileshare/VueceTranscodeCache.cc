@@ -0,0 +1,791 @@
+/*
+ * VueceTranscodeCache.cc
+ *
+ *  Created on: Mar 28, 2015
+ *      Author: jingjing
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <set>
+
+#include "talk/base/fileutils.h"
+#include "talk/base/pathutils.h"
+#include "talk/base/scoped_ptr.h"
+
+#include "VueceLogger.h"
+#include "VueceConstants.h"
+#include "VueceThreadUtil.h"
+#include "VueceTranscodeCache.h"
+
+#define VUECE_TRANSCODE_CACHE_INDEX_MAGIC 0x56544358 //"VTCX"
+
+//[magic][record count]
+#define VUECE_TRANSCODE_CACHE_INDEX_HEADER_LENGTH 8
+
+VueceTranscodeCacheEntry::VueceTranscodeCacheEntry(const std::string& key_, const std::string& base_path)
+{
+	key = key_;
+	data_path = base_path + VUECE_TRANSCODE_CACHE_DATA_EXT;
+	index_path = base_path + VUECE_TRANSCODE_CACHE_INDEX_EXT;
+
+	state = VueceTranscodeCacheState_Abandoned;
+
+	fWriteFile = NULL;
+	write_len = 0;
+	published_count = 0;
+
+	ref_count = 0;
+	last_used_ms = 0;
+
+	VueceThreadUtil::InitMutex(&mutex_entry);
+}
+
+VueceTranscodeCacheEntry::~VueceTranscodeCacheEntry()
+{
+	if(fWriteFile != NULL)
+	{
+		fclose(fWriteFile);
+		fWriteFile = NULL;
+	}
+}
+
+void VueceTranscodeCacheEntry::PutInt(uint8_t* b, int v)
+{
+	b[0] = (v >> 24) & 0xFF;
+	b[1] = (v >> 16) & 0xFF;
+	b[2] = (v >> 8) & 0xFF;
+	b[3] = v & 0xFF;
+}
+
+int VueceTranscodeCacheEntry::GetInt(const uint8_t* b)
+{
+	return (b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+}
+
+const std::string& VueceTranscodeCacheEntry::GetKey()
+{
+	return key;
+}
+
+VueceTranscodeCacheState VueceTranscodeCacheEntry::GetState()
+{
+	VueceTranscodeCacheState s;
+
+	VueceThreadUtil::MutexLock(&mutex_entry);
+	s = state;
+	VueceThreadUtil::MutexUnlock(&mutex_entry);
+
+	return s;
+}
+
+/* ---------------------------- writer side ---------------------------- */
+
+bool VueceTranscodeCacheEntry::BeginWrite()
+{
+	fWriteFile = fopen(data_path.c_str(), "wb");
+
+	if(fWriteFile == NULL)
+	{
+		VueceLogger::Error("VueceTranscodeCacheEntry::BeginWrite - Cannot create data file: %s", data_path.c_str());
+		return false;
+	}
+
+	write_len = 0;
+	state = VueceTranscodeCacheState_Writing;
+
+	return true;
+}
+
+/*
+ * Appends one encoded frame, header is the 9 bytes stream frame header which
+ * has already been built for this frame
+ */
+bool VueceTranscodeCacheEntry::AppendFrame(const uint8_t* header, const uint8_t* data, int len, int ts)
+{
+	VueceTranscodeCacheRecord rec;
+	int pending = 0;
+
+	if(fWriteFile == NULL)
+	{
+		return false;
+	}
+
+	if(fwrite(header, 1, VUECE_STREAM_FRAME_HEADER_LENGTH, fWriteFile) != VUECE_STREAM_FRAME_HEADER_LENGTH
+			|| fwrite(data, 1, len, fWriteFile) != (size_t)len)
+	{
+		VueceLogger::Error("VueceTranscodeCacheEntry::AppendFrame - Cannot write frame(%d bytes) into %s", len, data_path.c_str());
+		return false;
+	}
+
+	rec.offset = write_len;
+	rec.ts = ts;
+	rec.len = len;
+
+	write_len += VUECE_STREAM_FRAME_HEADER_LENGTH + len;
+
+	VueceThreadUtil::MutexLock(&mutex_entry);
+	records.push_back(rec);
+	pending = (int)records.size() - published_count;
+	VueceThreadUtil::MutexUnlock(&mutex_entry);
+
+	if(pending >= VUECE_TRANSCODE_CACHE_PUBLISH_FRAMES)
+	{
+		PublishFrames();
+	}
+
+	return true;
+}
+
+/*
+ * Frame data must reach the file before readers are allowed to see its record
+ */
+void VueceTranscodeCacheEntry::PublishFrames()
+{
+	if(fWriteFile != NULL)
+	{
+		fflush(fWriteFile);
+	}
+
+	VueceThreadUtil::MutexLock(&mutex_entry);
+	published_count = (int)records.size();
+	VueceThreadUtil::MutexUnlock(&mutex_entry);
+}
+
+bool VueceTranscodeCacheEntry::Complete()
+{
+	bool ret = false;
+
+	PublishFrames();
+
+	if(fWriteFile != NULL)
+	{
+		fclose(fWriteFile);
+		fWriteFile = NULL;
+	}
+
+	ret = SaveIndex();
+
+	VueceThreadUtil::MutexLock(&mutex_entry);
+	state = ret ? VueceTranscodeCacheState_Complete : VueceTranscodeCacheState_Abandoned;
+	VueceThreadUtil::MutexUnlock(&mutex_entry);
+
+	VueceLogger::Info("VueceTranscodeCacheEntry::Complete - %s, %d frames, %lu bytes, index saved: %d",
+			key.c_str(), published_count, (unsigned long)write_len, ret);
+
+	return ret;
+}
+
+void VueceTranscodeCacheEntry::Abandon()
+{
+	if(fWriteFile != NULL)
+	{
+		fclose(fWriteFile);
+		fWriteFile = NULL;
+	}
+
+	VueceThreadUtil::MutexLock(&mutex_entry);
+	state = VueceTranscodeCacheState_Abandoned;
+	VueceThreadUtil::MutexUnlock(&mutex_entry);
+
+	VueceLogger::Info("VueceTranscodeCacheEntry::Abandon - %s, transcoding stopped after %d frames", key.c_str(), published_count);
+}
+
+/* ---------------------------- reader side ---------------------------- */
+
+FILE* VueceTranscodeCacheEntry::OpenReader()
+{
+	FILE* f = fopen(data_path.c_str(), "rb");
+
+	if(f == NULL)
+	{
+		VueceLogger::Error("VueceTranscodeCacheEntry::OpenReader - Cannot open data file: %s", data_path.c_str());
+	}
+
+	return f;
+}
+
+int VueceTranscodeCacheEntry::GetPublishedFrameCount()
+{
+	int n = 0;
+
+	VueceThreadUtil::MutexLock(&mutex_entry);
+	n = published_count;
+	VueceThreadUtil::MutexUnlock(&mutex_entry);
+
+	return n;
+}
+
+bool VueceTranscodeCacheEntry::GetRecord(int frame_no, VueceTranscodeCacheRecord* rec)
+{
+	bool ret = false;
+
+	VueceThreadUtil::MutexLock(&mutex_entry);
+
+	if(frame_no >= 0 && frame_no < published_count)
+	{
+		*rec = records[frame_no];
+		ret = true;
+	}
+
+	VueceThreadUtil::MutexUnlock(&mutex_entry);
+
+	return ret;
+}
+
+/*
+ * Returns the number of whole published frames starting from first_frame_no
+ * which fit into max_len bytes, total_len is their length including headers
+ */
+int VueceTranscodeCacheEntry::CountFramesFitting(int first_frame_no, int max_len, int* total_len)
+{
+	int i = first_frame_no;
+	int total = 0;
+	int frame_total = 0;
+
+	VueceThreadUtil::MutexLock(&mutex_entry);
+
+	while(i < published_count)
+	{
+		frame_total = VUECE_STREAM_FRAME_HEADER_LENGTH + records[i].len;
+
+		if(total + frame_total > max_len)
+		{
+			break;
+		}
+
+		total += frame_total;
+		i++;
+	}
+
+	VueceThreadUtil::MutexUnlock(&mutex_entry);
+
+	*total_len = total;
+
+	return i - first_frame_no;
+}
+
+/*
+ * Binary search of the frame which covers target_ts, returns -1 if it's
+ * not published yet
+ */
+int VueceTranscodeCacheEntry::FindFrame(int target_ts)
+{
+	int lo = 0;
+	int hi = 0;
+	int mid = 0;
+	int ret = -1;
+
+	VueceThreadUtil::MutexLock(&mutex_entry);
+
+	hi = published_count - 1;
+
+	if(hi >= 0 && target_ts <= records[hi].ts)
+	{
+		while(lo < hi)
+		{
+			mid = (lo + hi + 1) / 2;
+
+			if(records[mid].ts <= target_ts)
+			{
+				lo = mid;
+			}
+			else
+			{
+				hi = mid - 1;
+			}
+		}
+
+		ret = lo;
+	}
+
+	VueceThreadUtil::MutexUnlock(&mutex_entry);
+
+	return ret;
+}
+
+/* ---------------------------- index file ---------------------------- */
+
+bool VueceTranscodeCacheEntry::SaveIndex()
+{
+	uint8_t buf[VUECE_TRANSCODE_CACHE_RECORD_LENGTH];
+	std::string tmp_path = index_path + ".tmp";
+	FILE* f = NULL;
+	size_t i = 0;
+	bool ret = true;
+
+	f = fopen(tmp_path.c_str(), "wb");
+
+	if(f == NULL)
+	{
+		VueceLogger::Error("VueceTranscodeCacheEntry::SaveIndex - Cannot create index file: %s", tmp_path.c_str());
+		return false;
+	}
+
+	PutInt(buf, VUECE_TRANSCODE_CACHE_INDEX_MAGIC);
+	PutInt(buf + 4, (int)records.size());
+
+	if(fwrite(buf, 1, VUECE_TRANSCODE_CACHE_INDEX_HEADER_LENGTH, f) != VUECE_TRANSCODE_CACHE_INDEX_HEADER_LENGTH)
+	{
+		ret = false;
+	}
+
+	for(i = 0; ret && i < records.size(); i++)
+	{
+		PutInt(buf, (int)records[i].offset);
+		PutInt(buf + 4, records[i].ts);
+		PutInt(buf + 8, records[i].len);
+
+		if(fwrite(buf, 1, VUECE_TRANSCODE_CACHE_RECORD_LENGTH, f) != VUECE_TRANSCODE_CACHE_RECORD_LENGTH)
+		{
+			ret = false;
+		}
+	}
+
+	if(fclose(f) != 0)
+	{
+		ret = false;
+	}
+
+	//index file only shows up when it's complete, it marks the entry as complete after restart
+	if(!ret || rename(tmp_path.c_str(), index_path.c_str()) != 0)
+	{
+		VueceLogger::Error("VueceTranscodeCacheEntry::SaveIndex - Cannot save index file: %s", index_path.c_str());
+		remove(tmp_path.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool VueceTranscodeCacheEntry::LoadIndex()
+{
+	uint8_t buf[VUECE_TRANSCODE_CACHE_RECORD_LENGTH];
+	VueceTranscodeCacheRecord rec;
+	size_t data_len = 0;
+	size_t expected = 0;
+	FILE* f = NULL;
+	int count = 0;
+	int i = 0;
+	bool ret = true;
+
+	if(!talk_base::Filesystem::GetFileSize(talk_base::Pathname(data_path), &data_len))
+	{
+		return false;
+	}
+
+	f = fopen(index_path.c_str(), "rb");
+
+	if(f == NULL)
+	{
+		return false;
+	}
+
+	if(fread(buf, 1, VUECE_TRANSCODE_CACHE_INDEX_HEADER_LENGTH, f) != VUECE_TRANSCODE_CACHE_INDEX_HEADER_LENGTH
+			|| GetInt(buf) != VUECE_TRANSCODE_CACHE_INDEX_MAGIC)
+	{
+		fclose(f);
+		return false;
+	}
+
+	count = GetInt(buf + 4);
+
+	records.clear();
+	records.reserve(count > 0 ? count : 0);
+
+	for(i = 0; i < count; i++)
+	{
+		if(fread(buf, 1, VUECE_TRANSCODE_CACHE_RECORD_LENGTH, f) != VUECE_TRANSCODE_CACHE_RECORD_LENGTH)
+		{
+			ret = false;
+			break;
+		}
+
+		rec.offset = (size_t)GetInt(buf);
+		rec.ts = GetInt(buf + 4);
+		rec.len = GetInt(buf + 8);
+
+		//frames are stored back to back
+		if(rec.offset != expected || rec.len <= 0)
+		{
+			ret = false;
+			break;
+		}
+
+		expected += VUECE_STREAM_FRAME_HEADER_LENGTH + rec.len;
+
+		records.push_back(rec);
+	}
+
+	fclose(f);
+
+	if(!ret || count <= 0 || expected != data_len)
+	{
+		VueceLogger::Warn("VueceTranscodeCacheEntry::LoadIndex - Index of %s doesn't match its data file, dropped", key.c_str());
+		records.clear();
+		return false;
+	}
+
+	write_len = data_len;
+	published_count = count;
+	state = VueceTranscodeCacheState_Complete;
+
+	return true;
+}
+
+void VueceTranscodeCacheEntry::DeleteFiles()
+{
+	remove(index_path.c_str());
+	remove(data_path.c_str());
+}
+
+/* ---------------------------- cache ---------------------------- */
+
+VueceTranscodeCache* VueceTranscodeCache::instance = NULL;
+
+VueceTranscodeCache* VueceTranscodeCache::Instance()
+{
+	if(instance == NULL)
+	{
+		instance = new VueceTranscodeCache();
+		instance->LoadEntries();
+	}
+
+	return instance;
+}
+
+void VueceTranscodeCache::Release()
+{
+	if(instance != NULL)
+	{
+		delete instance;
+		instance = NULL;
+	}
+}
+
+VueceTranscodeCache::VueceTranscodeCache()
+{
+	talk_base::Pathname path;
+
+	VueceLogger::Debug("VueceTranscodeCache - Constructor called");
+
+	talk_base::Filesystem::GetTemporaryFolder(path, true, NULL);
+	path.AppendFolder(VUECE_TRANSCODE_CACHE_FOLDER);
+
+	if(!talk_base::Filesystem::IsFolder(path) && !talk_base::Filesystem::CreateFolder(path))
+	{
+		VueceLogger::Error("VueceTranscodeCache - Cannot create cache folder: %s", path.pathname().c_str());
+	}
+
+	folder = path.pathname();
+
+	//only used to make file names unique, a replaced entry may still be read
+	file_seq = (unsigned int)VueceThreadUtil::GetCurTimeMs();
+
+	hit_count = 0;
+	miss_count = 0;
+
+	VueceThreadUtil::InitMutex(&mutex_cache);
+}
+
+VueceTranscodeCache::~VueceTranscodeCache()
+{
+	std::map<std::string, VueceTranscodeCacheEntry*>::iterator it;
+	size_t i = 0;
+
+	VueceLogger::Debug("VueceTranscodeCache - Destructor called, hits: %ld, misses: %ld", hit_count, miss_count);
+
+	for(it = entries.begin(); it != entries.end(); it++)
+	{
+		if(it->second->GetState() != VueceTranscodeCacheState_Complete)
+		{
+			it->second->DeleteFiles();
+		}
+
+		delete it->second;
+	}
+
+	for(i = 0; i < detached.size(); i++)
+	{
+		detached[i]->DeleteFiles();
+		delete detached[i];
+	}
+
+	entries.clear();
+	detached.clear();
+}
+
+/*
+ * FNV-1a hash of all parameters which affect transcoder output
+ */
+std::string VueceTranscodeCache::MakeKey(const std::string& file_path, long mtime, int sample_rate, int bit_rate, int nchannels)
+{
+	char tmp[64];
+	std::string s;
+	uint64_t h = 14695981039346656037ULL;
+	size_t i = 0;
+
+	sprintf(tmp, "|%ld|%d|%d|%d", mtime, sample_rate, bit_rate, nchannels);
+
+	s = file_path + tmp;
+
+	for(i = 0; i < s.length(); i++)
+	{
+		h ^= (uint8_t)s[i];
+		h *= 1099511628211ULL;
+	}
+
+	sprintf(tmp, "%08x%08x", (unsigned int)(h >> 32), (unsigned int)(h & 0xFFFFFFFF));
+
+	return std::string(tmp);
+}
+
+/*
+ * Picks up complete entries left by previous runs, file name of an entry is
+ * [key]_[sequence number], anything without a valid index is removed
+ */
+void VueceTranscodeCache::LoadEntries()
+{
+	talk_base::scoped_ptr<talk_base::DirectoryIterator> it(talk_base::Filesystem::IterateDirectory());
+	std::vector<std::string> index_names;
+	std::vector<std::string> data_names;
+	std::set<std::string> loaded;
+	std::string name;
+	std::string base;
+	size_t sep = 0;
+	size_t i = 0;
+
+	if(!it->Iterate(talk_base::Pathname(folder)))
+	{
+		VueceLogger::Warn("VueceTranscodeCache::LoadEntries - Cannot iterate cache folder: %s", folder.c_str());
+		return;
+	}
+
+	do
+	{
+		if(it->IsDirectory())
+		{
+			continue;
+		}
+
+		talk_base::Pathname p(it->Name());
+
+		if(p.extension() == VUECE_TRANSCODE_CACHE_INDEX_EXT)
+		{
+			index_names.push_back(p.basename());
+		}
+		else if(p.extension() == VUECE_TRANSCODE_CACHE_DATA_EXT)
+		{
+			data_names.push_back(p.basename());
+		}
+		else
+		{
+			//unfinished index file
+			remove((folder + it->Name()).c_str());
+		}
+
+	} while(it->Next());
+
+	for(i = 0; i < index_names.size(); i++)
+	{
+		base = index_names[i];
+		sep = base.find('_');
+
+		VueceTranscodeCacheEntry* e = new VueceTranscodeCacheEntry(base.substr(0, sep), folder + base);
+
+		if(sep == std::string::npos || entries.find(e->GetKey()) != entries.end() || !e->LoadIndex())
+		{
+			e->DeleteFiles();
+			delete e;
+			continue;
+		}
+
+		entries[e->GetKey()] = e;
+		loaded.insert(base);
+	}
+
+	//data files of transcoding which never finished
+	for(i = 0; i < data_names.size(); i++)
+	{
+		if(loaded.find(data_names[i]) == loaded.end())
+		{
+			remove((folder + data_names[i] + VUECE_TRANSCODE_CACHE_DATA_EXT).c_str());
+		}
+	}
+
+	VueceLogger::Info("VueceTranscodeCache::LoadEntries - %lu cached track(s) found in %s", (unsigned long)entries.size(), folder.c_str());
+
+	Evict();
+}
+
+/*
+ * Returns the entry of given track with one more reference, is_writer is set
+ * to true if a new entry is created and the caller is expected to fill it.
+ *
+ * NULL is returned if there is no entry and allow_write is false, or the
+ * entry cannot be created
+ */
+VueceTranscodeCacheEntry* VueceTranscodeCache::Acquire(const std::string& file_path, long mtime,
+		int sample_rate, int bit_rate, int nchannels, bool allow_write, bool* is_writer)
+{
+	std::string key = MakeKey(file_path, mtime, sample_rate, bit_rate, nchannels);
+	std::map<std::string, VueceTranscodeCacheEntry*>::iterator it;
+	VueceTranscodeCacheEntry* e = NULL;
+	char tmp[16];
+
+	*is_writer = false;
+
+	VueceThreadUtil::MutexLock(&mutex_cache);
+
+	it = entries.find(key);
+
+	if(it != entries.end())
+	{
+		e = it->second;
+		e->ref_count++;
+		e->last_used_ms = VueceThreadUtil::GetCurTimeMs();
+
+		hit_count++;
+
+		VueceThreadUtil::MutexUnlock(&mutex_cache);
+
+		VueceLogger::Debug("VueceTranscodeCache::Acquire - Hit: %s, state: %d, readers: %d", key.c_str(), e->GetState(), e->ref_count);
+
+		return e;
+	}
+
+	miss_count++;
+
+	if(!allow_write)
+	{
+		VueceThreadUtil::MutexUnlock(&mutex_cache);
+		return NULL;
+	}
+
+	sprintf(tmp, "_%u", file_seq++);
+
+	e = new VueceTranscodeCacheEntry(key, folder + key + tmp);
+
+	if(!e->BeginWrite())
+	{
+		VueceThreadUtil::MutexUnlock(&mutex_cache);
+		delete e;
+		return NULL;
+	}
+
+	e->ref_count = 1;
+	e->last_used_ms = VueceThreadUtil::GetCurTimeMs();
+
+	entries[key] = e;
+
+	*is_writer = true;
+
+	Evict();
+
+	VueceThreadUtil::MutexUnlock(&mutex_cache);
+
+	VueceLogger::Debug("VueceTranscodeCache::Acquire - Miss: %s, caller becomes writer", key.c_str());
+
+	return e;
+}
+
+/*
+ * Removes an abandoned entry from lookup so the track can be transcoded
+ * again, it's deleted when the last reader is gone
+ */
+void VueceTranscodeCache::Detach(VueceTranscodeCacheEntry* entry)
+{
+	std::map<std::string, VueceTranscodeCacheEntry*>::iterator it;
+
+	VueceThreadUtil::MutexLock(&mutex_cache);
+
+	it = entries.find(entry->GetKey());
+
+	if(it != entries.end() && it->second == entry)
+	{
+		entries.erase(it);
+		detached.push_back(entry);
+	}
+
+	VueceThreadUtil::MutexUnlock(&mutex_cache);
+}
+
+void VueceTranscodeCache::Unref(VueceTranscodeCacheEntry* entry)
+{
+	size_t i = 0;
+
+	VueceThreadUtil::MutexLock(&mutex_cache);
+
+	entry->ref_count--;
+	entry->last_used_ms = VueceThreadUtil::GetCurTimeMs();
+
+	for(i = 0; i < detached.size(); i++)
+	{
+		if(detached[i] == entry)
+		{
+			if(entry->ref_count <= 0)
+			{
+				entry->DeleteFiles();
+				delete entry;
+				detached.erase(detached.begin() + i);
+			}
+
+			break;
+		}
+	}
+
+	Evict();
+
+	VueceThreadUtil::MutexUnlock(&mutex_cache);
+}
+
+/*
+ * Must be called with cache mutex held
+ */
+void VueceTranscodeCache::Evict()
+{
+	std::map<std::string, VueceTranscodeCacheEntry*>::iterator it;
+	std::map<std::string, VueceTranscodeCacheEntry*>::iterator victim;
+	bool found = false;
+
+	while(entries.size() > VUECE_TRANSCODE_CACHE_MAX_ENTRIES)
+	{
+		found = false;
+
+		for(it = entries.begin(); it != entries.end(); it++)
+		{
+			if(it->second->ref_count > 0 || it->second->GetState() != VueceTranscodeCacheState_Complete)
+			{
+				continue;
+			}
+
+			if(!found || it->second->last_used_ms < victim->second->last_used_ms)
+			{
+				victim = it;
+				found = true;
+			}
+		}
+
+		//everything is in use, try again later
+		if(!found)
+		{
+			break;
+		}
+
+		VueceLogger::Debug("VueceTranscodeCache::Evict - Removing %s", victim->first.c_str());
+
+		victim->second->DeleteFiles();
+		delete victim->second;
+		entries.erase(victim);
+	}
+}
+
+long VueceTranscodeCache::GetHitCount()
+{
+	return hit_count;
+}
+
+long VueceTranscodeCache::GetMissCount()
+{
+	return miss_count;
+}
@@ -0,0 +1,173 @@
+/*
+ * VueceTranscodeCache.h
+ *
+ *  Created on: Mar 28, 2015
+ *      Author: jingjing
+ */
+
+#ifndef VUECETRANSCODECACHE_H_
+#define VUECETRANSCODECACHE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "jthread.h"
+
+#define VUECE_TRANSCODE_CACHE_FOLDER "vuece_transcode_cache"
+
+#define VUECE_TRANSCODE_CACHE_DATA_EXT ".dat"
+#define VUECE_TRANSCODE_CACHE_INDEX_EXT ".idx"
+
+/*
+ * Max number of complete tracks kept in cache, the least recently used
+ * one which is not being read is removed when the limit is exceeded
+ */
+#define VUECE_TRANSCODE_CACHE_MAX_ENTRIES 64
+
+/*
+ * Frames appended by the writer are made visible to tailing readers
+ * in batches of this size, so the data file is not flushed per frame
+ */
+#define VUECE_TRANSCODE_CACHE_PUBLISH_FRAMES 16
+
+/*
+ * Size of one index record: [FrameOffset][FrameTS][FrameLen], same layout
+ * as VUECE_CHUNK_INDEX_RECORD_LENGTH on client side
+ */
+#define VUECE_TRANSCODE_CACHE_RECORD_LENGTH 12
+
+typedef enum _VueceTranscodeCacheState{
+	VueceTranscodeCacheState_Writing = 0,
+	VueceTranscodeCacheState_Complete,
+	VueceTranscodeCacheState_Abandoned
+}VueceTranscodeCacheState;
+
+typedef struct VueceTranscodeCacheRecord
+{
+	//offset of frame header in data file
+	size_t offset;
+	int ts;
+	//payload length, not including frame header
+	int len;
+} VueceTranscodeCacheRecord;
+
+/*
+ * Transcoded output of one track, the data file holds AAC frames in stream
+ * layout: [SignalByte][FrameLen][FrameTS][DATA], so it can be sent to a hub
+ * client as it is. The frame index is kept in memory and written into the
+ * index file when the track is completely transcoded.
+ *
+ * An entry is written by one VueceMediaStream (the one which started the
+ * transcoding from position 0) and can be read by any number of streams at
+ * the same time, readers only see frames published by PublishFrames().
+ */
+class VueceTranscodeCacheEntry
+{
+public:
+	VueceTranscodeCacheEntry(const std::string& key, const std::string& base_path);
+	virtual ~VueceTranscodeCacheEntry();
+
+	//writer side
+	bool BeginWrite();
+	bool AppendFrame(const uint8_t* header, const uint8_t* data, int len, int ts);
+	void PublishFrames();
+	bool Complete();
+	void Abandon();
+
+	//reader side
+	FILE* OpenReader();
+	int  GetPublishedFrameCount();
+	bool GetRecord(int frame_no, VueceTranscodeCacheRecord* rec);
+	int  CountFramesFitting(int first_frame_no, int max_len, int* total_len);
+	int  FindFrame(int target_ts);
+
+	VueceTranscodeCacheState GetState();
+
+	bool LoadIndex();
+	void DeleteFiles();
+
+	const std::string& GetKey();
+
+private:
+	bool SaveIndex();
+
+	static void PutInt(uint8_t* b, int v);
+	static int  GetInt(const uint8_t* b);
+
+public:
+	//following fields are protected by the mutex of VueceTranscodeCache
+	int ref_count;
+	uint64_t last_used_ms;
+
+private:
+	std::string key;
+	std::string data_path;
+	std::string index_path;
+
+	VueceTranscodeCacheState state;
+
+	FILE* fWriteFile;
+	size_t write_len;
+
+	std::vector<VueceTranscodeCacheRecord> records;
+
+	//number of records readers are allowed to see
+	int published_count;
+
+	JMutex mutex_entry;
+};
+
+/*
+ * Hub side cache of transcoded (MP3/MP2 -> AAC) tracks, keyed by file path,
+ * modification time and target audio parameters.
+ *
+ * When several hub clients stream the same track, or a track is played again,
+ * only the first stream decodes and encodes it, others are served from the
+ * cache. Entries on disk are found again after hub restarts.
+ */
+class VueceTranscodeCache
+{
+public:
+	static VueceTranscodeCache* Instance();
+	static void Release();
+
+	VueceTranscodeCacheEntry* Acquire(const std::string& file_path, long mtime,
+			int sample_rate, int bit_rate, int nchannels, bool allow_write, bool* is_writer);
+	void Unref(VueceTranscodeCacheEntry* entry);
+	void Detach(VueceTranscodeCacheEntry* entry);
+
+	long GetHitCount();
+	long GetMissCount();
+
+private:
+	VueceTranscodeCache();
+	virtual ~VueceTranscodeCache();
+
+	void LoadEntries();
+	void Evict();
+
+	static std::string MakeKey(const std::string& file_path, long mtime, int sample_rate, int bit_rate, int nchannels);
+
+private:
+	static VueceTranscodeCache* instance;
+
+	std::string folder;
+
+	std::map<std::string, VueceTranscodeCacheEntry*> entries;
+
+	//entries replaced while still being read, deleted when the last reader is gone
+	std::vector<VueceTranscodeCacheEntry*> detached;
+
+	unsigned int file_seq;
+
+	long hit_count;
+	long miss_count;
+
+	JMutex mutex_cache;
+};
+
+#endif /* VUECETRANSCODECACHE_H_ */
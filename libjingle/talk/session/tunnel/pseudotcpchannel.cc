@@ -121,7 +121,7 @@ PseudoTcpChannel::PseudoTcpChannel(Thread* stream_thread, Session* session)
     stream_thread_(stream_thread),
     session_(session), channel_(NULL), tcp_(NULL), stream_(NULL),
     stream_readable_(false), pending_read_event_(false),
-    ready_to_connect_(false) {
+    ready_to_connect_(false), cc_(PseudoTcp::CC_RENO) {
   ASSERT(signal_thread_->IsCurrent());
   ASSERT(NULL != session_);
 }
@@ -169,6 +169,7 @@ bool PseudoTcpChannel::Connect(const std::string& content_name,
 
   ASSERT(tcp_ == NULL);
   tcp_ = new PseudoTcp(this, 0);
+  tcp_->SetOption(PseudoTcp::OPT_CONGESTION_CONTROL, cc_);
   if (session_->initiator()) {
     // Since we may try several protocols and network adapters that won't work,
     // waiting until we get our first writable notification before initiating
@@ -179,6 +180,23 @@ bool PseudoTcpChannel::Connect(const std::string& content_name,
   return true;
 }
 
+void PseudoTcpChannel::SetCongestionControl(PseudoTcp::CongestionControl cc) {
+  CritScope lock(&cs_);
+  cc_ = cc;
+  // Switching controllers mid-transfer would lose the window state, so a
+  // channel that is already connecting keeps the one it started with.
+  if (tcp_ && (tcp_->State() == PseudoTcp::TCP_LISTEN))
+    tcp_->SetOption(PseudoTcp::OPT_CONGESTION_CONTROL, cc_);
+}
+
+bool PseudoTcpChannel::GetStats(PseudoTcp::Stats* stats) const {
+  CritScope lock(&cs_);
+  if (!tcp_)
+    return false;
+  tcp_->GetStats(stats);
+  return true;
+}
+
 StreamInterface* PseudoTcpChannel::GetStream() {
   ASSERT(signal_thread_->IsCurrent());
   CritScope lock(&cs_);
@@ -540,24 +558,36 @@ void PseudoTcpChannel::OnMessage(Message* pmsg) {
 
 IPseudoTcpNotify::WriteResult PseudoTcpChannel::TcpWritePacket(
     PseudoTcp* tcp, const char* buffer, size_t len) {
+  IPseudoTcpNotify::WriteResult result;
+  TcpWritePackets(tcp, buffer, &len, 1, &result);
+  return result;
+}
+
+int PseudoTcpChannel::TcpWritePackets(PseudoTcp* tcp, const char* buffer,
+                                      const size_t* lens, int count,
+                                      IPseudoTcpNotify::WriteResult* result) {
   ASSERT(cs_.CurrentThreadIsOwner());
   ASSERT(tcp == tcp_);
   ASSERT(NULL != channel_);
-  int sent = channel_->SendPacket(buffer, len);
-  if (sent > 0) {
+  int sent = channel_->SendPackets(buffer, lens, count);
+  if (sent >= count) {
     //if(log_detail)LOG_F(LS_VERBOSE) << "(" << sent << ") Sent";
-    return IPseudoTcpNotify::WR_SUCCESS;
+    *result = IPseudoTcpNotify::WR_SUCCESS;
+    return count;
   } else if (IsBlockingError(channel_->GetError())) {
+    // The rest would block as well, PseudoTcp sends them again later
     if(log_detail)LOG_F(LS_VERBOSE) << "Blocking";
-    return IPseudoTcpNotify::WR_SUCCESS;
+    *result = IPseudoTcpNotify::WR_SUCCESS;
+    return sent;
   } else if (channel_->GetError() == EMSGSIZE) {
     LOG_F(LS_ERROR) << "EMSGSIZE";
-    return IPseudoTcpNotify::WR_TOO_LARGE;
+    *result = IPseudoTcpNotify::WR_TOO_LARGE;
   } else {
-    PLOG(LS_ERROR, channel_->GetError()) << "PseudoTcpChannel::TcpWritePacket";
+    PLOG(LS_ERROR, channel_->GetError()) << "PseudoTcpChannel::TcpWritePackets";
     ASSERT(false);
-    return IPseudoTcpNotify::WR_FAIL;
+    *result = IPseudoTcpNotify::WR_FAIL;
   }
+  return sent;
 }
 
 void PseudoTcpChannel::AdjustClock(bool clear) {
@@ -70,6 +70,11 @@ public:
                const std::string& channel_name);
   talk_base::StreamInterface* GetStream();
 
+  // Selects the congestion controller; takes effect if called before the
+  // connection starts.  GetStats may be called from any thread.
+  void SetCongestionControl(PseudoTcp::CongestionControl cc);
+  bool GetStats(PseudoTcp::Stats* stats) const;
+
   sigslot::signal1<PseudoTcpChannel*> SignalChannelClosed;
 
   void OnSessionTerminate(Session* session);
@@ -109,6 +114,9 @@ private:
   virtual IPseudoTcpNotify::WriteResult TcpWritePacket(PseudoTcp* tcp,
                                                        const char* buffer,
                                                        size_t len);
+  virtual int TcpWritePackets(PseudoTcp* tcp, const char* buffer,
+                              const size_t* lens, int count,
+                              IPseudoTcpNotify::WriteResult* result);
 
   talk_base::Thread* signal_thread_, * worker_thread_, * stream_thread_;
   Session* session_;
@@ -119,6 +127,7 @@ private:
   InternalStream* stream_;
   bool stream_readable_, pending_read_event_;
   bool ready_to_connect_;
+  PseudoTcp::CongestionControl cc_;
   mutable talk_base::CriticalSection cs_;
 };
 